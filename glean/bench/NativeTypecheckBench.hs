@@ -0,0 +1,62 @@
+{-
+  Copyright (c) Meta Platforms, Inc. and affiliates.
+  All rights reserved.
+
+  This source code is licensed under the BSD-style license found in the
+  LICENSE file in the root directory of this source tree.
+-}
+
+-- | Write throughput with native and bytecode typecheckers, using the
+-- predicates of NativeTypecheckTest.
+module NativeTypecheckBench (main) where
+
+import Control.Monad
+import Criterion.Types
+import qualified Data.ByteString as BS
+import qualified Data.ByteString.Char8 as BS8
+import qualified Data.Vector as Vector
+import Test.QuickCheck (generate, resize)
+
+import Glean.RTS
+import Glean.RTS.Foreign.Define (defineFact)
+import qualified Glean.RTS.Foreign.FactSet as FactSet
+import Glean.RTS.Foreign.Lookup (withCanLookup)
+import Glean.RTS.Term (Term(..))
+import qualified Glean.Types as Thrift
+import Glean.Util.Benchmark
+
+import NativeTypecheckTest
+  (inventory, namePid, declPid, declKey, declValue)
+import RTSTest (valueFor)
+
+-- | A batch of Name facts followed by Decl facts which refer to them
+testBatch :: Int -> Int -> IO Thrift.Batch
+testBatch names decls = do
+  facts <- FactSet.new lowestFid
+  ids <- fmap Vector.fromList $ forM [1 .. names] $ \i ->
+    define facts namePid (String $ BS8.pack $ "name" <> show i) (Tuple [])
+  let pick (Fid fid) = ids Vector.! (fromIntegral fid `mod` Vector.length ids)
+  replicateM_ decls $ do
+    key <- generate $ resize 10 $ valueFor declKey
+    value <- generate $ valueFor declValue
+    define facts declPid (fmap pick key) (fmap pick value)
+  FactSet.serialize facts
+  where
+    define facts pid key value =
+      withValue (Tuple [key, value]) $ \builder ->
+        defineFact facts pid builder (fromIntegral $ BS.length $ fromValue key)
+
+main :: IO ()
+main = benchmarkMain $ \run -> do
+  native <- inventory True
+  bytecode <- inventory False
+  batch <- testBatch 10000 50000
+  empty <- FactSet.new lowestFid
+  withCanLookup empty $ \empty_lookup -> do
+
+  let write inv = fst <$> FactSet.renameFacts inv empty_lookup lowestFid batch
+
+  run
+    [ bench "native" $ whnfIO $ write native
+    , bench "bytecode" $ whnfIO $ write bytecode
+    ]
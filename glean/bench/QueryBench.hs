@@ -11,6 +11,7 @@
 module QueryBench (main) where
 
 import Control.Concurrent.Async
+import Control.Exception (bracket_)
 import Control.Monad (void)
 import Criterion.Types
 import Data.Default
@@ -20,6 +21,7 @@ import Util.String.Quasi
 
 import Glean
 import Glean.Query.Thrift.Internal
+import Glean.RTS.Foreign.Query (setSubroutineCacheCapacity)
 import qualified Glean.Schema.CodeCxx.Types as Code.Cxx
 import qualified Glean.Schema.Cxx1.Types as Cxx
 import qualified Glean.Schema.Sys.Types as Sys
@@ -141,4 +143,18 @@ main = benchmarkMain $ \run -> withBenchDB 100000 $ \env repo -> do
             runQuery_ env repo pageNestedAngle
         ]
       ]
+      -- paging through a result set, rebuilding the bytecode from each
+      -- continuation vs. finding it in the cache by its hash
+    , bgroup "paging"
+      [ bench "inline" $ whnfIO $ withSubroutineCache 0 $
+          runQuery_ env repo pageNestedAngle
+      , bench "cached" $ whnfIO $ withSubroutineCache (64*1024*1024) $
+          runQuery_ env repo pageNestedAngle
+      ]
     ]
+  where
+  withSubroutineCache size act =
+    bracket_
+      (setSubroutineCacheCapacity size)
+      (setSubroutineCacheCapacity 0)
+      act
@@ -0,0 +1,60 @@
+{-
+  Copyright (c) Meta Platforms, Inc. and affiliates.
+  All rights reserved.
+
+  This source code is licensed under the BSD-style license found in the
+  LICENSE file in the root directory of this source tree.
+-}
+
+module RebaseBench (main) where
+
+import Criterion.Types
+import qualified Data.Vector.Storable as Vector
+
+import qualified Glean.Backend as Backend
+import Glean.Database.Test
+import qualified Glean.RTS.Foreign.FactSet as FactSet
+import Glean.RTS.Foreign.Lookup (withCanLookup)
+import qualified Glean.RTS.Foreign.LookupCache as LookupCache
+import Glean.RTS.Types (Fid(..), lowestFid)
+import Glean.Database.Schema (DbSchema(..))
+import qualified Glean.Types as Thrift
+import Glean.Util.Benchmark
+
+import TestBatch
+
+main :: IO ()
+main = benchmarkMain $ \run ->
+  withEmptyTestDB [] $ \env repo -> do
+  schema <- Backend.loadDbSchema env repo
+  batch <- testBatch 500000 env repo
+  empty_facts <- FactSet.new lowestFid
+  withCanLookup empty_facts $ \empty_lookup -> do
+
+  (facts, _) <- FactSet.renameFacts
+    (schemaInventory schema)
+    empty_lookup
+    lowestFid
+    batch
+  Fid next <- FactSet.firstFreeId facts
+
+  -- Pretend that the server has accepted the first half of the facts and
+  -- moved them up, so rebasing has to rewrite the references to them from
+  -- the second half.
+  let Fid first = lowestFid
+      count = (next - first) `div` 2
+      subst = Thrift.Subst
+        { subst_firstId = first
+        , subst_ids = Vector.generate (fromIntegral count) $ \i ->
+            next + fromIntegral i
+        }
+
+  stats <- LookupCache.newStats
+  cache <- LookupCache.new 1000000000 1 stats
+
+  let rebase = FactSet.rebase (schemaInventory schema) subst cache facts
+
+  _ <- rebase
+
+  run
+    [ bench "rebase" $ whnfIO rebase ]
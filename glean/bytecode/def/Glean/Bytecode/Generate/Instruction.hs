@@ -51,7 +51,7 @@ data Usage
 --
 -- BUMP THIS WHENEVER YOU CHANGE THE BYTECODE EVEN IF YOU JUST ADD INSTRUCTIONS
 version :: Int
-version = 7
+version = 8
 
 -- | Lowest bytecode version supported by the current engine.
 --
@@ -396,4 +396,20 @@ instructions =
       [ Arg "src" Word Load
       , Arg "dst" WordPtr Load
       ]
+
+    -- Decode count Nats from memory and encode them in a binary::Output.
+    -- This decodes the whole array in bulk.
+  , Insn "InputNats" FallThrough
+      [ Arg "begin" DataPtr Update
+      , Arg "end" DataPtr Load
+      , Arg "count" Word Load
+      , Arg "output" BinaryOutputPtr Load
+      ]
+
+    -- Validate and skip over count Nats
+  , Insn "InputSkipNats" FallThrough
+      [ Arg "begin" DataPtr Update
+      , Arg "end" DataPtr Load
+      , Arg "count" Word Load
+      ]
   ]
@@ -23,11 +23,12 @@ import Glean.Bytecode.Types
 
 -- We generate 3 files:
 --
--- instruction.h has the enum with all opcodes
+-- instruction.h has the enum with all opcodes and a table of their names
 --
--- evaluator.h defines functions for decoding instructions and two evaluators -
--- one based on switch and the other token-threaded. It is intended to be
--- included as part of the definition of an evaluator class.
+-- evaluator.h defines functions for decoding instructions and three
+-- evaluators - one based on switch, one token-threaded and a profiling one
+-- which records per-opcode counts and cycles in a SubroutineProfile. It is
+-- intended to be included as part of the definition of an evaluator class.
 
 indent :: Text -> Text
 indent x = "  " <> x
@@ -42,7 +43,7 @@ main = do
   createDirectoryIfMissing True dir
   genHeader (dir </> "instruction.h")
     ["#include <cstdint>"]
-    genOpEnum
+    (genOpEnum ++ [""] ++ genOpNames)
   genFile (dir </> "evaluate.h")
     genEvaluator
 
@@ -80,10 +81,20 @@ genOpEnum =
   ++ [indent $ op <> "," | op <- unusedOps]
   ++ ["};"]
 
+-- | Generate a table of opcode names, indexed by opcode.
+genOpNames :: [Text]
+genOpNames =
+  "constexpr const char * const opNames[] = {"
+  : [indent $ "\"" <> name <> "\"," | name <- names]
+  ++ ["};"]
+  where
+    names = map insnName instructions ++ unusedOps
+
 genEvaluator :: [Text]
 genEvaluator =
   intercalate [""] (map (map indent) $
-    genEvalSwitch : genEvalIndirect : map genInsnEval instructions)
+    genEvalSwitch : genEvalIndirect : genEvalProfile
+      : map genInsnEval instructions)
 
 -- | Generate a method which decodes and then executes (via a function which
 -- we expect to be defined) an instruction. For each instruction, we generate
@@ -194,6 +205,40 @@ genEvalSwitch =
     genUnusedAlt op =
       "      case Op::" <> op <> ":"
 
+-- | Generate a switch-based interpreter which records the number of times
+-- each opcode is executed and an estimate of the cycles spent in it
+-- (including any functions it calls) in a SubroutineProfile. This is much
+-- slower than evalSwitch and is only used when a query asks for a profile.
+genEvalProfile :: [Text]
+genEvalProfile =
+  [ "FOLLY_NOINLINE void evalProfile(SubroutineProfile& profile) {"
+  , "  while (true) {"
+  , "    auto op = static_cast<Op>(*pc++);"
+  , "    auto start = SubroutineProfile::now();"
+  , "    switch (op) {" ]
+  ++ intercalate [""] (map genAlt instructions)
+  ++
+  [ "" ]
+  ++ map genUnusedAlt unusedOps ++
+  [ "        rts::error(\"invalid opcode\");"
+  , "    }"
+  , "  }"
+  , "}" ]
+  where
+    genAlt insn =
+      [ "      case Op::" <> insnName insn <> ":"
+      , "        eval_" <> insnName insn <> "();"
+      , "        profile.record(op, start);" ]
+      ++
+      if insnControl insn == UncondReturn
+      then
+      [ "        return;"]
+      else
+      [ "        break;"]
+
+    genUnusedAlt op =
+      "      case Op::" <> op <> ":"
+
 -- | Generate a token-threaded interpreter (opcode are indices into a table
 -- of labels, dispatch via compute goto). Note dispatch is repeated for each
 -- instruction for (perhaps) better branch prediction.
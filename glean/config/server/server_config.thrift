@@ -188,4 +188,56 @@ struct Config {
     //   * --schema-id flag passed to the server
     //   * glean.schema_id from the DB
     //   * the latest all.N in the current schema instance
+  28: i32 query_subroutine_cache_mb = 0;
+    // size of the cache of query bytecode referenced by continuations
+    // in MB (0 means disabled). Continuations still carry the bytecode,
+    // and a server which doesn't have it cached, for example because it
+    // was evicted or the continuation came from another server, uses
+    // that instead.
+  29: i32 query_cursor_cache_mb = 0;
+    // memory budget in MB for keeping the live iterators of paused
+    // queries per DB, so that the next page can resume without
+    // re-seeking (0 means disabled).
+  30: i32 query_cursor_ttl_ms = 10000;
+    // how long the iterators of a paused query are kept
+  31: i32 query_result_cache_mb = 0;
+    // memory budget in MB for caching the results of queries against
+    // read-only DBs, keyed by the query bytecode or continuation, the
+    // limits and the DB (0 means disabled).
+  32: double db_rocksdb_cache_high_pri_ratio = 0.0;
+    // fraction of each rocksdb cache reserved for index and filter blocks,
+    // which are then kept in the cache with high priority (0 means they
+    // are kept outside of the cache)
+  33: map<string, i32> db_rocksdb_cache_family_mb = {};
+    // rocksdb column families which have a cache of their own and its size
+    // in MB, so that scans of other families can't evict their blocks. The
+    // glean.db.rocksdb.cache.* counters report the usage of each pool, but
+    // hits and misses are only for all families together, as rocksdb
+    // counts them per database rather than per column family.
+  34: bool db_rocksdb_hyper_clock_cache = false;
+    // use HyperClockCache rather than LRUCache for the rocksdb caches
+  35: i32 db_rocksdb_optimize_parallelism = 1;
+    // number of column families which are compacted at once when
+    // optimising a database
+  36: i32 db_rocksdb_optimize_subcompactions = 0;
+    // maximum number of threads the compaction of a column family can be
+    // split across (0 means use rocksdb's max_subcompactions)
+  37: i32 db_rocksdb_optimize_background_jobs = 0;
+    // rocksdb's max_background_jobs while optimising a database (0 means
+    // don't change it)
+  38: bool db_rocksdb_optimize_final = false;
+    // write the files of optimised databases with larger blocks and
+    // stronger compression, as they won't change any more
+  39: i32 db_derived_ownership_memory_limit_mb = 1024;
+    // when computing the ownership of derived facts, the (fact, owner)
+    // pairs are sorted and spilled to disk in runs of this size
+  40: string db_derived_ownership_spill_dir = "";
+    // where to spill the runs ("" means the system temporary directory)
+  41: i32 db_derived_ownership_threads = 0;
+    // threads for sorting the runs (0 means the number of hardware
+    // threads)
+  42: bool db_rocksdb_section_index = false;
+    // also index the keys of newly created databases by block of fact
+    // ids, which speeds up queries restricted to the facts added by
+    // recent batches at the cost of a second copy of every key
 }
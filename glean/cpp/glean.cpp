@@ -8,22 +8,34 @@
 
 #include <folly/gen/Base.h>
 #include "glean/cpp/glean.h"
+#include "glean/rts/define.h"
 #include "glean/rts/sanity.h"
+#include "glean/rts/substitution.h"
 
 namespace facebook {
 namespace glean {
 namespace cpp {
 
-BatchBase::BatchBase(const SchemaInventory *inv, size_t cache_capacity)
-  : inventory(inv)
-  , stats(std::make_shared<rts::LookupCache::Stats>())
+BatchCache::BatchCache(size_t capacity)
+  : stats(std::make_shared<rts::LookupCache::Stats>())
   , cache(
       rts::LookupCache::Options{
-        cache_capacity,
+        capacity,
         0 // disable deferred LRU list manipulation
       },
       stats)
-  , anchor(&rts::EmptyLookup::instance(), &cache)
+{}
+
+BatchBase::BatchBase(const SchemaInventory *inv, size_t cache_capacity)
+  : BatchBase(inv, std::make_shared<BatchCache>(cache_capacity))
+{}
+
+BatchBase::BatchBase(
+    const SchemaInventory *inv,
+    std::shared_ptr<BatchCache> c)
+  : inventory(inv)
+  , cache(std::move(c))
+  , anchor(&rts::EmptyLookup::instance(), &cache->cache)
   , buffer(Id::lowest())
   , facts(&anchor, &buffer)
 {}
@@ -32,10 +44,130 @@ thrift::Batch BatchBase::serialize() const {
   return buffer.serialize();
 }
 
+thrift::Batch BatchBase::serializeFrom(size_t skip, size_t& copied) const {
+  copied = 0;
+  if (skip == 0) {
+    return serialize();
+  }
+  const auto start = buffer.startingId();
+  const auto from = start + skip;
+
+  // Find the facts in [start,from) which the facts from 'from' onwards
+  // depend on. They have to be sent again as the server can't resolve
+  // references to facts in a batch it hasn't seen yet.
+  std::vector<bool> needed(skip, false);
+  std::vector<Id> todo;
+  rts::Traverser traverser([&](Id id, Pid) {
+    if (id >= start && id < from && !needed[distance(start, id)]) {
+      needed[distance(start, id)] = true;
+      todo.push_back(id);
+    }
+  });
+  auto traverse = [&](const rts::Fact& fact) {
+    auto predicate = inventory->inventory.lookupPredicate(fact.type());
+    CHECK_NOTNULL(predicate);
+    predicate->traverse(traverser, fact.clause());
+  };
+  for (auto i = buffer.lower_bound(from); i != buffer.end(); ++i) {
+    traverse(*i);
+  }
+  while (!todo.empty()) {
+    auto id = todo.back();
+    todo.pop_back();
+    traverse(*buffer.lower_bound(id));
+  }
+
+  // Renumber the copies and the new facts consecutively from 'from'.
+  // Everything before 'start' is known to the server and stays as it is.
+  rts::Substitution subst(start, distance(start, buffer.firstFreeId()));
+  auto next = from;
+  for (size_t i = 0; i < skip; ++i) {
+    if (needed[i]) {
+      subst.setAt(i, next++);
+      ++copied;
+    }
+  }
+  for (auto id = from; id < buffer.firstFreeId(); ++id) {
+    subst.set(id, next++);
+  }
+
+  rts::Substituter substituter(&subst);
+  rts::FactSet batch(from);
+  auto copy = [&](const rts::Fact& fact) {
+    auto predicate = inventory->inventory.lookupPredicate(fact.type());
+    binary::Output out;
+    uint64_t key_size;
+    predicate->substitute(substituter, fact.clause(), out, key_size);
+    batch.define(fact.type(), rts::Fact::Clause::from(out.bytes(), key_size));
+  };
+  for (auto i = buffer.begin(); i != buffer.lower_bound(from); ++i) {
+    if (needed[distance(start, (*i).id())]) {
+      copy(*i);
+    }
+  }
+  for (auto i = buffer.lower_bound(from); i != buffer.end(); ++i) {
+    copy(*i);
+  }
+  return batch.serialize();
+}
+
+thrift::Batch BatchBase::serializeAt(Id first) const {
+  const auto start = buffer.startingId();
+  if (first == start) {
+    return serialize();
+  }
+  rts::Substitution subst(start, buffer.size());
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    subst.setAt(i, first + i);
+  }
+  rts::Substituter substituter(&subst);
+  rts::FactSet batch(first);
+  for (const auto& fact : buffer) {
+    auto predicate = inventory->inventory.lookupPredicate(fact.type());
+    CHECK_NOTNULL(predicate);
+    binary::Output out;
+    uint64_t key_size;
+    predicate->substitute(substituter, fact.clause(), out, key_size);
+    batch.define(fact.type(), rts::Fact::Clause::from(out.bytes(), key_size));
+  }
+  return batch.serialize();
+}
+
 void BatchBase::rebase(const thrift::Subst& s) {
   auto subst = rts::Substitution::deserialize(s);
   GLEAN_SANITY_CHECK(subst.sanityCheck(false));
-  cache.withBulkStore([&](auto& store) {
+  rebase(subst);
+}
+
+void BatchBase::rebase(const thrift::Subst& s, size_t copied) {
+  // The substitution starts with the ids of the copies, which the batch they
+  // were copied from covers as well.
+  const auto& ids = *s.ids();
+  CHECK_LE(copied, ids.size());
+  std::vector<Id> items;
+  items.reserve(ids.size() - copied);
+  for (auto i = ids.begin() + copied; i != ids.end(); ++i) {
+    items.push_back(Id::fromThrift(*i));
+  }
+  rts::Substitution subst(buffer.startingId(), std::move(items));
+  GLEAN_SANITY_CHECK(subst.sanityCheck(false));
+  rebase(subst);
+}
+
+void BatchBase::insert(const thrift::Batch& batch) {
+  const auto first = Id::fromThrift(*batch.firstId());
+  CHECK(first == Id::lowest());
+  rts::defineUntrustedBatch(
+    facts,
+    inventory->inventory,
+    first,
+    nullptr,
+    *batch.count(),
+    binary::byteRange(*batch.facts()));
+}
+
+void BatchBase::rebase(const rts::Substitution& subst) {
+  cache->cache.withBulkStore([&](auto& store) {
     buffer = buffer.rebase(inventory->inventory, subst, store);
     facts = rts::Stacked<rts::Define>(&anchor, &buffer);
   });
@@ -43,7 +175,7 @@ void BatchBase::rebase(const thrift::Subst& s) {
 }
 
 BatchBase::CacheStats BatchBase::cacheStats() {
-  auto values = stats->read();
+  auto values = cache->stats->read();
   CacheStats res;
   res.facts = FactStats{
     values[rts::LookupCache::Stats::factBytes],
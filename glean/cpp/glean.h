@@ -413,11 +413,26 @@ struct SchemaInventory {
   std::vector<const rts::Predicate * FOLLY_NULLABLE> predicates;
 };
 
+// The fact cache of a Batch. It can be shared by several Batches for the same
+// repo, possibly used by different threads. A Batch only sees cached facts
+// with ids below its own local ids (see rts::Stacked), so facts which another
+// Batch caches later stay hidden, and may be sent again, until this Batch has
+// been rebased past them.
+struct BatchCache {
+  explicit BatchCache(size_t capacity);
+
+  std::shared_ptr<rts::LookupCache::Stats> stats;
+  rts::LookupCache cache;
+};
+
 class BatchBase {
 public:
   explicit BatchBase(
     const SchemaInventory *inventory,
     size_t cache_capacity);
+  BatchBase(
+    const SchemaInventory *inventory,
+    std::shared_ptr<BatchCache> cache);
   BatchBase(BatchBase&&) = default;
   BatchBase& operator=(BatchBase&&) = default;
 
@@ -435,10 +450,38 @@ public:
   thrift::Batch serialize() const;
   void rebase(const thrift::Subst&);
 
+  // Serialize the facts in the buffer except for the first 'skip' ones,
+  // which have been sent already and are still waiting for a substitution.
+  // The facts among these which the new ones refer to, directly or not, are
+  // copied to the front of the batch and 'copied' is set to their number.
+  thrift::Batch serializeFrom(size_t skip, size_t& copied) const;
+
+  // Rebase with the substitution for a batch produced by serializeFrom. It
+  // must be the oldest batch still waiting for one, which means that the
+  // facts it sent for the first time are at the front of the buffer.
+  void rebase(const thrift::Subst&, size_t copied);
+
+  // Serialize the facts in the buffer renumbered consecutively from 'first'.
+  // This is for senders which number the facts themselves, like the
+  // streaming file writer: batches which share a cache have overlapping local
+  // ids so the facts have to be renumbered before they can be written out.
+  // References to cached facts are left as they are.
+  thrift::Batch serializeAt(Id first) const;
+
+  // Define the facts of a batch which was produced by serialize() on another
+  // batch for the same schema with an empty cache, so that it only refers to
+  // its own facts. Facts which already exist are shared as usual.
+  void insert(const thrift::Batch&);
+
   FactStats bufferStats() const {
     return FactStats{buffer.factMemory(), buffer.size()};
   }
 
+  // The local id of the first fact in the buffer
+  Id bufferStart() const {
+    return buffer.startingId();
+  }
+
   // TODO: This is a temporary hack for backwards compatibility, add proper
   // stats reporting
   struct CacheStats {
@@ -450,9 +493,10 @@ public:
   CacheStats cacheStats();
 
 private:
+  void rebase(const rts::Substitution&);
+
   const SchemaInventory *inventory;
-  std::shared_ptr<rts::LookupCache::Stats> stats;
-  rts::LookupCache cache;
+  std::shared_ptr<BatchCache> cache;
   rts::LookupCache::Anchor anchor;
   rts::FactSet buffer;
   rts::Stacked<rts::Define> facts;
@@ -519,6 +563,9 @@ private:
 // that are in range of the substitution are moved to the cache; the remaining
 // local facts are assigned new Ids which don't clash which cached ones.
 //
+// Batches which share a BatchCache only ever see cached facts with Ids below
+// their own local ones so they can be rebased independently.
+//
 template<typename Schema>
 class Batch : private BatchBase {
 public:
@@ -526,6 +573,10 @@ public:
     : BatchBase(&(schema->inventory), cache_capacity)
     {}
 
+  Batch(const DbSchema<Schema>* schema, std::shared_ptr<BatchCache> cache)
+    : BatchBase(&(schema->inventory), std::move(cache))
+    {}
+
   template<typename P>
   const rts::Predicate *predicate() const {
     if (auto p = base().predicate(Schema::template index<P>::value)) {
@@ -577,6 +628,7 @@ public:
 
   using BatchBase::serialize;
   using BatchBase::rebase;
+  using BatchBase::insert;
   using BatchBase::bufferStats;
   using BatchBase::CacheStats;
   using BatchBase::cacheStats;
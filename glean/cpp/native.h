@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/*
+ * Native typecheckers, substituters and traversals for the predicates of a
+ * schema, instantiated from the representation types in glean.h.
+ *
+ * These are the C++ counterparts of the bytecode generated by
+ * Glean.RTS.Typecheck, Glean.RTS.Substitute and Glean.RTS.Traverse and must
+ * behave in exactly the same way. The schema code generator emits a table
+ * of them for every predicate when run with --cpp-native:
+ *
+ *   const rts::NativePredicate predicates[] = {
+ *     native::predicate<SCHEMA, Src::File>(0x...ULL, 0x...ULL),
+ *     ...
+ *   };
+ *
+ *   rts::NativeSchemaRegistration registration(
+ *     rts::NativeSchema{SCHEMA::count, folly::range(predicates)});
+ *
+ */
+
+#pragma once
+
+#include "glean/cpp/glean.h"
+#include "glean/rts/native.h"
+
+namespace facebook {
+namespace glean {
+namespace cpp {
+namespace native {
+
+template<typename Schema, typename T> struct Native;
+
+// Whether a value of representation type T can contain fact IDs
+template<typename Schema, typename T>
+constexpr bool hasRefs = Native<Schema, T>::refs;
+
+struct Typecheck {
+  const Pid* pids;
+  const rts::Renamer& renamer;
+  binary::Input& input;
+  binary::Output& output;
+};
+
+// For skipping over a trusted value. onFact is called with the input
+// pointing at each fact ID, which it must consume.
+template<typename F>
+struct Refs {
+  const Pid* pids;
+  binary::Input& input;
+  F& onFact;
+};
+
+template<typename Schema>
+struct Native<Schema, Byte> {
+  static constexpr bool refs = false;
+
+  static void typecheck(Typecheck& t) {
+    t.output.put(t.input.bytes(1));
+  }
+
+  template<typename F>
+  static void skip(Refs<F>& r) {
+    r.input.bytes(1);
+  }
+};
+
+template<typename Schema>
+struct Native<Schema, Nat> {
+  static constexpr bool refs = false;
+
+  static void typecheck(Typecheck& t) {
+    t.output.packed(t.input.packed<uint64_t>());
+  }
+
+  template<typename F>
+  static void skip(Refs<F>& r) {
+    r.input.packed<uint64_t>();
+  }
+};
+
+template<typename Schema>
+struct Native<Schema, String> {
+  static constexpr bool refs = false;
+
+  static void typecheck(Typecheck& t) {
+    auto start = t.input.data();
+    t.input.skipUntrustedString();
+    t.output.put({start, t.input.data()});
+  }
+
+  template<typename F>
+  static void skip(Refs<F>& r) {
+    r.input.skipTrustedString();
+  }
+};
+
+template<typename Schema, size_t N>
+struct Native<Schema, Enum<N>> {
+  static constexpr bool refs = false;
+
+  static void typecheck(Typecheck& t) {
+    auto sel = t.input.packed<uint64_t>();
+    t.output.packed(sel);
+    if (sel >= N) {
+      rts::error("selector out of range");
+    }
+  }
+
+  template<typename F>
+  static void skip(Refs<F>& r) {
+    r.input.packed<uint64_t>();
+  }
+};
+
+template<typename Schema, typename T>
+struct Native<Schema, Array<T>> {
+  static constexpr bool refs = hasRefs<Schema, T>;
+
+  static void typecheck(Typecheck& t) {
+    auto size = t.input.packed<uint64_t>();
+    t.output.packed(size);
+    if constexpr (std::is_same_v<T, Byte>) {
+      t.output.put(t.input.bytes(size));
+    } else if constexpr (std::is_same_v<T, Nat>) {
+      uint64_t buf[256];
+      for (uint64_t n = size; n != 0; ) {
+        const auto k = std::min(n, uint64_t(256));
+        t.input.packedArray(buf, k);
+        t.output.packedArray(buf, k);
+        n -= k;
+      }
+    } else {
+      for (uint64_t i = 0; i < size; ++i) {
+        Native<Schema, T>::typecheck(t);
+      }
+    }
+  }
+
+  template<typename F>
+  static void skip(Refs<F>& r) {
+    auto size = r.input.packed<uint64_t>();
+    if constexpr (std::is_same_v<T, Byte>) {
+      r.input.bytes(size);
+    } else if constexpr (std::is_same_v<T, Nat>) {
+      r.input.skipPackedArray(size);
+    } else {
+      for (uint64_t i = 0; i < size; ++i) {
+        Native<Schema, T>::skip(r);
+      }
+    }
+  }
+};
+
+template<typename Schema, typename... Ts>
+struct Native<Schema, Tuple<Ts...>> {
+  static constexpr bool refs = (hasRefs<Schema, Ts> || ...);
+
+  static void typecheck(Typecheck& t) {
+    (Native<Schema, Ts>::typecheck(t), ...);
+  }
+
+  template<typename F>
+  static void skip(Refs<F>& r) {
+    (Native<Schema, Ts>::skip(r), ...);
+  }
+};
+
+template<typename Schema, typename... Ts>
+struct Native<Schema, Sum<Ts...>> {
+  static constexpr bool refs = (hasRefs<Schema, Ts> || ...);
+
+  static void typecheck(Typecheck& t) {
+    using Alt = void (*)(Typecheck&);
+    static constexpr Alt alts[] = { &Native<Schema, Ts>::typecheck... };
+    auto sel = t.input.packed<uint64_t>();
+    t.output.packed(sel);
+    if (sel >= sizeof...(Ts)) {
+      rts::error("selector out of range");
+    }
+    alts[sel](t);
+  }
+
+  template<typename F>
+  static void skip(Refs<F>& r) {
+    using Alt = void (*)(Refs<F>&);
+    static constexpr Alt alts[] = {
+      &Native<Schema, Ts>::template skip<F>...
+    };
+    alts[r.input.packed<uint64_t>()](r);
+  }
+};
+
+// Anything else is a predicate
+template<typename Schema, typename P>
+struct Native {
+  static constexpr bool refs = true;
+
+  static Pid pid(const Pid* pids) {
+    return pids[Schema::template index<P>::value];
+  }
+
+  static void typecheck(Typecheck& t) {
+    auto id = t.input.packed<uint64_t>();
+    t.output.packed(t.renamer.rename(id, pid(t.pids).toWord()));
+  }
+
+  template<typename F>
+  static void skip(Refs<F>& r) {
+    r.onFact(pid(r.pids));
+  }
+};
+
+// Skip over a trusted value, calling onFact(pid) at each fact ID. Values
+// without fact IDs aren't decoded at all.
+template<typename Schema, typename T, typename F>
+void forEachRef(const Pid* pids, binary::Input& input, F& onFact) {
+  if constexpr (hasRefs<Schema, T>) {
+    Refs<F> r{pids, input, onFact};
+    Native<Schema, T>::skip(r);
+  }
+}
+
+template<typename P> using KeyRepr = Repr<typename P::KeyType>;
+template<typename P> using ValueRepr = Repr<typename P::ValueType>;
+
+template<typename Schema, typename P>
+void typecheck(
+    const Pid* pids,
+    const rts::Renamer& renamer,
+    rts::Fact::Clause clause,
+    binary::Output& output,
+    uint64_t& key_size) {
+  binary::Input key(clause.key());
+  Typecheck tk{pids, renamer, key, output};
+  Native<Schema, KeyRepr<P>>::typecheck(tk);
+  if (!key.empty()) {
+    rts::error("extra bytes at end of key");
+  }
+  key_size = output.size();
+  binary::Input value(clause.value());
+  Typecheck tv{pids, renamer, value, output};
+  Native<Schema, ValueRepr<P>>::typecheck(tv);
+  if (!value.empty()) {
+    rts::error("extra bytes at end of value");
+  }
+}
+
+template<typename Schema, typename P>
+void substitute(
+    const Pid* pids,
+    const rts::Renamer& renamer,
+    rts::Fact::Clause clause,
+    binary::Output& output,
+    uint64_t& key_size) {
+  // Copy everything between fact IDs wholesale.
+  const unsigned char* mark;
+  binary::Input input;
+  auto onFact = [&](Pid pid) {
+    output.put({mark, input.data()});
+    auto id = input.packed<uint64_t>();
+    output.packed(renamer.rename(id, pid.toWord()));
+    mark = input.data();
+  };
+  input = binary::Input(clause.key());
+  mark = input.data();
+  forEachRef<Schema, KeyRepr<P>>(pids, input, onFact);
+  output.put({mark, clause.key().end()});
+  key_size = output.size();
+  input = binary::Input(clause.value());
+  mark = input.data();
+  forEachRef<Schema, ValueRepr<P>>(pids, input, onFact);
+  output.put({mark, clause.value().end()});
+}
+
+template<typename Schema, typename P>
+void traverse(
+    const Pid* pids,
+    const rts::Traverser& traverser,
+    rts::Fact::Clause clause) {
+  binary::Input input(clause.key());
+  auto onFact = [&](Pid pid) {
+    traverser.traverse(input.packed<uint64_t>(), pid.toWord());
+  };
+  forEachRef<Schema, KeyRepr<P>>(pids, input, onFact);
+  input = binary::Input(clause.value());
+  forEachRef<Schema, ValueRepr<P>>(pids, input, onFact);
+}
+
+/// The native subroutines for predicate P of the Schema, which has the
+/// given hash.
+template<typename Schema, typename P>
+rts::NativePredicate predicate(uint64_t hash_hi, uint64_t hash_lo) {
+  return rts::NativePredicate{
+    rts::PredicateHash{hash_hi, hash_lo},
+    Schema::template index<P>::value,
+    &typecheck<Schema, P>,
+    &substitute<Schema, P>,
+    &traverse<Schema, P>
+  };
+}
+
+}
+}
+}
+}
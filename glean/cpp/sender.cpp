@@ -9,9 +9,20 @@
 #include "glean/cpp/sender.h"
 #include "glean/if/gen-cpp2/GleanServiceAsyncClient.h"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/File.h>
 #include <folly/FileUtil.h>
+#include <folly/compression/Compression.h>
 #include <folly/executors/GlobalExecutor.h>
 #include <folly/futures/Retrying.h>
+#include <folly/lang/Bits.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
 #if FACEBOOK
@@ -32,46 +43,136 @@ public:
     std::string repo_hash;
     double min_retry_delay;
     size_t max_errors;
+    size_t max_in_flight;
+    bool compress;
   };
 
   ThriftSender(
     std::unique_ptr<thrift::GleanServiceAsyncClient> cli,
     const Config& cfg)
-    : client(std::move(cli)), config(cfg) {}
+    : client(std::move(cli))
+    , config(cfg)
+    , compression(cfg.compress ? Compression::Unknown : Compression::None)
+    {}
 
   void rebaseAndSend(BatchBase& batch, bool wait = false) override {
-    if (future && (wait || future->isReady())) {
-      // We've already sent a batch and received back a substitution.
-      batch.rebase(std::move(*future).get());
-      future.reset();
+    auto& p = pending(batch);
+
+    // Each substitution renumbers the facts after the ones it covers, so
+    // they have to be applied in the order in which the batches were sent.
+    // If we have to wait, we only wait for the oldest one.
+    while (!p.in_flight.empty()
+        && (wait || p.in_flight.front().subst.isReady())) {
+      auto& oldest = p.in_flight.front();
+      batch.rebase(std::move(oldest.subst).get(), oldest.copied);
+      p.sent -= oldest.count;
+      p.in_flight.pop_front();
+      wait = false;
     }
 
-    if (!future) {
-      // We aren't waiting on a substitution (either we haven't sent anything
-      // yet or we just rebased). Send the next piece.
+    // Send the facts which haven't been sent yet if there is room in the
+    // window.
+    const auto buffered = batch.bufferStats().count;
+    if (p.in_flight.size() < config.max_in_flight && buffered > p.sent) {
       thrift::Repo repo;
       repo.name() = config.repo_name;
       repo.hash() = config.repo_hash;
       thrift::ComputedBatch cbatch;
       cbatch.repo() = std::move(repo);
       cbatch.remember() = true;
-      cbatch.batch() = batch.serialize();
-      future = std::make_unique<folly::Future<thrift::Subst>>(
-        send(
-          std::make_shared<thrift::ComputedBatch>(std::move(cbatch)))
-        .via(folly::getIOExecutor().get()));
+      size_t copied;
+      cbatch.batch() = batch.serializeFrom(p.sent, copied);
+      compress(cbatch);
+      p.in_flight.push_back(InFlight{
+        send(std::make_shared<thrift::ComputedBatch>(std::move(cbatch)))
+          .via(folly::getIOExecutor().get()),
+        copied,
+        buffered - p.sent});
+      p.sent = buffered;
     }
   }
 
   void flush(BatchBase& batch) override {
-    rebaseAndSend(batch, true);
-    if (future) {
-      future->wait();
-      future.reset();
+    auto& p = pending(batch);
+    // Send what's left, waiting for room in the window if necessary
+    while (batch.bufferStats().count > p.sent) {
+      rebaseAndSend(batch, p.in_flight.size() >= config.max_in_flight);
     }
+    for (auto& in_flight : p.in_flight) {
+      in_flight.subst.wait();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    futures.erase(&batch);
   }
 
 private:
+  // A batch we've sent and the substitution we're waiting for
+  struct InFlight {
+    folly::Future<thrift::Subst> subst;
+
+    // Facts from older batches in flight which it repeats
+    size_t copied;
+
+    // Facts it sent for the first time
+    size_t count;
+  };
+
+  // The batches in flight for a BatchBase, oldest first. The facts they sent
+  // for the first time are at the front of its buffer, in the same order.
+  struct Pending {
+    std::deque<InFlight> in_flight;
+    size_t sent = 0;
+  };
+
+  // Only the thread which owns the batch touches its slot so we only need to
+  // lock the map.
+  Pending& pending(const BatchBase& batch) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return futures[&batch];
+  }
+
+  enum class Compression {
+    // Ask the server which codecs it supports with the next batch
+    Unknown,
+    None,
+    Zstd
+  };
+
+  void compress(thrift::ComputedBatch& cbatch) const {
+    switch (compression.load()) {
+      case Compression::Unknown:
+        cbatch.negotiate() = true;
+        break;
+
+      case Compression::None:
+        break;
+
+      case Compression::Zstd: {
+        auto& facts = *cbatch.batch()->facts();
+        facts = folly::fbstring(
+          folly::io::getCodec(folly::io::CodecType::ZSTD)
+            ->compress(folly::StringPiece(facts.data(), facts.size())));
+        cbatch.compression() = thrift::BatchCompression::Zstd;
+        break;
+      }
+    }
+  }
+
+  // Record what the server told us about compression when we asked
+  void negotiated(
+      const thrift::ComputedBatch& batch,
+      const std::vector<thrift::BatchCompression>& codecs) const {
+    if (*batch.negotiate()) {
+      auto expected = Compression::Unknown;
+      compression.compare_exchange_strong(
+        expected,
+        std::find(codecs.begin(), codecs.end(), thrift::BatchCompression::Zstd)
+            != codecs.end()
+          ? Compression::Zstd
+          : Compression::None);
+    }
+  }
+
   // Communicate with the server, retrying if necessary.
   template<typename F>
   folly::invoke_result_t<F, thrift::GleanServiceAsyncClient *>
@@ -126,9 +227,17 @@ private:
         .thenValue([batch, this](thrift::SendResponse&& response) {
           switch (response.getType()) {
             case thrift::SendResponse::Type::handle:
-              // Server accepted the batch, now wait
+              // Server accepted the batch, now wait. If we asked about
+              // compression, it predates it.
+              negotiated(*batch, {});
               return finish(response.get_handle(), batch).semi();
 
+            case thrift::SendResponse::Type::accepted: {
+              const auto& accepted = response.get_accepted();
+              negotiated(*batch, *accepted.compression());
+              return finish(*accepted.handle(), batch).semi();
+            }
+
             case thrift::SendResponse::Type::retry:
               // Server asked to retry after a delay
               return retry(
@@ -179,7 +288,10 @@ private:
 
   const std::unique_ptr<thrift::GleanServiceAsyncClient> client;
   const Config config;
-  std::unique_ptr<folly::Future<thrift::Subst>> future;
+  mutable std::atomic<Compression> compression;
+  std::mutex mutex;
+  // NOTE: std::unordered_map doesn't invalidate references on insertion
+  std::unordered_map<const BatchBase *, Pending> futures;
 };
 
 }
@@ -190,11 +302,18 @@ std::unique_ptr<Sender> thriftSender(
     const std::string& repo_name,
     const std::string& repo_hash,
     double min_retry_delay,
-    size_t max_errors) {
+    size_t max_errors,
+    size_t max_in_flight,
+    bool compress) {
   return std::make_unique<ThriftSender>(
     cpp::service(service),
     ThriftSender::Config{
-      repo_name, repo_hash, min_retry_delay, max_errors
+      repo_name,
+      repo_hash,
+      min_retry_delay,
+      max_errors,
+      std::max(max_in_flight, size_t(1)),
+      compress
     }
   );
 }
@@ -213,13 +332,18 @@ public:
 
   void flush(BatchBase& batch) override {
     auto r = batch.serialize();
+    // Batches aren't rebased so we can't merge them. If there are several,
+    // write them to PATH, PATH.1, PATH.2 etc.
+    auto n = flushed++;
+    auto file = n == 0 ? path : path + "." + folly::to<std::string>(n);
     folly::writeFile(
       apache::thrift::CompactSerializer::serialize<std::string>(r),
-      path.c_str());
+      file.c_str());
   }
 
 private:
   std::string path;
+  std::atomic<size_t> flushed{0};
 };
 
 }
@@ -228,6 +352,82 @@ std::unique_ptr<Sender> fileWriter(std::string path) {
   return std::make_unique<FileWriter>(std::move(path));
 }
 
+namespace {
+
+class StreamWriter : public Sender {
+public:
+  StreamWriter(const std::string& path, bool compress)
+    : file(path, O_WRONLY | O_CREAT | O_TRUNC)
+    , compress(compress)
+    {}
+
+  void rebaseAndSend(BatchBase& batch, bool) override {
+    // Writing never has to wait for anything so we always write everything
+    write(batch);
+  }
+
+  void flush(BatchBase& batch) override {
+    write(batch);
+  }
+
+private:
+  // Append the buffer to the file as a segment and then rebase the batch as
+  // if the facts had been sent to a server which numbers them in the order
+  // in which they are written. This moves them to the cache so the buffer
+  // only ever holds the facts produced since the last call.
+  void write(BatchBase& batch) {
+    const auto count = batch.bufferStats().count;
+    if (count == 0) {
+      return;
+    }
+    const auto start = batch.bufferStart();
+
+    thrift::Subst subst;
+    {
+      // Several batches may share a cache so they all have to use the same
+      // numbering, which means that segments must be written in the same
+      // order as their ids are assigned. Their local ids overlap, so each
+      // batch is renumbered to start where the previous segment ended.
+      std::lock_guard<std::mutex> lock(mutex);
+      thrift::BatchSegment segment;
+      segment.batch() = batch.serializeAt(next);
+      segment.firstId() = next.toThrift();
+      if (compress) {
+        auto& facts = *segment.batch()->facts();
+        facts = folly::fbstring(
+          folly::io::getCodec(folly::io::CodecType::ZSTD)
+            ->compress(folly::StringPiece(facts.data(), facts.size())));
+        segment.compression() = thrift::BatchCompression::Zstd;
+      }
+      auto bytes =
+        apache::thrift::CompactSerializer::serialize<std::string>(segment);
+      uint64_t size = folly::Endian::little(uint64_t(bytes.size()));
+      bytes.insert(0, reinterpret_cast<const char *>(&size), sizeof(size));
+      if (folly::writeFull(file.fd(), bytes.data(), bytes.size()) == -1) {
+        folly::throwSystemError("couldn't write batch segment");
+      }
+      subst.firstId() = start.toThrift();
+      subst.ids()->reserve(count);
+      for (size_t i = 0; i < count; ++i) {
+        subst.ids()->push_back((next + i).toThrift());
+      }
+      next += count;
+    }
+    batch.rebase(subst);
+  }
+
+  folly::File file;
+  const bool compress;
+  std::mutex mutex;
+  Id next = Id::lowest();
+};
+
+}
+
+std::unique_ptr<Sender> streamWriter(const std::string& path, bool compress) {
+  return std::make_unique<StreamWriter>(path, compress);
+}
+
 
 }
 }
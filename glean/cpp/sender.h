@@ -13,6 +13,8 @@
 namespace facebook {
 namespace glean {
 
+// A Sender can be used by several threads at once as long as each of them
+// sends its own Batch.
 struct Sender {
   virtual ~Sender() {}
 
@@ -23,6 +25,10 @@ struct Sender {
   // After rebasing or if this is the first call to the function, start sending
   // all facts that are currently in the write buffer to the server.
   //
+  // A Sender may have several batches on their way to the server at once, in
+  // which case it only sends the facts it hasn't sent yet, and only waits for
+  // the oldest batch.
+  //
   // This retries as necessary on exceptions and aborts the program on
   // unrecoverable errors.
   //
@@ -41,20 +47,35 @@ struct Sender {
   virtual void flush(cpp::BatchBase& batch) = 0;
 };
 
-// A Sender which sends data synchronously via Thrift.
+// A Sender which sends data via Thrift, with up to max_in_flight batches on
+// their way to the server at once. If compress is set, it compresses batches
+// if the server supports it.
 std::unique_ptr<Sender> thriftSender(
   const std::string& service,
   const std::string& repo_name,
   const std::string& repo_hash,
   double min_retry_delay,
-  size_t max_errors
+  size_t max_errors,
+  size_t max_in_flight = 1,
+  bool compress = false
 );
 
 // A Sender which dumps all data into a file. This happens on the final flush,
-// rebaseAndSend is a noop. This is mostly useful for testing.
+// rebaseAndSend is a noop. Further batches are flushed to PATH.1, PATH.2 and
+// so on. This is mostly useful for testing.
 std::unique_ptr<Sender> fileWriter(
   std::string path
 );
 
+// A Sender which appends the facts to PATH as a sequence of segments each
+// time it is asked to send them, optionally compressing them with zstd. The
+// batch is rebased locally after each segment so its buffer doesn't keep
+// growing. Files from several workers can be loaded into a database with
+// `glean write --file-format segments` without going through a server.
+std::unique_ptr<Sender> streamWriter(
+  const std::string& path,
+  bool compress = false
+);
+
 }
 }
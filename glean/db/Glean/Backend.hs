@@ -58,6 +58,7 @@ import qualified Glean.Database.Config as Database
 import qualified Glean.Database.Env as Database
 import qualified Glean.Database.Create as Database
 import qualified Glean.Database.Delete as Database
+import qualified Glean.Database.Flatten as Database
 import Glean.Database.Open as Database
 import qualified Glean.Database.List as Database
 import qualified Glean.Database.PredicateStats as Database (predicateStats)
@@ -253,6 +254,11 @@ instance Backend LoggingBackend where
   deleteDatabase (LoggingBackend env) repo =
     loggingAction (runLogRepo "deleteDatabase" env repo) (const mempty) $
       deleteDatabase env repo
+  flattenDatabase (LoggingBackend env) rq =
+    loggingAction
+      (runLogRepo "flattenDatabase" env (Thrift.flattenDatabase_repo rq))
+      (const mempty) $
+      flattenDatabase env rq
   enqueueBatch (LoggingBackend env) cbatch =
     loggingAction
       (runLogRepo "enqueueBatch" env (Thrift.computedBatch_repo cbatch))
@@ -318,6 +324,10 @@ instance Backend Database.Env where
     Database.deleteDatabase env repo
     return def
 
+  flattenDatabase env Thrift.FlattenDatabase{..} =
+    Thrift.FlattenDatabaseResult <$>
+      Database.flattenDatabase env flattenDatabase_repo flattenDatabase_hash
+
   enqueueBatch env cbatch = Database.enqueueBatch env cbatch Nothing
   enqueueJsonBatch env cbatch = Database.enqueueJsonBatch env cbatch
   pollBatch env handle = Database.pollBatch env handle
@@ -549,6 +559,7 @@ instance Backend (Some LocalOrRemote) where
 
   restoreDatabase (Some backend) = restoreDatabase backend
   deleteDatabase (Some backend) = deleteDatabase backend
+  flattenDatabase (Some backend) = flattenDatabase backend
 
   enqueueBatch (Some backend) = enqueueBatch backend
   enqueueJsonBatch (Some backend) = enqueueJsonBatch backend
@@ -45,6 +45,7 @@ import Glean.Database.Backup.Locator
 import qualified Glean.Database.Catalog as Catalog
 import Glean.Database.Catalog.Filter
 import Glean.Database.CompletePredicates
+import Glean.Database.Flatten (switchOver)
 import qualified Glean.Database.Logger as Logger
 import Glean.Database.Meta
 import Glean.Database.Repo
@@ -303,11 +304,14 @@ doFinalize env@Env{..} repo =
 
     time <- getCurrentTime
     atomically $ do
-      void $ Catalog.modifyMeta envCatalog repo $ \meta -> return meta
-        { metaCompleteness = Complete $ DatabaseComplete
-          (utcTimeToPosixEpochTime time)
-          Nothing -- the size gets updated after a backup
-        }
+      void $ Catalog.modifyMeta envCatalog repo $ \meta -> do
+        -- a flattened database replaces its stack as it becomes complete
+        new <- switchOver envCatalog repo meta
+        return new
+          { metaCompleteness = Complete $ DatabaseComplete
+            (utcTimeToPosixEpochTime time)
+            Nothing -- the size gets updated after a backup
+          }
       notify envListener $ FinalizeFinished repo
     say logInfo "finished"
     return True
@@ -28,6 +28,7 @@ import qualified Glean.Database.Storage as Storage
 import Glean.Database.Types
 import Glean.Database.Writes
 import qualified Glean.RTS.Foreign.LookupCache as LookupCache
+import Glean.RTS.Foreign.Query (closeCursorTable)
 import Glean.Types hiding (Database)
 import qualified Glean.Types as Thrift
 import Glean.Util.Mutex
@@ -136,4 +137,6 @@ closeOpenDB env OpenDB{..} = do
       withMutex wrLock $ const $ LookupCache.clear wrLookupCache
       updateLookupCacheStats env
     Nothing -> return ()
+  -- parked iterators refer to the DB, so drop them first
+  mapM_ closeCursorTable odbCursors
   Storage.close odbHandle
@@ -9,6 +9,7 @@
 {-# LANGUAGE CPP #-}
 module Glean.Database.Create (
   kickOffDatabase,
+  kickOffCopy,
   updateProperties,
 ) where
 
@@ -55,7 +56,16 @@ import Glean.Util.Observed as Observed
 
 -- | Kick off a specifc database, scheduling its tasks as necessary.
 kickOffDatabase :: Env -> Thrift.KickOff -> IO Thrift.KickOffResponse
-kickOffDatabase env@Env{..} Thrift.KickOff{..}
+kickOffDatabase env = kickOff env Nothing
+
+-- | Kick off a database which will be filled with copies of the facts of
+-- an existing one. It doesn't depend on the original but has to use its
+-- schema, so that the predicate ids of the copies mean the same thing.
+kickOffCopy :: Env -> Repo -> Thrift.KickOff -> IO Thrift.KickOffResponse
+kickOffCopy env original = kickOff env (Just original)
+
+kickOff :: Env -> Maybe Repo -> Thrift.KickOff -> IO Thrift.KickOffResponse
+kickOff env@Env{..} copyOf Thrift.KickOff{..}
   | envReadOnly = dbError kickOff_repo "can't create database in read only mode"
   | otherwise = do
       ServerConfig.Config{..} <- Observed.get envServerConfig
@@ -72,6 +82,11 @@ kickOffDatabase env@Env{..} Thrift.KickOff{..}
             return $ Storage.Create start
               (Storage.UseThisSchema $ toSchemaInfo (odbSchema odb))
 
+        copyCreate repo =
+          readDatabase env repo $ \odb _ ->
+            return $ Storage.Create lowestFid
+              (Storage.UseThisSchema $ toSchemaInfo (odbSchema odb))
+
         -- If use_schema_id is enabled in the server config and the
         -- glean.schema_id property is set, we'll use this to decide
         -- which schema instance to store in the DB.
@@ -83,7 +98,9 @@ kickOffDatabase env@Env{..} Thrift.KickOff{..}
               Nothing -> Storage.UseDefaultSchema
 
       mode <- case kickOff_dependencies of
-        Nothing -> return $ Storage.Create lowestFid schemaToUse
+        Nothing -> case copyOf of
+          Just repo -> copyCreate repo
+          Nothing -> return $ Storage.Create lowestFid schemaToUse
         Just (Dependencies_stacked repo) -> stackedCreate repo
         Just (Dependencies_pruned update) -> stackedCreate (pruned_base update)
 
@@ -29,6 +29,8 @@ import Util.Log
 import Text.Printf
 
 import qualified Glean.RTS.Foreign.LookupCache as LookupCache
+import Glean.RTS.Foreign.Query
+  (setResultCacheCapacity, setSubroutineCacheCapacity)
 import Glean.Database.Backup (backuper)
 #ifdef FACEBOOK
 import qualified Glean.Database.Backup.Manifold as Backup
@@ -41,6 +43,7 @@ import Glean.Database.Janitor
 import qualified Glean.Database.Stats as Stats
 import Glean.Database.Open
 import Glean.Database.Sharding
+import qualified Glean.Database.Storage as Storage
 import Glean.Database.Types
 import Glean.Database.Work
 import Glean.Database.Work.Heartbeat
@@ -117,6 +120,7 @@ initEnv evb dbRoot shardManager cfg logger envSchemaSource envRecipeConfig envSe
     server_cfg@ServerConfig.Config{..} <- Observed.get envServerConfig
 
     Some envStorage <- cfgStorage cfg dbRoot server_cfg
+    setQueryCacheCapacities server_cfg
     envActive <- newTVarIO mempty
     envDeleting <- newTVarIO mempty
     envStats <- Stats.new (TimeSpec 10 0)
@@ -199,6 +203,9 @@ spawnThreads env = do
   doOnUpdate (envSchemaSource env) $
     atomically $ void $ tryPutTMVar (envSchemaUpdateSignal env) ()
 
+  doOnUpdate (envServerConfig env) $
+    setQueryCacheCapacities =<< Observed.get (envServerConfig env)
+
   -- Disk usage counters
   Warden.spawn_ (envWarden env) $ doPeriodically (seconds 600) $ do
     let getDfOutput (outp::String) = read . (!! 1) . words <$>
@@ -211,6 +218,23 @@ spawnThreads env = do
     void $ setCounter "glean.db.disk.capacity_bytes" available
     void $ setCounter "glean.db.disk.used_bytes" used
 
+  -- Storage counters, like the usage of the caches
+  case env of
+    Env{envStorage = storage} ->
+      Warden.spawn_ (envWarden env) $ doPeriodically (seconds 60) $ do
+        counters <- Storage.storageCounters storage
+        forM_ counters $ \(name, value) ->
+          void $ setCounter name (fromIntegral value)
+
+-- | The query caches are global, so they're sized here rather than when
+-- opening a DB.
+setQueryCacheCapacities :: ServerConfig.Config -> IO ()
+setQueryCacheCapacities ServerConfig.Config{..} = do
+  setSubroutineCacheCapacity
+    $ fromIntegral config_query_subroutine_cache_mb * 1024 * 1024
+  setResultCacheCapacity
+    $ fromIntegral config_query_result_cache_mb * 1024 * 1024
+
 -- Todo: this needs a lot more work.
 -- * We shouldn't just cancel the janitor, we should let it finish the
 --   current job if there is one.
@@ -0,0 +1,154 @@
+{-
+  Copyright (c) Meta Platforms, Inc. and affiliates.
+  All rights reserved.
+
+  This source code is licensed under the BSD-style license found in the
+  LICENSE file in the root directory of this source tree.
+-}
+
+module Glean.Database.Flatten
+  ( flattenDatabase
+  , switchOver
+  ) where
+
+import Control.Concurrent.STM
+import Control.Monad
+import Data.Default
+import qualified Data.HashMap.Strict as HashMap
+import Data.IORef
+import Data.Text (Text)
+import qualified Data.Text as Text
+
+import Util.Control.Exception
+import Util.Log
+
+import Glean.Database.Catalog (Catalog)
+import qualified Glean.Database.Catalog as Catalog
+import Glean.Database.Catalog.Filter
+import Glean.Database.Create
+import Glean.Database.Exception
+import Glean.Database.Meta
+import Glean.Database.Open
+import Glean.Database.Repo
+import Glean.Database.Schema
+import qualified Glean.Database.Storage as Storage
+import Glean.Database.Types
+import Glean.Database.Work
+import Glean.Internal.Types as Thrift
+import Glean.Repo.Text
+import Glean.RTS.Foreign.Lookup (firstFreeId)
+import Glean.Types as Thrift
+import Glean.Util.Mutex
+import qualified Glean.Util.Warden as Warden
+
+-- | Copy the facts visible in a complete stack of databases into a new
+-- database with the same repo name and the given hash, which doesn't
+-- depend on anything, so that reads no longer have to go through every
+-- layer of the stack. Facts hidden by the ownership slices of the stack
+-- aren't copied.
+--
+-- The copy is made in the background. The new database goes through the
+-- usual finalization and, when it becomes complete, replaces the stack as
+-- the latest database of the repo name (see 'switchOver'). The stack stays
+-- available until then and can be retired afterwards like any other
+-- database.
+flattenDatabase :: Env -> Repo -> Text -> IO Repo
+flattenDatabase env@Env{..} src hash = do
+  meta <- atomically $ do
+    meta <- Catalog.readMeta envCatalog src
+    case metaCompleteness meta of
+      Complete{} -> return ()
+      c -> dbError src $
+        "can't flatten: database is " <> Text.unpack (showCompleteness c)
+    -- the copy is going to be newer than every existing database of the
+    -- repo name, so it mustn't hide one which is newer than the stack
+    newer <- newerThan envCatalog src (metaCreated meta) [src]
+    forM_ newer $ \Item{..} -> dbError src $
+      "can't flatten: " <> showRepo itemRepo <> " is newer"
+    return meta
+  void $ kickOffCopy env src def
+    { kickOff_repo = dst
+    , kickOff_fill = Just $ KickOffFill_writeHandle flattenHandle
+    , kickOff_properties =
+        HashMap.insert flattenedFromProperty (repoToText src)
+          (metaProperties meta)
+    , kickOff_repo_hash_time = metaRepoHashTime meta
+    }
+  Warden.spawn_ envWarden $ do
+    r <- tryAll $ copy
+    workFinished env WorkFinished
+      { workFinished_work = def
+          { work_repo = dst
+          , work_handle = flattenHandle
+          }
+      , workFinished_outcome = case r of
+          Left e -> Outcome_failure $ Failure $ Text.pack $ show e
+          Right{} -> Outcome_success def
+      }
+  return dst
+  where
+    dst = Repo (repo_name src) hash
+
+    copy =
+      readDatabase env src $ \_ source ->
+      withOpenDatabase env dst $ \OpenDB{..} ->
+      case odbWriting of
+        Nothing -> dbError dst "can't write to a read-only database"
+        Just writing -> withMutex (wrLock writing) $ const $ do
+          n <- Storage.flatten odbHandle (schemaInventory odbSchema) source
+            flattenBatchBytes
+          writeIORef (wrNextId writing) =<< firstFreeId odbHandle
+          logInfo $ inRepo dst $
+            "flattened " <> show n <> " facts from " <> showRepo src
+
+-- | The write handle of the work parcel which copies the facts
+flattenHandle :: Handle
+flattenHandle = "flatten"
+
+-- | Facts are copied in batches of about this many bytes
+flattenBatchBytes :: Int
+flattenBatchBytes = 256 * 1024 * 1024
+
+-- | The property of a flattened database which names the stack it was
+-- copied from
+flattenedFromProperty :: Text
+flattenedFromProperty = "glean.flattened_from"
+
+-- | Databases of the same repo name other than the given ones which were
+-- created at the given time or later and aren't broken
+newerThan :: Catalog -> Repo -> PosixEpochTime -> [Repo] -> STM [Item]
+newerThan catalog repo created except = do
+  items <- Catalog.list catalog [Local, Restoring] $
+    repoNameV .==. repo_name repo
+  return
+    [ item
+    | item@Item{..} <- items
+    , itemRepo `notElem` except
+    , metaCreated itemMeta >= created
+    , completenessStatus itemMeta /= DatabaseStatus_Broken ]
+
+-- | Called in the transaction which marks a database complete. If it was
+-- made by 'flattenDatabase', this is when it replaces the stack as the
+-- latest database of the repo name, which is decided by creation time.
+-- Fail if a database has been created since the stack which the copy would
+-- hide, and make sure the copy is ordered after the stack even if both
+-- were created in the same second.
+switchOver :: Catalog -> Repo -> Meta -> STM Meta
+switchOver catalog repo meta
+  | Just src <-
+      parseRepoText =<< HashMap.lookup flattenedFromProperty
+        (metaProperties meta) = do
+    exists <- Catalog.exists catalog [Local] src
+    src_created <- if exists
+      then metaCreated <$> Catalog.readMeta catalog src
+      else return (metaCreated meta)
+    newer <- newerThan catalog repo src_created [src, repo]
+    forM_ newer $ \Item{..} ->
+      when (metaCreated itemMeta <= metaCreated meta) $ dbError repo $
+        "can't replace " <> showRepo src <> ": " <> showRepo itemRepo
+          <> " is newer"
+    return meta
+      { metaCreated = max (metaCreated meta) $
+          PosixEpochTime (unPosixEpochTime src_created + 1)
+      }
+  | otherwise = return meta
@@ -24,9 +24,12 @@ import Control.Exception hiding(try)
 import Control.Monad.Catch (try)
 import Control.Monad.Extra
 import qualified Data.HashMap.Strict as HashMap
+import Data.ByteString (ByteString)
 import Data.IORef
 import Data.Maybe
 import qualified Data.Text as Text
+import qualified Data.Text.Encoding as Text
+import Data.Unique
 
 import Util.Log
 import Util.Text
@@ -48,6 +51,7 @@ import qualified Glean.RTS.Foreign.Lookup as Lookup
 import Glean.RTS.Foreign.Lookup (Lookup)
 import qualified Glean.RTS.Foreign.LookupCache as LookupCache
 import qualified Glean.RTS.Foreign.Ownership as Ownership
+import Glean.RTS.Foreign.Query (CursorTable, newCursorTable)
 import qualified Glean.RTS.Foreign.Stacked as Stacked
 import qualified Glean.ServerConfig.Types as ServerConfig
 import Glean.Types (Repo)
@@ -170,6 +174,29 @@ readDatabaseWithBoundaries env repo f =
   withOpenDBLookup env repo odb $ \bounds lookup ->
     f odb bounds lookup
 
+-- | A table for parking the iterators of paused queries, if enabled.
+-- Only flat DBs get one: the iterators of a stacked DB refer to the
+-- lookup stack, which only lives as long as a single request.
+newCursors :: Env -> Maybe Thrift.Dependencies -> IO (Maybe CursorTable)
+newCursors Env{..} deps = do
+  ServerConfig.Config{..} <- Observed.get envServerConfig
+  if isNothing deps && config_query_cursor_cache_mb > 0
+    then Just <$> newCursorTable
+      (fromIntegral config_query_cursor_cache_mb * 1024 * 1024)
+      (fromIntegral config_query_cursor_ttl_ms)
+    else return Nothing
+
+-- | Results of queries can only be cached for read-only DBs. The key is
+-- unique to this opening of the DB, so the cache never outlives the
+-- slice and schema that the DB was opened with.
+newResultCacheKey :: Repo -> Mode -> IO (Maybe ByteString)
+newResultCacheKey repo mode = case mode of
+  ReadOnly -> do
+    u <- newUnique
+    return $ Just $ Text.encodeUtf8 $
+      repoToText repo <> "#" <> Text.pack (show (hashUnique u))
+  _ -> return Nothing
+
 newDB :: Repo -> STM DB
 newDB repo = DB repo
   <$> newTVar Closed
@@ -334,12 +361,14 @@ setupWriting Env{..} lookup = do
   queue <- WriteQueue <$> newTQueueIO <*> newTVarIO 0 <*> newTVarIO 0
     <*> newTVarIO 0 <*> newTVarIO 0
   anchorName <- newTVarIO Nothing
+  jsonFactSchema <- newIORef Nothing
   return Writing
     { wrLock = mutex
     , wrNextId = next_id
     , wrLookupCache = lookupCache
     , wrLookupCacheAnchorName = anchorName
     , wrQueue = queue
+    , wrJsonFactSchema = jsonFactSchema
     }
 
 -- | Open a database asynchronously, returning an 'Async' that can be waited on.
@@ -381,6 +410,8 @@ asyncOpenDB env@Env{..} db@DB{..} version mode deps on_success on_failure =
             maybeSlice <- baseSlice env deps
             idle <- newTVarIO =<< getTimePoint
             ownership <- newTVarIO =<< Storage.getOwnership handle
+            cursors <- newCursors env deps
+            cacheKey <- newResultCacheKey dbRepo mode
             on_success
             return OpenDB
               { odbHandle = handle
@@ -389,6 +420,8 @@ asyncOpenDB env@Env{..} db@DB{..} version mode deps on_success on_failure =
               , odbIdleSince = idle
               , odbBaseSlice = maybeSlice
               , odbOwnership = ownership
+              , odbCursors = cursors
+              , odbResultCacheKey = cacheKey
               }
           atomically $ writeTVar dbState $ Open odb
           return odb
@@ -57,6 +57,7 @@ import Glean.RTS.Foreign.Inventory as Inventory
 import Glean.Database.Config
 import Glean.Database.Schema.Types
 import Glean.Database.Schema.Transform (mkPredicateTransformation)
+import Glean.RTS.Substitute
 import Glean.RTS.Traverse
 import Glean.RTS.Typecheck
 import Glean.RTS.Types as RTS
@@ -163,6 +164,8 @@ inventory ps = Inventory.new
       , compiledRef = predicateRef d
       , compiledTypecheck = predicateTypecheck
       , compiledTraversal = predicateTraversal
+      , compiledSubstitution = predicateSubstitution
+      , compiledHash = predicateIdHash predicateId
       }
     | d@PredicateDetails{..} <- ps ]
 
@@ -590,6 +593,7 @@ typecheckSchema idToPid dbContent stored angleVersion
         (Just pid, Just keyType, Just valueType) -> do
           typecheck <- checkSignature keyType valueType
           traversal <- genTraversal keyType valueType
+          substitution <- genSubstitution keyType valueType
           let details = PredicateDetails
                 { predicatePid = pid
                 , predicateId = id
@@ -597,6 +601,7 @@ typecheckSchema idToPid dbContent stored angleVersion
                 , predicateKeyType = keyType
                 , predicateValueType = valueType
                 , predicateTraversal = traversal
+                , predicateSubstitution = substitution
                 , predicateTypecheck = typecheck
                 , predicateDeriving = NoDeriving
                 , predicateInStoredSchema = stored
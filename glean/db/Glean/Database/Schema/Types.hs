@@ -45,6 +45,7 @@ import Glean.RTS.Foreign.Bytecode (Subroutine)
 import Glean.RTS.Foreign.Inventory (Inventory)
 import Glean.RTS.Typecheck
 import Glean.RTS.Traverse
+import Glean.RTS.Substitute
 import Glean.RTS.Types (Pid(..), Type, PidRef(..), FieldDef, ExpandedType(..))
 import Glean.Types as Thrift
 import Glean.Schema.Types
@@ -100,6 +101,7 @@ data PredicateDetails = PredicateDetails
   , predicateValueType :: Type
   , predicateTypecheck :: Subroutine CompiledTypecheck
   , predicateTraversal :: Subroutine CompiledTraversal
+  , predicateSubstitution :: Maybe (Subroutine CompiledSubstitution)
   , predicateDeriving :: DerivingInfo TypecheckedQuery
   , predicateInStoredSchema :: Bool
     -- ^ True if this prediate is part of the schema stored in the DB.
@@ -21,11 +21,12 @@ import Data.ByteString (ByteString)
 import qualified Data.ByteString.Lazy as Lazy
 import Data.HashMap.Strict (HashMap)
 import qualified Data.Vector.Storable as VS
+import Data.Word (Word64)
 
 import Glean.Database.Backup.Backend (Data)
 import Glean.RTS.Foreign.FactSet (FactSet)
 import Glean.RTS.Foreign.Inventory (Inventory)
-import Glean.RTS.Foreign.Lookup (CanLookup)
+import Glean.RTS.Foreign.Lookup (CanLookup, Lookup)
 import Glean.RTS.Foreign.Ownership
 import Glean.RTS.Types (Fid, Pid)
 import Glean.ServerConfig.Types (DBVersion(..))
@@ -108,6 +109,18 @@ class CanLookup (Database s) => Storage s where
     -> AxiomOwnership
     -> IO ()
 
+  -- | Fill an empty database with copies of the facts visible through a
+  -- 'Lookup', typically a stack of databases with its ownership slices
+  -- applied. The copies get consecutive ids starting at the first free id
+  -- of the database and are committed in batches of roughly the given
+  -- number of bytes. Returns the number of facts copied.
+  flatten
+    :: Database s
+    -> Inventory
+    -> Lookup
+    -> Int
+    -> IO Int
+
   -- | Optimise a database for reading. This is typically done before backup.
   optimize :: Database s -> IO ()
 
@@ -155,3 +168,8 @@ class CanLookup (Database s) => Storage s where
     -> FilePath  -- ^ scratch directory
     -> FilePath  -- ^ file containing the serialiased database (produced by 'backup')
     -> IO ()
+
+  -- | Counters describing the state of the storage which is shared by all
+  -- databases, like caches, to be exported by the server.
+  storageCounters :: s -> IO [(ByteString, Word64)]
+  storageCounters _ = return []
@@ -76,6 +76,9 @@ instance Storage Memory where
   -- TODO: ownership
   commit db facts _ = FactSet.append (dbFacts db) facts
 
+  -- TODO
+  flatten db _ _ _ = dbError (dbRepo db) "unimplemented 'flatten'"
+
   optimize _ = return ()
 
   -- TODO: ownership
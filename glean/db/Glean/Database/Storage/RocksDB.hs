@@ -15,16 +15,21 @@ import qualified Codec.Archive.Tar as Tar
 import Codec.Archive.Tar.Entry (getDirectoryContentsRecursive)
 import Control.Exception
 import Control.Monad
+import Data.ByteString (ByteString)
+import qualified Data.ByteString as BS
 import qualified Data.ByteString.Lazy as LBS
 import qualified Data.HashMap.Strict as HashMap
 import Data.Int
 import Data.List (unzip4)
+import qualified Data.Map as Map
+import qualified Data.Text as Text
 import qualified Data.Vector.Storable as VS
 import Data.Word
 import Foreign.C.String
 import Foreign.C.Types
 import Foreign.ForeignPtr
 import Foreign.Marshal.Array
+import Foreign.Marshal.Utils (fromBool)
 import Foreign.Ptr
 import Foreign.Storable
 import System.Directory
@@ -39,6 +44,7 @@ import Glean.Database.Storage
 import Glean.FFI
 import Glean.Repo.Text
 import Glean.RTS.Foreign.FactSet (FactSet)
+import Glean.RTS.Foreign.Inventory (Inventory)
 import Glean.RTS.Foreign.Lookup
   (CanLookup(..), Lookup(..))
 import Glean.RTS.Foreign.Ownership as Ownership
@@ -54,9 +60,34 @@ instance Object Cache where
   unwrap (Cache p) = p
   destroy = glean_rocksdb_free_cache
 
-newCache :: Int -> IO Cache
-newCache size =
-  construct $ invoke $ glean_rocksdb_new_cache (fromIntegral size)
+newCache :: ServerConfig.Config -> IO Cache
+newCache ServerConfig.Config{..} =
+  withMany withCString (map Text.unpack families) $ \cfamilies ->
+  withArrayLen cfamilies $ \count families_ptr ->
+  withArray (map megabytes sizes) $ \sizes_ptr ->
+  construct $ invoke $ glean_rocksdb_new_cache
+    (megabytes config_db_rocksdb_cache_mb)
+    (realToFrac config_db_rocksdb_cache_high_pri_ratio)
+    (fromBool config_db_rocksdb_hyper_clock_cache)
+    (fromIntegral count)
+    families_ptr
+    sizes_ptr
+  where
+    (families, sizes) = unzip $ Map.toList config_db_rocksdb_cache_family_mb
+    megabytes mb = fromIntegral mb * 1024 * 1024
+
+-- | The capacity and usage of the caches and the block cache hits and
+-- misses of the databases which use them
+cacheStats :: Cache -> IO [(ByteString, Word64)]
+cacheStats cache = with cache $ \cache_ptr -> do
+  (count, names, names_size, values) <- invoke $
+    glean_rocksdb_cache_stats cache_ptr
+  usingMalloced names $ usingMalloced values $ do
+    bytes <- BS.packCStringLen (castPtr names, fromIntegral names_size)
+    vals <- peekArray (fromIntegral count) values
+    return
+      [ ("glean.db.rocksdb.cache." <> name, val)
+      | (name, val) <- zip (BS.split 0 bytes) vals ]
 
 withCache :: Maybe Cache -> (Ptr Cache -> IO a) -> IO a
 withCache (Just cache) f = with cache f
@@ -65,17 +96,51 @@ withCache Nothing f = f nullPtr
 data RocksDB = RocksDB
   { rocksRoot :: FilePath
   , rocksCache :: Maybe Cache
+  , rocksOptimize :: Optimize
+  , rocksDerivedOwnership :: Ownership.DerivedOwnershipOptions
+  , rocksSectionIndex :: Bool
+      -- ^ whether new databases index their keys by block of fact ids
+  }
+
+-- | How to compact a database when optimising it
+data Optimize = Optimize
+  { optimizeParallelism :: Int
+      -- ^ number of column families to compact at once
+  , optimizeSubcompactions :: Int
+      -- ^ threads the compaction of a column family can be split across
+  , optimizeBackgroundJobs :: Int
+      -- ^ rocksdb's max_background_jobs while compacting
+  , optimizeFinal :: Bool
+      -- ^ use larger blocks and stronger compression
   }
 
 newStorage :: FilePath -> ServerConfig.Config -> IO RocksDB
-newStorage root ServerConfig.Config{..} = do
+newStorage root config@ServerConfig.Config{..} = do
   cache <- if config_db_rocksdb_cache_mb > 0
-    then
-      Just <$> newCache (fromIntegral config_db_rocksdb_cache_mb * 1024 * 1024)
+    then Just <$> newCache config
     else return Nothing
   return RocksDB
     { rocksRoot = root
     , rocksCache = cache
+    , rocksOptimize = Optimize
+        { optimizeParallelism =
+            fromIntegral config_db_rocksdb_optimize_parallelism
+        , optimizeSubcompactions =
+            fromIntegral config_db_rocksdb_optimize_subcompactions
+        , optimizeBackgroundJobs =
+            fromIntegral config_db_rocksdb_optimize_background_jobs
+        , optimizeFinal = config_db_rocksdb_optimize_final
+        }
+    , rocksDerivedOwnership = Ownership.DerivedOwnershipOptions
+        { derivedOwnershipMemoryLimit =
+            fromIntegral config_db_derived_ownership_memory_limit_mb
+              * 1024 * 1024
+        , derivedOwnershipSpillDir =
+            Text.unpack config_db_derived_ownership_spill_dir
+        , derivedOwnershipThreads =
+            fromIntegral config_db_derived_ownership_threads
+        }
+    , rocksSectionIndex = config_db_rocksdb_section_index
     }
 
 newtype Container = Container (Ptr Container)
@@ -88,6 +153,8 @@ instance Storage RocksDB where
   data Database RocksDB = Database
     { dbPtr :: ForeignPtr (Database RocksDB)
     , dbRepo :: Repo
+    , dbOptimize :: Optimize
+    , dbDerivedOwnership :: Ownership.DerivedOwnershipOptions
     }
 
   open rocks repo mode (DBVersion version) = do
@@ -103,9 +170,18 @@ instance Storage RocksDB where
         $ \container -> do
       fp <- mask_ $ do
         p <- invoke $
-          glean_rocksdb_container_open_database container start version
+          glean_rocksdb_container_open_database
+            container
+            start
+            version
+            (fromBool $ rocksSectionIndex rocks)
         newForeignPtr glean_rocksdb_database_free p
-      return (Database fp repo)
+      return Database
+        { dbPtr = fp
+        , dbRepo = repo
+        , dbOptimize = rocksOptimize rocks
+        , dbDerivedOwnership = rocksDerivedOwnership rocks
+        }
     where
       path = containerPath rocks repo
 
@@ -113,6 +189,8 @@ instance Storage RocksDB where
 
   delete rocks = safeRemovePathForcibly . containerPath rocks
 
+  storageCounters = maybe (return []) cacheStats . rocksCache
+
   predicateStats db = withForeignPtr (dbPtr db) $ \db_ptr -> do
     (count, pids, counts, sizes) <- invoke $ glean_rocksdb_database_stats db_ptr
     usingMalloced pids $
@@ -169,7 +247,26 @@ instance Storage RocksDB where
         VS.unsafeWith facts $ \facts_ptr ->
         f (unit_ptr, unit_size, facts_ptr, fromIntegral $ VS.length facts)
 
-  optimize db = withContainer db $ invoke . glean_rocksdb_container_optimize
+  flatten db inventory source batch_bytes =
+    withForeignPtr (dbPtr db) $ \db_ptr ->
+    with inventory $ \inventory_ptr ->
+    withLookup source $ \source_ptr ->
+      fromIntegral <$> invoke
+        (glean_rocksdb_flatten
+          db_ptr
+          inventory_ptr
+          source_ptr
+          (fromIntegral batch_bytes))
+
+  optimize db = withContainer db $ \container ->
+    invoke $ glean_rocksdb_container_optimize
+      container
+      (fromIntegral optimizeParallelism)
+      (fromIntegral optimizeSubcompactions)
+      (fromIntegral optimizeBackgroundJobs)
+      (fromBool optimizeFinal)
+    where
+      Optimize{..} = dbOptimize db
 
   computeOwnership db inv =
     withForeignPtr (dbPtr db) $ \db_ptr ->
@@ -212,7 +309,7 @@ instance Storage RocksDB where
         glean_rocksdb_get_derived_fact_ownership_iterator
           db_ptr
           (fromIntegral pid)) $
-      Ownership.computeDerivedOwnership ownership
+      Ownership.computeDerivedOwnership (dbDerivedOwnership db) ownership
 
   backup db scratch process = do
     createDirectoryIfMissing True path
@@ -266,9 +363,23 @@ withContainer db f = withForeignPtr (dbPtr db) $
   f . glean_rocksdb_database_container
 
 foreign import ccall unsafe glean_rocksdb_new_cache
-  :: CSize -> Ptr (Ptr Cache) -> IO CString
+  :: CSize
+  -> CDouble
+  -> CBool
+  -> CSize
+  -> Ptr CString
+  -> Ptr CSize
+  -> Ptr (Ptr Cache)
+  -> IO CString
 foreign import ccall unsafe "&glean_rocksdb_free_cache"
   glean_rocksdb_free_cache :: Destroy Cache
+foreign import ccall unsafe glean_rocksdb_cache_stats
+  :: Ptr Cache
+  -> Ptr CSize
+  -> Ptr (Ptr ())
+  -> Ptr CSize
+  -> Ptr (Ptr Word64)
+  -> IO CString
 
 
 foreign import ccall safe glean_rocksdb_container_open
@@ -301,7 +412,12 @@ foreign import ccall unsafe glean_rocksdb_container_read_data
   -> IO CString
 
 foreign import ccall safe glean_rocksdb_container_optimize
-  :: Container -> IO CString
+  :: Container
+  -> CSize
+  -> Word32
+  -> Int32
+  -> CBool
+  -> IO CString
 
 foreign import ccall safe glean_rocksdb_container_backup
   :: Container -> CString -> IO CString
@@ -310,6 +426,7 @@ foreign import ccall unsafe glean_rocksdb_container_open_database
   :: Container
   -> Fid
   -> Int64
+  -> CBool
   -> Ptr (Ptr (Database RocksDB))
   -> IO CString
 foreign import ccall safe "&glean_rocksdb_database_free"
@@ -326,6 +443,14 @@ foreign import ccall safe glean_rocksdb_commit
   -> Ptr FactSet
   -> IO CString
 
+foreign import ccall safe glean_rocksdb_flatten
+  :: Ptr (Database RocksDB)
+  -> Ptr Inventory
+  -> Ptr Lookup
+  -> CSize
+  -> Ptr CSize
+  -> IO CString
+
 foreign import ccall safe glean_rocksdb_add_ownership
   :: Ptr (Database RocksDB)
   -> CSize
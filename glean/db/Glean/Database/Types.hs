@@ -19,6 +19,7 @@ import Control.Concurrent.Async
 import Control.Concurrent.MVar (MVar)
 import Control.Concurrent.STM
 import Control.Exception
+import Data.ByteString (ByteString)
 import Data.HashMap.Strict (HashMap)
 import Data.IORef (IORef)
 import Data.Text (Text)
@@ -39,9 +40,11 @@ import Glean.Database.Stats (Stats)
 import Glean.Database.Storage (Database, Storage)
 import Glean.Database.Work.Heartbeat (Heartbeats)
 import Glean.Database.Work.Queue (WorkQueue)
+import Glean.RTS.Foreign.JSONFacts (JsonFactSchema)
 import Glean.RTS.Foreign.LookupCache (LookupCache)
 import qualified Glean.RTS.Foreign.LookupCache as LookupCache
 import Glean.RTS.Foreign.Ownership (Ownership, Slice)
+import Glean.RTS.Foreign.Query (CursorTable)
 import Glean.RTS.Foreign.Subst (Subst)
 import Glean.RTS.Types (Fid(..))
 import qualified Glean.Recipes.Types as Recipes
@@ -70,6 +73,9 @@ data Writing = Writing
 
     -- Queue of writes to this DB
   , wrQueue :: WriteQueue
+
+    -- Schema for converting JSON writes, created by the first one
+  , wrJsonFactSchema :: IORef (Maybe JsonFactSchema)
   }
 
 -- An open database
@@ -91,6 +97,13 @@ data OpenDB = forall storage. Storage storage => OpenDB
 
     -- ownership data from the DB
   , odbOwnership :: TVar (Maybe Ownership)
+
+    -- live iterators of paused queries, if enabled
+  , odbCursors :: Maybe CursorTable
+
+    -- identifies this instance of the DB in the query result cache;
+    -- Nothing if the DB is writable
+  , odbResultCacheKey :: Maybe ByteString
   }
 
 -- State of a databases
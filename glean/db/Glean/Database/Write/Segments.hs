@@ -0,0 +1,109 @@
+{-
+  Copyright (c) Meta Platforms, Inc. and affiliates.
+  All rights reserved.
+
+  This source code is licensed under the BSD-style license found in the
+  LICENSE file in the root directory of this source tree.
+-}
+
+module Glean.Database.Write.Segments
+  ( loadSegments
+  , readSegments
+  ) where
+
+import Control.Exception
+import Control.Monad
+import Data.Bits
+import qualified Data.ByteString as BS
+import Data.IORef
+import Data.Proxy
+import Data.Int (Int64)
+import qualified Data.Vector.Storable as VS
+import qualified Data.Vector.Storable.Mutable as VSM
+import Data.Word
+import System.IO
+
+import Control.Concurrent.Stream (stream)
+import Thrift.Protocol
+import Thrift.Protocol.Compact (Compact)
+
+import Glean.Database.Exception
+import Glean.Database.Open
+import Glean.Database.Schema
+import Glean.Database.Types
+import Glean.Database.Write.Batch
+import Glean.Database.Writes (maxBatchSize)
+import Glean.RTS.Foreign.Define (decompressBatch, substituteBatch)
+import qualified Glean.RTS.Foreign.Subst as Subst
+import Glean.RTS.Types (Fid(..), lowestFid)
+import Glean.Types (Repo)
+import qualified Glean.Types as Thrift
+
+-- | Write the files produced by streaming file senders into a database
+-- directly, without going through a server. Up to the given number of files
+-- are loaded at once. The segments of a file refer to each other so they are
+-- written one after the other, but different files are independent.
+loadSegments :: Env -> Repo -> Int -> [FilePath] -> IO ()
+loadSegments env repo jobs files = do
+  inventory <- withOpenDatabase env repo $ \OpenDB{..} ->
+    return $ schemaInventory odbSchema
+  limit <- maxBatchSize env
+  stream jobs (forM_ files) $ \file -> do
+    -- The database ids of the facts in the segments we've written so far
+    ref <- newIORef =<< emptyIds
+    readSegments file $ \Thrift.BatchSegment{..} -> do
+      ids <- readIORef ref
+      base <- frozenIds ids
+      when (batchSegment_firstId /=
+          fromFid lowestFid + fromIntegral (VS.length base)) $
+        dbError repo $ file <> ": segments out of order"
+      batch <- substituteBatch inventory base =<<
+        decompressBatch limit batchSegment_compression batchSegment_batch
+      subst <- syncWriteDatabase env repo batch
+      writeIORef ref =<<
+        appendIds ids (Thrift.subst_ids (Subst.serialize subst))
+
+-- | A growable buffer of fact ids. It doubles when it fills up so appending
+-- the ids of a segment doesn't copy the ids of all the earlier ones.
+data Ids = Ids !(VSM.IOVector Int64) !Int
+
+emptyIds :: IO Ids
+emptyIds = do
+  buf <- VSM.new 1024
+  return $ Ids buf 0
+
+appendIds :: Ids -> VS.Vector Int64 -> IO Ids
+appendIds (Ids buf n) new = do
+  let m = n + VS.length new
+  buf' <- if m <= VSM.length buf
+    then return buf
+    else VSM.grow buf $ max m (2 * VSM.length buf) - VSM.length buf
+  VS.copy (VSM.slice n (VS.length new) buf') new
+  return $ Ids buf' m
+
+-- | The ids appended so far. This doesn't copy them, which is safe because
+-- appending never changes the ids that are already there.
+frozenIds :: Ids -> IO (VS.Vector Int64)
+frozenIds (Ids buf n) = VS.unsafeFreeze $ VSM.take n buf
+
+-- | Read the segments of a file written by a streaming file sender, in order
+readSegments :: FilePath -> (Thrift.BatchSegment -> IO ()) -> IO ()
+readSegments file f = withBinaryFile file ReadMode loop
+  where
+    loop h = do
+      header <- BS.hGet h 8
+      unless (BS.null header) $ do
+        size <- fromIntegral . decodeSize <$> exactly 8 header
+        bytes <- exactly size =<< BS.hGet h size
+        case deserializeGen (Proxy :: Proxy Compact) bytes of
+          Left err -> throwIO $ ErrorCall $ file <> ": " <> err
+          Right segment -> f segment
+        loop h
+
+    exactly n bytes
+      | BS.length bytes == n = return bytes
+      | otherwise = throwIO $ ErrorCall $ file <> ": truncated segment"
+
+    -- little-endian
+    decodeSize :: BS.ByteString -> Word64
+    decodeSize = BS.foldr' (\b n -> n `shiftL` 8 .|. fromIntegral b) 0
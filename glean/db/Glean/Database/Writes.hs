@@ -34,6 +34,7 @@ module Glean.Database.Writes
   , enqueueJsonBatch
   , enqueueJsonBatchByteString
   , enqueueCheckpoint
+  , maxBatchSize
   , pollBatch
   , reapWrites
   , writerThread
@@ -67,6 +68,7 @@ import Util.STM
 import Glean.Database.Open
 import Glean.Database.Write.Batch
 import Glean.Database.Types
+import Glean.RTS.Foreign.Define (decompressBatch, decompressedSize)
 import qualified Glean.RTS.Foreign.Subst as Subst
 import Glean.RTS.Foreign.Ownership (DefineOwnership)
 import qualified Glean.ServerConfig.Types as ServerConfig
@@ -261,17 +263,32 @@ enqueueBatch env ComputedBatch{..} ownership = do
   -- server restarts/crashes
   handle <- UUID.toText <$> UUID.nextRandom
 
-  let size = ByteString.length (batch_facts computedBatch_batch)
-  r <- try $ enqueueWrite env computedBatch_repo size $
-    writeDatabase env computedBatch_repo
-      (WriteContent computedBatch_batch ownership)
+  -- Admit the batch by its decompressed size, which compressed batches
+  -- record in a header, and only decompress it when it is written. A batch
+  -- which could never fit in the write queue is rejected outright.
+  limit <- maxBatchSize env
+  size <- decompressedSize limit computedBatch_compression computedBatch_batch
+  r <- try $ enqueueWrite env computedBatch_repo size $ \point -> do
+    batch <- decompressBatch size computedBatch_compression computedBatch_batch
+    writeDatabase env computedBatch_repo (WriteContent batch ownership) point
   case r of
     -- ToDo: make sendBatch use Retry exceptions instead of results too
     Left (Retry n) ->
       return $ Thrift.SendResponse_retry (BatchRetry n)
     Right write -> do
      when computedBatch_remember $ rememberWrite env handle write
-     return $ Thrift.SendResponse_handle handle
+     return $ if computedBatch_negotiate
+       then Thrift.SendResponse_accepted SendAccepted
+         { sendAccepted_handle = handle
+         , sendAccepted_compression = [BatchCompression_Zstd]
+         }
+       else Thrift.SendResponse_handle handle
+
+-- | The largest batch the write queue can take
+maxBatchSize :: Env -> IO Int
+maxBatchSize Env{..} = do
+  ServerConfig.Config{..} <- Observed.get envServerConfig
+  return $ fromIntegral config_db_write_queue_limit_mb * 1024 * 1024
 
 enqueueJsonBatch
   :: Env
@@ -439,6 +439,12 @@ runDerivation env repo ref pred Thrift.DerivePredicateQuery{..} = do
         , userQueryStats_execute_time_ns =
             addMaybe userQueryStats_execute_time_ns
         , userQueryStats_result_count = add userQueryStats_result_count
+        , userQueryStats_expand_rounds = addMaybe userQueryStats_expand_rounds
+        , userQueryStats_expand_facts = addMaybe userQueryStats_expand_facts
+        , userQueryStats_result_cache_hits =
+            addMaybe userQueryStats_result_cache_hits
+        , userQueryStats_result_cache_misses =
+            addMaybe userQueryStats_result_cache_misses
         }
 
 -- | Update envDerivations and the Catalog metadata to reflect the current
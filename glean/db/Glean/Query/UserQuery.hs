@@ -191,6 +191,13 @@ data Results stats fact = Results
 
     -- | Query execution time after compilation, for logging, in nanoseconds
   , resExecutionTime :: Maybe Word64
+
+    -- | Batched fetch rounds and facts fetched expanding nested facts
+  , resExpandRounds :: Maybe Word64
+  , resExpandFacts :: Maybe Word64
+
+    -- | Profile of the query execution, if requested
+  , resProfile :: Maybe Thrift.QueryProfile
   }
 
 class Encoding e where
@@ -410,7 +417,7 @@ userQueryFactsImpl
     lookup
     Thrift.UserQueryFacts{..} = do
   let opts = fromMaybe def userQueryFacts_options
-      limits = mkQueryRuntimeOptions opts config
+      limits = mkQueryRuntimeOptions opts config Nothing Nothing
 
   vlog 2 $ "userQueryFactsImpl: " <> show (length userQueryFacts_facts)
   qResults@QueryResults{..} <- do
@@ -438,6 +445,9 @@ userQueryFactsImpl
         , resBytecodeSize = Nothing
         , resCompileTime = Nothing
         , resExecutionTime = Nothing
+        , resExpandRounds = Just queryResultsExpandRounds
+        , resExpandFacts = Just queryResultsExpandFacts
+        , resProfile = queryResultsProfile
         }
 
   return $ if Thrift.userQueryOptions_omit_results opts
@@ -543,6 +553,7 @@ userQueryImpl
               , predicateId = ref
               , predicateSchema = error "predicateSchema"
               , predicateTraversal = error "predicateTraversal"
+              , predicateSubstitution = error "predicateSubstitution"
               , predicateTypecheck = error "predicateTypecheck"
               , predicateDeriving = NoDeriving
               , predicateInStoredSchema = False
@@ -561,7 +572,8 @@ userQueryImpl
       let ref = SourceRef userQuery_predicate userQuery_predicate_version
       checkPredicatesMatch schema details ref schemaVersion
 
-    let limits = mkQueryRuntimeOptions opts config
+    let limits = mkQueryRuntimeOptions opts config (odbCursors odb)
+          (resultCacheKey odb stored)
     nextId <- case Thrift.userQueryOptions_continuation opts of
       Just Thrift.UserQueryCont{..}
         | userQueryCont_nextId > 0 -> return (Fid userQueryCont_nextId)
@@ -645,6 +657,9 @@ userQueryImpl
           , resBytecodeSize = Just bytecodeSize
           , resCompileTime = Just compileTime
           , resExecutionTime = Just queryResultsElapsedNs
+          , resExpandRounds = Just queryResultsExpandRounds
+          , resExpandFacts = Just queryResultsExpandFacts
+          , resProfile = queryResultsProfile
           }
 
     return $ if Thrift.userQueryOptions_omit_results opts
@@ -710,13 +725,32 @@ userQueryImpl
           , resCompileTime = Nothing
           , resBytecodeSize = Nothing
           , resExecutionTime = Just queryResultsElapsedNs
+          , resExpandRounds = Just queryResultsExpandRounds
+          , resExpandFacts = Just queryResultsExpandFacts
+          , resProfile = queryResultsProfile
           }
 
-      limits0 = mkQueryRuntimeOptions opts config
+      limits0 = mkQueryRuntimeOptions opts config (odbCursors odb)
+        (resultCacheKey odb stored)
       getLimits pids
           | Thrift.userQueryOptions_recursive opts = limits0
           | otherwise = limits0 { queryDepth = ExpandPartial pids }
 
+      -- 1. Decode the JSON
+      -- 2. Parse the JSON query
+      parseJSONQuery = do
+        pat <- case Aeson.eitherDecode (LB.fromStrict userQuery_query) of
+          Left err -> throwIO $ Thrift.BadQuery $
+            "query is not valid JSON: " <> Text.pack err
+          Right pat -> return pat
+        case runExcept $ parseQuery schema opts details pat of
+          Left err -> throwIO $ Thrift.BadQuery (Text.pack err)
+          Right query -> return query
+
+      generators query = case toGenerators schema stored details query of
+        Left err -> throwIO $ Thrift.BadQuery err
+        Right r -> return r
+
     let
       mkDefineOwners nextId = if stored
         then do
@@ -735,8 +769,9 @@ userQueryImpl
         let stack = stacked lookup derived
             pids = Set.fromList $ Pid <$> userQueryCont_pids
             limits = getLimits pids
+            binaryCont = Thrift.userQueryCont_continuation ucont
         qResults <- restartCompiled schemaInventory defineOwners stack
-          (Just predicatePid) limits (Thrift.userQueryCont_continuation ucont)
+          (Just predicatePid) limits binaryCont
         let appliedTrans = toTransformations schema $
               Thrift.userQueryCont_evolutions ucont
         mkResults pids nextId derived appliedTrans qResults defineOwners
@@ -759,10 +794,7 @@ userQueryImpl
             nextId <- firstFreeId lookup
             let pids = getExpandPids query
                 limits = getLimits pids
-            (gens, appliedTrans) <-
-              case toGenerators schema stored details query of
-                Left err -> throwIO $ Thrift.BadQuery err
-                Right r -> return r
+            (gens, appliedTrans) <- generators query
             derived <- FactSet.new nextId
             defineOwners <- mkDefineOwners nextId
             let stack = stacked lookup derived
@@ -773,37 +805,29 @@ userQueryImpl
                 sub limits
             mkResults pids nextId derived appliedTrans qResults defineOwners
 
-        -- 1. Decode the JSON
-        pat <- case Aeson.eitherDecode (LB.fromStrict userQuery_query) of
-          Left err -> throwIO $ Thrift.BadQuery $
-            "query is not valid JSON: " <> Text.pack err
-          Right pat -> return pat
-
-        -- 2. Parse the JSON query
-        case runExcept $ parseQuery schema opts details pat of
-          Left err -> throwIO $ Thrift.BadQuery (Text.pack err)
-
+        query <- parseJSONQuery
+        case query of
           -- The only two options for userQueryTerm
-          Right (MatchTerm (NestedPred _ Nothing (Just term))) ->
+          MatchTerm (NestedPred _ Nothing (Just term)) ->
             userQueryTerm term
-          Right (MatchTerm (NestedPred _ Nothing Nothing)) ->
+          MatchTerm (NestedPred _ Nothing Nothing) ->
             userQueryTerm (Ref Wildcard)
 
           -- No continuation
-          Right (MatchTerm (NestedRef id)) -> do
+          MatchTerm (NestedRef id) -> do
             res@Results{resFacts = (fid,fact):_} <- get_facts [id]
             return $! res{resFacts = [(fid,fact)], resType = Just pred}
-          Right (MatchTerm (NestedPred _ (Just ids) Nothing)) -> do
+          MatchTerm (NestedPred _ (Just ids) Nothing) -> do
             res <- get_facts ids
             return res { resType = Just pred }
-          Right (MatchTerm (NestedPred _ (Just _) (Just _))) ->
+          MatchTerm (NestedPred _ (Just _) (Just _)) ->
             oops "impossible NestedPred found"
-          Right (MatchTerm NestedSum{}) -> oops "impossible NestedSum found"
-          Right (MatchTerm NestedArray{}) -> oops "impossible NestedArray found"
-          Right Variable -> oops "impossible Variable found"
-          Right Wildcard -> oops "impossible Wildcard found"
-          Right PrefixVariable{} -> oops "impossible PrefixVariable found"
-          Right PrefixWildcard{} -> oops "impossible PrefixWildcard found"
+          MatchTerm NestedSum{} -> oops "impossible NestedSum found"
+          MatchTerm NestedArray{} -> oops "impossible NestedArray found"
+          Variable -> oops "impossible Variable found"
+          Wildcard -> oops "impossible Wildcard found"
+          PrefixVariable{} -> oops "impossible PrefixVariable found"
+          PrefixWildcard{} -> oops "impossible PrefixWildcard found"
 
     return $ if Thrift.userQueryOptions_omit_results opts
        then withoutFacts results
@@ -900,8 +924,11 @@ withoutFacts results = results
 mkQueryRuntimeOptions
   :: Thrift.UserQueryOptions
   -> ServerConfig.Config
+  -> Maybe CursorTable
+  -> Maybe ByteString
   -> QueryRuntimeOptions
-mkQueryRuntimeOptions Thrift.UserQueryOptions{..} ServerConfig.Config{..} =
+mkQueryRuntimeOptions
+    Thrift.UserQueryOptions{..} ServerConfig.Config{..} cursors cacheKey =
   QueryRuntimeOptions
     { queryMaxResults = userQueryOptions_max_results
         <|> config_default_max_results -- from ServerConfig
@@ -910,10 +937,21 @@ mkQueryRuntimeOptions Thrift.UserQueryOptions{..} ServerConfig.Config{..} =
     , queryMaxTimeMs = userQueryOptions_max_time_ms
         <|> config_default_max_time_ms -- from ServerConfig
     , queryWantStats = userQueryOptions_collect_facts_searched
+    , queryWantProfile =
+        Thrift.queryDebugOptions_profile userQueryOptions_debug
     , queryDepth = if userQueryOptions_recursive
         then ExpandRecursive else ResultsOnly
+    , queryCursors = cursors
+    , queryResultCacheKey = cacheKey
     }
 
+-- | The key identifying the DB in the query result cache. Queries that
+-- store derived facts must always run.
+resultCacheKey :: OpenDB -> Bool -> Maybe ByteString
+resultCacheKey odb stored
+  | stored = Nothing
+  | otherwise = odbResultCacheKey odb
+
 
 writeDerivedFacts
   :: Env
@@ -933,13 +971,15 @@ writeDerivedFacts env repo firstId derived owned = do
   if Thrift.batch_count batch == 0
     then return Nothing
     else do
-      resp <- enqueueBatch env Thrift.ComputedBatch
-        { computedBatch_repo = repo
-        , computedBatch_remember = True
-        , computedBatch_batch = batch }
+      resp <- enqueueBatch env def
+        { Thrift.computedBatch_repo = repo
+        , Thrift.computedBatch_remember = True
+        , Thrift.computedBatch_batch = batch }
         owned
       case resp of
         Thrift.SendResponse_handle handle -> return (Just handle)
+        Thrift.SendResponse_accepted accepted ->
+          return (Just (Thrift.sendAccepted_handle accepted))
         Thrift.SendResponse_retry (Thrift.BatchRetry s) ->
           throwIO $ Thrift.Retry s
 
@@ -971,6 +1011,8 @@ checkPredicatesMatch dbSchema details predicate schemaVer = do
 data Stats = Stats
   { statFactCount :: {-# UNPACK #-} !Int
   , statResultCount :: {-# UNPACK #-} !Int
+  , statCacheHits :: {-# UNPACK #-} !Int
+  , statCacheMisses :: {-# UNPACK #-} !Int
   }
 
 getStats :: QueryResults -> IO Stats
@@ -983,11 +1025,19 @@ getStats QueryResults{..} = do
       Vector.length queryResultsFacts +
       Vector.length queryResultsNestedFacts
 
+    hits = fromIntegral queryResultsCacheHits
+    misses = fromIntegral queryResultsCacheMisses
+
   addStatValueType "glean.query.facts" facts Stats.Sum
   addStatValueType "glean.query.results" results Stats.Sum
+  when (hits + misses > 0) $ do
+    addStatValueType "glean.query.result_cache.hits" hits Stats.Sum
+    addStatValueType "glean.query.result_cache.misses" misses Stats.Sum
   return $ Stats
     { statFactCount = facts
     , statResultCount  = results
+    , statCacheHits = hits
+    , statCacheMisses = misses
     }
 
 withStats :: IO (Results Stats fact) -> IO (Results Thrift.UserQueryStats fact)
@@ -1007,7 +1057,19 @@ withStats io = do
             fmap (round . (* 1000000000)) (resCompileTime res )
         , Thrift.userQueryStats_execute_time_ns =
             fromIntegral <$> resExecutionTime res
+        , Thrift.userQueryStats_expand_rounds =
+            fromIntegral <$> resExpandRounds res
+        , Thrift.userQueryStats_expand_facts =
+            fromIntegral <$> resExpandFacts res
+        , Thrift.userQueryStats_result_cache_hits = cacheStat statCacheHits
+        , Thrift.userQueryStats_result_cache_misses = cacheStat statCacheMisses
+        , Thrift.userQueryStats_profile = resProfile res
         }
+      -- only report the cache for queries that could be cached
+      cacheStat f
+        | statCacheHits (resStats res) + statCacheMisses (resStats res) > 0 =
+          Just $ fromIntegral $ f $ resStats res
+        | otherwise = Nothing
   return res{ resStats = stats }
 
 
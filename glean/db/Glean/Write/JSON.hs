@@ -8,6 +8,10 @@
 
 module Glean.Write.JSON
   ( buildJsonBatch
+  , JsonFactSchema
+  , newJsonFactSchema
+  , buildJsonBatchStreaming
+  , buildJsonBatchesStreaming
   , emptySubst
   , syncWriteJsonBatch
   , writeJsonBatch
@@ -16,13 +20,18 @@ module Glean.Write.JSON
 
 import Control.Exception
 import Control.Monad.Reader
+import qualified Data.Aeson.Encoding as Aeson
 import Data.ByteString (ByteString)
+import qualified Data.ByteString.Builder as BB
+import qualified Data.ByteString.Lazy as LBS
 import qualified Data.ByteString.Unsafe as BS
 import Data.Coerce (coerce)
 import Data.Default
 import Data.IORef
 import Data.HashMap.Strict (HashMap)
 import qualified Data.HashMap.Strict as HashMap
+import qualified Data.IntMap as IntMap
+import Data.List (foldl', intersperse)
 import Data.Maybe
 import Data.Text (Text)
 import Data.Text.Prettyprint.Doc hiding ((<>))
@@ -34,7 +43,7 @@ import Foreign.C.Types (CSize)
 import TextShow hiding (Builder)
 
 import Thrift.Protocol.JSON.Base64
-import Util.FFI (invoke)
+import Util.FFI (ffiErrorMessage, invoke)
 
 import Glean.Database.Open
 import Glean.Database.Write.Batch
@@ -45,6 +54,8 @@ import Glean.RTS as RTS
 import Glean.RTS.Builder
 import Glean.RTS.Constants
 import qualified Glean.RTS.Foreign.JSON as J
+import Glean.RTS.Foreign.JSONFacts (JsonFactSchema)
+import qualified Glean.RTS.Foreign.JSONFacts as JSONFacts
 import Glean.RTS.Foreign.Subst as Subst (Subst, empty)
 import Glean.RTS.Types
 import Glean.Angle.Types hiding (Type)
@@ -80,8 +91,8 @@ writeJsonBatch
   -> Point -- ^ for measuring end-to-end latency of a write request
   -> IO ()
 writeJsonBatch env repo SendJsonBatch{..} tick = do
-  dbSchema <- withOpenDatabase env repo (return . Database.odbSchema)
-  batch <- buildJsonBatch dbSchema sendJsonBatch_options sendJsonBatch_batches
+  batch <- buildJsonBatchesStreaming env repo
+    sendJsonBatch_options sendJsonBatch_batches
   _ <- writeDatabase env repo (WriteContent batch Nothing) tick
   return ()
 
@@ -96,6 +107,66 @@ buildJsonBatch dbSchema opts batches =
       writeFacts dbSchema (fromMaybe def opts) builders
         jsonFactBatch_predicate jsonFactBatch_facts jsonFactBatch_unit
 
+-- | The schema needed by 'buildJsonBatchStreaming': the types of all the
+-- predicates in the DB and the names of the ones that can be written.
+newJsonFactSchema :: DbSchema -> IO JsonFactSchema
+newJsonFactSchema dbSchema = JSONFacts.newSchema preds names
+  where
+  preds =
+    [ (predicatePid, predicateKeyType, predicateValueType)
+    | PredicateDetails{..} <- IntMap.elems (predicatesByPid dbSchema) ]
+  refs = HashMap.keys $ HashMap.fromList
+    [ (predicateIdRef predId, ())
+    | predId <- HashMap.keys (predicatesById dbSchema) ]
+  names =
+    [ (ref, predicatePid details)
+    | ref@(PredicateRef name ver) <- refs
+    , Right details <-
+        [lookupPredicateSourceRef (SourceRef name (Just ver))
+          LatestSchemaAll dbSchema]
+    , predicateInStoredSchema details ]
+
+-- | Like 'buildJsonBatch' but for a whole file of JSON fact batches (as
+-- accepted by 'Glean.Write.fileToBatches'). The file is mapped into memory
+-- and converted straight to binary facts in a single pass without building
+-- a JSON value first, which is much faster and takes much less memory for
+-- large files.
+buildJsonBatchStreaming
+  :: JsonFactSchema
+  -> Maybe SendJsonBatchOptions
+  -> FilePath
+  -> IO Batch
+buildJsonBatchStreaming schema opts file =
+  toBatch =<< JSONFacts.convert
+    schema
+    (maybe False sendJsonBatchOptions_no_base64_binary opts)
+    (Fid firstAnonId)
+    file
+
+convertJsonFacts
+  :: JsonFactSchema
+  -> Maybe SendJsonBatchOptions
+  -> ByteString
+  -> IO Batch
+convertJsonFacts schema opts bytes =
+  toBatch =<< JSONFacts.convertBytes
+    schema
+    (maybe False sendJsonBatchOptions_no_base64_binary opts)
+    (Fid firstAnonId)
+    bytes
+
+toBatch :: JSONFacts.JsonFacts -> IO Batch
+toBatch JSONFacts.JsonFacts{..} = do
+  let
+    add m (unit, Fid from, Fid to) = HashMap.insertWith (++) unit [from, to] m
+    ownerMap = foldl' add HashMap.empty jsonFactsOwned
+  return $ Thrift.Batch
+    firstAnonId
+    (fromIntegral jsonFactsCount)
+    jsonFactsData
+    (Just jsonFactsIds)
+    (fmap Vector.fromList ownerMap)
+
 writeJsonBatchByteString
   :: Env
   -> Repo
@@ -105,11 +176,64 @@ writeJsonBatchByteString
   -> Point -- ^ for measuring end-to-end latency of a write request
   -> IO ()
 writeJsonBatchByteString env repo pred facts opts tick = do
-  dbSchema <- withOpenDatabase env repo (return . Database.odbSchema)
-  batch <- withFactBuilder $ \builder ->
-    writeFacts dbSchema opts builder pred facts Nothing{-TODO-}
+  batch <- buildJsonBatchesStreaming env repo (Just opts)
+    [JsonFactBatch pred facts Nothing{-TODO-}]
   void $ writeDatabase env repo (WriteContent batch Nothing) tick
 
+-- | Convert JSON fact batches sent to the server with the streaming
+-- converter, like 'buildJsonBatchStreaming' does for files. The facts are
+-- spliced into a single document without being parsed, so a batch is only
+-- parsed once, by the converter.
+buildJsonBatchesStreaming
+  :: Env
+  -> Repo
+  -> Maybe SendJsonBatchOptions
+  -> [JsonFactBatch]
+  -> IO Batch
+buildJsonBatchesStreaming env repo opts batches = do
+  (dbSchema, schema) <- withOpenDatabase env repo $ \odb ->
+    (Database.odbSchema odb,) <$> dbJsonFactSchema odb
+  -- Report predicates that can't be written the same way as 'buildJsonBatch'
+  forM_ batches $ \JsonFactBatch{..} ->
+    predDetailsForWriting dbSchema jsonFactBatch_predicate
+  handle (throwIO . Thrift.Exception . Text.pack . ffiErrorMessage) $
+    convertJsonFacts schema opts $ LBS.toStrict $ BB.toLazyByteString $
+      jsonFactBatchesDocument batches
+
+-- | The 'JsonFactSchema' of an open DB. A writable DB's schema doesn't
+-- change so we only create it for the first JSON write.
+dbJsonFactSchema :: OpenDB -> IO JsonFactSchema
+dbJsonFactSchema OpenDB{..} = case odbWriting of
+  Nothing -> newJsonFactSchema odbSchema
+  Just Writing{..} -> do
+    cached <- readIORef wrJsonFactSchema
+    case cached of
+      Just schema -> return schema
+      Nothing -> do
+        schema <- newJsonFactSchema odbSchema
+        atomicModifyIORef' wrJsonFactSchema $ \old -> case old of
+          Just existing -> (old, existing)
+          Nothing -> (Just schema, schema)
+
+-- | Render JSON fact batches in the format of the files accepted by
+-- 'buildJsonBatchStreaming'.
+jsonFactBatchesDocument :: [JsonFactBatch] -> BB.Builder
+jsonFactBatchesDocument batches = "[" <> commas (map batch batches) <> "]"
+  where
+  batch JsonFactBatch{..} =
+    "{\"predicate\":" <> predicate jsonFactBatch_predicate
+    <> ",\"facts\":[" <> commas (map BB.byteString jsonFactBatch_facts) <> "]"
+    <> foldMap (\unit -> ",\"unit\":" <> text unit) jsonFactBatch_unit
+    <> "}"
+
+  predicate (PredicateRef name version) =
+    "{\"name\":" <> text name
+    <> ",\"version\":" <> BB.int64Dec (fromIntegral version) <> "}"
+
+  text = Aeson.fromEncoding . Aeson.text
+
+  commas = mconcat . intersperse ","
+
 writeFacts
   :: DbSchema
   -> SendJsonBatchOptions
@@ -136,6 +136,14 @@ class Backend a where
   -- For a local database this will delete the specified repo
   deleteDatabase :: a -> Thrift.Repo -> IO Thrift.DeleteDatabaseResult
 
+  -- | Start copying a stack of databases into a new database of the same
+  -- repo name without dependencies, which replaces the stack as the latest
+  -- database of the repo name once it is complete.
+  flattenDatabase
+    :: a
+    -> Thrift.FlattenDatabase
+    -> IO Thrift.FlattenDatabaseResult
+
   -- Enqueue a batch for writing
   enqueueBatch :: a -> Thrift.ComputedBatch -> IO Thrift.SendResponse
 
@@ -210,6 +218,7 @@ instance Backend (Some Backend) where
 
   restoreDatabase (Some backend) = restoreDatabase backend
   deleteDatabase (Some backend) = deleteDatabase backend
+  flattenDatabase (Some backend) = flattenDatabase backend
 
   enqueueBatch (Some backend) = enqueueBatch backend
   enqueueJsonBatch (Some backend) = enqueueJsonBatch backend
@@ -349,6 +358,10 @@ instance Backend ThriftBackend where
   deleteDatabase t repo =
     withoutShard t $ GleanService.deleteDatabase repo
 
+  flattenDatabase t rq =
+    withShard t (Thrift.flattenDatabase_repo rq) $
+      GleanService.flattenDatabase rq
+
   enqueueBatch t cbatch =
     withShard t (Thrift.computedBatch_repo cbatch) $
       GleanService.sendBatch cbatch
@@ -12,11 +12,16 @@ module Glean.RTS.Foreign.Define
   , InvalidRedefinition(..)
   , defineFact
   , defineUntrustedBatch
+  , decompressedSize
+  , decompressBatch
+  , substituteBatch
   ) where
 
 import Control.Exception
 import Control.Monad
+import qualified Data.ByteString as BS
 import Data.Coerce (coerce)
+import Data.Int (Int64)
 import Data.Typeable
 import qualified Data.Vector.Storable as VS
 import Foreign.C.String
@@ -87,6 +92,61 @@ defineUntrustedBatch facts inventory batch =
               Thrift.Exception "mismatch between count and ids.size in batch"
       | otherwise = f nullPtr
 
+-- | The size of the facts in a batch which was sent with the given codec
+-- once they are decompressed. This only looks at the header of compressed
+-- facts and fails if they would be bigger than the given limit.
+decompressedSize :: Int -> Thrift.BatchCompression -> Thrift.Batch -> IO Int
+decompressedSize _ Thrift.BatchCompression_None batch =
+  return $ BS.length $ Thrift.batch_facts batch
+decompressedSize limit Thrift.BatchCompression_Zstd batch =
+  unsafeWithBytes (Thrift.batch_facts batch) $ \data_ptr data_size ->
+    fromIntegral <$> invoke
+      (glean_batch_zstd_size data_ptr data_size (fromIntegral limit))
+
+-- | Undo the compression of the facts in a batch which was sent with the
+-- given codec. Compressed facts which would be bigger than the given limit
+-- are rejected.
+decompressBatch
+  :: Int
+  -> Thrift.BatchCompression
+  -> Thrift.Batch
+  -> IO Thrift.Batch
+decompressBatch _ Thrift.BatchCompression_None batch = return batch
+decompressBatch limit Thrift.BatchCompression_Zstd batch =
+  unsafeWithBytes (Thrift.batch_facts batch) $ \data_ptr data_size -> do
+    (facts_ptr, facts_size) <- invoke $
+      glean_batch_decompress_zstd data_ptr data_size (fromIntegral limit)
+    facts <- unsafeMallocedByteString facts_ptr facts_size
+    return batch { Thrift.batch_facts = facts }
+
+-- | Rename a batch from a file written by a streaming file sender, which
+-- refers to the facts of earlier segments of the file by the ids they were
+-- written with. The vector contains the database ids of these facts, in
+-- order. The result can be written to the database like any other batch.
+substituteBatch
+  :: Inventory
+  -> VS.Vector Int64    -- ^ database ids of the facts in earlier segments
+  -> Thrift.Batch
+  -> IO Thrift.Batch
+substituteBatch inventory base batch =
+  with inventory $ \p_inventory ->
+  VS.unsafeWith base $ \base_ptr ->
+  unsafeWithBytes (Thrift.batch_facts batch) $ \data_ptr data_size -> do
+    (first_id, facts_ptr, facts_size) <- invoke $
+      glean_substitute_batch
+        p_inventory
+        base_ptr
+        (fromIntegral $ VS.length base)
+        (Fid $ Thrift.batch_firstId batch)
+        (fromIntegral $ Thrift.batch_count batch)
+        data_ptr
+        data_size
+    facts <- unsafeMallocedByteString facts_ptr facts_size
+    return batch
+      { Thrift.batch_firstId = fromFid first_id
+      , Thrift.batch_facts = facts
+      }
+
 foreign import ccall unsafe glean_define_fact
   :: Define
   -> Pid
@@ -105,3 +165,31 @@ foreign import ccall safe glean_define_untrusted_batch
   -> CSize
   -> Ptr (Ptr Subst)
   -> IO CString
+
+foreign import ccall safe glean_substitute_batch
+  :: Ptr Inventory
+  -> Ptr Int64
+  -> CSize
+  -> Fid
+  -> CSize
+  -> Ptr ()
+  -> CSize
+  -> Ptr Fid
+  -> Ptr (Ptr ())
+  -> Ptr CSize
+  -> IO CString
+
+foreign import ccall unsafe glean_batch_zstd_size
+  :: Ptr ()
+  -> CSize
+  -> CSize
+  -> Ptr CSize
+  -> IO CString
+
+foreign import ccall safe glean_batch_decompress_zstd
+  :: Ptr ()
+  -> CSize
+  -> CSize
+  -> Ptr (Ptr ())
+  -> Ptr CSize
+  -> IO CString
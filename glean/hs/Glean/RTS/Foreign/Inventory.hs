@@ -20,16 +20,19 @@ module Glean.RTS.Foreign.Inventory
 import Control.Monad
 import Data.ByteString (ByteString)
 import Data.Default
-import Data.List (unzip6)
+import Data.List (unzip7)
 import Foreign hiding (with, withMany, new)
 import Foreign.C
+import GHC.Fingerprint (Fingerprint(..))
 import System.IO.Unsafe (unsafePerformIO)
 
 import Util.FFI
 
+import Glean.Angle.Hash (Hash)
 import Glean.FFI
 import Glean.RTS.Typecheck
 import Glean.RTS.Traverse
+import Glean.RTS.Substitute
 import Glean.RTS.Foreign.Bytecode (Subroutine)
 import Glean.RTS.Foreign.Lookup (Lookup(..), CanLookup(..))
 import Glean.RTS.Types (Pid(..))
@@ -49,12 +52,18 @@ data CompiledPredicate = CompiledPredicate
   , compiledRef :: PredicateRef
   , compiledTypecheck :: Subroutine CompiledTypecheck
   , compiledTraversal :: Subroutine CompiledTraversal
+  , compiledSubstitution :: Maybe (Subroutine CompiledSubstitution)
+    -- ^ Nothing if the predicate has no fact references
+  , compiledHash :: Hash
+    -- ^ Used to find natively compiled subroutines for the predicate, see
+    -- glean/rts/native.h
   }
 
 -- | Create a new 'Inventory' from a list of predicate specs. Predicates will be
 -- assigned consecutive ids starting with first. Each predicate is accompanied
 -- by a bytecode subrouting for fact typechecking (from
--- 'Glean.RTS.Typecheck.checkSignature').
+-- 'Glean.RTS.Typecheck.checkSignature') and for substitution (from
+-- 'Glean.RTS.Substitute.genSubstitution').
 new :: [CompiledPredicate] -> Inventory
 -- NOTE: This is pure because inventories are immutable.
 new ps = unsafePerformIO $ withMany predicate ps $ \qs ->
@@ -63,7 +72,8 @@ new ps = unsafePerformIO $ withMany predicate ps $ \qs ->
        name_sizes,
        versions,
        tcs,
-       trs) = unzip6 qs
+       trs,
+       sts) = unzip7 qs
   in
   withArray ids $ \p_ids ->
   withArray name_ptrs $ \p_name_ptrs ->
@@ -71,6 +81,8 @@ new ps = unsafePerformIO $ withMany predicate ps $ \qs ->
   withArray versions $ \p_versions ->
   withArray tcs $ \p_tcs ->
   withArray trs $ \p_trs ->
+  withArray sts $ \p_sts ->
+  withArray (concatMap hashWords ps) $ \p_hashes ->
   construct $ invoke $ glean_inventory_new
     (fromIntegral n)
     p_ids
@@ -79,18 +91,24 @@ new ps = unsafePerformIO $ withMany predicate ps $ \qs ->
     p_versions
     p_tcs
     p_trs
+    p_sts
+    p_hashes
   where
     !n = length ps
     predicate CompiledPredicate{..} f =
       withUTF8Text (predicateRef_name compiledRef) $ \name_ptr name_size ->
       with compiledTypecheck $ \tc_ptr ->
       with compiledTraversal $ \tr_ptr ->
+      maybeWith with compiledSubstitution $ \st_ptr ->
       f ( compiledPid
         , name_ptr
         , name_size
         , fromIntegral $ predicateRef_version compiledRef
         , tc_ptr
-        , tr_ptr )
+        , tr_ptr
+        , st_ptr )
+    hashWords CompiledPredicate{..} =
+      let Fingerprint hi lo = compiledHash in [hi, lo]
 
 instance Eq Inventory where
   a == b = unsafePerformIO $
@@ -157,6 +175,8 @@ foreign import ccall unsafe glean_inventory_new
   -> Ptr Int32
   -> Ptr (Ptr (Subroutine CompiledTypecheck))
   -> Ptr (Ptr (Subroutine CompiledTraversal))
+  -> Ptr (Ptr (Subroutine CompiledSubstitution))
+  -> Ptr Word64
   -> Ptr (Ptr Inventory)
   -> IO CString
 foreign import ccall unsafe "&glean_inventory_free" glean_inventory_free
@@ -0,0 +1,226 @@
+{-
+  Copyright (c) Meta Platforms, Inc. and affiliates.
+  All rights reserved.
+
+  This source code is licensed under the BSD-style license found in the
+  LICENSE file in the root directory of this source tree.
+-}
+
+-- | Streaming conversion of JSON fact batches straight to binary facts,
+-- see glean/rts/jsonfacts.h
+module Glean.RTS.Foreign.JSONFacts
+  ( JsonFactSchema
+  , newSchema
+  , JsonFacts(..)
+  , convert
+  , convertBytes
+  ) where
+
+import Control.Monad
+import Data.ByteString (ByteString)
+import qualified Data.ByteString as BS
+import Data.ByteString.Builder (Builder)
+import qualified Data.ByteString.Builder as Builder
+import qualified Data.ByteString.Lazy as LBS
+import Data.Int
+import Data.Text (Text)
+import qualified Data.Text.Encoding as Text
+import qualified Data.Vector.Storable as VS
+import Foreign hiding (with, withMany)
+import Foreign.C
+
+import Util.FFI
+
+import Glean.Angle.Types (FieldDef_(..), Type_(..))
+import Glean.FFI
+import Glean.RTS.Types (ExpandedType(..), Fid(..), Pid(..), PidRef(..), Type)
+import Glean.Types (PredicateRef(..))
+
+newtype JsonFactSchema = JsonFactSchema (ForeignPtr JsonFactSchema)
+
+instance Object JsonFactSchema where
+  wrap = JsonFactSchema
+  unwrap (JsonFactSchema p) = p
+  destroy = glean_json_fact_schema_free
+
+-- | Create a schema for 'convert' from the key and value types of the
+-- predicates which may occur in the JSON and the names by which they can be
+-- referred to.
+newSchema :: [(Pid, Type, Type)] -> [(PredicateRef, Pid)] -> IO JsonFactSchema
+newSchema preds names =
+  unsafeWithBytes bytes $ \p n ->
+  construct $ invoke $ glean_json_fact_schema_new p n
+  where
+    bytes = LBS.toStrict $ Builder.toLazyByteString $
+      word (length preds) <> foldMap predicate preds <>
+      word (length names) <> foldMap name names
+
+    predicate (Pid pid, key, value) = word pid <> ty key <> ty value
+
+    name (PredicateRef n v, Pid pid) = text n <> word v <> word pid
+
+    ty :: Type -> Builder
+    ty t = case t of
+      ByteTy -> tag 0
+      NatTy -> tag 1
+      StringTy -> tag 2
+      ArrayTy elt -> tag 3 <> ty elt
+      RecordTy fields -> tag 4 <> fieldDefs fields
+      SumTy fields -> tag 5 <> fieldDefs fields
+      PredicateTy (PidRef (Pid pid) _) -> tag 6 <> word pid
+      NamedTy (ExpandedType _ named) -> ty named
+      EnumeratedTy vals -> tag 7 <> word (length vals)
+      MaybeTy elt -> tag 8 <> ty elt
+      BooleanTy -> tag 9
+
+    fieldDefs fields =
+      word (length fields) <>
+      mconcat [ text n <> ty t | FieldDef n t <- fields ]
+
+    tag :: Word8 -> Builder
+    tag = Builder.word8
+
+    word :: Integral a => a -> Builder
+    word = Builder.word64LE . fromIntegral
+
+    text :: Text -> Builder
+    text t = let b = Text.encodeUtf8 t in
+      word (BS.length b) <> Builder.byteString b
+
+-- | The result of 'convert', in the form expected by 'Glean.Types.Batch'
+data JsonFacts = JsonFacts
+  { jsonFactsCount :: Int
+  , jsonFactsData :: ByteString
+    -- ^ The serialized facts
+  , jsonFactsIds :: VS.Vector Int64
+    -- ^ For each fact, the id it was given in the JSON or 0
+  , jsonFactsOwned :: [(ByteString, Fid, Fid)]
+    -- ^ Ranges of facts owned by units, in order of occurrence
+  }
+
+-- | Convert a file of JSON fact batches to binary facts with ids starting
+-- from the given one. The file is mapped into memory rather than read.
+convert
+  :: JsonFactSchema
+  -> Bool -- ^ byte arrays aren't base64-encoded
+  -> Fid
+  -> FilePath
+  -> IO JsonFacts
+convert schema no_base64_binary first path =
+  with schema $ \schema_ptr ->
+  withCString path $ \path_ptr ->
+  withResult $ glean_json_facts_convert_file
+    schema_ptr
+    path_ptr
+    first
+    (fromBool no_base64_binary)
+
+-- | Like 'convert' but for JSON fact batches which are already in memory.
+convertBytes
+  :: JsonFactSchema
+  -> Bool -- ^ byte arrays aren't base64-encoded
+  -> Fid
+  -> ByteString
+  -> IO JsonFacts
+convertBytes schema no_base64_binary first bytes =
+  with schema $ \schema_ptr ->
+  unsafeWithBytes bytes $ \p n ->
+  withResult $ glean_json_facts_convert
+    schema_ptr
+    p
+    n
+    first
+    (fromBool no_base64_binary)
+
+withResult
+  :: (  Ptr CSize
+     -> Ptr (Ptr ())
+     -> Ptr CSize
+     -> Ptr (Ptr Int64)
+     -> Ptr CSize
+     -> Ptr (Ptr ())
+     -> Ptr (Ptr CSize)
+     -> Ptr (Ptr Int64)
+     -> IO CString )
+  -> IO JsonFacts
+withResult run =
+  alloca $ \p_count ->
+  alloca $ \p_facts ->
+  alloca $ \p_facts_size ->
+  alloca $ \p_ids ->
+  alloca $ \p_owned_count ->
+  alloca $ \p_names ->
+  alloca $ \p_name_sizes ->
+  alloca $ \p_ranges -> do
+    invoke $ run
+      p_count
+      p_facts
+      p_facts_size
+      p_ids
+      p_owned_count
+      p_names
+      p_name_sizes
+      p_ranges
+    count <- peek p_count
+    facts <- join $ unsafeMallocedByteString <$> peek p_facts
+      <*> peek p_facts_size
+    ids <- join $ unsafeMallocedVector <$> peek p_ids <*> pure count
+    owned_count <- fromIntegral <$> peek p_owned_count
+    name_sizes <- peek p_name_sizes
+    ranges <- peek p_ranges
+    names <- peek p_names
+    let malloced = [castPtr name_sizes, castPtr ranges, names]
+    owned <- usingManyMalloced malloced $ do
+      sizes <- peekArray owned_count name_sizes
+      bounds <- peekArray (2 * owned_count) ranges
+      all_names <- copyByteString names (sum sizes)
+      return $ units all_names sizes bounds
+    return JsonFacts
+      { jsonFactsCount = fromIntegral count
+      , jsonFactsData = facts
+      , jsonFactsIds = ids
+      , jsonFactsOwned = owned
+      }
+  where
+    units bytes (size : sizes) (from : to : bounds) =
+      let (unit, rest) = BS.splitAt (fromIntegral size) bytes in
+      (unit, Fid from, Fid to) : units rest sizes bounds
+    units _ _ _ = []
+
+foreign import ccall unsafe glean_json_fact_schema_new
+  :: Ptr ()
+  -> CSize
+  -> Ptr (Ptr JsonFactSchema)
+  -> IO CString
+foreign import ccall unsafe "&glean_json_fact_schema_free"
+  glean_json_fact_schema_free :: Destroy JsonFactSchema
+
+foreign import ccall safe glean_json_facts_convert
+  :: Ptr JsonFactSchema
+  -> Ptr ()
+  -> CSize
+  -> Fid
+  -> CBool
+  -> Ptr CSize
+  -> Ptr (Ptr ())
+  -> Ptr CSize
+  -> Ptr (Ptr Int64)
+  -> Ptr CSize
+  -> Ptr (Ptr ())
+  -> Ptr (Ptr CSize)
+  -> Ptr (Ptr Int64)
+  -> IO CString
+foreign import ccall safe glean_json_facts_convert_file
+  :: Ptr JsonFactSchema
+  -> CString
+  -> Fid
+  -> CBool
+  -> Ptr CSize
+  -> Ptr (Ptr ())
+  -> Ptr CSize
+  -> Ptr (Ptr Int64)
+  -> Ptr CSize
+  -> Ptr (Ptr ())
+  -> Ptr (Ptr CSize)
+  -> Ptr (Ptr Int64)
+  -> IO CString
@@ -0,0 +1,66 @@
+{-
+  Copyright (c) Meta Platforms, Inc. and affiliates.
+  All rights reserved.
+
+  This source code is licensed under the BSD-style license found in the
+  LICENSE file in the root directory of this source tree.
+-}
+
+module Glean.RTS.Substitute
+  ( CompiledSubstitution
+  , genSubstitution
+  ) where
+
+import Glean.Bytecode.Types
+import Glean.RTS.Foreign.Bytecode
+import Glean.RTS.Types
+import Glean.RTS.Bytecode.Code
+import Glean.RTS.Bytecode.Gen.Issue
+import Glean.RTS.Traverse (traverseFacts, hasRefs)
+
+-- | Type tag for Subroutine
+data CompiledSubstitution
+
+-- | Generate a subroutine which substitutes the fact IDs in a clause. It
+-- takes the same arguments as the typechecker (see
+-- 'Glean.RTS.Typecheck.checkSignature') but assumes that the clause is
+-- type correct: the bytes between fact IDs are copied to the output
+-- wholesale and only the fact IDs themselves are decoded and rewritten.
+--
+-- Returns Nothing if the clause can't contain fact IDs, in which case
+-- substitution is just a copy.
+genSubstitution
+  :: Type
+  -> Type
+  -> IO (Maybe (Subroutine CompiledSubstitution))
+genSubstitution key_ty val_ty
+  | not (hasRefs (repType key_ty) || hasRefs (repType val_ty)) =
+    return Nothing
+  | otherwise = fmap Just $
+    generate Optimised $
+      \( rename
+       , (clause_begin, key_end, clause_end)
+       , out
+       , out_key_size ) -> do
+      -- mark is the start of the input that hasn't been copied yet
+      local $ \mark -> do
+        move clause_begin mark
+        traverseFacts (subst rename clause_begin key_end mark out)
+          clause_begin key_end key_ty
+        outputBytes mark key_end out
+        local $ \size -> do
+          getOutputSize out size
+          storeWord size out_key_size
+        move key_end mark
+        traverseFacts (subst rename key_end clause_end mark out)
+          key_end clause_end val_ty
+        outputBytes mark clause_end out
+      ret
+  where
+    subst rename input inputend mark out (Pid pid) = local $ \ide -> do
+      outputBytes mark input out
+      inputNat input inputend ide
+      pidr <- constant (fromIntegral pid)
+      callFun_2_1 rename ide pidr ide
+      outputNat ide out
+      move input mark
@@ -10,6 +10,8 @@
 module Glean.RTS.Traverse
   ( CompiledTraversal
   , genTraversal
+  , traverseFacts
+  , hasRefs
   ) where
 
 import Control.Monad
@@ -29,7 +31,27 @@ traversal
   -> Register 'DataPtr
   -> Type
   -> Code ()
-traversal callback input inputend ty = go False (repType ty)
+traversal callback input inputend = traverseFacts onFact input inputend
+  where
+    onFact (Pid pid) = local $ \ide -> do
+      inputNat input inputend ide
+      pidr <- constant (fromIntegral pid)
+      callFun_2_0 callback ide pidr
+
+-- | Skip over a value of the given type, invoking the supplied action
+-- with the input pointing at each fact ID in the value. The action must
+-- consume the fact ID.
+--
+-- NOTE: Parts of the value that contain no fact IDs might not be
+-- traversed, so the input is only guaranteed to point after the value
+-- if the type contains fact IDs.
+traverseFacts
+  :: (Pid -> Code ())
+  -> Register 'DataPtr
+  -> Register 'DataPtr
+  -> Type
+  -> Code ()
+traverseFacts onFact input inputend ty = go False (repType ty)
   where
     -- if refs is True, we *must* leave the input pointer pointing
     -- after the value, because we're going to traverse more data.
@@ -44,6 +66,7 @@ traversal callback input inputend ty = go False (repType ty)
       inputNat input inputend size
       case elty of
         ByteRep -> add size (castRegister input)
+        NatRep -> inputSkipNats input inputend size
         _ -> mdo
           jumpIf0 size end
           loop <- label
@@ -71,10 +94,7 @@ traversal callback input inputend ty = go False (repType ty)
             return alt
           end <- label
           return ()
-    go _ (PredicateRep (Pid pid)) = local $ \ide -> do
-      inputNat input inputend ide
-      pidr <- constant (fromIntegral pid)
-      callFun_2_0 callback ide pidr
+    go _ (PredicateRep pid) = onFact pid
 
 -- | Generate a subroutine which traverses a clause (fact key + value)
 -- and invokes the supplied callback function for each fact ID
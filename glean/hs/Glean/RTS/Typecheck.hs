@@ -56,6 +56,7 @@ typecheck rename input inputend output = tc
           move input ptr
           inputBytes input inputend size
           outputBytes ptr input output
+        NatTy -> inputNats input inputend size output
         _ -> mdo
           jumpIf0 size end
           loop <- label
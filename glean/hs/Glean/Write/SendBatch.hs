@@ -39,9 +39,14 @@ sendBatch backend repo batch = do
 sendBatchAsync
   :: Backend be => be -> Thrift.Repo -> Thrift.Batch -> IO Thrift.Handle
 sendBatchAsync backend repo batch = do
-  r <- enqueueBatch backend $ Thrift.ComputedBatch repo True batch
+  r <- enqueueBatch backend $ def
+    { Thrift.computedBatch_repo = repo
+    , Thrift.computedBatch_remember = True
+    , Thrift.computedBatch_batch = batch
+    }
   case r of
     Thrift.SendResponse_handle h -> return h
+    Thrift.SendResponse_accepted a -> return $ Thrift.sendAccepted_handle a
     Thrift.SendResponse_retry (Thrift.BatchRetry r) ->
       retry r $ sendBatchAsync backend repo batch
 
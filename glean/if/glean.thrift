@@ -375,6 +375,12 @@ struct PredicateStats {
 
 typedef string Handle
 
+// Codecs for the facts of a ComputedBatch
+enum BatchCompression {
+  None = 0,
+  Zstd = 1,
+} (hs.nounknown)
+
 // A part of a computed batch that can be sent to the server
 struct ComputedBatch {
   1: Repo repo;
@@ -385,15 +391,49 @@ struct ComputedBatch {
   3: bool remember = false;
 
   4: Batch batch;
+
+  // The codec which batch.facts is compressed with. Only use codecs which
+  // the server has listed in a SendAccepted response.
+  5: BatchCompression compression = None;
+
+  // If true, ask the server to reply with SendAccepted rather than just the
+  // handle. Servers which predate compression ignore this and reply with the
+  // handle, which tells the client not to compress.
+  6: bool negotiate = false;
+}
+
+// A batch written to a file by a streaming file sender. A file is a
+// sequence of these, each preceded by its size in bytes as a little-endian
+// 64 bit integer.
+struct BatchSegment {
+  // Facts with ids below batch.firstId refer to facts in earlier segments of
+  // the same file.
+  1: Batch batch;
+
+  // The codec which batch.facts is compressed with
+  2: BatchCompression compression = None;
+
+  // The id which the writer gave to the first fact of the batch and which
+  // later segments refer to it by. The facts of a file are numbered
+  // consecutively from the lowest fact id in the order they were written.
+  3: Id firstId;
 }
 
 struct BatchRetry {
   1: double seconds;
 }
 
+struct SendAccepted {
+  1: Handle handle;
+
+  // Codecs the server can decompress
+  2: list<BatchCompression> compression;
+}
+
 union SendResponse {
   1: Handle handle;
   2: BatchRetry retry;
+  3: SendAccepted accepted;
 } (hs.nonempty)
 
 union FinishResponse {
@@ -500,6 +540,10 @@ struct QueryDebugOptions {
 
   // dump the compiled bytecode for the query
   2: bool bytecode = false;
+
+  // run the query in profiling mode and return a QueryProfile in the
+  // stats. This makes the query significantly slower.
+  3: bool profile = false;
 }
 
 # Encode results using Glean's internal binary representation
@@ -676,6 +720,37 @@ struct UserQuery {
   8: optional SchemaId schema_id;
 }
 
+struct QueryProfileCounter {
+  1: string name;
+  2: i64 count;
+  3: i64 cycles;
+  // estimated CPU cycles, including any callbacks made
+}
+
+// Fan-out of one generator in the query
+struct QueryProfileIterator {
+  1: i64 depth;
+  // nesting depth of the iterator: generators that are nested more
+  // deeply are run once for every fact produced by the enclosing ones
+  2: Id predicate;
+  // Use getSchemaInfo to map Id to PredicateRef
+  3: i64 seeks;
+  // number of times the generator was started
+  4: i64 facts;
+  // number of facts it produced in total
+  5: i64 cycles;
+  // estimated CPU cycles spent in seeking and iterating
+}
+
+struct QueryProfile {
+  1: list<QueryProfileCounter> ops;
+  // bytecode instructions executed
+  2: list<QueryProfileCounter> callbacks;
+  // calls from the bytecode into the query engine (seek, next,
+  // lookupKeyValue)
+  3: list<QueryProfileIterator> iterators;
+}
+
 struct UserQueryStats {
   // 1: deprecated
   2: i64 num_facts;
@@ -695,6 +770,16 @@ struct UserQueryStats {
   // time to execute the compiled query
   9: i64 result_count;
 // the number of top-level facts in the result. Not counting nested facts.
+  10: optional i64 expand_rounds;
+  // number of batched fetch rounds used to expand nested facts
+  11: optional i64 expand_facts;
+  // number of nested facts fetched while expanding results
+  12: optional i64 result_cache_hits;
+  13: optional i64 result_cache_misses;
+  // lookups in the server's query result cache, if the query could be
+  // served from it
+  14: optional QueryProfile profile;
+  // if requested with QueryDebugOptions.profile
 }
 
 # Results in Glean's internal binary representation
@@ -802,6 +887,16 @@ struct GetDatabaseResult {
 
 struct DeleteDatabaseResult {}
 
+struct FlattenDatabase {
+  1: Repo repo;
+  // hash of the flattened database, which has the same repo name
+  2: string hash;
+}
+
+struct FlattenDatabaseResult {
+  1: Repo repo;
+}
+
 struct JsonFactBatch {
   1: PredicateRef predicate;
   2: list<json> facts;
@@ -1073,6 +1168,16 @@ service GleanService extends fb303.FacebookService {
     2: UnknownDatabase u,
   );
 
+  // Copy the facts visible in a complete stack of databases into a new
+  // database with the same repo name which doesn't depend on anything.
+  // The copy is made in the background and becomes the latest database of
+  // the repo name when it is complete. The stack must be the latest
+  // database of the repo name.
+  FlattenDatabaseResult flattenDatabase(1: FlattenDatabase request) throws (
+    1: Exception e,
+    2: UnknownDatabase u,
+  );
+
   void restore(1: string locator) throws (1: InvalidLocator e);
 
   UserQueryResults userQueryFacts(1: Repo repo, 2: UserQueryFacts q) throws (
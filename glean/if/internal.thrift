@@ -25,6 +25,9 @@ struct SubroutineState {
   3: i64 inputs;
   4: list<i64> locals;
   5: list<string> literals;
+  6: optional binary code_hash;
+  // If set, the subroutine may be in the server's SubroutineCache
+  // under this hash. If it isn't, it is built from code and literals.
 }
 
 struct QueryCont {
@@ -34,6 +37,11 @@ struct QueryCont {
   // 4: deprecated, do not use
   5: i64 pid;
   6: optional Subroutine traverse;
+  7: optional binary traverse_hash;
+  // Like code_hash, for the traversal subroutine in traverse.
+  8: optional i64 cursor;
+  // The live iterators may be parked in the server's CursorTable under
+  // this id. The keys in iters are still valid if they aren't.
 }
 
 // Types for serialising/deserialising inventories. See comments in
@@ -48,12 +56,23 @@ struct Subroutine {
   6: list<string> literals;
 }
 
+// See PredicateId in Glean.Angle.Types
+struct PredicateHash {
+  1: i64 hi;
+  2: i64 lo;
+}
+
 struct Predicate {
   1: glean.Id id;
   2: glean.PredicateRef ref;
   // 3: deprecated
   4: Subroutine typechecker;
   5: Subroutine traverser;
+  // Specialised substitution, absent if the predicate has no fact refs or
+  // the inventory predates it (then we use the typechecker)
+  6: optional Subroutine substituter;
+  7: bool has_refs = true;
+  8: optional PredicateHash hash;
 }
 
 struct Inventory {
@@ -44,10 +44,12 @@ import qualified Thrift.Server.Types as Thrift.Server
 import qualified Glean
 import qualified Glean.LocalOrRemote as LocalOrRemote
 import Glean.Backend (BackendKind(..), LocalOrRemote(..), ThriftBackend(..))
+import Glean.Database.Schema (fromSchemaInfo, readWriteContent)
 import Glean.Derive
 import qualified Glean.Handler as GleanHandler
 import Glean.Indexer
 import Glean.Write
+import Glean.Write.JSON (buildJsonBatchStreaming, newJsonFactSchema)
 import Glean.Util.Service
 
 externalIndexer :: Indexer Ext
@@ -124,9 +126,13 @@ execExternal Ext{..} env repo IndexerParams{..} = do index; derive
       callCommand
         (unwords (extRunScript : map (quoteArg . subst jsonVars) extArgs))
       files <- listDirectory jsonBatchDir
+      schemaInfo <- Glean.getSchemaInfo env repo
+      dbSchema <- fromSchemaInfo schemaInfo readWriteContent
+      jsonSchema <- newJsonFactSchema dbSchema
       stream maxConcurrency (forM_ files) $ \file -> do
-        batches <- fileToBatches (jsonBatchDir </> file)
-        void $ LocalOrRemote.sendJsonBatch env repo batches Nothing
+        batch <- buildJsonBatchStreaming jsonSchema Nothing
+          (jsonBatchDir </> file)
+        void $ Glean.sendBatch env repo batch
 
     Server -> do
       let
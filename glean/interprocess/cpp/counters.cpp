@@ -13,14 +13,30 @@
 #endif
 #include "glean/interprocess/cpp/counters.h"
 #include "glean/interprocess/cpp/counters_ffi.h"
+#include "glean/interprocess/cpp/layout.h"
 
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <unordered_map>
 
 #include <boost/interprocess/file_mapping.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 
+// A counters file is either an array of n packed 64-bit counters or, by
+// default for new files, an interprocess::FileHeader followed by the counters
+// each in a slot of its own (see layout.h). We tell them apart by the size of
+// the file.
+
 using namespace facebook::hs;
+using namespace facebook::glean;
+
+namespace {
+
+// "GLEANCT" in the low 7 bytes
+constexpr uint64_t kCountersMagic = 0x54434e41454c47;
+
+}
 
 extern "C" {
 
@@ -28,42 +44,82 @@ struct glean_interprocess_counters_t final
     : public facebook::glean::interprocess::Counters{
   boost::interprocess::file_mapping mapping;
   boost::interprocess::mapped_region region;
-  std::atomic<uint64_t> *counters;
+  char *base;
+  size_t stride;
   size_t size;
 
   explicit glean_interprocess_counters_t(const char *path, size_t n) {
     mapping = boost::interprocess::file_mapping(
       path, boost::interprocess::read_write);
-    region = boost::interprocess::mapped_region(
-      mapping,
-      boost::interprocess::read_write,
-      0,
-      n * sizeof(uint64_t));
-    counters = static_cast<std::atomic<uint64_t> *>(region.get_address());
+    if (std::filesystem::file_size(path) == n * sizeof(uint64_t)) {
+      stride = sizeof(uint64_t);
+      region = boost::interprocess::mapped_region(
+        mapping,
+        boost::interprocess::read_write,
+        0,
+        n * sizeof(uint64_t));
+      base = static_cast<char *>(region.get_address());
+    } else {
+      region = boost::interprocess::mapped_region(
+        mapping,
+        boost::interprocess::read_only,
+        0,
+        sizeof(interprocess::FileHeader));
+      interprocess::FileHeader header;
+      std::memcpy(&header, region.get_address(), sizeof(header));
+      if (header.magic != kCountersMagic
+          || header.version != interprocess::kFileVersion
+          || header.count != n) {
+        throw std::runtime_error(
+          std::string("invalid counters file ") + path);
+      }
+      stride = header.slot;
+      region = boost::interprocess::mapped_region(
+        mapping,
+        boost::interprocess::read_write,
+        0,
+        stride * (n + 1));
+      base = static_cast<char *>(region.get_address()) + stride;
+    }
     size = n;
-    assert(std::atomic_is_lock_free(counters));
+    assert(std::atomic_is_lock_free(
+      reinterpret_cast<std::atomic<uint64_t> *>(base)));
   }
 
   static void create(
       const char *path,
-      size_t n) {
-    std::vector<uint64_t> contents(n, 0);
+      size_t n,
+      interprocess::Layout layout) {
+    std::vector<uint64_t> contents;
+    if (layout == interprocess::Layout::Padded) {
+      interprocess::FileHeader header{};
+      header.magic = kCountersMagic;
+      header.version = interprocess::kFileVersion;
+      header.count = n;
+      header.slot = interprocess::kSlotSize;
+      contents.resize((n + 1) * interprocess::kSlotSize / sizeof(uint64_t), 0);
+      std::memcpy(contents.data(), &header, sizeof(header));
+    } else {
+      contents.resize(n, 0);
+    }
     std::ofstream stream(path, std::ios::out | std::ios::binary);
     stream.write(
-      reinterpret_cast<const char *>(contents.data()), n * sizeof(uint64_t));
+      reinterpret_cast<const char *>(contents.data()),
+      contents.size() * sizeof(uint64_t));
   }
 
   std::atomic<uint64_t> *counter(size_t i) override {
     if (i >= size) {
       throw std::invalid_argument("counter index out of range");
     }
-    return counters + i;
+    return reinterpret_cast<std::atomic<uint64_t> *>(base + stride * i);
   }
 };
 
 const char *glean_interprocess_counters_create(const char *path, size_t size) {
   return ffi::wrap([=] {
-    glean_interprocess_counters_t::create(path, size);
+    glean_interprocess_counters_t::create(
+      path, size, interprocess::Layout::Padded);
   });
 }
 
@@ -105,8 +161,8 @@ namespace facebook {
 namespace glean {
 namespace interprocess {
 
-void countersSetup(const std::string& path, size_t size) {
-  glean_interprocess_counters_t::create(path.c_str(), size);
+void countersSetup(const std::string& path, size_t size, Layout layout) {
+  glean_interprocess_counters_t::create(path.c_str(), size, layout);
 }
 
 std::unique_ptr<Counters> counters(const std::string& path, size_t size) {
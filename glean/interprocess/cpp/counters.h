@@ -14,6 +14,8 @@
 #include <string>
 #include <vector>
 
+#include "glean/interprocess/cpp/layout.h"
+
 namespace facebook {
 namespace glean {
 namespace interprocess {
@@ -25,7 +27,10 @@ struct Counters {
   virtual counter_t *counter(size_t index) = 0;
 };
 
-void countersSetup(const std::string& path, size_t count);
+void countersSetup(
+  const std::string& path,
+  size_t count,
+  Layout layout = Layout::Padded);
 
 std::unique_ptr<Counters> counters(const std::string& path, size_t size);
 
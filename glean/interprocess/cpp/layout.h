@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+
+#include <folly/lang/Align.h>
+
+namespace facebook {
+namespace glean {
+namespace interprocess {
+
+/// How the shared counters of interprocess files are laid out.
+enum class Layout {
+  /// All counters are packed next to each other, with up to 8 per cache
+  /// line. This is the original format which older readers understand.
+  Packed,
+
+  /// Each counter gets its own slot of kSlotSize bytes, and the file starts
+  /// with a FileHeader in a slot of its own. This avoids false sharing
+  /// between processes updating their own counters.
+  Padded,
+};
+
+/// Size of a slot in padded files. It is fixed when the file is created and
+/// recorded in the header so readers don't depend on it.
+constexpr size_t kSlotSize = folly::hardware_destructive_interference_size;
+
+/// First slot of a padded file
+struct FileHeader {
+  uint64_t magic;
+  uint64_t version;
+  // number of counters
+  uint64_t count;
+  // distance between counters in bytes
+  uint64_t slot;
+  // format specific
+  uint64_t flags;
+  uint64_t extra;
+};
+
+static_assert(sizeof(FileHeader) <= kSlotSize);
+
+constexpr uint64_t kFileVersion = 1;
+
+}
+}
+}
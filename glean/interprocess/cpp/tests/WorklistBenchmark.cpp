@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <common/init/Init.h>
+#include <folly/Benchmark.h>
+#include <folly/experimental/TestUtil.h>
+
+#include <queue>
+#include <thread>
+
+#include <boost/thread/barrier.hpp>
+#include <glog/logging.h>
+
+#include "glean/interprocess/cpp/worklist.h"
+#include "glean/interprocess/cpp/worklist_ffi.h"
+
+using namespace facebook::glean;
+
+namespace {
+
+// Simulated indexing cost of each item: mostly small, with occasional items
+// up to a hundred times more expensive which come in clusters, much like
+// translation units which pull in the same huge headers.
+std::vector<uint64_t> skewed(size_t items) {
+  std::vector<uint64_t> costs;
+  costs.reserve(items);
+  uint64_t state = 0x9E3779B97F4A7C15;
+  for (size_t i = 0; i < items; ++i) {
+    state = state * 6364136223846793005 + 1442695040888963407;
+    const auto r = state >> 33;
+    const bool hot = (i / 64) % 16 == 3;
+    costs.push_back(hot && r % 2 == 0 ? 200 + r % 2000 : 1 + r % 20);
+  }
+  return costs;
+}
+
+// Runs a discrete event simulation of workers processing the items via the
+// worklist and returns the time at which the last one finishes.
+uint64_t makespan(
+    bool weighted,
+    size_t workers,
+    const std::vector<uint64_t>& costs) {
+  const auto items = costs.size();
+  std::vector<worklist::Counter::Value> values;
+  for (size_t i = 0; i < workers; ++i) {
+    values.push_back({
+      static_cast<uint32_t>(items * i / workers),
+      static_cast<uint32_t>(items * (i+1) / workers)});
+  }
+
+  folly::test::TemporaryFile file;
+  file.close();
+  const auto path = file.path().string();
+  if (weighted) {
+    worklist::stealingCounterSetup(path, values, costs);
+  } else {
+    worklist::stealingCounterSetup(path, values);
+  }
+  glean_interprocess_worklist_t *w;
+  if (auto err = glean_interprocess_worklist_open(path.c_str(), &w)) {
+    LOG(FATAL) << err;
+  }
+
+  using Event = std::pair<uint64_t, size_t>;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+  for (size_t i = 0; i < workers; ++i) {
+    events.push({0, i});
+  }
+  uint64_t finish = 0;
+  while (!events.empty()) {
+    auto [time, worker] = events.top();
+    events.pop();
+    uint32_t start, end;
+    size_t victim;
+    glean_interprocess_worklist_next(w, worker, &start, &end, &victim);
+    if (start < end) {
+      events.push({time + costs[start], worker});
+    } else {
+      finish = std::max(finish, time);
+    }
+  }
+  glean_interprocess_worklist_close(w);
+  return finish;
+}
+
+void simulate(
+    folly::UserCounters& counters,
+    bool weighted,
+    size_t workers,
+    size_t items) {
+  folly::BenchmarkSuspender braces;
+  const auto costs = skewed(items);
+  uint64_t total = 0;
+  for (auto c : costs) {
+    total += c;
+  }
+  const auto ideal = (total + workers - 1) / workers;
+  braces.dismiss();
+
+  auto t = makespan(weighted, workers, costs);
+  // makespan relative to a perfect split of the total cost, in percent
+  counters["makespan"] = t;
+  counters["overhead"] = t * 100 / ideal - 100;
+}
+
+// Workers in separate threads with their own mappings of the file, like
+// indexer processes, each taking items from their own range. Nobody steals so
+// any slowdown is due to counters sharing cache lines.
+void contention(size_t iters, interprocess::Layout layout, size_t workers) {
+  folly::BenchmarkSuspender braces;
+  std::vector<worklist::Counter::Value> values;
+  const auto range = static_cast<uint32_t>(
+    std::min(iters + 1, size_t(UINT32_MAX) / workers));
+  for (uint32_t i = 0; i < workers; ++i) {
+    values.push_back({i * range, (i+1) * range});
+  }
+  folly::test::TemporaryFile file;
+  file.close();
+  const auto path = file.path().string();
+  worklist::stealingCounterSetup(path, values, layout);
+
+  std::vector<std::thread> threads;
+  boost::barrier start(workers + 1);
+  for (size_t i = 0; i < workers; ++i) {
+    threads.emplace_back([&, i] {
+      glean_interprocess_worklist_t *w;
+      if (auto err = glean_interprocess_worklist_open(path.c_str(), &w)) {
+        LOG(FATAL) << err;
+      }
+      start.count_down_and_wait();
+      for (size_t k = 0; k < iters; ++k) {
+        uint32_t s, e;
+        size_t victim;
+        glean_interprocess_worklist_next(w, i, &s, &e, &victim);
+        folly::doNotOptimizeAway(s);
+      }
+      glean_interprocess_worklist_close(w);
+    });
+  }
+  start.count_down_and_wait();
+  braces.dismiss();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+} // namespace
+
+BENCHMARK_COUNTERS(count_16x10k, counters) {
+  simulate(counters, false, 16, 10000);
+}
+BENCHMARK_COUNTERS(cost_16x10k, counters) {
+  simulate(counters, true, 16, 10000);
+}
+BENCHMARK_DRAW_LINE();
+BENCHMARK_COUNTERS(count_64x10k, counters) {
+  simulate(counters, false, 64, 10000);
+}
+BENCHMARK_COUNTERS(cost_64x10k, counters) {
+  simulate(counters, true, 64, 10000);
+}
+BENCHMARK_DRAW_LINE();
+BENCHMARK_COUNTERS(count_256x100k, counters) {
+  simulate(counters, false, 256, 100000);
+}
+BENCHMARK_COUNTERS(cost_256x100k, counters) {
+  simulate(counters, true, 256, 100000);
+}
+
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(contention, packed_1, interprocess::Layout::Packed, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(
+  contention, padded_1, interprocess::Layout::Padded, 1)
+BENCHMARK_NAMED_PARAM(contention, packed_8, interprocess::Layout::Packed, 8)
+BENCHMARK_RELATIVE_NAMED_PARAM(
+  contention, padded_8, interprocess::Layout::Padded, 8)
+BENCHMARK_NAMED_PARAM(contention, packed_64, interprocess::Layout::Packed, 64)
+BENCHMARK_RELATIVE_NAMED_PARAM(
+  contention, padded_64, interprocess::Layout::Padded, 64)
+
+int main(int argc, char** argv) {
+  facebook::initFacebook(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -45,9 +45,19 @@ namespace {
 struct StealingFile {
   folly::test::TemporaryFile file;
 
-  explicit StealingFile(const std::vector<Counter::Value>& values) {
+  explicit StealingFile(
+      const std::vector<Counter::Value>& values,
+      interprocess::Layout layout = interprocess::Layout::Padded) {
     file.close();
-    stealingCounterSetup(file.path().string(), values);
+    stealingCounterSetup(file.path().string(), values, layout);
+  }
+
+  StealingFile(
+      const std::vector<Counter::Value>& values,
+      const std::vector<uint64_t>& costs,
+      interprocess::Layout layout = interprocess::Layout::Padded) {
+    file.close();
+    stealingCounterSetup(file.path().string(), values, costs, layout);
   }
 
   const std::string& path() const {
@@ -101,20 +111,21 @@ TEST(WorklistTest, Steal1) {
   CHECK_EQ(visits, std::vector<size_t>(values.back().end, 1));
 }
 
-TEST(WorklistTest, Steal2) {
-  std::vector<Counter::Value> values{{0,30},{30,120},{120,121},{121,345}};
+// Run a thread per worker and check that each item is visited exactly once
+void stealAll(
+    const std::vector<Counter::Value>& values,
+    const std::string& path) {
   const size_t len = values.back().end;
   auto atomic_visits = std::make_unique<std::atomic<size_t>[]>(len);
   for (auto i = 0; i < len; ++i) {
     atomic_visits[i].store(0);
   }
 
-  StealingFile file(values);
   std::vector<std::thread> threads;
   boost::barrier barrier(values.size());
   for (auto i = 0; i < values.size(); ++i) {
     threads.push_back(std::thread([&,i] {
-      auto counter = stealingCounter(file.path(), i, values.size());
+      auto counter = stealingCounter(path, i, values.size());
       barrier.count_down_and_wait();
       while (auto r = counter->next()) {
         CHECK_LT(r.value().start, len);
@@ -130,7 +141,78 @@ TEST(WorklistTest, Steal2) {
   for (auto i = 0; i < len; ++i) {
     visits.push_back(atomic_visits[i].load());
   }
-  CHECK_EQ(visits, std::vector<size_t>(values.back().end, 1));
+  CHECK_EQ(visits, std::vector<size_t>(len, 1));
+}
+
+TEST(WorklistTest, Steal2) {
+  std::vector<Counter::Value> values{{0,30},{30,120},{120,121},{121,345}};
+  StealingFile file(values);
+  stealAll(values, file.path());
+}
+
+// Files in the original packed layout still work
+TEST(WorklistTest, Packed) {
+  std::vector<Counter::Value> values{{0,30},{30,120},{120,121},{121,345}};
+  StealingFile file(values, interprocess::Layout::Packed);
+  stealAll(values, file.path());
+}
+
+// Worker 1 has run out and steals from worker 0 which has a single expensive
+// item followed by cheap ones: it should leave the victim just the expensive
+// item rather than half of the items.
+TEST(WorklistTest, WeightedSteal) {
+  std::vector<uint64_t> costs{1, 100, 1, 1, 1, 1, 1, 1, 1};
+  StealingFile file({{0,9},{9,9}}, costs);
+
+  auto victim = stealingCounter(file.path(), 0, 2);
+  auto thief = stealingCounter(file.path(), 1, 2);
+  CHECK_EQ(victim->next(), Counter::Value({0,9}));
+  CHECK_EQ(thief->next(), Counter::Value({2,9}));
+  CHECK_EQ(victim->next(), Counter::Value({1,2}));
+}
+
+// The expensive item is at the end of the victim's range so the thief takes
+// just that one.
+TEST(WorklistTest, WeightedStealLast) {
+  std::vector<uint64_t> costs{1, 1, 1, 1, 1, 1, 100};
+  StealingFile file({{0,7},{7,7}}, costs);
+
+  auto victim = stealingCounter(file.path(), 0, 2);
+  auto thief = stealingCounter(file.path(), 1, 2);
+  CHECK_EQ(victim->next(), Counter::Value({0,7}));
+  CHECK_EQ(thief->next(), Counter::Value({6,7}));
+  checkAll(victim.get(), {1,6});
+  CHECK(!victim->next());
+  CHECK(!thief->next());
+}
+
+// Idle workers pick their victim by remaining cost, not by item count
+TEST(WorklistTest, WeightedVictim) {
+  std::vector<uint64_t> costs{1, 1, 1, 1, 50, 50, 0};
+  StealingFile file({{0,4},{4,6},{6,6}}, costs);
+
+  auto thief = stealingCounter(file.path(), 2, 3);
+  CHECK_EQ(thief->next(), Counter::Value({5,6}));
+}
+
+TEST(WorklistTest, WeightedSteal2) {
+  std::vector<Counter::Value> values{{0,30},{30,120},{120,121},{121,345}};
+  std::vector<uint64_t> costs;
+  for (size_t i = 0; i < values.back().end; ++i) {
+    costs.push_back(i % 17 == 0 ? 1000 : i % 3);
+  }
+  for (auto layout :
+      {interprocess::Layout::Padded, interprocess::Layout::Packed}) {
+    StealingFile file(values, costs, layout);
+    stealAll(values, file.path());
+  }
+}
+
+TEST(WorklistTest, WeightedBadCosts) {
+  folly::test::TemporaryFile file;
+  file.close();
+  EXPECT_ANY_THROW(
+    stealingCounterSetup(file.path().string(), {{0,4}}, {1, 2, 3}));
 }
 
 }
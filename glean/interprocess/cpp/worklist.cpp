@@ -11,11 +11,16 @@
 #else
 #include <common/hs/util/cpp/wrap.h>
 #endif
+#include "glean/interprocess/cpp/layout.h"
 #include "glean/interprocess/cpp/worklist.h"
 #include "glean/interprocess/cpp/worklist_ffi.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <fstream>
+#include <stdexcept>
+#include <string>
 
 #include <boost/interprocess/file_mapping.hpp>
 #include <boost/interprocess/mapped_region.hpp>
@@ -43,17 +48,60 @@
 //
 // With files, we don't need the size at the beginning, strictly speaking. We
 // will, though, if we switch to shmem objects.
+//
+// A weighted stealing counter file sets the top bit of n and follows the
+// counters with the prefix sums of per-item cost estimates:
+//
+//        uint64         uint64     uint64             uint64
+// +-----------------+-...-+-----+-----------+-------+-----------+
+// | n | (1 << 63)   | ... |  m  |  cost[0]  | ..... |  cost[m]  |
+// +-----------------+-...-+-----+-----------+-------+-----------+
+//
+// where m is the number of items and cost[i] is the total cost of items 0 to
+// i-1. The table is never written after setup so workers read it without
+// synchronisation. An idle worker then steals from the worker with the most
+// remaining cost rather than the most remaining items, and takes the suffix
+// of its range which comes closest to half of that cost.
+//
+// The layout above packs 8 workers' counters into each cache line so every
+// fetch_add in next() contends with 7 other processes. New files therefore
+// use the padded layout (see layout.h) by default:
+//
+//     slot        slot               slot        uint64           uint64
+// +--------+------------+-----+------------+---------+-----+---------+
+// | header | start0 end0| ... | start(n-1) | cost[0] | ... | cost[m] |
+// |        |            |     |   end(n-1) |         |     |         |
+// +--------+------------+-----+------------+---------+-----+---------+
+//
+// where the header is an interprocess::FileHeader with kWorklistMagic, the
+// WEIGHTED flag if there are costs and m in extra, and each (start,end) pair
+// sits at the start of a slot of its own. The cost table is read-only, so it
+// is packed.
 
 using namespace facebook::hs;
 using namespace facebook::glean;
 
+namespace {
+
+// "GLEANWL" in the low 7 bytes
+constexpr uint64_t kWorklistMagic = 0x4c574e41454c47;
+
+}
+
 extern "C" {
 
 struct glean_interprocess_worklist_t {
+  static constexpr uint64_t WEIGHTED = uint64_t(1) << 63;
+
   boost::interprocess::file_mapping mapping;
   boost::interprocess::mapped_region region;
-  std::atomic<uint64_t> *counters;
+  // address of worker i's counter is base + stride * i
+  char *base;
+  size_t stride;
   size_t size;
+  // prefix sums of item costs for weighted worklists, nullptr otherwise
+  const uint64_t *costs = nullptr;
+  size_t items = 0;
 
   static worklist::Counter::Value unpack(uint64_t n) {
       return {static_cast<uint32_t>(n), static_cast<uint32_t>(n >> 32)};
@@ -71,25 +119,104 @@ struct glean_interprocess_worklist_t {
       boost::interprocess::read_only,
       0,
       sizeof(uint64_t));
-    size = *static_cast<const uint64_t *>(region.get_address());
+    interprocess::FileHeader header{};
+    header.magic = *static_cast<const uint64_t *>(region.get_address());
+    size_t costs_offset;
+    bool weighted;
+    if (header.magic == kWorklistMagic) {
+      region = boost::interprocess::mapped_region(
+        mapping,
+        boost::interprocess::read_only,
+        0,
+        sizeof(header));
+      std::memcpy(&header, region.get_address(), sizeof(header));
+      if (header.version != interprocess::kFileVersion) {
+        throw std::runtime_error(
+          "unsupported worklist version " + std::to_string(header.version));
+      }
+      size = header.count;
+      stride = header.slot;
+      weighted = header.flags & WEIGHTED;
+      items = header.extra;
+      costs_offset = stride * (size + 1);
+    } else {
+      size = header.magic & ~WEIGHTED;
+      stride = sizeof(uint64_t);
+      weighted = header.magic & WEIGHTED;
+      if (weighted) {
+        region = boost::interprocess::mapped_region(
+          mapping,
+          boost::interprocess::read_only,
+          0,
+          sizeof(uint64_t) * (size + 2));
+        items = static_cast<const uint64_t *>(region.get_address())[size + 1];
+      }
+      costs_offset = sizeof(uint64_t) * (size + 2);
+    }
     region = boost::interprocess::mapped_region(
       mapping,
       boost::interprocess::read_write,
       0,
-      sizeof(uint64_t) * (size + 1));
-    counters =
-      static_cast<std::atomic<uint64_t> *>(region.get_address()) + 1;
-    assert(std::atomic_is_lock_free(counters));
+      weighted
+        ? costs_offset + sizeof(uint64_t) * (items + 1)
+        : stride * (size + 1));
+    base = static_cast<char *>(region.get_address()) + stride;
+    if (weighted) {
+      costs = reinterpret_cast<const uint64_t *>(
+        static_cast<const char *>(region.get_address()) + costs_offset);
+    }
+    assert(std::atomic_is_lock_free(&counter(0)));
+  }
+
+  std::atomic<uint64_t>& counter(size_t worker) const noexcept {
+    return *reinterpret_cast<std::atomic<uint64_t> *>(base + stride * worker);
   }
 
   static void create(
       const char *path,
-      const std::vector<worklist::Counter::Value>& values) {
+      const std::vector<worklist::Counter::Value>& values,
+      const std::vector<uint64_t> *costs,
+      interprocess::Layout layout) {
+    const size_t stride = layout == interprocess::Layout::Padded
+      ? interprocess::kSlotSize
+      : sizeof(uint64_t);
+    const size_t slot_words = stride / sizeof(uint64_t);
     std::vector<uint64_t> words;
-    words.reserve(values.size()+1);
-    words.push_back(values.size());
+    words.reserve(
+      slot_words * (values.size() + 1) + (costs ? costs->size() + 2 : 0));
+    if (layout == interprocess::Layout::Padded) {
+      interprocess::FileHeader header{};
+      header.magic = kWorklistMagic;
+      header.version = interprocess::kFileVersion;
+      header.count = values.size();
+      header.slot = stride;
+      header.flags = costs ? WEIGHTED : 0;
+      header.extra = costs ? costs->size() : 0;
+      words.resize(slot_words);
+      std::memcpy(words.data(), &header, sizeof(header));
+    } else {
+      words.push_back(values.size() | (costs ? WEIGHTED : 0));
+    }
     for (const auto& value : values) {
+      if (costs && value.end > costs->size()) {
+        throw std::invalid_argument(
+          "worklist range " + std::to_string(value.start) + "-"
+          + std::to_string(value.end) + " exceeds "
+          + std::to_string(costs->size()) + " item costs");
+      }
       words.push_back(pack(value));
+      words.resize(words.size() + slot_words - 1);
+    }
+    if (costs) {
+      if (layout == interprocess::Layout::Packed) {
+        words.push_back(costs->size());
+      }
+      uint64_t total = 0;
+      words.push_back(total);
+      for (auto cost : *costs) {
+        total += cost;
+        words.push_back(total);
+      }
     }
     std::ofstream stream(path, std::ios::out | std::ios::binary);
     stream.write(
@@ -98,12 +225,48 @@ struct glean_interprocess_worklist_t {
   }
 
   worklist::Counter::Value get(size_t worker) const noexcept {
-    return unpack(counters[worker].load());
+    return unpack(counter(worker).load());
+  }
+
+  // Total estimated cost of the remaining items in a range, or the number of
+  // items if the worklist isn't weighted.
+  uint64_t cost(worklist::Counter::Value value) const noexcept {
+    if (value.empty()) {
+      return 0;
+    } else if (costs) {
+      return costs[value.end] - costs[value.start];
+    } else {
+      return value.size();
+    }
+  }
+
+  // Where to split a nonempty range when stealing from it: the thief takes
+  // [split,end[ and the victim keeps [start,split[. The thief always gets at
+  // least one item.
+  uint32_t split(worklist::Counter::Value value) const noexcept {
+    const auto total = cost(value);
+    if (!costs || total == 0) {
+      return value.start + value.size() / 2;
+    }
+    // The first point where the victim's share reaches half the total, or
+    // the one before it if that is closer to an even split.
+    const auto base = costs[value.start];
+    const auto half = base + (total + 1) / 2;
+    uint32_t split = std::lower_bound(
+      costs + value.start, costs + value.end, half) - costs;
+    if (split > value.start) {
+      const auto over = costs[split] - half;
+      const auto under = half - costs[split-1];
+      if (under < over) {
+        --split;
+      }
+    }
+    return std::min(split, value.end - 1);
   }
 
   std::pair<worklist::Counter::Value, size_t> next(size_t worker) noexcept {
     auto victim = worker;
-    auto value = unpack(counters[worker].fetch_add(1));
+    auto value = unpack(counter(worker).fetch_add(1));
     if (value.empty()) {
       // NOTE: We assume that other workers will only steal from us, never give
       // us things to do.
@@ -115,29 +278,33 @@ struct glean_interprocess_worklist_t {
       while (!done) {
         worklist::Counter::Value other = value;
 
-        // Find the worker with the most work.
+        // Find the worker with the most work, going by the estimated cost if
+        // we have it.
+        uint64_t most = 0;
         for (size_t i = (worker+1) % size; i != worker; i = (i+1) % size) {
           auto x = get(i);
-          if (x.size() > other.size()) {
+          auto c = cost(x);
+          if (c > most || (c == most && x.size() > other.size())) {
             other = x;
+            most = c;
             victim = i;
           }
         }
 
         if (!other.empty()) {
           // If we found a worker which has some work left, steal half of it.
-          uint32_t split = other.start + other.size() / 2;
+          uint32_t split = this->split(other);
           auto expected = pack(other);
 
           // To steal, just update their start/end pair provided it hasn't
           // changed. If it has, we'll do the whole thing again.
-          if (counters[victim].compare_exchange_strong(
+          if (counter(victim).compare_exchange_strong(
                 expected, pack({other.start, split}))) {
             // We've stolen work, now set our start/end pair. We know it hasn't
             // changed because we have no more work left so nobody else is going
             // to update it.
             value = {split, other.end};
-            counters[worker].store(pack({split+1, other.end}));
+            counter(worker).store(pack({split+1, other.end}));
             done = true;
           }
         } else {
@@ -162,7 +329,27 @@ const char *glean_interprocess_worklist_create(
     for (size_t i = 0; i < count; ++i) {
       values.push_back({starts[i], ends[i]});
     }
-    glean_interprocess_worklist_t::create(path, values);
+    glean_interprocess_worklist_t::create(
+      path, values, nullptr, interprocess::Layout::Padded);
+  });
+}
+
+const char *glean_interprocess_worklist_create_weighted(
+    const char *path,
+    size_t count,
+    const uint32_t *starts,
+    const uint32_t *ends,
+    size_t item_count,
+    const uint64_t *costs) {
+  return ffi::wrap([=] {
+    std::vector<worklist::Counter::Value> values;
+    values.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      values.push_back({starts[i], ends[i]});
+    }
+    std::vector<uint64_t> item_costs(costs, costs + item_count);
+    glean_interprocess_worklist_t::create(
+      path, values, &item_costs, interprocess::Layout::Padded);
   });
 }
 
@@ -268,8 +455,17 @@ std::unique_ptr<Counter> stealingCounter(
 
 void stealingCounterSetup(
     const std::string& path,
-    const std::vector<Counter::Value>& values) {
-  glean_interprocess_worklist_t::create(path.c_str(), values);
+    const std::vector<Counter::Value>& values,
+    interprocess::Layout layout) {
+  glean_interprocess_worklist_t::create(path.c_str(), values, nullptr, layout);
+}
+
+void stealingCounterSetup(
+    const std::string& path,
+    const std::vector<Counter::Value>& values,
+    const std::vector<uint64_t>& costs,
+    interprocess::Layout layout) {
+  glean_interprocess_worklist_t::create(path.c_str(), values, &costs, layout);
 }
 
 }
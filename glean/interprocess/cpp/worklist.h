@@ -13,6 +13,8 @@
 
 #include <folly/Optional.h>
 
+#include "glean/interprocess/cpp/layout.h"
+
 namespace facebook {
 namespace glean {
 namespace worklist {
@@ -61,7 +63,19 @@ std::unique_ptr<Counter> stealingCounter(
 /// Setup a stealing counter file
 void stealingCounterSetup(
   const std::string& path,
-  const std::vector<Counter::Value>& values
+  const std::vector<Counter::Value>& values,
+  interprocess::Layout layout = interprocess::Layout::Padded
+);
+
+/// Setup a stealing counter file where idle workers steal by estimated cost
+/// rather than by number of items. The costs are indexed by work item (e.g.,
+/// file sizes or historical indexing times) and must cover all the ranges.
+/// Workers open the file via stealingCounter as usual.
+void stealingCounterSetup(
+  const std::string& path,
+  const std::vector<Counter::Value>& values,
+  const std::vector<uint64_t>& costs,
+  interprocess::Layout layout = interprocess::Layout::Padded
 );
 
 }
@@ -24,6 +24,15 @@ const char *glean_interprocess_worklist_create(
   const uint32_t *sizes
 );
 
+const char *glean_interprocess_worklist_create_weighted(
+  const char *file,
+  size_t count,
+  const uint32_t *indices,
+  const uint32_t *sizes,
+  size_t item_count,
+  const uint64_t *costs
+);
+
 const char *glean_interprocess_worklist_open(
   const char *file,
   glean_interprocess_worklist_t **worklist
@@ -20,14 +20,17 @@ import Glean.Init
 import Glean.Interprocess.Worklist
 
 
-testRanges :: Int -> Test
-testRanges n = TestCase $ do
+testRanges
+  :: ([Range] -> (FilePath -> Worklist -> IO ()) -> IO ())
+  -> Int
+  -> Test
+testRanges withWorklist n = TestCase $ do
   let initial =
         [ Range lo hi
         | i <- [ 0 .. pred n ]
         , let lo = 10 * i
         , let hi = 10 * succ i ]
-  withTemp initial $ \ workfile _ -> do
+  withWorklist initial $ \ workfile _ -> do
     forM_ (zip [0..] initial) $ \ (worker, r1) -> do
       r2 <- peek workfile worker
       assertEqual ("initial " <> show (worker, r1, r2)) r1 r2
@@ -41,5 +44,9 @@ testRanges n = TestCase $ do
 main :: IO ()
 main = withUnitTest $ do
   testRunner $ TestList
-    [ TestLabel ("worker_count="<>show n) $ testRanges n
-    | n <- [1 .. 10] ]
+    [ TestLabel (kind <> " worker_count="<>show n) $ testRanges with n
+    | (kind, with) <-
+        [ ("count", withTemp)
+        , ("weighted", \rs -> withTempWeighted rs [1 .. 100])
+        ]
+    , n <- [1 .. 10] ]
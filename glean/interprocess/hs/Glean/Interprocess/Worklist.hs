@@ -7,13 +7,14 @@
 -}
 
 module Glean.Interprocess.Worklist
-  ( Worker, Worklist, Range(..), withTemp, get, next, peek, doNext
+  ( Worker, Worklist, Range(..), withTemp, withTempWeighted
+  , get, next, peek, doNext
   ) where
 
 import Util.FFI (invoke)
 
 import Control.Exception (bracket)
-import Data.Word (Word32)
+import Data.Word (Word32, Word64)
 import Foreign.C.String
 import Foreign.C.Types
 import Foreign.Marshal.Array
@@ -35,16 +36,30 @@ mkRange :: Word32 -> Word32 -> Range
 mkRange start end = Range (fromIntegral start) (fromIntegral end)
 
 withTemp :: [Range] -> (FilePath -> Worklist -> IO a) -> IO a
-withTemp xs f = withSystemTempFile ".glean-worklist" $ \path h -> do
+withTemp xs = withTempFile xs $ \cpath n starts ends ->
+  invoke $ glean_interprocess_worklist_create cpath n starts ends
+
+-- | Like 'withTemp' but idle workers steal by the estimated cost of the
+-- remaining items rather than by their number. The list gives the cost of
+-- each item and must cover all the ranges.
+withTempWeighted
+  :: [Range] -> [Word64] -> (FilePath -> Worklist -> IO a) -> IO a
+withTempWeighted xs costs = withTempFile xs $ \cpath n starts ends ->
+  withArrayLen costs $ \m pcosts ->
+    invoke $ glean_interprocess_worklist_create_weighted
+      cpath n starts ends (fromIntegral m) pcosts
+
+withTempFile
+  :: [Range]
+  -> (CString -> CSize -> Ptr Word32 -> Ptr Word32 -> IO ())
+  -> (FilePath -> Worklist -> IO a)
+  -> IO a
+withTempFile xs create f = withSystemTempFile ".glean-worklist" $ \path h -> do
   hClose h
   withCString path $ \cpath -> do
     withArray (map (fromIntegral . rangeStart) xs) $ \starts ->
       withArray (map (fromIntegral . rangeEnd) xs) $ \ends ->
-        invoke $ glean_interprocess_worklist_create
-          cpath
-          (fromIntegral $ length xs)
-          starts
-          ends
+        create cpath (fromIntegral $ length xs) starts ends
     bracket
       (invoke $ glean_interprocess_worklist_open cpath)
       glean_interprocess_worklist_close
@@ -79,6 +94,10 @@ peek w = withWorkfile get w
 foreign import ccall unsafe glean_interprocess_worklist_create
   :: CString -> CSize -> Ptr Word32 -> Ptr Word32 -> IO CString
 
+foreign import ccall unsafe glean_interprocess_worklist_create_weighted
+  :: CString -> CSize -> Ptr Word32 -> Ptr Word32 -> CSize -> Ptr Word64
+  -> IO CString
+
 foreign import ccall unsafe glean_interprocess_worklist_open
   :: CString -> Ptr Worklist -> IO CString
 
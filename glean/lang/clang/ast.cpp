@@ -679,6 +679,10 @@ struct ASTVisitor : public clang::RecursiveASTVisitor<ASTVisitor> {
           visitor, decl, visitor.parentScopeRepr(decl), range.range);
       if (result) {
         visitor.db.declaration(range, result->declaration());
+        if (range.file && range.file->memoized) {
+          // We've produced the facts below when we indexed the header before
+          return result;
+        }
         // The name location retrieval logic should be consistent with ClangD:
         // https://github.com/llvm/llvm-project/blob/a3a2239aaaf6860eaee591c70a016b7c5984edde/clang-tools-extra/clangd/AST.cpp#L167-L172
         auto nameRange =
@@ -706,7 +710,11 @@ struct ASTVisitor : public clang::RecursiveASTVisitor<ASTVisitor> {
   void visitDeclaration(Memo& memo, const Decl *decl) {
     if (auto cdecl = memo(decl)) {
       if (DeclTraits::isDefinition(decl)) {
-        cdecl->define(*this, decl);
+        if (db.memoized(decl->getLocation())) {
+          db.skippedDefinition();
+        } else {
+          cdecl->define(*this, decl);
+        }
       }
       auto same = representative(memo, decl, cdecl.value());
       if (same) {
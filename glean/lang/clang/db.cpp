@@ -9,6 +9,7 @@
 #include "glean/lang/clang/db.h"
 
 #include <folly/Overload.h>
+#include <folly/hash/SpookyHashV2.h>
 
 #include "glean/lang/clang/path.h"
 
@@ -31,8 +32,64 @@ std::filesystem::path subpath(
 
 }
 
+uint64_t HeaderMemo::contentHash(
+    const clang::FileEntry& entry,
+    clang::StringRef data) {
+  const auto id = entry.getUniqueID();
+  const FileKey file{
+    id.getDevice(),
+    id.getFile(),
+    static_cast<uint64_t>(entry.getSize()),
+    static_cast<int64_t>(entry.getModificationTime())};
+  if (auto hash = folly::get_optional(*hashes.rlock(), file)) {
+    return hash.value();
+  }
+  const auto hash =
+    folly::hash::SpookyHashV2::Hash64(data.data(), data.size(), 0);
+  hashes.wlock()->insert({file, hash});
+  return hash;
+}
+
+uint64_t HeaderMemo::key(
+    const clang::FileEntry& entry,
+    clang::StringRef contents,
+    uint64_t macros) {
+  // The facts depend on the name of the file, too
+  const auto name = entry.getName();
+  const auto real = entry.tryGetRealPathName();
+  return folly::hash::hash_combine(
+    std::string_view("header"),
+    std::string_view(name.data(), name.size()),
+    std::string_view(real.data(), real.size()),
+    contentHash(entry, contents),
+    macros);
+}
+
+uint64_t HeaderMemo::linesKey(
+    const clang::FileEntry& entry,
+    clang::StringRef contents,
+    const std::string& path) {
+  return folly::hash::hash_combine(
+    std::string_view("lines"), contentHash(entry, contents), path);
+}
+
+void ClangDB::dependency(const clang::FileEntry& entry) {
+  if (dependencies) {
+    // The working directory changes between compilations so the paths have
+    // to be absolute
+    llvm::SmallString<256> path(entry.tryGetRealPathName());
+    if (path.empty()) {
+      path = entry.getName();
+      sourceManager().getFileManager().makeAbsolutePath(path);
+    }
+    dependencies->push_back(path.str().str());
+  }
+}
+
 Fact<Src::File> ClangDB::fileFromEntry(
     const clang::FileEntry& entry) {
+  dependency(entry);
+
   // Clang files have a Name and *maybe* a RealPathName (which seems to be
   // Name with symlinks resolved). For fbcode sources, RealPathName tends to
   // be what we want for sources (RealPathName could be "folly/File.h" and
@@ -62,6 +119,12 @@ Fact<Src::File> ClangDB::fileFromEntry(
   auto buffer = sourceManager().getMemoryBufferForFile(&entry, &invalid);
   if (buffer != nullptr && !invalid) {
   #endif
+    if (headers && !headers->insert(
+          headers->linesKey(entry, buffer->getBuffer(), path.native()))) {
+      // We've produced the same FileLines before
+      ++headers->stats.file_lines_skipped;
+      return file;
+    }
     std::vector<uint64_t> lengths;
     bool hasUnicodeOrTabs = false;
     auto p = buffer->getBufferStart();
@@ -122,10 +185,26 @@ void ClangDB::include(
 }
 
 void ClangDB::enterFile(
-    clang::SourceLocation loc, folly::Optional<Include> inc) {
+    clang::SourceLocation loc,
+    folly::Optional<Include> inc,
+    uint64_t macros) {
   auto id = sourceManager().getFileID(loc);
   if (auto r = physicalFile(id)) {
-    file_data.push_back(FileData{id, r.value(), {}, {}, {}, folly::none});
+    bool memoized = false;
+    if (headers && id != sourceManager().getMainFileID()) {
+      if (auto entry = sourceManager().getFileEntryForID(id)) {
+        bool invalid = false;
+        const auto contents = sourceManager().getBufferData(id, &invalid);
+        if (!invalid) {
+          const auto key = headers->key(*entry, contents, macros);
+          memoized = headers->contains(key);
+          ++(memoized ? headers->stats.hits : headers->stats.misses);
+          header_keys.push_back(key);
+        }
+      }
+    }
+    file_data.push_back(
+      FileData{id, r.value(), {}, {}, {}, folly::none, memoized});
     files.insert({id, &file_data.back()});
     if (inc && inc->entry != nullptr &&
           sourceManager().getFileEntryForID(id) == inc->entry) {
@@ -136,6 +215,10 @@ void ClangDB::enterFile(
 
 void ClangDB::skipFile(
     folly::Optional<Include> inc, const clang::FileEntry *entry) {
+  // Files skipped because of include guards still affect the compilation
+  if (entry) {
+    dependency(*entry);
+  }
   if (inc && inc->entry != nullptr && inc->entry == entry) {
     include(inc.value(), fileFromEntry(*entry), folly::none);
   }
@@ -380,6 +463,15 @@ void ClangDB::finish() {
   } else {
     LOG(WARNING) << "translation unit has no file data";
   }
+
+  // Only now that the translation unit has been indexed have the facts for
+  // its headers been produced.
+  if (headers) {
+    for (auto key : header_keys) {
+      headers->insert(key);
+    }
+    header_keys.clear();
+  }
 }
 
 
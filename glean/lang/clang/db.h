@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <filesystem>
 #include <variant>
 
@@ -15,8 +16,11 @@
 #include <clang/Tooling/Tooling.h>
 #include <llvm/Config/llvm-config.h>
 
+#include <folly/container/F14Map.h>
+#include <folly/container/F14Set.h>
 #include <folly/gen/Base.h>
 #include <folly/MapUtil.h>
+#include <folly/Synchronized.h>
 
 #include "glean/lang/clang/gleandiagnosticbuffer.h"
 #include "glean/lang/clang/schema.h"
@@ -33,6 +37,78 @@ namespace Sys = schema::Sys;
 using SCHEMA = schema::SCHEMA;
 
 
+/**
+ * The headers a worker has indexed so far, shared by all of its threads
+ *
+ * A header is identified by a hash of its name, its contents and the macros
+ * which are defined when it is entered. Indexing a header again in the same state
+ * produces the same facts, so the ones which don't depend on the rest of the
+ * translation unit (definitions, comments, name spans) aren't produced again
+ * and FileLines are only produced once per file.
+ */
+class HeaderMemo {
+public:
+  // Identify a header from its name, its contents and the macro state
+  uint64_t key(
+    const clang::FileEntry& entry,
+    clang::StringRef contents,
+    uint64_t macros);
+
+  // Identify the FileLines of a file from its path and contents
+  uint64_t linesKey(
+    const clang::FileEntry& entry,
+    clang::StringRef contents,
+    const std::string& path);
+
+  bool contains(uint64_t key) const {
+    return keys.rlock()->count(key) != 0;
+  }
+
+  // Returns false if the key was known already
+  bool insert(uint64_t key) {
+    return keys.wlock()->insert(key).second;
+  }
+
+  struct Stats {
+    // Headers entered which had been indexed in the same state before
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    // Facts we didn't produce again
+    std::atomic<uint64_t> definitions_skipped{0};
+    std::atomic<uint64_t> file_lines_skipped{0};
+  };
+
+  Stats stats;
+
+private:
+  // Hash of the contents of a file, which we only compute the first time we
+  // see it.
+  uint64_t contentHash(const clang::FileEntry& entry, clang::StringRef data);
+
+  struct FileKey {
+    uint64_t device;
+    uint64_t file;
+    uint64_t size;
+    int64_t mtime;
+
+    bool operator==(const FileKey& other) const {
+      return device == other.device && file == other.file
+        && size == other.size && mtime == other.mtime;
+    }
+  };
+
+  struct HashFileKey {
+    size_t operator()(const FileKey& k) const {
+      return folly::hash::hash_combine(k.device, k.file, k.size, k.mtime);
+    }
+  };
+
+  folly::Synchronized<folly::F14FastMap<FileKey, uint64_t, HashFileKey>>
+    hashes;
+  folly::Synchronized<folly::F14FastSet<uint64_t>> keys;
+};
+
 /**
  * A Clang AST batch
  *
@@ -50,6 +126,9 @@ public:
     folly::Optional<std::string> subdir;
     folly::Optional<std::string> path_prefix;
     Batch<SCHEMA>& batch;
+    HeaderMemo *headers = nullptr;
+    // If set, the paths of the files the compilation reads are added to it
+    std::vector<std::string> *dependencies = nullptr;
   };
 
   ClangDB(
@@ -62,6 +141,8 @@ public:
         subdir(env.subdir),
         path_prefix(env.path_prefix),
         batch(env.batch),
+        headers(env.headers),
+        dependencies(env.dependencies),
         compilerInstance(ci),
         diagnosticBuffer(diagnosticBuffer) {}
   ClangDB(const ClangDB&) = delete;
@@ -153,6 +234,10 @@ public:
     std::vector<PrePPEvent> events;
     std::vector<CrossRef> xrefs;
     folly::Optional<Fact<Cxx::Trace>> trace;
+
+    // Whether the file is a header which has been indexed in the same state
+    // before (see HeaderMemo)
+    bool memoized = false;
   };
 
   struct SourceRange {
@@ -168,7 +253,10 @@ public:
     const Include& inc,
     Fact<Src::File> file,
     folly::Optional<clang::FileID> id);
-  void enterFile(clang::SourceLocation loc, folly::Optional<Include> inc);
+  void enterFile(
+    clang::SourceLocation loc,
+    folly::Optional<Include> inc,
+    uint64_t macros);
   void skipFile(folly::Optional<Include> inc, const clang::FileEntry *entry);
 
   void declaration(const SourceRange& range, Cxx::Declaration decl) {
@@ -177,6 +265,28 @@ public:
     }
   }
 
+  // Whether the location is in a header which has been indexed in the same
+  // state before
+  bool memoized(clang::SourceLocation loc) const {
+    if (headers == nullptr) {
+      return false;
+    }
+    const auto id =
+      sourceManager().getFileID(sourceManager().getExpansionLoc(loc));
+    const auto data = folly::get_default(files, id, nullptr);
+    return data != nullptr && data->memoized;
+  }
+
+  bool memoizingHeaders() const {
+    return headers != nullptr;
+  }
+
+  void skippedDefinition() {
+    if (headers) {
+      ++headers->stats.definitions_skipped;
+    }
+  }
+
   void xref(
     clang::SourceRange range,
     folly::Optional<clang::SourceLocation> loc,
@@ -223,6 +333,8 @@ private:
   const folly::Optional<std::string> subdir;
   const folly::Optional<std::string> path_prefix;
   Batch<SCHEMA>& batch;
+  HeaderMemo * FOLLY_NULLABLE headers;
+  std::vector<std::string> * FOLLY_NULLABLE dependencies;
   clang::CompilerInstance& compilerInstance;
   const GleanDiagnosticBuffer *diagnosticBuffer;
 
@@ -235,6 +347,12 @@ private:
   std::deque<FileData> file_data;
   folly::F14FastMap<clang::FileID, FileData *, HashFileID> files;
 
+  void dependency(const clang::FileEntry& entry);
+
+  // The HeaderMemo keys of the headers we've entered, which we add to the
+  // memo once the translation unit has been indexed
+  std::vector<uint64_t> header_keys;
+
   /// returns the language processed by the compilerInstance
   Src::Language getLanguage() const {
     auto opts = compilerInstance.getLangOpts();
@@ -9,8 +9,10 @@
 #include <csignal>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <filesystem>
+#include <thread>
 
 #include "clang/Basic/DiagnosticOptions.h"
 #include <clang/Frontend/CompilerInstance.h>
@@ -19,6 +21,7 @@
 #include <clang/Tooling/Tooling.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/VirtualFileSystem.h>
 
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -44,11 +47,15 @@
 #include "glean/lang/clang/ast.h"
 #include "glean/lang/clang/gleandiagnosticbuffer.h"
 #include "glean/lang/clang/preprocessor.h"
+#include "glean/lang/clang/tucache.h"
 #include "glean/rts/binary.h"
 #include "glean/rts/inventory.h"
 
 DEFINE_string(service, "", "TIER or HOST:PORT of Glean server");
 DEFINE_string(dump, "", "dump the produce batch to file at PATH");
+DEFINE_bool(dump_stream, false,
+  "append batches to the --dump file as they are produced, in the format of "
+  "`glean write --file-format segments`");
 DEFINE_string(work_file, "", "PATH to work file");
 DEFINE_string(task, "", "task id (for logging)");
 DEFINE_string(request, "", "request id (for logging)");
@@ -70,9 +77,21 @@ DEFINE_bool(dry_run, false, "don't send data");
 DEFINE_bool(fact_stats, true, "log fact statistics");
 DEFINE_uint64(fact_cache, 805306368, "set maximum fact cache size");
 DEFINE_uint64(fact_buffer, 201326592, "set maximum fact buffer size");
+DEFINE_uint32(send_window, 1,
+  "maximum number of batches on their way to the server at once");
+DEFINE_bool(compress_batches, false,
+  "compress batches if the server supports it, and --dump_stream segments");
+DEFINE_bool(memo_headers, false,
+  "don't produce facts again for headers which this worker has already "
+  "indexed with the same contents and macros");
+DEFINE_string(tu_cache, "",
+  "PATH to a directory which keeps the facts of translation units so that "
+  "they aren't indexed again while nothing they depend on changes");
 DEFINE_uint32(log_every, 1, "log every N translation units");
 DEFINE_uint32(worker_index, 0, "index of this worker");
 DEFINE_uint32(worker_count, 1, "total number of workers");
+DEFINE_uint32(threads, 1,
+  "number of indexing threads in this worker, sharing one fact cache");
 DEFINE_string(counter_file, "", "PATH to stats counter file");
 DEFINE_string(counters, "", "comma-separated list of NAME@N");
 DEFINE_bool(suppress_diagnostics, false, "suppress all Clang diagnostics");
@@ -138,6 +157,12 @@ struct Counters {
       {"fact_cache_size", &fact_cache_size},
       {"fact_cache_hits", &fact_cache_hits},
       {"fact_cache_misses", &fact_cache_misses},
+      {"header_memo_hits", &header_memo_hits},
+      {"header_memo_misses", &header_memo_misses},
+      {"definitions_skipped", &definitions_skipped},
+      {"file_lines_skipped", &file_lines_skipped},
+      {"tu_cache_hits", &tu_cache_hits},
+      {"tu_cache_misses", &tu_cache_misses},
     };
 
     for (const auto& x : fields) {
@@ -165,6 +190,12 @@ struct Counters {
   counter_t *fact_cache_size;
   counter_t *fact_cache_hits;
   counter_t *fact_cache_misses;
+  counter_t *header_memo_hits;
+  counter_t *header_memo_misses;
+  counter_t *definitions_skipped;
+  counter_t *file_lines_skipped;
+  counter_t *tu_cache_hits;
+  counter_t *tu_cache_misses;
   std::unique_ptr<interprocess::Counters> counters;
   std::deque<std::atomic<uint64_t>> locals;
 };
@@ -184,7 +215,8 @@ struct Config {
 
   std::unique_ptr<DbSchema<SCHEMA>> schema;
 
-  std::unique_ptr<GleanDiagnosticBuffer> diagnostics;
+  // Set if --tu_cache is
+  std::unique_ptr<TuCache> tu_cache;
 
   std::vector<SourceFile> sources;
 
@@ -221,14 +253,18 @@ struct Config {
         FLAGS_repo_name,
         FLAGS_repo_hash,
         10,          // hardcode min_retry_delay for now
-        static_cast<size_t>(FLAGS_max_comm_errors)
+        static_cast<size_t>(FLAGS_max_comm_errors),
+        FLAGS_send_window,
+        FLAGS_compress_batches
       );
     } else
       #endif
       if (!FLAGS_dump.empty()) {
       // No logging when dumping to a file
       should_log = false;
-      sender = fileWriter(FLAGS_dump);
+      sender = FLAGS_dump_stream
+        ? streamWriter(FLAGS_dump, FLAGS_compress_batches)
+        : fileWriter(FLAGS_dump);
     } else {
       fail("missing --service or --dump");
     }
@@ -243,9 +279,25 @@ struct Config {
 
       schema = std::make_unique<DbSchema<SCHEMA>>(
         rts::Inventory::deserialize(binary::byteRange(contents)));
-    }
 
-    diagnostics = diagnosticConsumer();
+      if (!FLAGS_tu_cache.empty()) {
+        // Translation units are indexed into batches of their own for the
+        // cache, which memoised headers would leave facts out of
+        if (FLAGS_memo_headers) {
+          fail("--tu_cache can't be used with --memo_headers");
+        }
+        // Cached facts are only valid for the same indexer and schema. The
+        // indexer is identified by its executable rather than a version
+        // number, which a change to the facts could forget to bump.
+        auto exe = TuCache::executableVersion();
+        if (!exe) {
+          fail("--tu_cache: couldn't read the indexer executable");
+        }
+        tu_cache = std::make_unique<TuCache>(
+          FLAGS_tu_cache,
+          folly::to<std::string>(exe.value(), '\0', contents));
+      }
+    }
 
     // Add targets from json
     for (int i = 1; i < argc; ++i) {
@@ -350,31 +402,90 @@ struct SourceIndexer {
   const Config& config;
   Batch<SCHEMA> batch;
   CDB cdb;
-
-  explicit SourceIndexer(Config& cfg)
+  std::unique_ptr<GleanDiagnosticBuffer> diagnostics;
+  // ClangTool changes the working directory of its file system for each
+  // compilation. When several indexers run in the same process, each of them
+  // needs a file system with its own working directory rather than the real
+  // one which is shared by the process.
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs;
+  // Shared by all indexers of the worker, if --memo_headers is set
+  HeaderMemo * FOLLY_NULLABLE headers;
+
+  SourceIndexer(
+      Config& cfg,
+      std::shared_ptr<BatchCache> cache,
+      HeaderMemo * FOLLY_NULLABLE memo,
+      bool own_fs)
     : config(cfg)
-    , batch(cfg.schema.get(), FLAGS_fact_cache)
+    , batch(cfg.schema.get(), std::move(cache))
+    , diagnostics(Config::diagnosticConsumer())
+    , headers(memo)
     {
       blank_cell_name = (!FLAGS_blank_cell_name.empty())
         ? folly::Optional<std::string>(FLAGS_blank_cell_name)
         : folly::none;
+      fs = own_fs
+        ? llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>(
+            llvm::vfs::createPhysicalFileSystem().release())
+        : llvm::vfs::getRealFileSystem();
     }
 
   bool index(const SourceFile& source) {
     auto pcdb = cdb.load(source);
+    if (!config.tu_cache) {
+      return run(source, *pcdb, batch, headers, nullptr);
+    }
+
+    const auto command = commandOf(source, *pcdb);
+    if (command) {
+      if (auto cached = config.tu_cache->lookup(command.value())) {
+        batch.insert(cached.value());
+        return true;
+      }
+    }
+
+    // Index into a batch of our own so that the facts don't refer to anything
+    // else
+    Batch<SCHEMA> fresh(config.schema.get(), size_t(0));
+    std::vector<std::string> dependencies;
+    const bool ok = run(source, *pcdb, fresh, nullptr, &dependencies);
+    const auto facts = fresh.serialize();
+    batch.insert(facts);
+    if (ok && command) {
+      config.tu_cache->store(
+        command.value(), std::move(dependencies), facts);
+    }
+    return ok;
+  }
+
+private:
+  folly::Optional<std::string> blank_cell_name;
+
+  bool run(
+      const SourceFile& source,
+      const clang::tooling::CompilationDatabase& db,
+      Batch<SCHEMA>& target,
+      HeaderMemo * FOLLY_NULLABLE memo,
+      std::vector<std::string> * FOLLY_NULLABLE dependencies) {
     ClangCfg cfg{
       ClangDB::Env{
-        locatorOf(source),
-        platformOf(source),
+        locatorOf(source, target),
+        platformOf(source, target),
         config.root,
         config.target_subdir,
         config.path_prefix,
-        batch,
+        target,
+        memo,
+        dependencies,
       },
-      config.diagnostics.get()
+      diagnostics.get()
     };
     FrontendActionFactory factory(&cfg);
-    clang::tooling::ClangTool tool(*pcdb, source.file);
+    clang::tooling::ClangTool tool(
+      db,
+      source.file,
+      std::make_shared<clang::PCHContainerOperations>(),
+      fs);
     if (!FLAGS_clang_arguments.empty()) {
       clang::tooling::CommandLineArguments args;
       folly::split(" ", FLAGS_clang_arguments, args, true);
@@ -422,10 +533,44 @@ struct SourceIndexer {
     return tool.run(&factory) == 0;
   }
 
-private:
-  folly::Optional<std::string> blank_cell_name;
+  // Everything the facts of a translation unit depend on except for the files
+  // it reads, or none if we can't tell what these are
+  folly::Optional<std::string> commandOf(
+      const SourceFile& source,
+      const clang::tooling::CompilationDatabase& db) const {
+    std::string key;
+    folly::toAppend(
+      source.target, '\0',
+      source.platform.value_or(""), '\0',
+      source.file, '\0',
+      config.root.native(), '\0',
+      FLAGS_cwd_subdir, '\0',
+      config.target_subdir.value_or(""), '\0',
+      config.path_prefix.value_or(""), '\0',
+      FLAGS_blank_cell_name, '\0',
+      FLAGS_clang_arguments, '\0',
+      FLAGS_clang_resource_dir, '\0',
+      FLAGS_clang_no_pch, FLAGS_clang_no_modules, FLAGS_index_on_error,
+      &key);
+    for (const auto& command : db.getCompileCommands(source.file)) {
+      folly::toAppend('\0', command.Directory, &key);
+      for (const auto& arg : command.CommandLine) {
+        // Precompiled headers and modules are read in ways we don't track
+        if ((!FLAGS_clang_no_pch
+              && (arg == "-include-pch" || boost::ends_with(arg, ".pch")))
+            || (!FLAGS_clang_no_modules
+              && (arg == "-fmodules" || arg == "-fcxx-modules"))) {
+          return folly::none;
+        }
+        folly::toAppend('\0', arg, &key);
+      }
+    }
+    return key;
+  }
 
-  Fact<Buck::Locator> locatorOf(const SourceFile& source) {
+  Fact<Buck::Locator> locatorOf(
+      const SourceFile& source,
+      Batch<SCHEMA>& target) {
     // Parsing source.target as cell//path:name
     const auto slashes = source.target.find("//");
     const size_t cell_len = (slashes == std::string::npos) ? 0 : slashes;
@@ -448,7 +593,7 @@ private:
       cell = folly::none;
     }
 
-    return batch.fact<Buck::Locator>(
+    return target.fact<Buck::Locator>(
       maybe(cell),
       source.target.substr(path_start, path_len),
       source.target.substr(name_start)
@@ -456,9 +601,10 @@ private:
   }
 
   folly::Optional<Fact<Buck::Platform>> platformOf(
-      const SourceFile& file) {
+      const SourceFile& file,
+      Batch<SCHEMA>& target) {
     if (file.platform) {
-      return batch.fact<Buck::Platform>(file.platform.value());
+      return target.fact<Buck::Platform>(file.platform.value());
     } else {
       return folly::none;
     }
@@ -569,69 +715,90 @@ int getSelfRSS() {
   return 0;
 }
 
-}
-
-int main(int argc, char **argv) {
-#if FACEBOOK
-  facebook::initFacebook(&argc, &argv);
-#else
-  folly::init(&argc, &argv);
-#endif
-
-  std::signal(SIGTERM, [](int) {
-    #if FACEBOOK
-    LOG(CRITICAL)
-    #else
-    LOG(ERROR)
-    #endif
-      << "worker " << FLAGS_worker_index << " received SIGTERM, exiting";
-    _exit(1);
-  });
-
-  Config config(argc, argv);
-
-  std::filesystem::current_path(
-    config.root / std::filesystem::path(config.cwd_subdir.value_or("")));
-
-  const auto work_counter = FLAGS_work_file.empty()
-    ? worklist::serialCounter(0, config.sources.size())
-    : worklist::stealingCounter(
-        FLAGS_work_file, FLAGS_worker_index, FLAGS_worker_count);
+// State shared by the indexing threads of a worker
+struct Progress {
+  Config& config;
+  std::mutex work_mutex;
+  // guarded by work_mutex
+  std::unique_ptr<worklist::Counter> work;
+  uint32_t started = 0;
+
+  // number of files to index, for logging
+  size_t n;
+  size_t threads;
+
+  std::atomic<uint32_t> lifetime_files{0};
+  std::atomic<size_t> lifetime_memory{0};
+  std::atomic<size_t> lifetime_count{0};
+  // current fact buffer size of each thread
+  std::unique_ptr<std::atomic<size_t>[]> buffer_sizes;
+  std::atomic<bool> error_exit{false};
+  std::atomic<bool> memory_exit{false};
+  std::atomic<int> rss{0};
+
+  Progress(Config& cfg, std::unique_ptr<worklist::Counter> w, size_t threads)
+    : config(cfg)
+    , work(std::move(w))
+    , threads(threads)
+    , buffer_sizes(std::make_unique<std::atomic<size_t>[]>(threads))
+  {
+    n = FLAGS_stop_after != 0
+      ? std::min(size_t(FLAGS_stop_after), config.sources.size())
+      : config.sources.size();
+    for (size_t i = 0; i < threads; ++i) {
+      buffer_sizes[i].store(0);
+    }
+  }
 
-  SourceIndexer indexer(config);
+  // Get the next file to index unless we've been told to stop. Once a thread
+  // has decided to stop, we mustn't take more work from the counter because
+  // that would skip the next target for no good reason.
+  folly::Optional<worklist::Counter::Value> next() {
+    std::lock_guard<std::mutex> lock(work_mutex);
+    if (error_exit || memory_exit
+        || (FLAGS_stop_after != 0 && started >= FLAGS_stop_after)) {
+      return folly::none;
+    }
+    auto r = work->next();
+    if (r) {
+      ++started;
+    }
+    return r;
+  }
 
-  llvm::install_fatal_error_handler(&handleLLVMError, nullptr);
+  bool stopping() const {
+    return error_exit || memory_exit
+      || (FLAGS_stop_after != 0 && lifetime_files >= FLAGS_stop_after);
+  }
 
-  const size_t n = FLAGS_stop_after != 0
-    ? std::min(size_t(FLAGS_stop_after), config.sources.size())
-    : config.sources.size();
+  void run(SourceIndexer& indexer, size_t thread, const std::string& log_pfx);
+};
 
+void Progress::run(
+    SourceIndexer& indexer,
+    size_t thread,
+    const std::string& log_pfx) {
   FactStats prev_stats = {0,0};
-  FactStats lifetime_stats = {0,0};
-  uint32_t lifetime_files = 0;
-
-  bool error_exit = false;
-  bool memory_exit = false;
-  int rss = 0;
-  for (auto next = work_counter->next();
-        next.has_value();
-        next = work_counter->next()) {
+
+  for (auto next = this->next(); next.has_value(); next = this->next()) {
     const auto i = next.value().start;
     auto errorGuard = folly::makeGuard([&] {
-      LOG_CFG(ERROR,config) << "error guard at "
+      LOG(ERROR) << log_pfx << "error guard at "
         << i+1 << "/" << next.value().end << " [" << n << "] "
         << config.sources[i].file;
     });
 
-    if (FLAGS_log_every != 0 && (lifetime_files % FLAGS_log_every) == 0) {
-      LOG_CFG(INFO,config)
+    const auto files = lifetime_files.load();
+    if (FLAGS_log_every != 0 && (files % FLAGS_log_every) == 0) {
+      LOG(INFO) << log_pfx
         << i+1 << "/" << next.value().end << " [" << n << "] "
         << config.sources[i].file;
       if (FLAGS_fact_stats) {
-        LOG_CFG(INFO,config)
+        LOG(INFO) << log_pfx
           << "fact buffer: " << showStats(indexer.batch.bufferStats())
           << " cache: " << showStats(indexer.batch.cacheStats().facts)
-          << " lifetime: " << showStats(lifetime_stats);
+          << " lifetime: "
+          << showStats(FactStats{lifetime_memory, lifetime_count});
       }
     }
 
@@ -654,20 +821,39 @@ int main(int argc, char **argv) {
       error_exit = true;
     } catch(const std::exception& e) {
       LOG(ERROR) << "while indexing " << source.file << ": " << e.what();
-      error_exit = FLAGS_fail_on_error;
+      if (FLAGS_fail_on_error) {
+        error_exit = true;
+      }
     }
 
-    lifetime_stats.memory += buf_stats.memory - prev_stats.memory;
-    lifetime_stats.count += buf_stats.count - prev_stats.count;
-    config.counters.fact_buffer_size->store(buf_stats.memory);
+    lifetime_memory += buf_stats.memory - prev_stats.memory;
+    lifetime_count += buf_stats.count - prev_stats.count;
+    buffer_sizes[thread].store(buf_stats.memory);
+    size_t buffer_size = 0;
+    for (size_t k = 0; k < threads; ++k) {
+      buffer_size += buffer_sizes[k].load();
+    }
+    config.counters.fact_buffer_size->store(buffer_size);
     config.counters.fact_cache_size->store(cache_stats.facts.memory);
     config.counters.fact_cache_hits->store(cache_stats.hits);
     config.counters.fact_cache_misses->store(cache_stats.misses);
+    if (indexer.headers) {
+      const auto& memo = indexer.headers->stats;
+      config.counters.header_memo_hits->store(memo.hits);
+      config.counters.header_memo_misses->store(memo.misses);
+      config.counters.definitions_skipped->store(memo.definitions_skipped);
+      config.counters.file_lines_skipped->store(memo.file_lines_skipped);
+    }
+    if (config.tu_cache) {
+      config.counters.tu_cache_hits->store(config.tu_cache->stats.hits);
+      config.counters.tu_cache_misses->store(config.tu_cache->stats.misses);
+    }
     if (!FLAGS_dry_run) {
-      const bool wait =
-        FLAGS_fact_buffer != 0 && buf_stats.memory >= FLAGS_fact_buffer;
+      // The limit is for the whole worker so each thread gets its share.
+      const bool wait = FLAGS_fact_buffer != 0
+        && buf_stats.memory >= FLAGS_fact_buffer / threads;
       if (wait) {
-        LOG_CFG(INFO,config)
+        LOG(INFO) << log_pfx
           << "fact buffer size " << buf_stats.memory << ", waiting";
       }
       config.logger(wait ? "clang/wait" : "clang/send").log([&]() {
@@ -677,49 +863,137 @@ int main(int argc, char **argv) {
     prev_stats = indexer.batch.bufferStats();
     ++lifetime_files;
 
-    memory_exit = FLAGS_max_rss != 0 && (rss = getSelfRSS()) > FLAGS_max_rss;
+    if (FLAGS_max_rss != 0) {
+      auto r = getSelfRSS();
+      if (r > FLAGS_max_rss) {
+        rss = r;
+        memory_exit = true;
+      }
+    }
 
     errorGuard.dismiss();
 
-    if ((FLAGS_stop_after != 0 && lifetime_files >= FLAGS_stop_after)
-        || memory_exit
-        || error_exit) {
-      LOG_CFG(WARNING,config)
+    if (stopping()) {
+      LOG(WARNING) << log_pfx
         << "Exiting after "
         << i+1 << "/" << next.value().end << " [" << n << "] "
         << config.sources[i].file;
-      // we do not want the for loop to call work_counter->next()
-      // because that will skip the next target for no good reason
       break;
     }
   }
 
   if (!FLAGS_dry_run) {
-    LOG_CFG(INFO,config) << "flushing";
+    LOG(INFO) << log_pfx << "flushing";
     config.logger("clang/flush").log([&]() {
       config.sender->flush(indexer.batch.base());
     });
   }
+  buffer_sizes[thread].store(0);
+}
+
+}
+
+int main(int argc, char **argv) {
+#if FACEBOOK
+  facebook::initFacebook(&argc, &argv);
+#else
+  folly::init(&argc, &argv);
+#endif
+
+  std::signal(SIGTERM, [](int) {
+    #if FACEBOOK
+    LOG(CRITICAL)
+    #else
+    LOG(ERROR)
+    #endif
+      << "worker " << FLAGS_worker_index << " received SIGTERM, exiting";
+    _exit(1);
+  });
+
+  Config config(argc, argv);
+
+  std::filesystem::current_path(
+    config.root / std::filesystem::path(config.cwd_subdir.value_or("")));
+
+  if (FLAGS_threads == 0) {
+    config.fail("--threads must be at least 1");
+  }
+
+  Progress progress(
+    config,
+    FLAGS_work_file.empty()
+      ? worklist::serialCounter(0, config.sources.size())
+      : worklist::stealingCounter(
+          FLAGS_work_file, FLAGS_worker_index, FLAGS_worker_count),
+    FLAGS_threads);
+
+  // All threads share one fact cache so facts which are common to many
+  // translation units, like those from system headers, are mostly sent and
+  // cached once per worker. A thread still re-sends facts which another one
+  // has cached since its own last rebase (see BatchCache).
+  auto cache = std::make_shared<BatchCache>(FLAGS_fact_cache);
+  // Likewise, headers are only indexed in full once per worker and state.
+  auto headers = FLAGS_memo_headers ? std::make_unique<HeaderMemo>() : nullptr;
+  const bool threaded = FLAGS_threads > 1;
+  std::vector<std::unique_ptr<SourceIndexer>> indexers;
+  for (size_t i = 0; i < FLAGS_threads; ++i) {
+    indexers.push_back(std::make_unique<SourceIndexer>(
+      config, cache, headers.get(), threaded));
+  }
+
+  llvm::install_fatal_error_handler(&handleLLVMError, nullptr);
+
+  if (threaded) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < FLAGS_threads; ++i) {
+      threads.emplace_back([&, i] {
+        progress.run(
+          *indexers[i],
+          i,
+          folly::to<std::string>(FLAGS_worker_index, ".", i, ": "));
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  } else {
+    progress.run(*indexers[0], 0, config.log_pfx);
+  }
 
   config.counters.fact_buffer_size->store(0);
   config.counters.fact_cache_size->store(0);
 
-  if (memory_exit) {
+  if (progress.memory_exit) {
     LOG_CFG(ERROR, config)
-      << "Exiting due to memory pressure, RSS was " << rss
+      << "Exiting due to memory pressure, RSS was " << progress.rss
       << " kB, RSS after flushing is " << getSelfRSS()
       << " kB, --max-rss is " << FLAGS_max_rss << " kB";
   }
 
   LOG_CFG(INFO,config)
-    << (error_exit || memory_exit ? "aborting" : "finished")
-    << ", lifetime files: " << lifetime_files
-    << " facts: " << showStats(lifetime_stats);
+    << (progress.error_exit || progress.memory_exit ? "aborting" : "finished")
+    << ", lifetime files: " << progress.lifetime_files
+    << " facts: " << showStats(FactStats{
+        progress.lifetime_memory, progress.lifetime_count});
+
+  if (headers) {
+    LOG_CFG(INFO,config)
+      << "header memo: " << headers->stats.hits << " hits, "
+      << headers->stats.misses << " misses, "
+      << headers->stats.definitions_skipped << " definitions and "
+      << headers->stats.file_lines_skipped << " FileLines skipped";
+  }
+
+  if (config.tu_cache) {
+    LOG_CFG(INFO,config)
+      << "translation unit cache: " << config.tu_cache->stats.hits
+      << " hits, " << config.tu_cache->stats.misses << " misses";
+  }
 
-  if (memory_exit) {
+  if (progress.memory_exit) {
     return 147;
   }
-  if (error_exit) {
+  if (progress.error_exit) {
     return 1;
   }
   return 0;
@@ -9,6 +9,11 @@
 #include "glean/lang/clang/preprocessor.h"
 #include <llvm/Config/llvm-config.h>
 
+#include <string_view>
+
+#include <folly/container/F14Map.h>
+#include <folly/hash/Hash.h>
+
 namespace {
 
 using namespace facebook::glean::clangx;
@@ -28,7 +33,7 @@ struct PPCallbacks final : public clang::PPCallbacks {
       clang::SrcMgr::CharacteristicKind,
       clang::FileID) override {
     if (reason == clang::PPCallbacks::EnterFile) {
-      db.enterFile(loc, last_include);
+      db.enterFile(loc, last_include, macro_state);
       last_include.reset();
     }
   }
@@ -86,7 +91,14 @@ struct PPCallbacks final : public clang::PPCallbacks {
 
   void MacroDefined(
       const clang::Token& name,
-      const clang::MacroDirective *) override {
+      const clang::MacroDirective *directive) override {
+    if (db.memoizingHeaders()) {
+      forgetMacro(name);
+      const auto hash = macroHash(
+        name, directive ? directive->getMacroInfo() : nullptr);
+      macro_hashes.insert({name.getIdentifierInfo(), hash});
+      macro_state ^= hash;
+    }
     auto src = db.srcRange(name.getLocation());
     auto def = db.fact<Pp::Define>(macro(name), src.range);
     db.ppevent(Cxx::PPEvent::define(def), src);
@@ -96,11 +108,50 @@ struct PPCallbacks final : public clang::PPCallbacks {
       const clang::Token& name,
       const clang::MacroDefinition&,
       const clang::MacroDirective *) override {
+    forgetMacro(name);
     auto src = db.srcRange(name.getLocation());
     auto undef = db.fact<Pp::Undef>(macro(name), src.range);
     db.ppevent(Cxx::PPEvent::undef(undef), src);
   }
 
+  static std::string_view view(clang::StringRef s) {
+    return std::string_view(s.data(), s.size());
+  }
+
+  // Hash a macro definition independently of where it is
+  static uint64_t macroHash(
+      const clang::Token& name,
+      const clang::MacroInfo * FOLLY_NULLABLE info) {
+    auto hash = std::hash<std::string_view>()(
+      view(name.getIdentifierInfo()->getName()));
+    if (info) {
+      hash = folly::hash::hash_combine(
+        hash, info->isFunctionLike(), info->isVariadic());
+      for (auto param : info->params()) {
+        hash = folly::hash::hash_combine(hash, view(param->getName()));
+      }
+      for (const auto& token : info->tokens()) {
+        hash = folly::hash::hash_combine(hash, int(token.getKind()));
+        if (auto ident = token.getIdentifierInfo()) {
+          hash = folly::hash::hash_combine(hash, view(ident->getName()));
+        } else if (token.isLiteral() && token.getLiteralData()) {
+          hash = folly::hash::hash_combine(
+            hash,
+            std::string_view(token.getLiteralData(), token.getLength()));
+        }
+      }
+    }
+    return hash;
+  }
+
+  void forgetMacro(const clang::Token& name) {
+    auto i = macro_hashes.find(name.getIdentifierInfo());
+    if (i != macro_hashes.end()) {
+      macro_state ^= i->second;
+      macro_hashes.erase(i);
+    }
+  }
+
   void macroUsed(
       const clang::Token& name,
       const clang::MacroDefinition& def,
@@ -260,6 +311,11 @@ struct PPCallbacks final : public clang::PPCallbacks {
 
   // Cached locations of macro definitions (see macroUsed).
   folly::F14FastMap<clang::MacroInfo *, Src::Loc> macros;
+
+  // A fingerprint of the macros which are currently defined, for the
+  // HeaderMemo: the XOR of the hashes of their definitions.
+  uint64_t macro_state = 0;
+  folly::F14FastMap<const clang::IdentifierInfo *, uint64_t> macro_hashes;
 };
 
 }
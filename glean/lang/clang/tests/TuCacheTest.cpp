@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "glean/lang/clang/tucache.h"
+
+#include <folly/FileUtil.h>
+#include <folly/testing/TestUtil.h>
+#include <gtest/gtest.h>
+
+namespace facebook {
+namespace glean {
+namespace clangx {
+
+namespace {
+
+thrift::Batch batchOf(const std::string& facts) {
+  thrift::Batch batch;
+  batch.firstId() = 1024;
+  batch.count() = 1;
+  batch.facts() = facts;
+  return batch;
+}
+
+void write(const std::filesystem::path& path, const std::string& contents) {
+  ASSERT_TRUE(folly::writeFile(contents, path.c_str()));
+}
+
+size_t batches(const std::filesystem::path& dir) {
+  auto entries = std::filesystem::directory_iterator(dir / "batches");
+  return std::distance(begin(entries), end(entries));
+}
+
+}
+
+// Each TuCache stands for a new run of the indexer, as files aren't expected
+// to change during one.
+TEST(TuCacheTest, invalidation) {
+  folly::test::TemporaryDirectory tmp;
+  const auto dir = std::filesystem::path(tmp.path().string());
+  const auto cache = dir / "cache";
+  const auto source = (dir / "main.cpp").string();
+  const auto header = (dir / "header.h").string();
+  write(source, "#include \"header.h\"\n");
+  write(header, "int x;\n");
+  const std::string command = "clang++ -c main.cpp";
+
+  {
+    TuCache tu(cache, "v1");
+    EXPECT_FALSE(tu.lookup(command).hasValue());
+    tu.store(command, {source, header}, batchOf("first"));
+  }
+
+  {
+    TuCache tu(cache, "v1");
+    auto batch = tu.lookup(command);
+    ASSERT_TRUE(batch.hasValue());
+    EXPECT_EQ(*batch->facts(), "first");
+    EXPECT_EQ(tu.stats.hits.load(), 1u);
+  }
+
+  // A different indexer or schema doesn't see the facts
+  {
+    TuCache tu(cache, "v2");
+    EXPECT_FALSE(tu.lookup(command).hasValue());
+  }
+
+  // Changing a header the translation unit read is a miss
+  write(header, "int y;\n");
+  {
+    TuCache tu(cache, "v1");
+    EXPECT_FALSE(tu.lookup(command).hasValue());
+    EXPECT_EQ(tu.stats.misses.load(), 1u);
+    tu.store(command, {source, header}, batchOf("second"));
+  }
+
+  // The batch for the old contents is gone
+  EXPECT_EQ(batches(cache), 1u);
+
+  {
+    TuCache tu(cache, "v1");
+    auto batch = tu.lookup(command);
+    ASSERT_TRUE(batch.hasValue());
+    EXPECT_EQ(*batch->facts(), "second");
+  }
+
+  // Going back to the old contents is a miss too, as only the latest batch
+  // is kept
+  write(header, "int x;\n");
+  {
+    TuCache tu(cache, "v1");
+    EXPECT_FALSE(tu.lookup(command).hasValue());
+  }
+
+  // And so is removing the header
+  std::filesystem::remove(header);
+  {
+    TuCache tu(cache, "v1");
+    EXPECT_FALSE(tu.lookup(command).hasValue());
+  }
+}
+
+TEST(TuCacheTest, executableVersion) {
+  auto version = TuCache::executableVersion();
+  ASSERT_TRUE(version.hasValue());
+  EXPECT_FALSE(version->empty());
+  EXPECT_EQ(TuCache::executableVersion(), version);
+}
+
+}
+}
+}
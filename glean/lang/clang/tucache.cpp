@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "glean/lang/clang/tucache.h"
+
+#include <algorithm>
+#include <fcntl.h>
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/MapUtil.h>
+#include <folly/ScopeGuard.h>
+#include <folly/String.h>
+#include <folly/hash/SpookyHashV2.h>
+#include <glog/logging.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+namespace facebook {
+namespace glean {
+namespace clangx {
+
+namespace {
+
+std::string hash128(folly::StringPiece data) {
+  uint64_t h1 = 0;
+  uint64_t h2 = 0;
+  folly::hash::SpookyHashV2::Hash128(data.data(), data.size(), &h1, &h2);
+  return folly::sformat("{:016x}{:016x}", h1, h2);
+}
+
+// The part of the key of a batch which covers a file it depends on
+void appendFile(
+    std::string& key,
+    folly::StringPiece path,
+    folly::StringPiece hash) {
+  key.push_back('\0');
+  key.append(path.data(), path.size());
+  key.push_back('\0');
+  key.append(hash.data(), hash.size());
+}
+
+// The files a manifest lists along with their hashes. Each line of the
+// manifest is the hash of a file and its path.
+std::vector<std::pair<folly::StringPiece, folly::StringPiece>> parseManifest(
+    folly::StringPiece manifest) {
+  std::vector<folly::StringPiece> lines;
+  folly::split('\n', manifest, lines, true);
+  std::vector<std::pair<folly::StringPiece, folly::StringPiece>> files;
+  files.reserve(lines.size());
+  for (auto line : lines) {
+    auto path = line;
+    const auto hash = path.split_step(' ');
+    files.emplace_back(path, hash);
+  }
+  return files;
+}
+
+}
+
+TuCache::TuCache(std::filesystem::path d, std::string v)
+  : dir(std::move(d))
+  , version(hash128(v)) {
+  std::filesystem::create_directories(dir / "manifests");
+  std::filesystem::create_directories(dir / "batches");
+}
+
+folly::Optional<std::string> TuCache::executableVersion() {
+  // Hashed a chunk at a time as the indexer links in most of Clang
+  const int fd = folly::openNoInt("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return folly::none;
+  }
+  SCOPE_EXIT {
+    folly::closeNoInt(fd);
+  };
+  folly::hash::SpookyHashV2 hash;
+  hash.Init(0, 0);
+  std::vector<char> buffer(1 << 20);
+  while (true) {
+    const auto n = folly::readNoInt(fd, buffer.data(), buffer.size());
+    if (n < 0) {
+      return folly::none;
+    } else if (n == 0) {
+      break;
+    }
+    hash.Update(buffer.data(), n);
+  }
+  uint64_t h1 = 0;
+  uint64_t h2 = 0;
+  hash.Final(&h1, &h2);
+  return folly::sformat("{:016x}{:016x}", h1, h2);
+}
+
+std::string TuCache::commandHash(const std::string& command) const {
+  return hash128(folly::to<std::string>(version, '\0', command));
+}
+
+folly::Optional<std::string> TuCache::fileHash(const std::string& path) {
+  if (auto hash = folly::get_optional(*hashes.rlock(), path)) {
+    return hash;
+  }
+  std::string contents;
+  if (!folly::readFile(path.c_str(), contents)) {
+    return folly::none;
+  }
+  auto hash = hash128(contents);
+  hashes.wlock()->insert({path, hash});
+  return hash;
+}
+
+folly::Optional<thrift::Batch> TuCache::lookup(const std::string& command) {
+  const auto id = commandHash(command);
+  std::string manifest;
+  if (folly::readFile((dir / "manifests" / id).c_str(), manifest)) {
+    auto key = id;
+    bool valid = true;
+    for (auto [path, hash] : parseManifest(manifest)) {
+      if (path.empty() || fileHash(path.str()) != hash.str()) {
+        valid = false;
+        break;
+      }
+      appendFile(key, path, hash);
+    }
+    std::string bytes;
+    if (valid
+        && folly::readFile((dir / "batches" / hash128(key)).c_str(), bytes)) {
+      try {
+        auto batch = apache::thrift::CompactSerializer::deserialize<
+          thrift::Batch>(bytes);
+        ++stats.hits;
+        return batch;
+      } catch (const std::exception& e) {
+        LOG(WARNING) << "ignoring cached batch for " << id << ": " << e.what();
+      }
+    }
+  }
+  ++stats.misses;
+  return folly::none;
+}
+
+void TuCache::store(
+    const std::string& command,
+    std::vector<std::string> files,
+    const thrift::Batch& batch) {
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end()), files.end());
+
+  const auto id = commandHash(command);
+  auto key = id;
+  std::string manifest;
+  for (const auto& file : files) {
+    auto hash = fileHash(file);
+    if (!hash) {
+      // We can't tell whether the file changes so don't cache anything
+      return;
+    }
+    appendFile(key, file, hash.value());
+    folly::toAppend(hash.value(), ' ', file, '\n', &manifest);
+  }
+
+  // The batch the old manifest refers to, which nothing else can refer to
+  // once we replace the manifest
+  folly::Optional<std::string> old_key;
+  std::string old_manifest;
+  if (folly::readFile((dir / "manifests" / id).c_str(), old_manifest)) {
+    old_key = id;
+    for (auto [path, hash] : parseManifest(old_manifest)) {
+      appendFile(*old_key, path, hash);
+    }
+  }
+
+  // Write the batch first so that a manifest always refers to a batch, even
+  // when several workers store the same translation unit at the same time
+  folly::writeFileAtomic(
+    (dir / "batches" / hash128(key)).native(),
+    apache::thrift::CompactSerializer::serialize<std::string>(batch));
+  folly::writeFileAtomic((dir / "manifests" / id).native(), manifest);
+
+  // Otherwise every change to a file a translation unit depends on would
+  // leave a batch behind. If another worker stores the same translation unit
+  // at the same time, its manifest might end up referring to the batch we
+  // delete, but lookup treats a missing batch as a miss.
+  if (old_key && old_key.value() != key) {
+    std::error_code ec;
+    std::filesystem::remove(dir / "batches" / hash128(old_key.value()), ec);
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <folly/container/F14Map.h>
+#include <folly/Optional.h>
+#include <folly/Synchronized.h>
+
+#include "glean/if/gen-cpp2/glean_types.h"
+
+namespace facebook {
+namespace glean {
+namespace clangx {
+
+/**
+ * The facts produced for translation units in earlier runs of the indexer,
+ * stored in a local directory which may be shared by all workers
+ *
+ * The facts of a translation unit are stored under a key which covers
+ * everything they depend on: the compile command, the contents of every file
+ * the compilation read and the version of the indexer. As we can't know which
+ * files a compilation reads without running it, each compile command has a
+ * manifest which lists the files its last compilation read and their hashes,
+ * much like ccache's direct mode.
+ *
+ * The batches only refer to their own facts and can be added to any Batch with
+ * BatchBase::insert.
+ */
+class TuCache {
+public:
+  // The version identifies the indexer and the schema it produces facts for.
+  TuCache(std::filesystem::path dir, std::string version);
+
+  // Identifies the running indexer by the contents of its executable, so that
+  // any rebuild of the indexer invalidates the facts cached by earlier ones.
+  // None if the executable can't be read.
+  static folly::Optional<std::string> executableVersion();
+
+  // Look up the facts for a compile command, which must identify everything
+  // about the translation unit except for the files it reads.
+  folly::Optional<thrift::Batch> lookup(const std::string& command);
+
+  // Store the facts for a compile command along with the files the
+  // compilation read
+  void store(
+    const std::string& command,
+    std::vector<std::string> files,
+    const thrift::Batch& batch);
+
+  struct Stats {
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+  };
+
+  Stats stats;
+
+private:
+  // Hash of the contents of a file, memoised for the lifetime of the cache
+  // as files aren't expected to change while we're indexing
+  folly::Optional<std::string> fileHash(const std::string& path);
+
+  std::string commandHash(const std::string& command) const;
+
+  const std::filesystem::path dir;
+  // Hash of the version
+  const std::string version;
+  folly::Synchronized<folly::F14FastMap<std::string, std::string>> hashes;
+};
+
+}
+}
+}
@@ -15,6 +15,7 @@
 #endif
 #include "glean/rocksdb/rocksdb.h"
 #include "glean/rocksdb/ffi.h"
+#include "glean/rts/flatten.h"
 
 using namespace facebook::hs;
 
@@ -30,9 +31,21 @@ struct SharedCache {
 
 const char *glean_rocksdb_new_cache(
     size_t capacity,
+    double high_pri_ratio,
+    bool hyper_clock,
+    size_t pool_count,
+    const char * const *pool_families,
+    const size_t *pool_capacities,
     SharedCache **cache) {
   return ffi::wrap([=]{
-    *cache = new SharedCache{rocks::newCache(capacity)};
+    CacheOptions options;
+    options.capacity = capacity;
+    options.high_pri_ratio = high_pri_ratio;
+    options.hyper_clock = hyper_clock;
+    for (size_t i = 0; i < pool_count; ++i) {
+      options.pools.emplace_back(pool_families[i], pool_capacities[i]);
+    }
+    *cache = new SharedCache{rocks::newCache(options)};
   });
 }
 
@@ -40,6 +53,28 @@ void glean_rocksdb_free_cache(SharedCache *cache) {
   ffi::free_(cache);
 }
 
+const char *glean_rocksdb_cache_stats(
+    SharedCache *cache,
+    size_t *count,
+    void **names,
+    size_t *names_size,
+    uint64_t **values) {
+  return ffi::wrap([=] {
+    const auto stats = rocks::cacheStats(*cache->value);
+    // The names are separated by NULs
+    std::string all;
+    auto values_arr = ffi::malloc_array<uint64_t>(stats.size());
+    for (size_t i = 0; i < stats.size(); ++i) {
+      all += stats[i].first;
+      all += '\0';
+      values_arr[i] = stats[i].second;
+    }
+    *count = stats.size();
+    ffi::clone_bytes(all).release_to(names, names_size);
+    *values = values_arr.release();
+  });
+}
+
 
 void glean_rocksdb_container_close(Container *container) {
   container->close();
@@ -77,9 +112,18 @@ const char *glean_rocksdb_container_read_data(
 }
 
 const char *glean_rocksdb_container_optimize(
-    Container *container) {
+    Container *container,
+    size_t parallelism,
+    uint32_t subcompactions,
+    int32_t background_jobs,
+    bool final) {
   return ffi::wrap([=] {
-    container->optimize();
+    OptimizeOptions options;
+    options.parallelism = parallelism;
+    options.subcompactions = subcompactions;
+    options.background_jobs = background_jobs;
+    options.final = final;
+    container->optimize(options);
   });
 }
 
@@ -115,10 +159,11 @@ const char *glean_rocksdb_container_open_database(
     Container *container,
     glean_fact_id_t start,
     int64_t version,
+    bool section_index,
     Database **database) {
   return ffi::wrap([=] {
     *database = std::move(*container)
-      .openDatabase(Id::fromThrift(start), version)
+      .openDatabase(Id::fromThrift(start), version, section_index)
       .release();
   });
 }
@@ -143,6 +188,22 @@ const char *glean_rocksdb_commit(
   });
 }
 
+const char *glean_rocksdb_flatten(
+    Database *db,
+    Inventory *inventory,
+    Lookup *source,
+    size_t batch_bytes,
+    size_t *count) {
+  return ffi::wrap([=] {
+    *count = rts::flatten(
+      *inventory,
+      *source,
+      db->firstFreeId(),
+      batch_bytes,
+      [db](FactSet& facts) { db->commit(facts); });
+  });
+}
+
 const char *glean_rocksdb_add_ownership(
     Database *db,
     size_t count,
@@ -40,11 +40,23 @@ typedef struct SharedCache SharedCache;
 
 const char *glean_rocksdb_new_cache(
   size_t capacity,
+  double high_pri_ratio,
+  bool hyper_clock,
+  size_t pool_count,
+  const char * const *pool_families,
+  const size_t *pool_capacities,
   SharedCache **cache
 );
 void glean_rocksdb_free_cache(
   SharedCache *cache
 );
+const char *glean_rocksdb_cache_stats(
+  SharedCache *cache,
+  size_t *count,
+  void **names,
+  size_t *names_size,
+  uint64_t **values
+);
 
 
 void glean_rocksdb_container_close(
@@ -69,7 +81,11 @@ const char *glean_rocksdb_container_read_data(
 );
 
 const char *glean_rocksdb_container_optimize(
-  Container *db
+  Container *db,
+  size_t parallelism,
+  uint32_t subcompactions,
+  int32_t background_jobs,
+  bool final
 );
 
 const char *glean_rocksdb_container_backup(
@@ -92,6 +108,7 @@ const char *glean_rocksdb_container_open_database(
   Container *container,
   glean_fact_id_t start,
   int64_t version,
+  bool section_index,
   Database **db
 );
 void glean_rocksdb_database_free(
@@ -111,6 +128,14 @@ const char *glean_rocksdb_commit(
   FactSet *facts
 );
 
+const char *glean_rocksdb_flatten(
+  Database *db,
+  Inventory *inventory,
+  Lookup *source,
+  size_t batch_bytes,
+  size_t *count
+);
+
 const char *glean_rocksdb_add_ownership(
   Database *db,
   size_t count,
@@ -6,16 +6,24 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <utility>
 
+#include <folly/Conv.h>
 #include <folly/Range.h>
 #include <folly/container/F14Map.h>
+#include <folly/lang/Bits.h>
 
+#include <rocksdb/cache.h>
 #include <rocksdb/db.h>
 #include <rocksdb/filter_policy.h>
 #include <rocksdb/slice_transform.h>
+#include <rocksdb/statistics.h>
 #include <rocksdb/table.h>
 #include <rocksdb/utilities/backup_engine.h>
+#include <rocksdb/version.h>
 
 #include "glean/rocksdb/rocksdb.h"
 #include "glean/rocksdb/stats.h"
@@ -86,8 +94,12 @@ namespace {
 struct Family {
 private:
   template<typename F>
-  Family(const char *n, F&& o, bool keep_ = true)
-    : index(families.size()), name(n), options(std::forward<F>(o)), keep(keep_)
+  Family(const char *n, F&& o, bool keep_ = true, bool optional_ = false)
+    : index(families.size())
+    , name(n)
+    , options(std::forward<F>(o))
+    , keep(keep_)
+    , optional(optional_)
   {
     families.push_back(this);
   }
@@ -107,9 +119,15 @@ public:
   // deleted before compaction.
   bool keep = true;
 
+  // Whether this column family is only created for the databases which use
+  // it (see DatabaseImpl) rather than for all of them, so that databases
+  // which don't can still be opened by versions which don't know about it.
+  bool optional = false;
+
   static const Family admin;
   static const Family entities;
   static const Family keys;
+  static const Family sectionKeys;
   static const Family stats;
   static const Family meta;
   static const Family ownershipUnits;
@@ -147,6 +165,13 @@ const Family Family::entities("entities", [](auto& opts){
 const Family Family::keys("keys", [](auto& opts) {
   opts.prefix_extractor.reset(
     rocksdb::NewFixedPrefixTransform(sizeof(Id::word_type))); });
+// The keys family again, but with the block of fact ids (see
+// SECTION_BLOCK_BITS) between the Pid and the key, so seeks bounded by an id
+// range only visit the blocks which overlap it.
+const Family Family::sectionKeys("sectionKeys", [](auto& opts) {
+  opts.prefix_extractor.reset(
+    rocksdb::NewFixedPrefixTransform(
+      sizeof(Id::word_type) + sizeof(uint64_t))); }, true, true);
 const Family Family::stats("stats", [](auto& opts) {
   opts.OptimizeForPointLookup(10); });
 const Family Family::meta("meta", [](auto&) {});
@@ -162,16 +187,36 @@ const Family Family::ownershipSets("ownershipSets", [](auto& opts){
 const Family Family::factOwners("factOwners", [](auto& opts){
   opts.inplace_update_support = false; });
 
+}
+
+struct Cache {
+  CacheOptions options;
+
+  // Used by the column families which don't have a pool
+  std::shared_ptr<rocksdb::Cache> shared;
+
+  // The families which have a cache of their own, indexed by Family::index
+  std::vector<std::shared_ptr<rocksdb::Cache>> pools;
+
+  // Shared by all databases which use the caches. RocksDB counts block
+  // cache hits per database rather than per column family.
+  std::shared_ptr<rocksdb::Statistics> statistics;
+};
+
+namespace {
+
 enum class AdminId : uint32_t {
   NEXT_ID,
   VERSION,
-  STARTING_ID
+  STARTING_ID,
+  SECTION_INDEX
 };
 
 const char *admin_names[] = {
   "NEXT_ID",
   "VERSION",
-  "STARTING_ID"
+  "STARTING_ID",
+  "SECTION_INDEX"
 };
 
 struct ContainerImpl final : Container {
@@ -181,11 +226,18 @@ struct ContainerImpl final : Container {
   std::unique_ptr<rocksdb::DB> db;
   std::vector<rocksdb::ColumnFamilyHandle *> families;
 
+  // The block caches, if shared with other databases
+  std::shared_ptr<Cache> cache;
+
   ContainerImpl(
       const std::string& path,
       Mode m,
-      folly::Optional<std::shared_ptr<Cache>> cache) {
+      folly::Optional<std::shared_ptr<Cache>> c) {
     mode = m;
+    if (c) {
+      cache = std::move(c.value());
+      options.statistics = cache->statistics;
+    }
 
     if (mode == Mode::Create ) {
       options.error_if_exists = true;
@@ -198,17 +250,7 @@ struct ContainerImpl final : Container {
     options.inplace_update_support = true;
     options.allow_concurrent_memtable_write = false;
 
-    {
-      rocksdb::BlockBasedTableOptions table_options;
-      if (cache) {
-        table_options.block_cache = std::move(cache.value());
-      }
-      table_options.filter_policy.reset(
-        rocksdb::NewBloomFilterPolicy(10, false));
-      table_options.whole_key_filtering = true;
-      options.table_factory.reset(
-        rocksdb::NewBlockBasedTableFactory(table_options));
-    }
+    options.table_factory = tableFactory(cache ? cache->shared : nullptr);
 
 #ifdef FACEBOOK
     localOptions(options);
@@ -232,8 +274,15 @@ struct ContainerImpl final : Container {
         if (auto family = Family::family(name)) {
           rocksdb::ColumnFamilyOptions opts(options);
           family->options(opts);
+          usePool(opts, *family);
           existing.push_back(rocksdb::ColumnFamilyDescriptor(name, opts));
           ptrs.push_back(&families[family->index]);
+        } else if (mode == Mode::ReadOnly) {
+          // An optional family added by a newer version, which reading the
+          // database can do without
+          LOG(WARNING) << "ignoring unknown column family '" << name << "'";
+          existing.push_back(rocksdb::ColumnFamilyDescriptor(name, options));
+          ptrs.push_back(nullptr);
         } else {
           rts::error("Unknown column family '{}'", name);
         }
@@ -269,18 +318,49 @@ struct ContainerImpl final : Container {
     }
 
     for (size_t i = 0; i < families.size(); ++i) {
-      if (families[i] == nullptr) {
-        auto family = Family::family(i);
-        assert(family != nullptr);
-
-        rocksdb::ColumnFamilyOptions opts(options);
-        family->options(opts);
-        check(db->CreateColumnFamily(
-          opts,
-          family->name,
-          &families[i]));
+      auto family = Family::family(i);
+      assert(family != nullptr);
+      if (families[i] == nullptr && !family->optional) {
+        createFamily(*family);
+      }
+    }
+  }
+
+  void createFamily(const Family& family) {
+    rocksdb::ColumnFamilyOptions opts(options);
+    family.options(opts);
+    usePool(opts, family);
+    check(db->CreateColumnFamily(
+      opts,
+      family.name,
+      &families[family.index]));
+  }
+
+  std::shared_ptr<rocksdb::TableFactory> tableFactory(
+      std::shared_ptr<rocksdb::Cache> block_cache) const {
+    rocksdb::BlockBasedTableOptions table_options;
+    if (block_cache) {
+      table_options.block_cache = std::move(block_cache);
+      if (cache->options.high_pri_ratio > 0) {
+        // Index and filter blocks are needed by every lookup so keep them in
+        // the high priority pool where scans of data blocks can't evict them
+        table_options.cache_index_and_filter_blocks = true;
+        table_options.cache_index_and_filter_blocks_with_high_priority = true;
+        table_options.pin_l0_filter_and_index_blocks_in_cache = true;
       }
     }
+    table_options.filter_policy.reset(
+      rocksdb::NewBloomFilterPolicy(10, false));
+    table_options.whole_key_filtering = true;
+    return std::shared_ptr<rocksdb::TableFactory>(
+      rocksdb::NewBlockBasedTableFactory(table_options));
+  }
+
+  // Use the family's own cache if it has one
+  void usePool(rocksdb::ColumnFamilyOptions& opts, const Family& family) const {
+    if (cache && cache->pools[family.index]) {
+      opts.table_factory = tableFactory(cache->pools[family.index]);
+    }
   }
 
   ContainerImpl(const ContainerImpl&) = delete;
@@ -316,7 +396,9 @@ struct ContainerImpl final : Container {
     }
   }
 
-  rocksdb::ColumnFamilyHandle *family(const Family& family) const {
+  // nullptr for an optional family the database doesn't have
+  rocksdb::ColumnFamilyHandle * FOLLY_NULLABLE family(
+      const Family& family) const {
     assert(family.index < families.size());
     return families[family.index];
   }
@@ -350,7 +432,9 @@ struct ContainerImpl final : Container {
     }
   }
 
-  void optimize() override {
+  void optimize(const OptimizeOptions& opts) override {
+    auto t = makeAutoTimer("optimize");
+    std::vector<size_t> todo;
     for (uint32_t i = 0; i < families.size(); i++) {
       auto family = Family::family(i);
       auto handle = families[i];
@@ -361,6 +445,7 @@ struct ContainerImpl final : Container {
           db->DestroyColumnFamilyHandle(handle);
           rocksdb::ColumnFamilyOptions opts(options);
           family->options(opts);
+          usePool(opts, *family);
           check(db->CreateColumnFamily(
             opts,
             family->name,
@@ -369,13 +454,103 @@ struct ContainerImpl final : Container {
         }
         const auto nlevels = db->NumberLevels(handle);
         if (nlevels != 2) {
-          rocksdb::CompactRangeOptions copts;
-          copts.change_level = true;
-          copts.target_level = 1;
-          check(db->CompactRange(copts, handle, nullptr, nullptr));
+          todo.push_back(i);
         }
       }
     }
+
+    const auto background_jobs = db->GetDBOptions().max_background_jobs;
+    if (opts.background_jobs > 0) {
+      setBackgroundJobs(opts.background_jobs);
+    }
+    if (opts.final) {
+      for (auto i : todo) {
+        finalOptions(families[i]);
+      }
+    }
+
+    // The families are independent so several of them can be compacted at
+    // once. Manual compactions are only exclusive when there is just one.
+    // Moving the result to level 1 (change_level) pauses all manual
+    // compactions in the DB, which makes the others fail, so with several
+    // threads the families are moved one at a time afterwards.
+    const auto threads =
+      std::min(std::max(opts.parallelism, size_t(1)), todo.size());
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    rocksdb::Status failure;
+    auto compact = [&] {
+      for (auto k = next++; k < todo.size(); k = next++) {
+        const auto family = Family::family(todo[k]);
+        LOG(INFO) << "optimize: compacting " << family->name
+          << " (" << k+1 << "/" << todo.size() << ")";
+        auto t = makeAutoTimer(
+          folly::to<std::string>("optimize(", family->name, ")"));
+        rocksdb::CompactRangeOptions copts;
+        copts.change_level = threads <= 1;
+        copts.target_level = 1;
+        copts.exclusive_manual_compaction = threads <= 1;
+        if (opts.subcompactions != 0) {
+          copts.max_subcompactions = opts.subcompactions;
+        }
+        auto status =
+          db->CompactRange(copts, families[todo[k]], nullptr, nullptr);
+        if (!status.ok()) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (failure.ok()) {
+            failure = std::move(status);
+          }
+          next = todo.size();
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) {
+      workers.emplace_back(compact);
+    }
+    compact();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+
+    if (threads > 1 && failure.ok()) {
+      // Each family is now in a single level so this only moves its files
+      for (auto i : todo) {
+        rocksdb::CompactRangeOptions copts;
+        copts.change_level = true;
+        copts.target_level = 1;
+        copts.bottommost_level_compaction =
+          rocksdb::BottommostLevelCompaction::kSkip;
+        failure = db->CompactRange(copts, families[i], nullptr, nullptr);
+        if (!failure.ok()) {
+          break;
+        }
+      }
+    }
+
+    if (opts.background_jobs > 0) {
+      setBackgroundJobs(background_jobs);
+    }
+    check(failure);
+  }
+
+  void setBackgroundJobs(int jobs) {
+    check(db->SetDBOptions(
+      {{"max_background_jobs", folly::to<std::string>(jobs)}}));
+  }
+
+  // Write the files of a family with settings for data which won't change
+  // any more. Full filters are used anyway (see tableFactory).
+  void finalOptions(rocksdb::ColumnFamilyHandle *handle) {
+    auto status = db->SetOptions(handle, {
+      {"compression", "kZSTD"},
+      {"bottommost_compression", "kZSTD"},
+      {"block_based_table_factory", "{block_size=65536;}"},
+    });
+    if (!status.ok()) {
+      // Older versions of rocksdb can't change some of these
+      LOG(WARNING) << "optimize: " << status.ToString();
+    }
   }
 
   static std::unique_ptr<rocksdb::BackupEngine> backupEngine(
@@ -393,7 +568,8 @@ struct ContainerImpl final : Container {
     check(backupEngine(path)->CreateNewBackup(db.get(), true));
   }
 
-  std::unique_ptr<Database> openDatabase(Id start, int32_t version) && override;
+  std::unique_ptr<Database> openDatabase(
+    Id start, int32_t version, bool section_index) && override;
 };
 
 void serializeEliasFano(binary::Output& out, const OwnerSet& set) {
@@ -427,6 +603,9 @@ struct DatabaseImpl final : Database {
   ContainerImpl container_;
   Id starting_id;
   Id next_id;
+  // Whether all facts are in Family::sectionKeys. This is only the case for
+  // databases created with the index enabled.
+  bool section_index;
   AtomicPredicateStats stats_;
   std::vector<size_t> ownership_unit_counters;
   folly::F14FastMap<uint64_t,size_t> ownership_derived_counters;
@@ -435,7 +614,7 @@ struct DatabaseImpl final : Database {
   // TODO: initialize this lazily
   std::unique_ptr<Usets> usets_;
 
-  explicit DatabaseImpl(ContainerImpl c, Id start, int64_t version)
+  DatabaseImpl(ContainerImpl c, Id start, int64_t version, bool index)
       : container_(std::move(c)) {
     starting_id = Id::fromWord(getAdminValue(
       AdminId::STARTING_ID,
@@ -463,6 +642,21 @@ struct DatabaseImpl final : Database {
       rts::error("unexpected database version {}", db_version);
     }
 
+    section_index = getAdminValue(
+      AdminId::SECTION_INDEX,
+      uint64_t(container_.mode == Mode::Create && index),
+      container_.mode == Mode::Create,
+      []{}) != 0;
+
+    if (section_index && container_.family(Family::sectionKeys) == nullptr) {
+      if (container_.mode == Mode::Create) {
+        container_.createFamily(Family::sectionKeys);
+      } else {
+        rts::error("corrupt database - missing column family '{}'",
+          Family::sectionKeys.name);
+      }
+    }
+
     stats_.set(loadStats());
     ownership_unit_counters = loadOwnershipUnitCounters();
     ownership_derived_counters = loadOwnershipDerivedCounters();
@@ -727,27 +921,90 @@ struct DatabaseImpl final : Database {
     }
   }
 
+  void factsById(
+      folly::Range<const Id*> ids,
+      std::function<void(Id, Pid, Fact::Clause)> f) override {
+    container_.requireOpen();
+    auto begin = std::lower_bound(ids.begin(), ids.end(), startingId());
+    auto end = std::lower_bound(begin, ids.end(), firstFreeId());
+    const size_t n = end - begin;
+    if (n == 0) {
+      return;
+    }
+    // nat encoding preserves order so the keys are sorted, which lets
+    // rocksdb batch the reads by block.
+    std::vector<EncodedNat> keys;
+    std::vector<rocksdb::Slice> slices;
+    keys.reserve(n);
+    slices.reserve(n);
+    for (auto it = begin; it != end; ++it) {
+      keys.emplace_back(it->toWord());
+      slices.push_back(slice(keys.back().byteRange()));
+    }
+    std::vector<rocksdb::PinnableSlice> vals(n);
+    std::vector<rocksdb::Status> statuses(n);
+    container_.db->MultiGet(
+      rocksdb::ReadOptions(),
+      container_.family(Family::entities),
+      n,
+      slices.data(),
+      vals.data(),
+      statuses.data(),
+      true);
+    for (size_t i = 0; i < n; ++i) {
+      if (!statuses[i].IsNotFound()) {
+        check(statuses[i]);
+        auto ref = decomposeFact(begin[i], vals[i]);
+        f(ref.id, ref.type, ref.clause);
+      }
+    }
+  }
+
+  // Number of fact ids per block in Family::sectionKeys
+  static constexpr size_t SECTION_BLOCK_BITS = 16;
+
+  // Bounded seeks which overlap more blocks than this scan the entire
+  // predicate instead of merging the blocks.
+  static constexpr uint64_t MAX_SECTION_BLOCKS = 64;
+
+  static uint64_t sectionBlock(Id id) {
+    return id.toWord() >> SECTION_BLOCK_BITS;
+  }
+
+  // Key prefix in Family::sectionKeys. The block is big endian so that
+  // blocks are ordered.
+  static void sectionPrefix(binary::Output& out, Pid type, uint64_t block) {
+    out.fixed(type);
+    out.fixed(folly::Endian::big(block));
+  }
+
   struct SeekIterator final : rts::FactIterator {
+    // 'start' and 'prefix_size' include the 'header' bytes which come before
+    // the fact key in 'family', starting with the Pid.
     SeekIterator(
         folly::ByteRange start,
         size_t prefix_size,
         Pid type,
-        const DatabaseImpl *db)
+        const DatabaseImpl *db,
+        const Family& family = Family::keys,
+        size_t header = sizeof(Pid))
       : upper_bound_(binary::lexicographicallyNext({start.data(), prefix_size}))
       , upper_bound_slice_(
           reinterpret_cast<const char *>(upper_bound_.data()),
           upper_bound_.size())
       , type_(type)
+      , header_(header)
       , db_(db)
     {
       assert(prefix_size <= start.size());
+      assert(header <= prefix_size);
       // both upper_bound_slice_ and options_ need to be alive for the duration
       // of the iteration
       options_.iterate_upper_bound = &upper_bound_slice_;
       iter_.reset(
         db->container_.db->NewIterator(
           options_,
-          db->container_.family(Family::keys)));
+          db->container_.family(family)));
       if (iter_) {
         iter_->Seek(slice(start));
       } else {
@@ -765,15 +1022,15 @@ struct DatabaseImpl final : Database {
 
     Fact::Ref get(Demand demand) override {
       if (iter_->Valid()) {
-        auto key = input(iter_->key());
-        auto ty = key.fixed<Pid>();
-        assert(ty == type_);
+        auto key = byteRange(iter_->key());
+        assert(input(iter_->key()).fixed<Pid>() == type_);
+        key.advance(header_);
         auto value = input(iter_->value());
         auto id = value.fixed<Id>();
         assert(value.empty());
 
         if (demand == KeyOnly) {
-          return Fact::Ref{id, type_, Fact::Clause::fromKey(key.bytes())};
+          return Fact::Ref{id, type_, Fact::Clause::fromKey(key)};
         } else {
           auto found = db_->lookupById(id, slice_);
           assert(found);
@@ -787,6 +1044,7 @@ struct DatabaseImpl final : Database {
     const std::vector<unsigned char> upper_bound_;
     const rocksdb::Slice upper_bound_slice_;
     const Pid type_;
+    const size_t header_;
     rocksdb::ReadOptions options_;
     std::unique_ptr<rocksdb::Iterator> iter_;
     const DatabaseImpl *db_;
@@ -824,11 +1082,42 @@ struct DatabaseImpl final : Database {
       return seek(type, start, prefix_size);
     }
 
-    if (upto <= startingId() || firstFreeId() <= from) {
+    if (upto <= startingId() || firstFreeId() <= from
+        || count(type).high() == 0) {
       return std::make_unique<EmptyIterator>();
     }
 
-    return Section(this, from, upto).seek(type, start, prefix_size);
+    from = std::max(from, startingId());
+    upto = std::min(upto, firstFreeId());
+    const auto first = sectionBlock(from);
+    const auto last = sectionBlock(upto - 1);
+    if (!section_index || last - first >= MAX_SECTION_BLOCKS) {
+      return FactIterator::section(
+        seek(type, start, prefix_size), from, upto);
+    }
+
+    // Seek in each block overlapping the section and merge the results. Only
+    // the first and last block can contain facts outside of the section.
+    container_.requireOpen();
+    std::vector<std::unique_ptr<FactIterator>> iters;
+    for (auto block = first; block <= last; ++block) {
+      binary::Output out;
+      sectionPrefix(out, type, block);
+      const auto header = out.size();
+      out.put(start);
+      std::unique_ptr<FactIterator> iter = std::make_unique<SeekIterator>(
+        out.bytes(),
+        header + prefix_size,
+        type,
+        this,
+        Family::sectionKeys,
+        header);
+      if (sectionBlock(from - 1) == block || sectionBlock(upto) == block) {
+        iter = FactIterator::section(std::move(iter), from, upto);
+      }
+      iters.push_back(std::move(iter));
+    }
+    return FactIterator::merge(std::move(iters), prefix_size);
   }
 
   // Legacy DBs don't store fact ids as 8 byte little-endian numbers so we can't
@@ -1049,6 +1338,18 @@ struct DatabaseImpl final : Database {
         v.fixed(fact.id);
 
         put(container_.family(Family::keys), slice(k), slice(v));
+
+        // not included in the stats which shouldn't depend on whether the
+        // database has the index
+        if (section_index) {
+          binary::Output sk;
+          sectionPrefix(sk, fact.type, sectionBlock(fact.id));
+          sk.put(fact.key());
+          check(batch.Put(
+            container_.family(Family::sectionKeys),
+            slice(sk),
+            slice(v)));
+        }
       }
 
       new_stats[fact.type] += MemoryStats::one(mem);
@@ -1510,8 +1811,9 @@ std::unique_ptr<rts::OwnershipSetIterator>
 }
 
 std::unique_ptr<Database> ContainerImpl::openDatabase(
-    Id start, int32_t version) && {
-  return std::make_unique<DatabaseImpl>(std::move(*this), start, version);
+    Id start, int32_t version, bool section_index) && {
+  return std::make_unique<DatabaseImpl>(
+    std::move(*this), start, version, section_index);
 }
 
 }
@@ -1523,8 +1825,73 @@ std::unique_ptr<Container> open(
   return std::make_unique<ContainerImpl>(path, mode, std::move(cache));
 }
 
-std::shared_ptr<Cache> newCache(size_t capacity) {
-  return rocksdb::NewLRUCache(capacity);
+namespace {
+
+std::shared_ptr<rocksdb::Cache> newBlockCache(
+    size_t capacity,
+    const CacheOptions& options) {
+  if (options.hyper_clock) {
+#if ROCKSDB_MAJOR > 7 || (ROCKSDB_MAJOR == 7 && ROCKSDB_MINOR >= 7)
+    // HyperClockCache needs an estimate of the size of its entries, which
+    // are mostly blocks of the default size
+    return rocksdb::HyperClockCacheOptions(capacity, 4096).MakeSharedCache();
+#else
+    rts::error("rocksdb: HyperClockCache isn't supported by this version");
+#endif
+  }
+  rocksdb::LRUCacheOptions opts;
+  opts.capacity = capacity;
+  opts.high_pri_pool_ratio = options.high_pri_ratio;
+  return rocksdb::NewLRUCache(opts);
+}
+
+}
+
+std::shared_ptr<Cache> newCache(const CacheOptions& options) {
+  auto cache = std::make_shared<Cache>();
+  cache->options = options;
+  cache->shared = newBlockCache(options.capacity, options);
+  cache->pools.resize(Family::count());
+  for (const auto& [name, capacity] : options.pools) {
+    auto family = Family::family(name);
+    if (family == nullptr) {
+      rts::error("rocksdb: unknown column family '{}'", name);
+    }
+    cache->pools[family->index] = newBlockCache(capacity, options);
+  }
+  cache->statistics = rocksdb::CreateDBStatistics();
+  // We only report tickers, and timing reads and writes for the histograms
+  // would slow down every database which uses the caches
+  cache->statistics->set_stats_level(
+    rocksdb::StatsLevel::kExceptHistogramOrTimers);
+  return cache;
+}
+
+std::vector<std::pair<std::string, uint64_t>> cacheStats(const Cache& cache) {
+  std::vector<std::pair<std::string, uint64_t>> stats;
+  auto usage = [&](const std::string& name, const rocksdb::Cache& c) {
+    stats.emplace_back(name + ".capacity", c.GetCapacity());
+    stats.emplace_back(name + ".usage", c.GetUsage());
+    stats.emplace_back(name + ".pinned_usage", c.GetPinnedUsage());
+  };
+  usage("shared", *cache.shared);
+  for (size_t i = 0; i < cache.pools.size(); ++i) {
+    if (cache.pools[i]) {
+      usage(Family::family(i)->name, *cache.pools[i]);
+    }
+  }
+  const std::pair<const char *, rocksdb::Tickers> tickers[] = {
+    {"data.hits", rocksdb::BLOCK_CACHE_DATA_HIT},
+    {"data.misses", rocksdb::BLOCK_CACHE_DATA_MISS},
+    {"index.hits", rocksdb::BLOCK_CACHE_INDEX_HIT},
+    {"index.misses", rocksdb::BLOCK_CACHE_INDEX_MISS},
+    {"filter.hits", rocksdb::BLOCK_CACHE_FILTER_HIT},
+    {"filter.misses", rocksdb::BLOCK_CACHE_FILTER_MISS},
+  };
+  for (const auto& [name, ticker] : tickers) {
+    stats.emplace_back(name, cache.statistics->getTickerCount(ticker));
+  }
+  return stats;
 }
 
 void restore(const std::string& target, const std::string& source) {
@@ -17,7 +17,6 @@
 #include "glean/rts/store.h"
 
 namespace rocksdb {
-struct Cache;
 struct Iterator;
 }
 
@@ -28,14 +27,51 @@ namespace rocks {
 using rts::Id;
 using rts::Pid;
 
-using Cache = ::rocksdb::Cache;
+/// The block caches shared by all databases of a server
+struct Cache;
+
+struct CacheOptions {
+  /// Capacity of the cache shared by the column families without a pool
+  size_t capacity = 0;
+
+  /// Fraction of each cache reserved for index and filter blocks. If this
+  /// isn't 0, they are kept in the caches with high priority (and pinned for
+  /// L0 files) rather than in the table readers.
+  double high_pri_ratio = 0;
+
+  /// Use HyperClockCache rather than LRUCache
+  bool hyper_clock = false;
+
+  /// Column families which have a cache of their own and its capacity, so
+  /// that reads of other families can't evict their blocks
+  std::vector<std::pair<std::string, size_t>> pools;
+};
 
-std::shared_ptr<Cache> newCache(
-  size_t capacity
-);
+std::shared_ptr<Cache> newCache(const CacheOptions& options);
+
+/// The capacity and usage of each cache, by the column family it is for or
+/// "shared", and the block cache hits and misses of the databases which use
+/// the caches, by type of block
+std::vector<std::pair<std::string, uint64_t>> cacheStats(const Cache& cache);
 
 struct Database;
 
+struct OptimizeOptions {
+  /// Number of column families to compact at once
+  size_t parallelism = 1;
+
+  /// Maximum number of threads the compaction of a column family can be
+  /// split across (0 means use the database's setting)
+  uint32_t subcompactions = 0;
+
+  /// max_background_jobs while compacting (0 means leave it alone)
+  int background_jobs = 0;
+
+  /// Write the compacted files with settings for data which won't change
+  /// any more: larger blocks and stronger compression
+  bool final = false;
+};
+
 /// A rocksdb container for storing facts
 struct Container {
   virtual ~Container() {}
@@ -51,16 +87,20 @@ struct Container {
     folly::ByteRange key, std::function<void(folly::ByteRange)> f) = 0;
 
   /// Optimise the container for reading
-  virtual void optimize() = 0;
+  virtual void optimize(const OptimizeOptions& options) = 0;
 
   /// Backup the Container to the specified directory.
   virtual void backup(const std::string& path) = 0;
 
   /// Convert the Container to a full fact Database with the given
   /// representation version - accessing the original Container afterwards isn't
-  /// allowed. If the database is being created, start is the starting fact id.
-  virtual
-    std::unique_ptr<Database> openDatabase(Id start, int32_t version) && = 0;
+  /// allowed. If the database is being created, start is the starting fact id
+  /// and section_index says whether to also write the keys by block of fact
+  /// ids, which speeds up seeks within sections but costs a second copy of
+  /// every key. Existing databases keep the choice made when they were
+  /// created. Only databases with the index have its column family.
+  virtual std::unique_ptr<Database> openDatabase(
+    Id start, int32_t version, bool section_index = false) && = 0;
 };
 
 enum class Mode {
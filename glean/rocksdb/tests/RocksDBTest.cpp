@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <map>
+
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/testing/TestUtil.h>
+#include <gtest/gtest.h>
+#include <rocksdb/db.h>
+
+#include "glean/rocksdb/rocksdb.h"
+#include "glean/rts/tests/uniform.h"
+
+namespace facebook {
+namespace glean {
+namespace rocks {
+
+namespace {
+
+const Pid NAME = Pid::fromWord(1024);
+const Pid DECL = Pid::fromWord(1025);
+
+// The blocks of DatabaseImpl::SECTION_BLOCK_BITS and MAX_SECTION_BLOCKS
+constexpr uint64_t BLOCK = uint64_t(1) << 16;
+constexpr uint64_t MAX_SECTION_BLOCKS = 64;
+
+// The batches leave gaps between them so that the facts span more than
+// MAX_SECTION_BLOCKS blocks without there being many of them.
+constexpr size_t BATCHES = 300;
+constexpr size_t BATCH = 50;
+constexpr uint64_t STRIDE = BLOCK / 4;
+
+std::unique_ptr<Database> openDB(
+    const std::string& path,
+    Mode mode,
+    bool section_index) {
+  return std::move(*open(path, mode, folly::none))
+    .openDatabase(Id::lowest(), 1, section_index);
+}
+
+void fill(Database& db) {
+  uint64_t n = 0;
+  for (size_t i = 0; i < BATCHES; ++i) {
+    rts::FactSet facts(Id::lowest() + i * STRIDE);
+    for (size_t j = 0; j < BATCH; ++j, ++n) {
+      // The first character selects one of 16 prefixes
+      auto key = folly::sformat("{:x}{:016x}", n % 16, uniform64(n));
+      facts.define(
+        n % 3 == 0 ? DECL : NAME,
+        rts::Fact::Clause::fromKey(binary::byteRange(key)));
+    }
+    db.commit(facts);
+  }
+}
+
+bool hasFamily(const std::string& path, const std::string& name) {
+  std::vector<std::string> names;
+  EXPECT_TRUE(
+    rocksdb::DB::ListColumnFamilies(rocksdb::DBOptions(), path, &names).ok());
+  return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+// The number of files in each level of each column family
+std::map<std::string, std::vector<uint64_t>> levels(const std::string& path) {
+  std::vector<std::string> names;
+  EXPECT_TRUE(
+    rocksdb::DB::ListColumnFamilies(rocksdb::DBOptions(), path, &names).ok());
+  std::vector<rocksdb::ColumnFamilyDescriptor> descriptors;
+  for (const auto& name : names) {
+    descriptors.emplace_back(name, rocksdb::ColumnFamilyOptions());
+  }
+  std::vector<rocksdb::ColumnFamilyHandle *> handles;
+  rocksdb::DB *db;
+  std::map<std::string, std::vector<uint64_t>> result;
+  auto status = rocksdb::DB::OpenForReadOnly(
+    rocksdb::DBOptions(), path, descriptors, &handles, &db);
+  EXPECT_TRUE(status.ok()) << status.ToString();
+  if (!status.ok()) {
+    return result;
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    auto& files = result[names[i]];
+    for (int level = 0; level < db->NumberLevels(handles[i]); ++level) {
+      std::string value;
+      EXPECT_TRUE(db->GetProperty(
+        handles[i],
+        folly::to<std::string>("rocksdb.num-files-at-level", level),
+        &value));
+      files.push_back(folly::to<uint64_t>(value));
+    }
+    db->DestroyColumnFamilyHandle(handles[i]);
+  }
+  delete db;
+  return result;
+}
+
+using Facts = std::vector<std::pair<Id, std::string>>;
+
+Facts drain(std::unique_ptr<rts::FactIterator> iter) {
+  Facts facts;
+  for (; auto fact = iter->get(rts::FactIterator::KeyOnly); iter->next()) {
+    facts.emplace_back(fact.id, binary::mkString(fact.key()));
+  }
+  return facts;
+}
+
+}
+
+// seekWithinSection must find the same facts whether or not the database
+// has the section index: within a block, across block boundaries, and when
+// the section spans too many blocks for the index to be used.
+TEST(RocksDBTest, seekWithinSection) {
+  folly::test::TemporaryDirectory tmp;
+  const auto indexed = (tmp.path() / "indexed").string();
+  const auto plain = (tmp.path() / "plain").string();
+  fill(*openDB(indexed, Mode::Create, true));
+  fill(*openDB(plain, Mode::Create, false));
+
+  // The choice is made when the database is created
+  auto with = openDB(indexed, Mode::ReadOnly, false);
+  auto without = openDB(plain, Mode::ReadOnly, true);
+  ASSERT_EQ(with->firstFreeId(), without->firstFreeId());
+
+  const auto start = Id::lowest();
+  const auto end = with->firstFreeId();
+  auto block = [](uint64_t n) { return Id::fromWord(n * BLOCK); };
+  ASSERT_LT(block(6 + MAX_SECTION_BLOCKS), end);
+
+  const std::vector<std::pair<Id, Id>> sections = {
+    {start, end},
+    {start + 10, start + 3000},
+    {block(1) - 5000, block(1) + 5000},
+    {block(2), block(4)},
+    {block(3) + 7, block(40) + 9},
+    {block(5), block(5 + MAX_SECTION_BLOCKS)},
+    {block(5), block(5 + MAX_SECTION_BLOCKS) + 1},
+    {block(2) + 1, block(2) + 1},
+    {block(60), end + BLOCK},
+  };
+
+  // (start, prefix_size) of the seeks
+  const std::vector<std::pair<std::string, size_t>> seeks = {
+    {"", 0},
+    {"a", 1},
+    {"a8", 1},
+  };
+
+  for (auto type : {NAME, DECL}) {
+    for (const auto& [seek, prefix_size] : seeks) {
+      const auto all = drain(with->seek(type, binary::byteRange(seek), 0));
+      for (const auto& [from, upto] : sections) {
+        SCOPED_TRACE(folly::sformat(
+          "type {} seek '{}' from {} upto {}",
+          type.toWord(), seek, from.toWord(), upto.toWord()));
+        Facts expected;
+        for (const auto& fact : all) {
+          if (from <= fact.first && fact.first < upto
+              && fact.second.compare(0, prefix_size, seek, 0, prefix_size)
+                == 0) {
+            expected.push_back(fact);
+          }
+        }
+        auto range = binary::byteRange(seek);
+        EXPECT_EQ(
+          drain(with->seekWithinSection(type, range, prefix_size, from, upto)),
+          expected);
+        EXPECT_EQ(
+          drain(
+            without->seekWithinSection(type, range, prefix_size, from, upto)),
+          expected);
+      }
+    }
+  }
+}
+
+// Only databases with the section index have its column family, so that
+// the others can be opened by versions which don't know about it.
+TEST(RocksDBTest, sectionKeysFamily) {
+  folly::test::TemporaryDirectory tmp;
+  const auto indexed = (tmp.path() / "indexed").string();
+  const auto plain = (tmp.path() / "plain").string();
+  openDB(indexed, Mode::Create, true);
+  openDB(plain, Mode::Create, false);
+  EXPECT_TRUE(hasFamily(indexed, "sectionKeys"));
+  EXPECT_FALSE(hasFamily(plain, "sectionKeys"));
+
+  openDB(plain, Mode::ReadWrite, true);
+  EXPECT_FALSE(hasFamily(plain, "sectionKeys"));
+}
+
+// Compacting several column families at once must work and still leave each
+// of them in level 1.
+TEST(RocksDBTest, optimizeParallel) {
+  folly::test::TemporaryDirectory tmp;
+  const auto path = tmp.path().string();
+  {
+    auto db = openDB(path, Mode::Create, true);
+    fill(*db);
+    OptimizeOptions opts;
+    opts.parallelism = 4;
+    db->container().optimize(opts);
+  }
+
+  size_t compacted = 0;
+  for (const auto& [name, files] : levels(path)) {
+    SCOPED_TRACE(name);
+    for (size_t level = 0; level < files.size(); ++level) {
+      if (level != 1) {
+        EXPECT_EQ(files[level], 0u);
+      } else if (files[level] != 0) {
+        ++compacted;
+      }
+    }
+  }
+  // at least entities, keys, sectionKeys, admin and stats
+  EXPECT_GE(compacted, 5u);
+
+  auto db = openDB(path, Mode::ReadOnly, false);
+  EXPECT_EQ(
+    drain(db->seek(NAME, {}, 0)).size() + drain(db->seek(DECL, {}, 0)).size(),
+    BATCHES * BATCH);
+}
+
+}
+}
+}
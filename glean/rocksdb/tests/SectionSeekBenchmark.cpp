@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <common/init/Init.h>
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+#include <folly/experimental/TestUtil.h>
+
+#include "glean/rocksdb/rocksdb.h"
+#include "glean/rts/stacked.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+const Pid NAME = Pid::fromWord(1024);
+const Pid DECL = Pid::fromWord(1025);
+
+// Size of the batches committed to the database, each of which is the
+// section added by one incremental update.
+constexpr size_t BATCH = 10000;
+
+// A database of one million facts in 100 batches, and the same database with
+// one more batch on top which hasn't been committed yet, like the writable
+// top of an incremental stack.
+struct Stack {
+  Stack() {
+    auto container =
+      rocks::open(dir.path().string(), rocks::Mode::Create, folly::none);
+    db = std::move(*container).openDatabase(Id::lowest(), 1, true);
+    uint64_t n = 0;
+    for (size_t i = 0; i < 100; ++i) {
+      FactSet batch(db->firstFreeId());
+      fill(batch, n);
+      db->commit(batch);
+    }
+    top = std::make_unique<FactSet>(db->firstFreeId());
+    fill(*top, n);
+    stacked = std::make_unique<Stacked<Lookup>>(db.get(), top.get());
+  }
+
+  static void fill(FactSet& facts, uint64_t& n) {
+    for (size_t i = 0; i < BATCH; ++i, ++n) {
+      auto key = folly::sformat("{:016x}", uniform64(n));
+      facts.define(
+        n % 4 == 0 ? DECL : NAME,
+        Fact::Clause::fromKey(binary::byteRange(key)));
+    }
+  }
+
+  folly::test::TemporaryDirectory dir;
+  std::unique_ptr<rocks::Database> db;
+  std::unique_ptr<FactSet> top;
+  std::unique_ptr<Stacked<Lookup>> stacked;
+};
+
+Stack& stack() {
+  static Stack s;
+  return s;
+}
+
+size_t drain(std::unique_ptr<FactIterator> iter) {
+  size_t n = 0;
+  for (; iter->get(FactIterator::KeyOnly); iter->next()) {
+    ++n;
+  }
+  return n;
+}
+
+// What seekWithinSection did before the sectionKeys index: seek over the
+// entire predicate and skip the facts outside of the section.
+void scan(size_t iters, size_t batches) {
+  folly::BenchmarkSuspender braces;
+  auto& s = stack();
+  const auto upto = s.db->firstFreeId();
+  const auto from = upto - batches * BATCH;
+  braces.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    folly::doNotOptimizeAway(
+      drain(FactIterator::section(s.db->seek(NAME, {}, 0), from, upto)));
+  }
+}
+
+void section(size_t iters, size_t batches) {
+  folly::BenchmarkSuspender braces;
+  auto& s = stack();
+  const auto upto = s.db->firstFreeId();
+  const auto from = upto - batches * BATCH;
+  braces.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    folly::doNotOptimizeAway(
+      drain(s.db->seekWithinSection(NAME, {}, 0, from, upto)));
+  }
+}
+
+// The newest committed batch and the uncommitted one on top of it
+void stacked(size_t iters) {
+  folly::BenchmarkSuspender braces;
+  auto& s = stack();
+  const auto from = s.db->firstFreeId() - BATCH;
+  const auto upto = s.stacked->firstFreeId();
+  braces.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    folly::doNotOptimizeAway(
+      drain(s.stacked->seekWithinSection(NAME, {}, 0, from, upto)));
+  }
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM(scan, 1_batch, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(section, 1_batch, 1)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(scan, 10_batches, 10)
+BENCHMARK_RELATIVE_NAMED_PARAM(section, 10_batches, 10)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(scan, 100_batches, 100)
+BENCHMARK_RELATIVE_NAMED_PARAM(section, 100_batches, 100)
+BENCHMARK_DRAW_LINE();
+BENCHMARK(stacked_top, iters) {
+  stacked(iters);
+}
+
+int main(int argc, char** argv) {
+  facebook::initFacebook(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -183,6 +183,26 @@ struct Input {
     buf = {p, buf.end()};
   }
 
+  /// Validate and read n packed unsigned numbers
+  void packedArray(uint64_t* out, size_t n) {
+    auto p = rts::loadUntrustedVarints(buf.begin(), buf.end(), out, n);
+    if (p != nullptr) {
+      buf = {p, buf.end()};
+    } else {
+      rts::error("invalid packed value");
+    }
+  }
+
+  /// Validate and skip over n packed unsigned numbers
+  void skipPackedArray(size_t n) {
+    auto p = rts::skipUntrustedVarints(buf.begin(), buf.end(), n);
+    if (p != nullptr) {
+      buf = {p, buf.end()};
+    } else {
+      rts::error("invalid packed value");
+    }
+  }
+
   uint8_t byte() {
     want(1);
     auto c = *buf.data();
@@ -303,6 +323,12 @@ struct Output {
     buf.use(n);
   }
 
+  /// Write n packed unsigned numbers
+  void packedArray(const uint64_t* xs, size_t n) {
+    auto p = buf.buffer(n * folly::kMaxVarintLength64);
+    buf.use(rts::storeVarints(p, xs, n));
+  }
+
   // Write a fixed width number
   template <typename T>
   void fixed(T x) {
@@ -325,6 +351,11 @@ struct Output {
     (void)buf.buffer(n);
   }
 
+  /// Remove the contents but keep the memory for reuse
+  void clear() {
+    buf.clear();
+  }
+
   /// Store the mangled representation of a UTF-8 string. The validity of the
   /// string isn't checked.
   void mangleString(folly::ByteRange r) {
@@ -394,6 +425,10 @@ struct Output {
       len += n;
     }
 
+    void clear() {
+      len = 0;
+    }
+
     /// Increase the buffer size by n and return a pointer to the new memory.
     unsigned char* grab(size_t n) {
       auto p = buffer(n);
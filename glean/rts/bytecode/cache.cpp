@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/hash/SpookyHashV2.h>
+
+#include "glean/rts/bytecode/cache.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+SubroutineCache::SubroutineCache(size_t capacity) : capacity_(capacity) {}
+
+std::string SubroutineCache::hash(const Subroutine& sub) {
+  folly::hash::SpookyHashV2 h;
+  h.Init(0, 0);
+  const uint64_t layout[] = {
+    sub.inputs,
+    sub.outputs,
+    sub.locals,
+    sub.code.size(),
+    sub.constants.size(),
+    sub.literals.size()
+  };
+  h.Update(layout, sizeof(layout));
+  h.Update(sub.code.data(), sub.code.size() * sizeof(uint64_t));
+  h.Update(sub.constants.data(), sub.constants.size() * sizeof(uint64_t));
+  for (const auto& lit : sub.literals) {
+    uint64_t size = lit.size();
+    h.Update(&size, sizeof(size));
+    h.Update(lit.data(), lit.size());
+  }
+  uint64_t out[2];
+  h.Final(&out[0], &out[1]);
+  return std::string(reinterpret_cast<const char *>(out), sizeof(out));
+}
+
+void SubroutineCache::State::evict(size_t capacity) {
+  while (size > capacity && !lru.empty()) {
+    auto& victim = lru.back();
+    size -= victim.size;
+    index.erase(victim.hash);
+    lru.pop_back();
+  }
+}
+
+bool SubroutineCache::insert(
+    const std::string& hash,
+    std::shared_ptr<Subroutine> sub) {
+  auto capacity = capacity_.load(std::memory_order_relaxed);
+  auto size = sub->size() + hash.size();
+  if (size > capacity) {
+    return false;
+  }
+  auto s = state.lock();
+  auto it = s->index.find(hash);
+  if (it != s->index.end()) {
+    s->lru.splice(s->lru.begin(), s->lru, it->second);
+    return true;
+  }
+  s->lru.push_front(Entry{hash, std::move(sub), size});
+  s->index.emplace(hash, s->lru.begin());
+  s->size += size;
+  s->evict(capacity);
+  return true;
+}
+
+bool SubroutineCache::touch(const std::string& hash) {
+  if (!enabled()) {
+    return false;
+  }
+  auto s = state.lock();
+  auto it = s->index.find(hash);
+  if (it == s->index.end()) {
+    return false;
+  }
+  s->lru.splice(s->lru.begin(), s->lru, it->second);
+  return true;
+}
+
+std::shared_ptr<Subroutine> SubroutineCache::lookup(const std::string& hash) {
+  auto s = state.lock();
+  auto it = s->index.find(hash);
+  if (it == s->index.end()) {
+    return nullptr;
+  }
+  s->lru.splice(s->lru.begin(), s->lru, it->second);
+  return it->second->sub;
+}
+
+void SubroutineCache::setCapacity(size_t capacity) {
+  capacity_.store(capacity, std::memory_order_relaxed);
+  state.lock()->evict(capacity);
+}
+
+SubroutineCache& SubroutineCache::global() {
+  static SubroutineCache cache(0);
+  return cache;
+}
+
+}
+}
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+
+#include "glean/rts/bytecode/subroutine.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+/// A bounded, content-addressed LRU cache of Subroutines.
+///
+/// Query continuations carry the hash of their bytecode along with the
+/// bytecode itself. Restarting one on a server which still has the hash
+/// cached here reuses the Subroutine rather than building it again from
+/// the continuation on every page. The cache is per-process and entries
+/// may be evicted at any time, so the bytecode in the continuation is
+/// always there to fall back on.
+///
+/// A capacity of 0 disables the cache.
+class SubroutineCache {
+public:
+  explicit SubroutineCache(size_t capacity);
+
+  SubroutineCache(const SubroutineCache&) = delete;
+  SubroutineCache& operator=(const SubroutineCache&) = delete;
+
+  /// A 128-bit hash of everything that determines the behaviour of a
+  /// Subroutine: code, literals, constants and frame layout.
+  static std::string hash(const Subroutine& sub);
+
+  /// Add a subroutine under the given hash, evicting the least recently
+  /// used entries to make room. Returns false if the subroutine doesn't
+  /// fit (or the cache is disabled).
+  bool insert(const std::string& hash, std::shared_ptr<Subroutine> sub);
+
+  /// Mark an entry as recently used. Returns false if it isn't cached.
+  bool touch(const std::string& hash);
+
+  /// Find a cached subroutine, or nullptr.
+  std::shared_ptr<Subroutine> lookup(const std::string& hash);
+
+  /// Change the capacity, evicting entries if necessary.
+  void setCapacity(size_t capacity);
+
+  bool enabled() const {
+    return capacity_.load(std::memory_order_relaxed) != 0;
+  }
+
+  /// The cache used by the query engine.
+  static SubroutineCache& global();
+
+private:
+  struct Entry {
+    std::string hash;
+    std::shared_ptr<Subroutine> sub;
+    size_t size;
+  };
+
+  struct State {
+    size_t size = 0;
+    // most recently used at the front
+    std::list<Entry> lru;
+    folly::F14FastMap<std::string, std::list<Entry>::iterator> index;
+
+    void evict(size_t capacity);
+  };
+
+  std::atomic<size_t> capacity_;
+  folly::Synchronized<State, std::mutex> state;
+};
+
+}
+}
+}
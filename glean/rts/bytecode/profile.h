@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <folly/CPortability.h>
+#include <folly/chrono/Hardware.h>
+
+#include "glean/rts/bytecode/gen/instruction.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+/// Execution counts and cycle estimates for the instructions of a
+/// subroutine, collected by Subroutine::execute when given a profile.
+///
+/// Cycles are measured with the hardware timestamp counter and include
+/// the time spent in any functions that an instruction calls, so the
+/// CallFun_* instructions account for the time spent in query callbacks.
+struct SubroutineProfile {
+  struct Counter {
+    uint64_t count = 0;
+    uint64_t cycles = 0;
+
+    FOLLY_ALWAYS_INLINE void record(uint64_t start) {
+      ++count;
+      cycles += now() - start;
+    }
+  };
+
+  /// Indexed by opcode
+  std::array<Counter, 256> ops;
+
+  static FOLLY_ALWAYS_INLINE uint64_t now() {
+    return folly::hardware_timestamp();
+  }
+
+  FOLLY_ALWAYS_INLINE void record(Op op, uint64_t start) {
+    ops[static_cast<uint8_t>(op)].record(start);
+  }
+};
+
+}
+}
+}
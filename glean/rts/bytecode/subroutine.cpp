@@ -6,6 +6,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+
+#include <folly/Likely.h>
+
 #include "glean/rts/binary.h"
 #include "glean/rts/bytecode/subroutine.h"
 #include "glean/rts/id.h"
@@ -70,6 +74,27 @@ struct Eval {
         const_cast<unsigned char*>(input.data()));
   }
 
+  FOLLY_ALWAYS_INLINE void execute(InputNats a) {
+    binary::Input input { *a.begin, a.end };
+    constexpr uint64_t CHUNK = 256;
+    uint64_t buf[CHUNK];
+    for (uint64_t n = a.count; n != 0; ) {
+      const auto k = std::min(n, CHUNK);
+      input.packedArray(buf, k);
+      a.output->packedArray(buf, k);
+      n -= k;
+    }
+    *a.begin = reinterpret_cast<void *>(
+        const_cast<unsigned char*>(input.data()));
+  }
+
+  FOLLY_ALWAYS_INLINE void execute(InputSkipNats a) {
+    binary::Input input { *a.begin, a.end };
+    input.skipPackedArray(a.count);
+    *a.begin = reinterpret_cast<void *>(
+        const_cast<unsigned char*>(input.data()));
+  }
+
   FOLLY_ALWAYS_INLINE void execute(InputSkipTrustedString a) {
     binary::Input input { *a.begin, a.end };
     input.skipTrustedString();
@@ -326,12 +351,19 @@ struct Eval {
 
 #define USE_SWITCH 1
 
-void Subroutine::execute(const uint64_t *args) const {
+void Subroutine::execute(
+    const uint64_t *args,
+    SubroutineProfile *profile) const {
   uint64_t frame[inputs + locals];
   std::copy(args, args + inputs, frame);
   assert(constants.size() <= locals);
   std::copy(constants.begin(), constants.end(), frame + inputs);
-  Eval{literals.data(), code.data(), code.data(), frame}.
+  Eval eval{literals.data(), code.data(), code.data(), frame};
+  if (FOLLY_UNLIKELY(profile != nullptr)) {
+    eval.evalProfile(*profile);
+    return;
+  }
+  eval.
 #if USE_SWITCH
     evalSwitch();
 #else
@@ -339,8 +371,16 @@ void Subroutine::execute(const uint64_t *args) const {
 #endif
 }
 
-void Subroutine::restart(uint64_t *regs, uint64_t offset) const {
-  Eval{literals.data(), code.data(), code.data() + offset, regs}.
+void Subroutine::restart(
+    uint64_t *regs,
+    uint64_t offset,
+    SubroutineProfile *profile) const {
+  Eval eval{literals.data(), code.data(), code.data() + offset, regs};
+  if (FOLLY_UNLIKELY(profile != nullptr)) {
+    eval.evalProfile(*profile);
+    return;
+  }
+  eval.
 #if USE_SWITCH
     evalSwitch();
 #else
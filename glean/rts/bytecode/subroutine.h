@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "glean/rts/bytecode/gen/instruction.h"
+#include "glean/rts/bytecode/profile.h"
 #include "glean/if/gen-cpp2/internal_types.h"
 
 namespace facebook {
@@ -58,12 +59,20 @@ struct Subroutine {
   /// Execute the subroutine with the given arguments. The number of arguments
   /// is given by 'inputs'. The arguments are copied to their registers before
   /// execution.
-  void execute(const uint64_t *args) const;
+  ///
+  /// If 'profile' is given, the subroutine runs in a (much slower) mode
+  /// which accumulates per-opcode counts and cycles into it.
+  void execute(
+      const uint64_t *args,
+      SubroutineProfile *profile = nullptr) const;
 
   /// Restart a subroutine with the given set of regs (must be an
   /// array of size inputs + locals) and initializing pc to the given
   /// offset into the code array.
-  void restart(uint64_t *regs, uint64_t offset) const;
+  void restart(
+      uint64_t *regs,
+      uint64_t offset,
+      SubroutineProfile *profile = nullptr) const;
 
   bool operator==(const Subroutine& other) const;
   bool operator!=(const Subroutine& other) const {
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/Random.h>
+
+#include "glean/rts/cursor.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+CursorTable::CursorTable(const Options& o) : opts(o) {}
+
+std::unique_ptr<FactIterator> CursorTable::seek(
+    Define& facts,
+    Id bound,
+    Pid type,
+    folly::ByteRange start,
+    size_t prefix_size) {
+  if (facts.firstFreeId() != bound) {
+    return nullptr;
+  }
+  return facts.seekWithinSection(
+      type, start, prefix_size, Id::invalid(), bound);
+}
+
+void CursorTable::State::drop(
+    std::list<Entry>::iterator it,
+    std::vector<Iterators>& garbage) {
+  bytes -= it->bytes;
+  index.erase(it->id);
+  garbage.push_back(std::move(it->iters));
+  entries.erase(it);
+}
+
+void CursorTable::State::expire(
+    Clock::time_point now,
+    size_t capacity,
+    std::vector<Iterators>& garbage) {
+  // Entries are in order of creation and all have the same TTL, so the
+  // expired ones and the ones to evict are all at the front.
+  while (!entries.empty() &&
+         (entries.front().expires <= now || bytes > capacity)) {
+    drop(entries.begin(), garbage);
+  }
+}
+
+uint64_t CursorTable::park(Iterators iters, Id bound, size_t bytes) {
+  std::vector<Iterators> garbage;
+  if (bytes > opts.capacity) {
+    return 0;
+  }
+  auto now = Clock::now();
+  uint64_t id;
+  {
+    auto s = state.lock();
+    if (s->closed) {
+      return 0;
+    }
+    s->expire(now, opts.capacity - bytes, garbage);
+    // Cursor ids are random so that they can't be guessed from the ids
+    // of other queries.
+    do {
+      id = folly::Random::secureRand64();
+    } while (id == 0 || s->index.count(id) != 0);
+    s->entries.push_back(
+        Entry{id, std::move(iters), bound, bytes, now + opts.ttl});
+    s->index.emplace(id, std::prev(s->entries.end()));
+    s->bytes += bytes;
+  }
+  return id;
+}
+
+CursorTable::Iterators CursorTable::take(uint64_t cursor, Id bound) {
+  std::vector<Iterators> garbage;
+  Iterators iters;
+  auto s = state.lock();
+  s->expire(Clock::now(), opts.capacity, garbage);
+  auto it = s->index.find(cursor);
+  if (it != s->index.end()) {
+    auto entry = it->second;
+    if (entry->bound == bound) {
+      iters = std::move(entry->iters);
+    }
+    s->drop(entry, garbage);
+  }
+  s.unlock();
+  return iters;
+}
+
+void CursorTable::close() {
+  std::vector<Iterators> garbage;
+  auto s = state.lock();
+  s->closed = true;
+  while (!s->entries.empty()) {
+    s->drop(s->entries.begin(), garbage);
+  }
+}
+
+CursorTable::Stats CursorTable::stats() {
+  auto s = state.lock();
+  return Stats{s->entries.size(), s->bytes};
+}
+
+}
+}
+}
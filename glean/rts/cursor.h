@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+
+#include "glean/rts/define.h"
+#include "glean/rts/lookup.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+/// A short-lived table of the live iterator stacks of paused queries.
+///
+/// When a query returns a continuation, its iterators can be parked here
+/// under a random cursor id which is recorded in the continuation. If the
+/// next page arrives before the cursor expires, the query resumes with
+/// the live iterators instead of re-seeking every level of nesting from
+/// the saved keys. The serialised keys in the continuation remain the
+/// fallback, so losing a cursor is never an error.
+///
+/// The iterators refer to the underlying storage, so a table must only be
+/// used with a single Lookup and must be closed before that Lookup is
+/// destroyed. Each cursor is taken at most once.
+class CursorTable {
+public:
+  using Iterators = std::vector<std::unique_ptr<FactIterator>>;
+
+  struct Options {
+    /// Approximate memory budget for parked iterators, in bytes
+    size_t capacity;
+
+    /// How long a parked cursor stays valid
+    std::chrono::milliseconds ttl;
+  };
+
+  explicit CursorTable(const Options& opts);
+
+  CursorTable(const CursorTable&) = delete;
+  CursorTable& operator=(const CursorTable&) = delete;
+
+  /// Park the iterators of a paused query. 'bound' identifies the view
+  /// of the facts that the iterators were created against (the first
+  /// free fact id) and must match when the cursor is taken. 'bytes' is
+  /// an estimate of the memory held by the iterators. Returns the cursor
+  /// id, or 0 if the iterators were not parked.
+  uint64_t park(Iterators iters, Id bound, size_t bytes);
+
+  /// Remove and return the iterators parked under the given cursor, or
+  /// an empty vector if the cursor has expired, was evicted or was
+  /// created against a different view of the facts.
+  Iterators take(uint64_t cursor, Id bound);
+
+  /// Seek for an iterator that can be parked. Queries run against the DB
+  /// with the facts derived by the request stacked on top from 'bound'
+  /// upwards, and those are discarded at the end of the request. As long as
+  /// none have been derived, this seeks only the facts below 'bound', so
+  /// the iterator doesn't refer to the derived facts at all. Otherwise it
+  /// returns nullptr and the caller must seek normally and not park the
+  /// iterator.
+  static std::unique_ptr<FactIterator> seek(
+      Define& facts,
+      Id bound,
+      Pid type,
+      folly::ByteRange start,
+      size_t prefix_size);
+
+  /// Drop all parked iterators and refuse any new ones. This must be
+  /// called before the Lookup that the iterators came from is closed.
+  void close();
+
+  struct Stats {
+    size_t cursors;
+    size_t bytes;
+  };
+
+  Stats stats();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    uint64_t id;
+    Iterators iters;
+    Id bound;
+    size_t bytes;
+    Clock::time_point expires;
+  };
+
+  struct State {
+    // oldest first
+    std::list<Entry> entries;
+    folly::F14FastMap<uint64_t, std::list<Entry>::iterator> index;
+    size_t bytes = 0;
+    bool closed = false;
+
+    // Dropped iterators are moved to 'garbage' so that they can be
+    // destroyed without holding the lock.
+    void drop(std::list<Entry>::iterator it, std::vector<Iterators>& garbage);
+    void expire(
+        Clock::time_point now,
+        size_t capacity,
+        std::vector<Iterators>& garbage);
+  };
+
+  Options opts;
+  folly::Synchronized<State, std::mutex> state;
+};
+
+}
+}
+}
@@ -94,6 +94,48 @@ Substitution defineUntrustedBatch(
   return subst;
 }
 
+Id substituteBatch(
+    const Inventory& inventory,
+    folly::Range<const Id *> base,
+    Id first,
+    size_t count,
+    folly::ByteRange batch,
+    binary::Output& output) {
+  // Leave the batch where it is if that's above all of 'base'
+  auto next = first;
+  for (auto id : base) {
+    next = std::max(next, id + 1);
+  }
+  const auto offset = distance(first, next);
+
+  Renamer renamer([&](Id id, Pid) {
+    if (id < Id::lowest()
+        || (id < first && id >= Id::lowest() + base.size())
+        || id >= first + count) {
+      error("invalid fact reference {}", id);
+    }
+    return id < first ? base[distance(Id::lowest(), id)] : id + offset;
+  });
+
+  binary::Input input(batch);
+  for (size_t i = 0; i < count; ++i) {
+    Pid ty;
+    Fact::Clause clause;
+    Fact::deserialize(input, ty, clause);
+
+    if (const auto *predicate = inventory.lookupPredicate(ty)) {
+      binary::Output out;
+      uint64_t key_size;
+      predicate->typecheck(renamer, clause, out, key_size);
+      Fact::serialize(
+        output, ty, Fact::Clause::from(out.bytes(), key_size));
+    } else {
+      error("invalid predicate id {}", ty);
+    }
+  }
+  return next;
+}
+
 }
 }
 }
@@ -42,6 +42,22 @@ Substitution defineUntrustedBatch(
   size_t count,
   folly::ByteRange batch);
 
+/// Rename a batch which refers to the facts of earlier batches by the ids
+/// they were written with rather than by their ids in the database, like the
+/// segments written by a streaming file sender. References below 'first'
+/// are to earlier batches and 'base' contains the database ids of their
+/// facts, in order from Id::lowest(). The facts of the batch are renumbered
+/// to follow all of these ids if necessary so that defineUntrustedBatch can
+/// tell them apart. Returns the new id of the first fact in the batch and
+/// writes the renamed facts to 'output'.
+Id substituteBatch(
+  const Inventory& inventory,
+  folly::Range<const Id *> base,
+  Id first,
+  size_t count,
+  folly::ByteRange batch,
+  binary::Output& output);
+
 }
 }
 }
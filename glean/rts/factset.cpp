@@ -8,6 +8,9 @@
 
 #include "glean/rts/factset.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace facebook {
 namespace glean {
 namespace rts {
@@ -106,53 +109,69 @@ std::unique_ptr<FactIterator> FactSet::seek(
     Pid type,
     folly::ByteRange start,
     size_t prefix_size) {
-  struct SeekIterator : FactIterator {
-    explicit SeekIterator(Index::map_t::iterator b, Index::map_t::iterator e)
-      : current(b)
-      , end(e)
-    {}
+  // Merges the matching parts of the runs. There are only O(log n) runs and
+  // typically very few so we just scan them for the smallest key.
+  struct SeekIterator final : FactIterator {
+    using iter_t = Index::run_t::const_iterator;
+
+    explicit SeekIterator(Index::runs_t r) : runs(std::move(r)) {}
+
+    void init(folly::ByteRange start, folly::ByteRange upto) {
+      for (const auto& run : runs) {
+        auto cmp = [](const Fact *fact, folly::ByteRange key) {
+          return fact->key() < key;
+        };
+        auto b = std::lower_bound(run->begin(), run->end(), start, cmp);
+        auto e = upto.empty()
+          ? run->end()
+          : std::lower_bound(b, run->end(), upto, cmp);
+        if (b != e) {
+          ranges.push_back({b,e});
+        }
+      }
+      select();
+    }
+
+    void select() {
+      current = ranges.size();
+      for (size_t i = 0; i < ranges.size(); ++i) {
+        if (current == ranges.size()
+            || (*ranges[i].first)->key() < (*ranges[current].first)->key()) {
+          current = i;
+        }
+      }
+    }
 
     void next() override {
-      assert(current != end);
-      ++current;
+      assert(current < ranges.size());
+      auto& range = ranges[current];
+      ++range.first;
+      if (range.first == range.second) {
+        ranges.erase(ranges.begin() + current);
+      }
+      select();
     }
 
     Fact::Ref get(Demand) override {
-      return current != end ? current->second->ref() : Fact::Ref::invalid();
+      return current < ranges.size()
+        ? (*ranges[current].first)->ref()
+        : Fact::Ref::invalid();
     }
 
-    Index::map_t::const_iterator current;
-    const Index::map_t::const_iterator end;
+    // keeps the runs alive
+    const Index::runs_t runs;
+    std::vector<std::pair<iter_t, iter_t>> ranges;
+    size_t current;
   };
 
   assert(prefix_size <= start.size());
 
-  if (const auto p = keys.lookup(type)) {
-    auto& entry = index[type];
-    // Check if the entry is up to date (i.e., has the same number of items as
-    // the key hashmap). If it doesn't, fill it.
-    if (!entry.withRLock([&](auto& map) { return map.size() == p->size(); })) {
-      entry.withWLock([&](auto& map) {
-        if (map.size() != p->size()) {
-          map.clear();
-          for (const Fact *fact : *p) {
-            map.insert({fact->key(), fact});
-          }
-        }
-      });
-    }
-    // The map for a pid is only created once so this is safe. We are *not*
-    // thread safe with respect to concurrent modifications of the FactSet
-    // as per spec.
-    auto& map = entry.unsafeGetUnlocked();
-
+  if (keys.lookup(type)) {
+    auto iter = std::make_unique<SeekIterator>(index.runs(*this, type));
     const auto next =
       binary::lexicographicallyNext({start.data(), prefix_size});
-    return std::make_unique<SeekIterator>(
-      map.lower_bound(start),
-      next.empty()
-        ? map.end()
-        : map.lower_bound(binary::byteRange(next)));
+    iter->init(start, binary::byteRange(next));
+    return iter;
   } else {
     return std::make_unique<EmptyIterator>();
   }
@@ -318,34 +337,91 @@ bool FactSet::appendable(const FactSet& other) const {
 }
 
 struct FactSet::Index::Impl {
-  Impl() {}
-  Impl(Impl&&) = default;
-  Impl& operator=(Impl&&) = default;
-  Impl(const Impl&) = delete;
-  Impl& operator=(const Impl&) = delete;
-
-  entry_t& operator[](Pid pid) {
-    // Try getting an existing entry with a reader lock. If there is no entry,
-    // obtain a writer lock and create one if it still doesn't exist.
-    auto p = index.withRLock([pid](auto& locked) {
-      const auto q = locked.lookup(pid);
-      return q ? q->get() : nullptr;
-    });
-    if (!p) {
-      p = index.withWLock([pid](auto& locked) {
-        auto& r = locked[pid];
-        if (r.get() == nullptr) {
-          r.reset(new entry_t);
-        }
-        return r.get();
-      });
-    }
-    return *p;
+  struct State {
+    // facts[0,upto) have been added to all predicates in 'runs'
+    size_t upto = 0;
+    DenseMap<Pid, runs_t> runs;
+  };
+
+  folly::Synchronized<State> state;
+
+  static bool byKey(const Fact *x, const Fact *y) {
+    return x->key() < y->key();
   }
 
-  folly::Synchronized<DenseMap<Pid, std::unique_ptr<entry_t>>> index;
+  // Add a sorted run, merging it with the last run until the runs have
+  // geometrically decreasing sizes. This keeps the number of runs logarithmic
+  // and means each fact is merged O(log n) times.
+  static void push(runs_t& runs, run_t run) {
+    while (!runs.empty() && runs.back()->size() <= 2 * run.size()) {
+      const auto& last = *runs.back();
+      run_t merged;
+      merged.reserve(last.size() + run.size());
+      std::merge(
+        last.begin(), last.end(),
+        run.begin(), run.end(),
+        std::back_inserter(merged),
+        byKey);
+      runs.pop_back();
+      run = std::move(merged);
+    }
+    runs.push_back(std::make_shared<const run_t>(std::move(run)));
+  }
 };
 
+FactSet::Index::runs_t FactSet::Index::runs(const FactSet& set, Pid pid) {
+  auto p = impl.load(std::memory_order_acquire);
+  if (p == nullptr) {
+    auto k = std::make_unique<Impl>();
+    if (impl.compare_exchange_strong(p, k.get(), std::memory_order_acq_rel)) {
+      p = k.release();
+    }
+  }
+
+  const auto size = set.facts.size();
+  {
+    auto state = p->state.rlock();
+    if (state->upto == size) {
+      if (auto r = state->runs.lookup(pid)) {
+        return *r;
+      }
+    }
+  }
+
+  auto state = p->state.wlock();
+  if (state->upto < size) {
+    // Distribute the new facts to the predicates we've indexed so far.
+    DenseMap<Pid, run_t> added;
+    for (auto i = state->upto; i < size; ++i) {
+      const Fact *fact = set.facts[i].get();
+      if (state->runs.lookup(fact->type())) {
+        added[fact->type()].push_back(fact);
+      }
+    }
+    for (auto x : added) {
+      auto& run = x.second;
+      std::sort(run.begin(), run.end(), Impl::byKey);
+      Impl::push(*state->runs.lookup(x.first), std::move(run));
+    }
+    state->upto = size;
+  }
+
+  if (auto r = state->runs.lookup(pid)) {
+    return *r;
+  }
+
+  // First seek for this predicate, index all its facts.
+  run_t run;
+  if (const auto keys = set.keys.lookup(pid)) {
+    run.reserve(keys->size());
+    run.insert(run.end(), keys->begin(), keys->end());
+    std::sort(run.begin(), run.end(), Impl::byKey);
+  }
+  auto& runs = state->runs[pid];
+  Impl::push(runs, std::move(run));
+  return runs;
+}
+
 FactSet::Index::~Index() {
   delete impl.load(std::memory_order_relaxed);
 }
@@ -361,17 +437,6 @@ FactSet::Index& FactSet::Index::operator=(FactSet::Index&& other) {
   return *this;
 }
 
-FactSet::Index::entry_t& FactSet::Index::operator[](Pid pid) {
-  auto p = impl.load(std::memory_order_relaxed);
-  if (p == nullptr) {
-    auto k = std::make_unique<Impl>();
-    if (impl.compare_exchange_strong(p, k.get(), std::memory_order_acq_rel)) {
-      p = k.release();
-    }
-  }
-  return (*p)[pid];
-}
-
 bool FactSet::sanityCheck() const {
   // TODO: implement
   return true;
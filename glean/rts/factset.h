@@ -16,6 +16,8 @@
 #include "glean/rts/store.h"
 
 #include <atomic>
+#include <memory>
+#include <vector>
 #include <boost/intrusive/list.hpp>
 #include <boost/iterator/transform_iterator.hpp>
 #include <folly/container/F14Set.h>
@@ -193,9 +195,8 @@ public:
   /// Prefix seeks. This function can be called from multiple threads but prefix
   /// seeks can *not* be interleaved with modifying the FactSet.
   ///
-  /// WARNING: This is currently not intended for production use as it is very
-  /// slow. The first call for each predicate will be especially slow as it will
-  /// need to create an index.
+  /// The first call for each predicate needs to sort all its facts. Later
+  /// calls only index the facts defined since.
   std::unique_ptr<FactIterator> seek(
     Pid type,
     folly::ByteRange start,
@@ -249,8 +250,16 @@ private:
   DenseMap<Pid, FastSetBy<const Fact *, FactByKeyOnly>> keys;
   size_t fact_memory;
 
-  /// Index for prefix seeks. It is lazily initialised and slow as we typically
-  /// don't do seeks on FactSets.
+  /// Index for prefix seeks. It is lazily initialised for each predicate the
+  /// first time we seek on it and then kept up to date with facts defined
+  /// since, LSM-style: new facts are sorted into a run of their own and runs
+  /// of similar size are merged. This makes interleaving definitions and
+  /// seeks (as derivations do) cost O(log n) per fact rather than rebuilding
+  /// the whole index each time.
+  ///
+  /// Runs are immutable once built and shared with iterators, so seeks can
+  /// safely run concurrently with each other and an iterator remains valid
+  /// while other seeks update the index.
   class Index final {
   public:
     Index() : impl(nullptr) {}
@@ -262,15 +271,15 @@ private:
 
     void swap(Index&) noexcept;
 
-    /// Type of index maps
-    using map_t = std::map<folly::ByteRange, const Fact *>;
+    /// A run of facts of one predicate, sorted by key
+    using run_t = std::vector<const Fact *>;
 
-    /// Type of index maps with synchronised access
-    using entry_t = folly::Synchronized<map_t>;
+    /// Runs which cover all facts of a predicate, in no particular order
+    using runs_t = std::vector<std::shared_ptr<const run_t>>;
 
-    /// Get a reference to the index map for the given predicate, creating an
-    /// empty one if necessary
-    entry_t& operator[](Pid pid);
+    /// Get the runs for the given predicate after indexing all facts in the
+    /// FactSet which haven't been indexed yet.
+    runs_t runs(const FactSet& facts, Pid pid);
 
   private:
     struct Impl;
@@ -16,14 +16,17 @@
 #include <common/hs/util/cpp/wrap.h>
 #endif
 #include "glean/if/gen-cpp2/glean_types.h"
+#include "glean/rts/bytecode/cache.h"
 #include "glean/rts/bytecode/subroutine.h"
 #include "glean/rts/cache.h"
 #include "glean/rts/ffi.h"
 #include "glean/rts/id.h"
+#include "glean/rts/jsonfacts.h"
 #include "glean/rts/lookup.h"
 #include "glean/rts/ownership.h"
 #include "glean/rts/ownership/slice.h"
 #include "glean/rts/query.h"
+#include "glean/rts/querycache.h"
 #include "glean/rts/sanity.h"
 #include "glean/rts/stacked.h"
 #include "glean/rts/string.h"
@@ -31,6 +34,9 @@
 #include "glean/rts/validate.h"
 
 #include <folly/Exception.h>
+#include <folly/compression/Compression.h>
+#include <folly/system/MemoryMapping.h>
+#include <sys/mman.h>
 #include <vector>
 #include <algorithm>
 
@@ -78,6 +84,8 @@ const char *glean_inventory_new(
     const int32_t *versions,
     SharedSubroutine * const *typecheckers,
     SharedSubroutine * const *traversals,
+    SharedSubroutine * const *substituters,
+    const uint64_t *hashes,
     Inventory **inventory) {
   return ffi::wrap([=]{
     std::vector<rts::Predicate> predicates;
@@ -88,7 +96,12 @@ const char *glean_inventory_new(
         std::string(static_cast<const char *>(name_ptrs[i]), name_sizes[i]),
         versions[i],
         typecheckers[i]->value,
-        traversals[i]->value
+        traversals[i]->value,
+        // no substitution means that the predicate has no fact refs
+        substituters[i] ? substituters[i]->value : nullptr,
+        substituters[i] != nullptr,
+        // two words per predicate
+        PredicateHash{hashes[2*i], hashes[2*i+1]}
       });
     }
     *inventory = new Inventory(std::move(predicates));
@@ -230,6 +243,36 @@ void glean_interrupt_running_queries() {
   interruptRunningQueries();
 }
 
+const char *glean_cursor_table_new(
+    size_t capacity,
+    uint64_t ttl_ms,
+    CursorTable **table) {
+  return ffi::wrap([=] {
+    *table = new CursorTable(
+      CursorTable::Options{capacity, std::chrono::milliseconds(ttl_ms)});
+  });
+}
+
+void glean_cursor_table_free(CursorTable *table) {
+  ffi::free_(table);
+}
+
+void glean_cursor_table_close(CursorTable *table) {
+  table->close();
+}
+
+namespace {
+
+folly::Optional<folly::ByteRange> cacheKey(const void *key, size_t size) {
+  if (key) {
+    return folly::ByteRange(static_cast<const unsigned char *>(key), size);
+  } else {
+    return folly::none;
+  }
+}
+
+}
+
 const char *glean_query_execute_compiled(
     Inventory *inventory,
     Define *facts,
@@ -244,6 +287,10 @@ const char *glean_query_execute_compiled(
     uint64_t *expand_pids,
     uint64_t num_expand_pids,
     uint64_t want_stats,
+    uint64_t want_profile,
+    CursorTable *cursors,
+    const void *cache_key,
+    size_t cache_key_size,
     QueryResults **presults
 ) {
   return ffi::wrap([=]() {
@@ -267,7 +314,9 @@ const char *glean_query_execute_compiled(
         static_cast<Depth>(depth),
         expandPids,
         want_stats,
-        folly::none
+        want_profile,
+        cursors,
+        cacheKey(cache_key, cache_key_size)
       ).release();
   });
 }
@@ -285,6 +334,10 @@ const char *glean_query_restart_compiled(
     uint64_t *expand_pids,
     uint64_t num_expand_pids,
     uint64_t want_stats,
+    uint64_t want_profile,
+    CursorTable *cursors,
+    const void *cache_key,
+    size_t cache_key_size,
     QueryResults **presults
 ) {
   return ffi::wrap([=]() {
@@ -305,11 +358,22 @@ const char *glean_query_restart_compiled(
         static_cast<Depth>(depth),
         expandPids,
         want_stats,
+        want_profile,
+        cursors,
+        cacheKey(cache_key, cache_key_size),
         cont, cont_size
       ).release();
   });
 }
 
+void glean_query_set_subroutine_cache_capacity(size_t capacity) {
+  SubroutineCache::global().setCapacity(capacity);
+}
+
+void glean_query_set_result_cache_capacity(size_t capacity) {
+  QueryCache::global().setCapacity(capacity);
+}
+
 void glean_lookup_free(Lookup *lookup) {
   ffi::free_(lookup);
 }
@@ -395,6 +459,84 @@ const char *glean_define_untrusted_batch(
   });
 }
 
+const char *glean_substitute_batch(
+    Inventory *inventory,
+    const int64_t *base,
+    size_t base_size,
+    int64_t batch_first_id,
+    size_t batch_count,
+    const void *batch_facts_data,
+    size_t batch_facts_size,
+    int64_t *first_id,
+    void **facts,
+    size_t *facts_size) {
+  return ffi::wrap([=] {
+    binary::Output output;
+    *first_id = substituteBatch(
+      *inventory,
+      folly::Range<const Id *>(reinterpret_cast<const Id *>(base), base_size),
+      Id::fromThrift(batch_first_id),
+      batch_count,
+      folly::ByteRange(
+        static_cast<const unsigned char *>(batch_facts_data),
+        batch_facts_size),
+      output).toThrift();
+    ffi::clone_bytes(output.bytes()).release_to(facts, facts_size);
+  });
+}
+
+namespace {
+
+// The size of the data in a zstd frame, which must be recorded in the frame
+// header and at most max_size. This is checked before decompressing so that
+// a small frame can't make us allocate an arbitrary amount of memory.
+size_t zstdSize(
+    folly::io::Codec& codec,
+    const void *data,
+    size_t size,
+    size_t max_size) {
+  auto buf = folly::IOBuf::wrapBufferAsValue(data, size);
+  auto length = codec.getUncompressedLength(&buf);
+  if (!length) {
+    rts::error("compressed batch doesn't record its size");
+  }
+  if (*length > max_size) {
+    rts::error(
+      "compressed batch too large: {} bytes, limit {}", *length, max_size);
+  }
+  return *length;
+}
+
+}
+
+const char *glean_batch_zstd_size(
+    const void *data,
+    size_t size,
+    size_t max_size,
+    size_t *facts_size) {
+  return ffi::wrap([=] {
+    auto codec = folly::io::getCodec(folly::io::CodecType::ZSTD);
+    *facts_size = zstdSize(*codec, data, size, max_size);
+  });
+}
+
+const char *glean_batch_decompress_zstd(
+    const void *data,
+    size_t size,
+    size_t max_size,
+    void **facts,
+    size_t *facts_size) {
+  return ffi::wrap([=] {
+    auto codec = folly::io::getCodec(folly::io::CodecType::ZSTD);
+    auto length = zstdSize(*codec, data, size, max_size);
+    // the codec fails if the data doesn't decompress to exactly length bytes
+    ffi::clone_bytes(codec->uncompress(
+        folly::StringPiece(static_cast<const char *>(data), size),
+        length))
+      .release_to(facts, facts_size);
+  });
+}
+
 
 const char *glean_new_subst(
     int64_t first,
@@ -752,6 +894,131 @@ const char *glean_push_fact(
 }
 
 
+const char *glean_json_fact_schema_new(
+    const void *data,
+    size_t size,
+    JsonFactSchema **schema) {
+  return ffi::wrap([=] {
+    *schema = JsonFactSchema::decode(
+      {static_cast<const unsigned char *>(data), size}).release();
+  });
+}
+
+void glean_json_fact_schema_free(JsonFactSchema *schema) {
+  ffi::free_(schema);
+}
+
+namespace {
+
+void convertJsonFactsTo(
+    JsonFactSchema *schema,
+    folly::ByteRange input,
+    int64_t first_id,
+    bool no_base64_binary,
+    size_t *count,
+    void **facts,
+    size_t *facts_size,
+    int64_t **ids,
+    size_t *owned_count,
+    void **owned_names,
+    size_t **owned_name_sizes,
+    int64_t **owned_ranges) {
+  JsonFactOptions opts;
+  opts.no_base64_binary = no_base64_binary;
+  auto result = convertJsonFacts(
+    *schema,
+    input,
+    Id::fromThrift(first_id),
+    opts);
+  *count = result.count;
+  result.facts.moveBytes().release_to(facts, facts_size);
+  *ids = ffi::clone_array(result.ids.data(), result.ids.size()).release();
+
+  const auto n = result.owned.size();
+  binary::Output names;
+  auto sizes = ffi::malloc_array<size_t>(n);
+  auto ranges = ffi::malloc_array<int64_t>(2 * n);
+  for (size_t i = 0; i < n; ++i) {
+    const auto& [unit, range] = result.owned[i];
+    names.put(binary::byteRange(unit));
+    sizes.get()[i] = unit.size();
+    ranges.get()[2 * i] = range.first.toThrift();
+    ranges.get()[2 * i + 1] = range.second.toThrift();
+  }
+  *owned_count = n;
+  size_t names_size;
+  names.moveBytes().release_to(owned_names, &names_size);
+  *owned_name_sizes = sizes.release();
+  *owned_ranges = ranges.release();
+}
+
+}
+
+const char *glean_json_facts_convert(
+    JsonFactSchema *schema,
+    const void *data,
+    size_t size,
+    int64_t first_id,
+    bool no_base64_binary,
+    size_t *count,
+    void **facts,
+    size_t *facts_size,
+    int64_t **ids,
+    size_t *owned_count,
+    void **owned_names,
+    size_t **owned_name_sizes,
+    int64_t **owned_ranges) {
+  return ffi::wrap([=] {
+    convertJsonFactsTo(
+      schema,
+      {static_cast<const unsigned char *>(data), size},
+      first_id,
+      no_base64_binary,
+      count,
+      facts,
+      facts_size,
+      ids,
+      owned_count,
+      owned_names,
+      owned_name_sizes,
+      owned_ranges);
+  });
+}
+
+const char *glean_json_facts_convert_file(
+    JsonFactSchema *schema,
+    const char *path,
+    int64_t first_id,
+    bool no_base64_binary,
+    size_t *count,
+    void **facts,
+    size_t *facts_size,
+    int64_t **ids,
+    size_t *owned_count,
+    void **owned_names,
+    size_t **owned_name_sizes,
+    int64_t **owned_ranges) {
+  return ffi::wrap([=] {
+    // Map the file rather than reading it, the conversion makes a single
+    // pass over it.
+    folly::MemoryMapping input(path);
+    input.advise(MADV_SEQUENTIAL);
+    convertJsonFactsTo(
+      schema,
+      input.range(),
+      first_id,
+      no_base64_binary,
+      count,
+      facts,
+      facts_size,
+      ids,
+      owned_count,
+      owned_names,
+      owned_name_sizes,
+      owned_ranges);
+  });
+}
+
 size_t glean_string_demangle_trusted(
     const uint8_t *start,
     size_t size,
@@ -999,9 +1266,16 @@ void glean_define_ownership_free(DefineOwnership *def) {
 const char *glean_derived_ownership_compute(
   Ownership *own,
   DerivedFactOwnershipIterator *iter,
+  size_t memory_limit,
+  const char *spill_dir,
+  size_t threads,
   ComputedOwnership **result) {
   return ffi::wrap([=] {
-    *result = computeDerivedOwnership(*own, iter).release();
+    DerivedOwnershipOptions opts;
+    opts.memory_limit = memory_limit;
+    opts.spill_dir = spill_dir;
+    opts.threads = threads;
+    *result = computeDerivedOwnership(*own, iter, opts).release();
   });
 }
 
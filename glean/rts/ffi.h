@@ -41,7 +41,9 @@ typedef struct Lookup Lookup;
 typedef struct Define Define;
 typedef struct FactSet FactSet;
 typedef struct Inventory Inventory;
+typedef struct JsonFactSchema JsonFactSchema;
 typedef struct LookupCache LookupCache;
+typedef struct CursorTable CursorTable;
 typedef struct Predicate Predicate;
 typedef struct Substitution Substitution;
 typedef struct QueryResults QueryResults;
@@ -99,6 +101,8 @@ const char *glean_inventory_new(
   const int32_t *versions,
   SharedSubroutine * const *typecheckers,
   SharedSubroutine * const *traversals,
+  SharedSubroutine * const *substituters,
+  const uint64_t *hashes,
   Inventory **inventory
 );
 void glean_inventory_free(
@@ -179,6 +183,18 @@ void glean_lookupcache_anchor_free(
   Lookup *anchor
 );
 
+const char *glean_cursor_table_new(
+  size_t capacity,
+  uint64_t ttl_ms,
+  CursorTable **table
+);
+void glean_cursor_table_free(
+  CursorTable *table
+);
+void glean_cursor_table_close(
+  CursorTable *table
+);
+
 const char *glean_query_execute_compiled(
   Inventory *inventory,
   Define *facts,
@@ -193,6 +209,10 @@ const char *glean_query_execute_compiled(
   uint64_t *expand_pids,
   uint64_t num_expand_pids,
   uint64_t want_stats,
+  uint64_t want_profile,
+  CursorTable *cursors,
+  const void *cache_key,
+  size_t cache_key_size,
   QueryResults **presults
 );
 
@@ -209,9 +229,21 @@ const char *glean_query_restart_compiled(
   uint64_t *expand_pids,
   uint64_t num_expand_pids,
   uint64_t want_stats,
+  uint64_t want_profile,
+  CursorTable *cursors,
+  const void *cache_key,
+  size_t cache_key_size,
   QueryResults **results
 );
 
+void glean_query_set_subroutine_cache_capacity(
+  size_t capacity
+);
+
+void glean_query_set_result_cache_capacity(
+  size_t capacity
+);
+
 void glean_lookup_free(
   Lookup *lookup
 );
@@ -254,6 +286,34 @@ const char *glean_define_untrusted_batch(
   Substitution **subst
 );
 
+const char *glean_substitute_batch(
+  Inventory *inventory,
+  const int64_t *base,
+  size_t base_size,
+  int64_t batch_first_id,
+  size_t batch_count,
+  const void *batch_facts_data,
+  size_t batch_facts_size,
+  int64_t *first_id,
+  void **facts,
+  size_t *facts_size
+);
+
+const char *glean_batch_zstd_size(
+  const void *data,
+  size_t size,
+  size_t max_size,
+  size_t *facts_size
+);
+
+const char *glean_batch_decompress_zstd(
+  const void *data,
+  size_t size,
+  size_t max_size,
+  void **facts,
+  size_t *facts_size
+);
+
 const char *glean_new_subst(
   int64_t first,
   size_t size,
@@ -437,6 +497,47 @@ const char *glean_push_fact(
   size_t key_size
 );
 
+const char *glean_json_fact_schema_new(
+  const void *data,
+  size_t size,
+  JsonFactSchema **schema
+);
+
+void glean_json_fact_schema_free(
+  JsonFactSchema *schema
+);
+
+const char *glean_json_facts_convert(
+  JsonFactSchema *schema,
+  const void *data,
+  size_t size,
+  int64_t first_id,
+  bool no_base64_binary,
+  size_t *count,
+  void **facts,
+  size_t *facts_size,
+  int64_t **ids,
+  size_t *owned_count,
+  void **owned_names,
+  size_t **owned_name_sizes,
+  int64_t **owned_ranges
+);
+
+const char *glean_json_facts_convert_file(
+  JsonFactSchema *schema,
+  const char *path,
+  int64_t first_id,
+  bool no_base64_binary,
+  size_t *count,
+  void **facts,
+  size_t *facts_size,
+  int64_t **ids,
+  size_t *owned_count,
+  void **owned_names,
+  size_t **owned_name_sizes,
+  int64_t **owned_ranges
+);
+
 size_t glean_string_demangle_trusted(
   const uint8_t *start,
   size_t size,
@@ -575,6 +676,9 @@ void glean_define_ownership_free(DefineOwnership *def);
 const char *glean_derived_ownership_compute(
   Ownership *own,
   DerivedFactOwnershipIterator *iter,
+  size_t memory_limit,
+  const char *spill_dir,
+  size_t threads,
   ComputedOwnership **result
 );
 
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "glean/rts/flatten.h"
+#include "glean/rts/binary.h"
+#include "glean/rts/error.h"
+#include "glean/rts/substitution.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+size_t flatten(
+    const Inventory& inventory,
+    Lookup& source,
+    Id start,
+    size_t batch_bytes,
+    const std::function<void(FactSet&)>& commit) {
+  const auto first = source.startingId();
+  Substitution subst(first, distance(first, source.firstFreeId()));
+
+  // Facts are enumerated in id order, so everything a fact refers to has
+  // been copied by the time we get to it. Ownership slices are closed under
+  // references which means that this holds for sliced stacks, too.
+  Substituter substituter(&subst);
+
+  auto batch = std::make_unique<FactSet>(start);
+  size_t count = 0;
+  for (auto iter = source.enumerate(); auto ref = iter->get(); iter->next()) {
+    auto pred = inventory.lookupPredicate(ref.type);
+    if (pred == nullptr) {
+      error("invalid predicate id {}", ref.type);
+    }
+    binary::Output out;
+    uint64_t key_size;
+    pred->substitute(substituter, ref.clause, out, key_size);
+    auto id =
+      batch->define(ref.type, Fact::Clause::from(out.bytes(), key_size));
+    if (!id) {
+      error("invalid fact redefinition ({})", pred->name);
+    }
+    subst.set(ref.id, id);
+    ++count;
+
+    if (batch->factMemory() >= batch_bytes) {
+      commit(*batch);
+      batch = std::make_unique<FactSet>(batch->firstFreeId());
+    }
+  }
+  if (batch->size() != 0) {
+    commit(*batch);
+  }
+  return count;
+}
+
+}
+}
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "glean/rts/factset.h"
+#include "glean/rts/inventory.h"
+#include "glean/rts/lookup.h"
+
+#include <functional>
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+/// Copy every fact visible through 'source' - typically a stack of
+/// databases with the ownership slices of the stack applied - into a dense
+/// range of ids beginning at 'start', renaming the references between facts
+/// as they are copied. The copies are passed to 'commit' in batches of about
+/// 'batch_bytes' each, every batch starting where the previous one ended.
+///
+/// Returns the number of facts copied.
+size_t flatten(
+  const Inventory& inventory,
+  Lookup& source,
+  Id start,
+  size_t batch_bytes,
+  const std::function<void(FactSet&)>& commit);
+
+}
+}
+}
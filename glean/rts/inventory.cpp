@@ -11,6 +11,7 @@
 #include "glean/rts/fact.h"
 #include "glean/rts/inventory.h"
 
+#include <folly/container/F14Map.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
 namespace facebook {
@@ -44,6 +45,35 @@ Inventory::Inventory(std::vector<Predicate> ps) {
     const auto i = distance(first_id, p.id);
     preds[i] = std::move(p);
   }
+  attachNative();
+}
+
+void Inventory::attachNative() {
+  for (const auto& schema : nativeSchemas()) {
+    folly::F14FastMap<std::pair<uint64_t, uint64_t>, const NativePredicate *>
+      by_hash;
+    for (const auto& native : schema.predicates) {
+      by_hash.insert({{native.hash.hi, native.hash.lo}, &native});
+    }
+    auto pids = std::make_shared<std::vector<Pid>>(
+      schema.count, Pid::invalid());
+    std::vector<std::pair<Predicate *, const NativePredicate *>> matched;
+    for (auto& p : preds) {
+      if (p.id && p.hash && !p.native) {
+        auto i = by_hash.find({p.hash->hi, p.hash->lo});
+        if (i != by_hash.end()) {
+          (*pids)[i->second->index] = p.id;
+          matched.push_back({&p, i->second});
+        }
+      }
+    }
+    // The hash of a predicate covers the predicates it refers to, so these
+    // are all in the table now.
+    for (auto [p, native] : matched) {
+      p->native = native;
+      p->native_pids = pids;
+    }
+  }
 }
 
 const Predicate * FOLLY_NULLABLE Inventory::lookupPredicate(Pid id) const & {
@@ -78,6 +108,15 @@ std::string Inventory::serialize() const {
       ser.ref()->version() = p.version;
       ser.typechecker() = Subroutine::toThrift(*p.typechecker);
       ser.traverser() =  Subroutine::toThrift(*p.traverser);
+      if (p.substitution) {
+        ser.substituter() = Subroutine::toThrift(*p.substitution);
+      }
+      ser.has_refs() = p.has_refs;
+      if (p.hash) {
+        ser.hash() = {};
+        ser.hash()->hi() = static_cast<int64_t>(p.hash->hi);
+        ser.hash()->lo() = static_cast<int64_t>(p.hash->lo);
+      }
       inv.predicates()->push_back(std::move(ser));
     }
   }
@@ -95,7 +134,16 @@ Inventory Inventory::deserialize(folly::ByteRange bytes) {
       ser.get_ref().get_name(),
       ser.get_ref().get_version(),
       Subroutine::fromThrift(ser.get_typechecker()),
-      Subroutine::fromThrift(ser.get_traverser())
+      Subroutine::fromThrift(ser.get_traverser()),
+      ser.substituter().has_value()
+        ? Subroutine::fromThrift(*ser.substituter())
+        : nullptr,
+      *ser.has_refs(),
+      ser.hash().has_value()
+        ? folly::Optional<PredicateHash>(PredicateHash{
+            static_cast<uint64_t>(*ser.hash()->hi()),
+            static_cast<uint64_t>(*ser.hash()->lo())})
+        : folly::none
       });
   };
   return Inventory(std::move(preds));
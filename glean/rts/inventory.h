@@ -11,9 +11,11 @@
 #include "glean/rts/fact.h"
 #include "glean/rts/id.h"
 #include "glean/rts/lookup.h"
+#include "glean/rts/native.h"
 #include "glean/rts/substitution.h"
 #include "glean/rts/bytecode/subroutine.h"
 
+#include <folly/Optional.h>
 #include <vector>
 
 namespace facebook {
@@ -94,6 +96,26 @@ struct Predicate {
   /// const void * - end of clause/value
   std::shared_ptr<Subroutine> traverser;
 
+  /// Substitution for clauses which are known to be type correct. Takes the
+  /// same arguments as the typechecker but only rewrites fact IDs, copying
+  /// everything else unchanged. If it is null, substitution falls back to
+  /// the typechecker.
+  std::shared_ptr<Subroutine> substitution = nullptr;
+
+  /// Whether clauses can contain fact IDs at all. If not, substitution is a
+  /// plain copy.
+  bool has_refs = true;
+
+  /// Hash of the predicate definition, if known. This is used to find
+  /// natively compiled subroutines for the predicate.
+  folly::Optional<PredicateHash> hash = folly::none;
+
+  /// Natively compiled subroutines which take precedence over the bytecode,
+  /// set up by the Inventory (see NativeSchema). native_pids maps the
+  /// predicates of the native schema to Pids.
+  const NativePredicate * FOLLY_NULLABLE native = nullptr;
+  std::shared_ptr<const std::vector<Pid>> native_pids = nullptr;
+
   bool operator==(const Predicate& other) const;
   bool operator!=(const Predicate& other) const {
     return !(*this == other);
@@ -104,7 +126,12 @@ struct Predicate {
       Fact::Clause clause,
       binary::Output& output,
       uint64_t& key_size) const {
-    runTypecheck(*typechecker, renamer, clause, output, key_size);
+    if (native) {
+      native->typecheck(
+          native_pids->data(), renamer, clause, output, key_size);
+    } else {
+      runTypecheck(*typechecker, renamer, clause, output, key_size);
+    }
   }
 
   void substitute(
@@ -112,9 +139,19 @@ struct Predicate {
       Fact::Clause clause,
       binary::Output& output,
       uint64_t& key_size) const {
-    // TODO: We implement substitution via the typechecker for now but it we
-    // might want to generate a more efficient subroutine just for substitution.
-    typecheck(substituter.renamer, clause, output, key_size);
+    if (native) {
+      native->substitute(
+          native_pids->data(), substituter.renamer, clause, output, key_size);
+    } else if (!has_refs) {
+      output.put(clause.key());
+      key_size = output.size();
+      output.put(clause.value());
+    } else if (substitution) {
+      runTypecheck(
+          *substitution, substituter.renamer, clause, output, key_size);
+    } else {
+      typecheck(substituter.renamer, clause, output, key_size);
+    }
   }
 
   static void runTypecheck(
@@ -136,7 +173,11 @@ struct Predicate {
   void traverse(
       const Traverser& handler,
       Fact::Clause clause) const {
-    runTraverse(*traverser, handler, clause);
+    if (native) {
+      native->traverse(native_pids->data(), handler, clause);
+    } else {
+      runTraverse(*traverser, handler, clause);
+    }
   }
 
   static void runTraverse(
@@ -187,6 +228,10 @@ public:
   }
 
 private:
+  /// Use the native subroutines of registered NativeSchemas for predicates
+  /// with matching hashes.
+  void attachNative();
+
   Pid first_id;
   std::vector<Predicate> preds;
     // an INVALID Predicate::id means there is no predicate with that id
@@ -0,0 +1,1154 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "glean/rts/jsonfacts.h"
+#include "glean/rts/error.h"
+#include "glean/rts/fact.h"
+
+#include <folly/Conv.h>
+#include <folly/CpuId.h>
+#include <folly/Optional.h>
+
+#if __x86_64__
+#include <immintrin.h>
+#endif
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+namespace {
+
+std::string decodeString(binary::Input& input) {
+  auto size = input.fixed<uint64_t>();
+  return binary::mkString(input.bytes(size));
+}
+
+}
+
+const JsonType *JsonFactSchema::decodeType(binary::Input& input) {
+  auto ty = std::make_unique<JsonType>();
+  auto kind = input.fixed<uint8_t>();
+  if (kind > static_cast<uint8_t>(JsonType::Kind::Bool)) {
+    error("invalid JSON schema type {}", kind);
+  }
+  ty->kind = static_cast<JsonType::Kind>(kind);
+  switch (ty->kind) {
+    case JsonType::Kind::Array:
+    case JsonType::Kind::Maybe:
+      ty->elem = decodeType(input);
+      break;
+
+    case JsonType::Kind::Record:
+    case JsonType::Kind::Sum: {
+      auto n = input.fixed<uint64_t>();
+      for (uint64_t i = 0; i < n; ++i) {
+        auto name = decodeString(input);
+        auto field = decodeType(input);
+        ty->fields.push_back({std::move(name), field});
+      }
+      if (ty->kind == JsonType::Kind::Sum && n == 0) {
+        error("empty sum type in JSON schema");
+      }
+      break;
+    }
+
+    case JsonType::Kind::Predicate:
+    case JsonType::Kind::Enum:
+      ty->arg = input.fixed<uint64_t>();
+      break;
+
+    default:
+      break;
+  }
+  types.push_back(std::move(ty));
+  return types.back().get();
+}
+
+std::unique_ptr<JsonFactSchema> JsonFactSchema::decode(folly::ByteRange bytes) {
+  auto schema = std::make_unique<JsonFactSchema>();
+  binary::Input input(bytes);
+  auto preds = input.fixed<uint64_t>();
+  for (uint64_t i = 0; i < preds; ++i) {
+    auto pid = Pid::fromWord(input.fixed<uint64_t>());
+    auto key = schema->decodeType(input);
+    auto value = schema->decodeType(input);
+    schema->by_pid.insert({pid, Predicate{pid, key, value}});
+  }
+  auto names = input.fixed<uint64_t>();
+  for (uint64_t i = 0; i < names; ++i) {
+    auto name = decodeString(input);
+    auto version = input.fixed<uint64_t>();
+    auto pid = Pid::fromWord(input.fixed<uint64_t>());
+    if (!schema->by_pid.count(pid)) {
+      error("JSON schema: unknown pid {} for {}.{}", pid, name, version);
+    }
+    schema->by_name[name][version] = pid;
+  }
+  if (!input.empty()) {
+    error("JSON schema: extra bytes at end");
+  }
+  return schema;
+}
+
+const JsonFactSchema::Predicate * FOLLY_NULLABLE
+JsonFactSchema::lookup(Pid pid) const {
+  auto i = by_pid.find(pid);
+  return i != by_pid.end() ? &i->second : nullptr;
+}
+
+const JsonFactSchema::Predicate * FOLLY_NULLABLE
+JsonFactSchema::lookup(folly::StringPiece name, uint64_t version) const {
+  auto i = by_name.find(name);
+  if (i != by_name.end()) {
+    auto j = i->second.find(version);
+    if (j != i->second.end()) {
+      return lookup(j->second);
+    }
+  }
+  return nullptr;
+}
+
+namespace {
+
+/// Bitmasks of the characters in a 64 byte block
+struct Masks {
+  uint64_t backslash;
+  uint64_t quote;
+  uint64_t op;
+};
+
+/// Kernels for classifying blocks of the input. There is a scalar
+/// implementation and a SIMD one, and we pick the one the CPU supports at
+/// runtime.
+struct Kernels {
+  Masks (*classify)(const unsigned char *p);
+
+  /// Bits set from each odd set bit up to (not including) the next one
+  uint64_t (*prefixXor)(uint64_t x);
+};
+
+namespace scalar {
+
+Masks classify(const unsigned char *p) {
+  Masks m{0, 0, 0};
+  for (size_t i = 0; i < 64; ++i) {
+    const uint64_t bit = uint64_t(1) << i;
+    switch (p[i]) {
+      case '\\': m.backslash |= bit; break;
+      case '"': m.quote |= bit; break;
+      case '{': case '}': case '[': case ']': case ':': case ',':
+        m.op |= bit;
+        break;
+      default:
+        break;
+    }
+  }
+  return m;
+}
+
+uint64_t prefixXor(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+const Kernels kernels{classify, prefixXor};
+
+}
+
+#if __x86_64__
+
+#define GLEAN_AVX2 __attribute__((target("avx2,pclmul")))
+
+namespace avx2 {
+
+GLEAN_AVX2 FOLLY_ALWAYS_INLINE Masks masks(__m256i v) {
+  const auto bs = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+  const auto qt = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+  // '[' | 0x20 == '{' and ']' | 0x20 == '}'
+  const auto lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  const auto op = _mm256_or_si256(
+    _mm256_or_si256(
+      _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')),
+      _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+    _mm256_or_si256(
+      _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+      _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+  return Masks{
+    static_cast<uint32_t>(_mm256_movemask_epi8(bs)),
+    static_cast<uint32_t>(_mm256_movemask_epi8(qt)),
+    static_cast<uint32_t>(_mm256_movemask_epi8(op))};
+}
+
+GLEAN_AVX2 Masks classify(const unsigned char *p) {
+  auto lo = masks(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+  auto hi =
+    masks(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)));
+  return Masks{
+    lo.backslash | (hi.backslash << 32),
+    lo.quote | (hi.quote << 32),
+    lo.op | (hi.op << 32)};
+}
+
+GLEAN_AVX2 uint64_t prefixXor(uint64_t x) {
+  return _mm_cvtsi128_si64(_mm_clmulepi64_si128(
+    _mm_set_epi64x(0, x), _mm_set1_epi8(-1), 0));
+}
+
+const Kernels kernels{classify, prefixXor};
+
+}
+
+#undef GLEAN_AVX2
+
+#endif
+
+const Kernels* kernelsFor(JsonFactsKernels k) {
+  switch (k) {
+#if __x86_64__
+    case JsonFactsKernels::AVX2: {
+      folly::CpuId cpu;
+      return cpu.avx2() && cpu.pclmuldq() ? &avx2::kernels : nullptr;
+    }
+#else
+    case JsonFactsKernels::AVX2:
+      return nullptr;
+#endif
+    case JsonFactsKernels::Scalar:
+      return &scalar::kernels;
+  }
+  return nullptr;
+}
+
+const Kernels*& currentKernelsPtr() {
+  static const Kernels* current = kernelsFor(bestJsonFactsKernels());
+  return current;
+}
+
+const Kernels& currentKernels() {
+  return *currentKernelsPtr();
+}
+
+/// Stage 1: find the structural characters of the input, a window at a
+/// time.
+///
+/// This follows simdjson: each 64 byte block is classified into bitmasks of
+/// backslashes, quotes and structural characters, escaped characters are
+/// found by looking for odd-length runs of backslashes and the parts of the
+/// block inside strings are computed with a prefix xor of the unescaped
+/// quotes. The tokens are the structural characters outside of strings
+/// along with all unescaped quotes, so every string is delimited by two
+/// consecutive tokens.
+///
+/// Only the positions for one window of the input exist at any time; the
+/// state carried between blocks is two words.
+class Tokens {
+public:
+  Tokens(folly::ByteRange input, size_t window)
+    : input(input), window((std::max(window, size_t(64)) + 63) & ~size_t(63))
+    {}
+
+  /// Position of the next token or input.size() if there are none left.
+  size_t peek() {
+    while (next == toks.size()) {
+      if (indexed == input.size()) {
+        return input.size();
+      }
+      refill();
+    }
+    return base + toks[next];
+  }
+
+  void pop() {
+    ++next;
+  }
+
+  /// Restart indexing at pos which must not be inside a string.
+  void seek(size_t pos) {
+    toks.clear();
+    next = 0;
+    indexed = pos;
+    prev_escaped = 0;
+    prev_in_string = 0;
+  }
+
+private:
+  // Characters preceded by an odd number of backslashes
+  uint64_t escaped(uint64_t backslash) {
+    const uint64_t even = 0x5555555555555555ULL;
+    backslash &= ~prev_escaped;
+    const uint64_t follows = (backslash << 1) | prev_escaped;
+    const uint64_t odd_starts = backslash & ~even & ~follows;
+    uint64_t even_ends;
+    prev_escaped = __builtin_add_overflow(odd_starts, backslash, &even_ends);
+    return (even ^ (even_ends << 1)) & follows;
+  }
+
+  void block(const unsigned char *p, uint32_t offset) {
+    const auto m = kernels.classify(p);
+    const auto quote = m.quote & ~escaped(m.backslash);
+    const auto in_string = kernels.prefixXor(quote) ^ prev_in_string;
+    prev_in_string = static_cast<uint64_t>(
+      static_cast<int64_t>(in_string) >> 63);
+    auto bits = (m.op & ~in_string) | quote;
+    while (bits != 0) {
+      toks.push_back(offset + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+
+  void refill() {
+    toks.clear();
+    next = 0;
+    base = indexed;
+    const auto end = std::min(base + window, input.size());
+    const auto full = base + ((end - base) & ~size_t(63));
+    auto p = input.data();
+    for (size_t i = base; i < full; i += 64) {
+      block(p + i, i - base);
+    }
+    if (full < end) {
+      unsigned char buf[64];
+      std::memset(buf, ' ', sizeof(buf));
+      std::memcpy(buf, p + full, end - full);
+      block(buf, full - base);
+    }
+    indexed = end;
+  }
+
+  const Kernels& kernels = currentKernels();
+  folly::ByteRange input;
+  size_t window;
+
+  std::vector<uint32_t> toks;
+  size_t next = 0;
+  size_t base = 0;
+  size_t indexed = 0;
+  uint64_t prev_escaped = 0;
+  uint64_t prev_in_string = 0;
+};
+
+inline bool isSpace(unsigned char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+void appendUtf8(std::string& s, uint32_t c) {
+  if (c < 0x80) {
+    s += static_cast<char>(c);
+  } else if (c < 0x800) {
+    s += static_cast<char>(0xC0 | (c >> 6));
+    s += static_cast<char>(0x80 | (c & 0x3F));
+  } else if (c < 0x10000) {
+    s += static_cast<char>(0xE0 | (c >> 12));
+    s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+    s += static_cast<char>(0x80 | (c & 0x3F));
+  } else {
+    s += static_cast<char>(0xF0 | (c >> 18));
+    s += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+    s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+    s += static_cast<char>(0x80 | (c & 0x3F));
+  }
+}
+
+const int8_t BASE64[256] = {
+#define X -1
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X, 62,  X,  X,  X, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61, X,  X,  X,  X,  X,  X,
+  X,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, X,  X,  X,  X,  X,
+  X, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+#undef X
+};
+
+/// Stage 2: a recursive descent over the tokens, guided by the schema, which
+/// produces binary values as it goes.
+class Converter {
+public:
+  Converter(
+      const JsonFactSchema& schema,
+      folly::ByteRange input,
+      Id first_id,
+      const JsonFactOptions& opts,
+      JsonFacts& out)
+    : schema(schema)
+    , opts(opts)
+    , input(input)
+    , tokens(input, opts.window)
+    , first_id(first_id)
+    , next_id(first_id)
+    , out(out)
+    {}
+
+  void batches() {
+    expect('[');
+    if (!emptyArray()) {
+      do {
+        batch();
+      } while (nextElement());
+    }
+    whitespace(input.size());
+    if (tokens.peek() != input.size()) {
+      fail("trailing characters");
+    }
+  }
+
+private:
+  // Per-depth scratch buffers
+  struct Level {
+    binary::Output array;
+    binary::Output clause;
+    binary::Output value;
+    std::vector<binary::Output> fields;
+    std::vector<bool> present;
+    std::string string;
+  };
+
+  [[noreturn]] void fail(folly::StringPiece msg) {
+    error("invalid JSON facts at offset {}: {}", cur, msg);
+  }
+
+  [[noreturn]] void typeError(const JsonType& ty) {
+    static const char *expecting[] = {
+      "number", "number", "string", "array", "object", "object",
+      "fact ID or fact", "number", "value", "true or false"
+    };
+    fail(folly::sformat(
+      "expecting {}", expecting[static_cast<size_t>(ty.kind)]));
+  }
+
+  unsigned char at(size_t pos) const {
+    return pos < input.size() ? input[pos] : 0;
+  }
+
+  // Check that there is only whitespace between cur and pos
+  void whitespace(size_t pos) {
+    for (; cur < pos; ++cur) {
+      if (!isSpace(input[cur])) {
+        fail("unexpected character");
+      }
+    }
+  }
+
+  // Consume the next token, which must be c
+  void expect(unsigned char c) {
+    auto t = tokens.peek();
+    whitespace(t);
+    if (at(t) != c) {
+      fail(folly::sformat("expecting '{}'", static_cast<char>(c)));
+    }
+    tokens.pop();
+    cur = t + 1;
+  }
+
+  // Consume the next token if it is c and only whitespace precedes it
+  bool consume(unsigned char c) {
+    auto t = tokens.peek();
+    if (at(t) != c) {
+      return false;
+    }
+    for (auto p = cur; p < t; ++p) {
+      if (!isSpace(input[p])) {
+        return false;
+      }
+    }
+    tokens.pop();
+    cur = t + 1;
+    return true;
+  }
+
+  // Position of the first character of the next value
+  size_t start() {
+    auto p = cur;
+    while (p < input.size() && isSpace(input[p])) {
+      ++p;
+    }
+    return p;
+  }
+
+  // The text of a number or literal, which ends at the next token
+  folly::StringPiece scalar() {
+    auto p = start();
+    auto t = tokens.peek();
+    if (p >= t) {
+      return {};
+    }
+    auto e = t;
+    while (isSpace(input[e - 1])) {
+      --e;
+    }
+    cur = t;
+    return {reinterpret_cast<const char *>(input.data()) + p,
+            reinterpret_cast<const char *>(input.data()) + e};
+  }
+
+  bool integer(int64_t& result) {
+    auto s = scalar();
+    auto p = s.begin();
+    bool neg = p != s.end() && *p == '-';
+    if (neg) {
+      ++p;
+    }
+    if (p == s.end() || (*p == '0' && p + 1 != s.end())) {
+      return false;
+    }
+    uint64_t n = 0;
+    for (; p != s.end(); ++p) {
+      const unsigned d = *p - '0';
+      if (d > 9 || n > (uint64_t(INT64_MAX) + neg - d) / 10) {
+        return false;
+      }
+      n = n * 10 + d;
+    }
+    result = neg ? static_cast<int64_t>(0 - n) : static_cast<int64_t>(n);
+    return true;
+  }
+
+  int64_t integer(const JsonType& ty) {
+    int64_t n;
+    if (!integer(n)) {
+      typeError(ty);
+    }
+    return n;
+  }
+
+  bool emptyArray() {
+    return consume(']');
+  }
+
+  // After an element or member, consume ',' (true) or the closing bracket
+  bool nextElement() {
+    return next(']');
+  }
+
+  bool nextMember() {
+    return next('}');
+  }
+
+  bool next(unsigned char close) {
+    auto t = tokens.peek();
+    whitespace(t);
+    auto c = at(t);
+    if (c != ',' && c != close) {
+      fail(folly::sformat("expecting ',' or '{}'", static_cast<char>(close)));
+    }
+    tokens.pop();
+    cur = t + 1;
+    return c == ',';
+  }
+
+  // A string, decoded into buf if it contains escapes
+  folly::StringPiece string(std::string& buf) {
+    auto t = tokens.peek();
+    whitespace(t);
+    if (at(t) != '"') {
+      fail("expecting string");
+    }
+    tokens.pop();
+    auto e = tokens.peek();
+    if (at(e) != '"') {
+      cur = t;
+      fail("unterminated string");
+    }
+    tokens.pop();
+    cur = e + 1;
+    auto p = input.data() + t + 1;
+    auto end = input.data() + e;
+    for (auto q = p; q != end; ++q) {
+      if (*q == '\\' || *q < 0x20) {
+        return unescape(p, q, end, buf);
+      }
+    }
+    return {reinterpret_cast<const char *>(p),
+            reinterpret_cast<const char *>(end)};
+  }
+
+  folly::StringPiece unescape(
+      const unsigned char *p,
+      const unsigned char *q,
+      const unsigned char *end,
+      std::string& buf) {
+    buf.assign(p, q);
+    auto hex4 = [&]() {
+      if (end - q < 4) {
+        fail("invalid \\u escape");
+      }
+      uint32_t c = 0;
+      for (int i = 0; i < 4; ++i) {
+        auto d = *q++;
+        c <<= 4;
+        if (d >= '0' && d <= '9') {
+          c |= d - '0';
+        } else if ((d | 0x20) >= 'a' && (d | 0x20) <= 'f') {
+          c |= (d | 0x20) - 'a' + 10;
+        } else {
+          fail("invalid \\u escape");
+        }
+      }
+      return c;
+    };
+    while (q != end) {
+      auto c = *q++;
+      if (c < 0x20) {
+        fail("control character in string");
+      } else if (c != '\\') {
+        buf += static_cast<char>(c);
+        continue;
+      }
+      if (q == end) {
+        fail("invalid escape");
+      }
+      switch (*q++) {
+        case '"': buf += '"'; break;
+        case '\\': buf += '\\'; break;
+        case '/': buf += '/'; break;
+        case 'b': buf += '\b'; break;
+        case 'f': buf += '\f'; break;
+        case 'n': buf += '\n'; break;
+        case 'r': buf += '\r'; break;
+        case 't': buf += '\t'; break;
+        case 'u': {
+          auto u = hex4();
+          if (u >= 0xD800 && u < 0xDC00) {
+            if (end - q < 2 || q[0] != '\\' || q[1] != 'u') {
+              fail("unpaired surrogate");
+            }
+            q += 2;
+            auto l = hex4();
+            if (l < 0xDC00 || l >= 0xE000) {
+              fail("unpaired surrogate");
+            }
+            u = 0x10000 + ((u - 0xD800) << 10) + (l - 0xDC00);
+          } else if (u >= 0xDC00 && u < 0xE000) {
+            fail("unpaired surrogate");
+          }
+          appendUtf8(buf, u);
+          break;
+        }
+        default:
+          fail("invalid escape");
+      }
+    }
+    return buf;
+  }
+
+  void base64(folly::StringPiece s, binary::Output& output) {
+    while (!s.empty() && s.back() == '=') {
+      s.pop_back();
+    }
+    if (s.size() % 4 == 1) {
+      fail("invalid base64");
+    }
+    const auto rest = s.size() % 4;
+    output.packed(s.size() / 4 * 3 + (rest == 0 ? 0 : rest - 1));
+    uint32_t acc = 0;
+    size_t bits = 0;
+    for (unsigned char c : s) {
+      auto d = BASE64[c];
+      if (d < 0) {
+        fail("invalid base64");
+      }
+      acc = (acc << 6) | d;
+      bits += 6;
+      if (bits >= 8) {
+        bits -= 8;
+        output.fixed<uint8_t>(acc >> bits);
+      }
+    }
+  }
+
+  Level& level(size_t depth) {
+    if (depth > opts.recursion_limit) {
+      fail("nesting too deep");
+    }
+    while (levels.size() <= depth) {
+      levels.push_back(std::make_unique<Level>());
+    }
+    return *levels[depth];
+  }
+
+  void value(const JsonType& ty, binary::Output& output, size_t depth) {
+    switch (ty.kind) {
+      case JsonType::Kind::Byte:
+        output.fixed<uint8_t>(static_cast<uint8_t>(integer(ty)));
+        break;
+
+      case JsonType::Kind::Nat:
+        output.packed(static_cast<uint64_t>(integer(ty)));
+        break;
+
+      case JsonType::Kind::String:
+        if (at(start()) != '"') {
+          typeError(ty);
+        }
+        output.mangleString(folly::ByteRange(string(level(depth).string)));
+        break;
+
+      case JsonType::Kind::Array: {
+        auto p = start();
+        if (ty.elem->kind == JsonType::Kind::Byte && at(p) == '"') {
+          auto s = string(level(depth).string);
+          if (opts.no_base64_binary) {
+            output.packed(s.size());
+            output.put(folly::ByteRange(s));
+          } else {
+            base64(s, output);
+          }
+        } else if (at(p) == '[') {
+          expect('[');
+          if (emptyArray()) {
+            output.packed(0);
+            break;
+          }
+          auto& elems = level(depth).array;
+          elems.clear();
+          size_t n = 0;
+          do {
+            value(*ty.elem, elems, depth + 1);
+            ++n;
+          } while (nextElement());
+          output.packed(n);
+          output.put(elems.bytes());
+        } else {
+          typeError(ty);
+        }
+        break;
+      }
+
+      case JsonType::Kind::Record:
+        if (at(start()) != '{') {
+          typeError(ty);
+        }
+        record(ty, output, depth);
+        break;
+
+      case JsonType::Kind::Sum: {
+        if (at(start()) != '{') {
+          typeError(ty);
+        }
+        expect('{');
+        if (consume('}')) {
+          fail("expecting exactly one alternative");
+        }
+        auto k = field(ty, string(level(depth).string));
+        expect(':');
+        output.packed(k);
+        value(*ty.fields[k].type, output, depth + 1);
+        if (nextMember()) {
+          fail("expecting exactly one alternative");
+        }
+        break;
+      }
+
+      case JsonType::Kind::Predicate:
+        if (at(start()) == '{') {
+          auto pred = schema.lookup(Pid::fromWord(ty.arg));
+          if (pred == nullptr) {
+            fail("unknown predicate");
+          }
+          output.packed(fact(*pred, depth));
+        } else {
+          auto n = integer(ty);
+          if (n == 0) {
+            fail("cannot use 0 as a fact ID");
+          }
+          output.packed(static_cast<uint64_t>(n));
+        }
+        break;
+
+      case JsonType::Kind::Enum: {
+        auto n = integer(ty);
+        if (n < 0 || static_cast<uint64_t>(n) >= ty.arg) {
+          typeError(ty);
+        }
+        output.packed(static_cast<uint64_t>(n));
+        break;
+      }
+
+      case JsonType::Kind::Maybe:
+        output.packed(1);
+        value(*ty.elem, output, depth);
+        break;
+
+      case JsonType::Kind::Bool: {
+        auto s = scalar();
+        if (s == "true") {
+          output.packed(1);
+        } else if (s == "false") {
+          output.packed(0);
+        } else {
+          typeError(ty);
+        }
+        break;
+      }
+    }
+  }
+
+  size_t field(const JsonType& ty, folly::StringPiece name, size_t hint = 0) {
+    const auto n = ty.fields.size();
+    for (size_t i = 0; i < n; ++i) {
+      auto k = hint + i < n ? hint + i : hint + i - n;
+      if (ty.fields[k].name == name) {
+        return k;
+      }
+    }
+    fail(folly::sformat("unknown field '{}'", name));
+  }
+
+  // Fields are written straight to the output while they arrive in order,
+  // out of order ones are buffered and missing ones get default values.
+  void record(const JsonType& ty, binary::Output& output, size_t depth) {
+    expect('{');
+    const auto n = ty.fields.size();
+    auto& l = level(depth);
+    bool buffered = false;
+    size_t done = 0;
+    if (!consume('}')) {
+      do {
+        auto k = field(ty, string(l.string), done);
+        expect(':');
+        if (k < done || (buffered && l.present[k])) {
+          fail(folly::sformat("duplicate field '{}'", ty.fields[k].name));
+        }
+        if (k == done) {
+          value(*ty.fields[k].type, output, depth + 1);
+          ++done;
+          while (buffered && done < n && l.present[done]) {
+            output.put(l.fields[done].bytes());
+            l.present[done] = false;
+            ++done;
+          }
+        } else {
+          if (!buffered) {
+            if (l.fields.size() < n) {
+              l.fields.resize(n);
+            }
+            l.present.assign(n, false);
+            buffered = true;
+          }
+          l.fields[k].clear();
+          value(*ty.fields[k].type, l.fields[k], depth + 1);
+          l.present[k] = true;
+        }
+      } while (nextMember());
+    }
+    for (; done < n; ++done) {
+      if (buffered && l.present[done]) {
+        output.put(l.fields[done].bytes());
+      } else {
+        defaultValue(*ty.fields[done].type, output);
+      }
+    }
+  }
+
+  void defaultValue(const JsonType& ty, binary::Output& output) {
+    switch (ty.kind) {
+      case JsonType::Kind::Byte:
+        output.fixed<uint8_t>(0);
+        break;
+
+      case JsonType::Kind::String:
+        output.mangleString({});
+        break;
+
+      case JsonType::Kind::Record:
+        for (const auto& f : ty.fields) {
+          defaultValue(*f.type, output);
+        }
+        break;
+
+      case JsonType::Kind::Sum:
+        output.packed(0);
+        defaultValue(*ty.fields[0].type, output);
+        break;
+
+      case JsonType::Kind::Predicate:
+        fail("no default for a predicate reference; "
+             "JSON might be missing a predicate ref, "
+             "or include one in an unexpected location");
+
+      default:
+        // Nat, Array, Enum, Maybe, Bool
+        output.packed(0);
+        break;
+    }
+  }
+
+  // A fact {"id": N, "key": ..., "value": ...} which is a reference if it
+  // only has an id. Returns the fact's id.
+  Id fact(const JsonFactSchema::Predicate& pred, size_t depth) {
+    auto bad = [&]() {
+      fail("expecting a fact {[\"id\": N, ] \"key\": ... [, \"value\": ...]}");
+    };
+    if (at(start()) != '{') {
+      bad();
+    }
+    expect('{');
+    auto& l = level(depth);
+    l.clause.clear();
+    bool has_id = false, has_key = false, has_value = false;
+    int64_t id = 0;
+    size_t key_size = 0;
+    if (!consume('}')) {
+      do {
+        auto name = string(l.string);
+        expect(':');
+        if (name == "id" && !has_id) {
+          if (!integer(id)) {
+            bad();
+          }
+          has_id = true;
+        } else if (name == "key" && !has_key) {
+          value(*pred.key, l.clause, depth + 1);
+          key_size = l.clause.size();
+          if (has_value) {
+            l.clause.put(l.value.bytes());
+          }
+          has_key = true;
+        } else if (name == "value" && !has_value) {
+          if (has_key) {
+            value(*pred.value, l.clause, depth + 1);
+          } else {
+            l.value.clear();
+            value(*pred.value, l.value, depth + 1);
+          }
+          has_value = true;
+        } else {
+          bad();
+        }
+      } while (nextMember());
+    }
+    if (has_id && !has_key && !has_value) {
+      if (id == 0) {
+        fail("cannot use 0 as a fact ID");
+      }
+      return Id::fromWord(id);
+    }
+    if (!has_key) {
+      bad();
+    }
+    if (has_id && id >= static_cast<int64_t>(first_id.toWord())) {
+      fail(folly::sformat("id too high: {}", id));
+    }
+    Fact::serialize(
+      out.facts,
+      pred.pid,
+      Fact::Clause::from(l.clause.bytes(), key_size));
+    out.ids.push_back(has_id ? id : 0);
+    ++out.count;
+    return next_id++;
+  }
+
+  const JsonFactSchema::Predicate& predicate() {
+    auto& buf = level(0).string;
+    if (at(start()) == '"') {
+      auto ref = string(buf);
+      auto dot = ref.rfind('.');
+      if (dot != folly::StringPiece::npos) {
+        auto version = folly::tryTo<uint64_t>(ref.subpiece(dot + 1));
+        if (version.hasValue()) {
+          return predicate(ref.subpiece(0, dot), *version);
+        }
+      }
+      return predicate(ref, 1);
+    }
+    expect('{');
+    std::string name;
+    int64_t version = -1;
+    if (!consume('}')) {
+      do {
+        auto key = string(buf);
+        expect(':');
+        if (key == "name") {
+          name = string(buf).str();
+        } else if (key == "version") {
+          if (!integer(version)) {
+            fail("invalid predicate version");
+          }
+        } else {
+          skip();
+        }
+      } while (nextMember());
+    }
+    if (name.empty() || version < 0) {
+      fail("expecting a predicate name and version");
+    }
+    return predicate(name, version);
+  }
+
+  const JsonFactSchema::Predicate& predicate(
+      folly::StringPiece name,
+      uint64_t version) {
+    auto pred = schema.lookup(name, version);
+    if (pred == nullptr) {
+      fail(folly::sformat("unknown predicate {}.{}", name, version));
+    }
+    return *pred;
+  }
+
+  void facts(const JsonFactSchema::Predicate& pred) {
+    expect('[');
+    if (!emptyArray()) {
+      do {
+        fact(pred, 1);
+      } while (nextElement());
+    }
+  }
+
+  // Skip a value without interpreting it
+  void skip() {
+    auto p = start();
+    auto t = tokens.peek();
+    if (p < t) {
+      cur = t;
+      return;
+    }
+    auto c = at(t);
+    if (c == '"') {
+      std::string buf;
+      string(buf);
+    } else if (c == '{' || c == '[') {
+      size_t depth = 0;
+      do {
+        t = tokens.peek();
+        if (t == input.size()) {
+          fail("unexpected end of input");
+        }
+        c = at(t);
+        tokens.pop();
+        if (c == '{' || c == '[') {
+          ++depth;
+        } else if (c == '}' || c == ']') {
+          --depth;
+        }
+      } while (depth != 0);
+      cur = t + 1;
+    } else {
+      fail("expecting value");
+    }
+  }
+
+  // {"predicate": ..., "facts": [...], "unit": ...}
+  //
+  // When "facts" comes before "predicate" we don't know how to convert them
+  // yet so we remember where they are and come back to them.
+  void batch() {
+    expect('{');
+    const JsonFactSchema::Predicate *pred = nullptr;
+    folly::Optional<size_t> deferred;
+    bool has_facts = false;
+    std::string unit;
+    bool has_unit = false;
+    const auto before = next_id;
+    if (!consume('}')) {
+      do {
+        auto key = string(level(0).string);
+        expect(':');
+        if (key == "predicate" && pred == nullptr) {
+          pred = &predicate();
+        } else if (key == "facts" && !has_facts) {
+          has_facts = true;
+          if (pred != nullptr) {
+            facts(*pred);
+          } else {
+            deferred = start();
+            skip();
+          }
+        } else if (key == "unit" && !has_unit) {
+          if (at(start()) == '"') {
+            unit = string(level(0).string).str();
+            has_unit = true;
+          } else if (scalar() != "null") {
+            fail("expecting a string for unit");
+          }
+        } else if (key == "predicate" || key == "facts" || key == "unit") {
+          fail(folly::sformat("duplicate '{}'", key));
+        } else {
+          skip();
+        }
+      } while (nextMember());
+    }
+    if (pred == nullptr) {
+      fail("missing 'predicate'");
+    }
+    if (!has_facts) {
+      fail("missing 'facts'");
+    }
+    if (deferred) {
+      const auto resume = cur;
+      tokens.seek(*deferred);
+      cur = *deferred;
+      facts(*pred);
+      tokens.seek(resume);
+      cur = resume;
+    }
+    if (has_unit && next_id > before) {
+      out.owned.push_back({std::move(unit), {before, next_id - 1}});
+    }
+  }
+
+  const JsonFactSchema& schema;
+  const JsonFactOptions& opts;
+  folly::ByteRange input;
+  Tokens tokens;
+  size_t cur = 0;
+  Id first_id;
+  Id next_id;
+  JsonFacts& out;
+  std::vector<std::unique_ptr<Level>> levels;
+};
+
+}
+
+JsonFacts convertJsonFacts(
+    const JsonFactSchema& schema,
+    folly::ByteRange input,
+    Id first_id,
+    const JsonFactOptions& opts) {
+  JsonFacts facts;
+  Converter(schema, input, first_id, opts, facts).batches();
+  return facts;
+}
+
+JsonFactsKernels bestJsonFactsKernels() {
+#if __x86_64__
+  folly::CpuId cpu;
+  if (cpu.avx2() && cpu.pclmuldq()) {
+    return JsonFactsKernels::AVX2;
+  }
+#endif
+  return JsonFactsKernels::Scalar;
+}
+
+bool selectJsonFactsKernels(JsonFactsKernels k) {
+  if (auto p = kernelsFor(k)) {
+    currentKernelsPtr() = p;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/container/F14Map.h>
+#include <folly/Range.h>
+
+#include "glean/rts/binary.h"
+#include "glean/rts/id.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+/// Schema types as needed for converting JSON facts to binary. Named types
+/// are expanded.
+struct JsonType {
+  enum class Kind : uint8_t {
+    Byte,
+    Nat,
+    String,
+    Array,
+    Record,
+    Sum,
+    Predicate,
+    Enum,
+    Maybe,
+    Bool,
+  };
+
+  struct Field {
+    std::string name;
+    const JsonType *type;
+  };
+
+  Kind kind;
+
+  /// Pid for Predicate, number of values for Enum
+  uint64_t arg = 0;
+
+  /// Element type for Array and Maybe
+  const JsonType * FOLLY_NULLABLE elem = nullptr;
+
+  /// Fields for Record and Sum
+  std::vector<Field> fields;
+};
+
+/// The predicates which can be written as JSON.
+///
+/// The schema is serialised by the Haskell side (see Glean.Write.JSON) as
+/// a sequence of little-endian 64 bit words, bytes and strings (a word with
+/// the size followed by the bytes):
+///
+///   schema    ::= <word count> predicate* <word count> name*
+///   predicate ::= <word pid> type type
+///   name      ::= <string name> <word version> <word pid>
+///   type      ::= <byte kind> ...
+///
+/// The kinds are the values of JsonType::Kind, followed by the element type
+/// (Array, Maybe), the number of fields and the fields as a name and a type
+/// each (Record, Sum) or the Pid or number of values (Predicate, Enum).
+class JsonFactSchema {
+public:
+  struct Predicate {
+    Pid pid;
+    const JsonType *key;
+    const JsonType *value;
+  };
+
+  static std::unique_ptr<JsonFactSchema> decode(folly::ByteRange);
+
+  const Predicate * FOLLY_NULLABLE lookup(Pid pid) const;
+  const Predicate * FOLLY_NULLABLE lookup(
+    folly::StringPiece name,
+    uint64_t version) const;
+
+private:
+  const JsonType *decodeType(binary::Input& input);
+
+  std::vector<std::unique_ptr<JsonType>> types;
+  folly::F14FastMap<Pid, Predicate> by_pid;
+  folly::F14FastMap<std::string, folly::F14FastMap<uint64_t, Pid>> by_name;
+};
+
+struct JsonFactOptions {
+  /// Byte arrays are strings rather than base64-encoded strings
+  bool no_base64_binary = false;
+
+  /// Maximum nesting depth of JSON values
+  size_t recursion_limit = 500;
+
+  /// Number of bytes of input to index at a time, which bounds the memory
+  /// used for parsing.
+  size_t window = 256 * 1024;
+};
+
+/// Facts converted from JSON in the format of thrift::Batch.
+struct JsonFacts {
+  /// Number of facts
+  size_t count = 0;
+
+  /// The facts, serialised with Fact::serialize
+  binary::Output facts;
+
+  /// For each fact, the id it was given in the JSON or 0 if it had none
+  std::vector<int64_t> ids;
+
+  /// For each unit (in order of occurence), the first and last id of a
+  /// range of facts it owns
+  std::vector<std::pair<std::string, std::pair<Id, Id>>> owned;
+};
+
+/// Convert a file of JSON fact batches (as written by indexers and
+/// accepted by glean write) straight to binary facts. The facts get ids
+/// starting from first_id.
+///
+/// This is equivalent to parsing the JSON and calling buildJsonBatch in
+/// Glean.Write.JSON but it streams over the input without ever building a
+/// JSON tree: the input is indexed a window at a time, simdjson-style, and
+/// each fact is typechecked against the schema and encoded as it is parsed.
+JsonFacts convertJsonFacts(
+  const JsonFactSchema& schema,
+  folly::ByteRange input,
+  Id first_id,
+  const JsonFactOptions& opts = {});
+
+/// Implementations of the kernels which find the structural characters of
+/// the input. By default, we use the best one supported by the CPU.
+enum class JsonFactsKernels { Scalar, AVX2 };
+
+/// The best kernels supported by the CPU.
+JsonFactsKernels bestJsonFactsKernels();
+
+/// Switch to the given kernels, returning false if the CPU doesn't support
+/// them. This is not thread safe and is only meant for tests and benchmarks.
+bool selectJsonFactsKernels(JsonFactsKernels);
+
+}
+}
+}
@@ -98,6 +98,113 @@ std::unique_ptr<FactIterator> FactIterator::merge(
   }
 }
 
+namespace {
+
+// Merges any number of iterators with a loser tree. Leaf i is node n+i and
+// internal node k has children 2k and 2k+1; each internal node remembers
+// the loser of the match between the winners of its subtrees. Advancing the
+// overall winner only replays the matches on its path to the root, so next()
+// does O(log n) key comparisons no matter how many iterators there are.
+struct LoserTreeIterator final : FactIterator {
+  LoserTreeIterator(
+      std::vector<std::unique_ptr<FactIterator>> iters,
+      size_t pfxsize)
+    : iters_(std::move(iters))
+    , refs_(iters_.size())
+    , losers_(iters_.size())
+    , prefix_size(pfxsize) {
+    const auto n = iters_.size();
+    for (size_t i = 0; i < n; ++i) {
+      refs_[i] = iters_[i]->get(KeyOnly);
+    }
+    // winners of the subtrees rooted at internal nodes
+    std::vector<size_t> winners(n);
+    auto winner = [&](size_t node) {
+      return node >= n ? node - n : winners[node];
+    };
+    for (size_t k = n - 1; k > 0; --k) {
+      auto l = winner(2*k);
+      auto r = winner(2*k+1);
+      if (beats(r, l)) {
+        std::swap(l, r);
+      }
+      winners[k] = l;
+      losers_[k] = r;
+    }
+    winner_ = n > 1 ? winners[1] : 0;
+  }
+
+  void next() override {
+    auto& iter = iters_[winner_];
+    iter->next();
+    refs_[winner_] = iter->get(KeyOnly);
+    auto w = winner_;
+    for (auto k = (w + iters_.size()) / 2; k > 0; k /= 2) {
+      if (beats(losers_[k], w)) {
+        std::swap(losers_[k], w);
+      }
+    }
+    winner_ = w;
+  }
+
+  Fact::Ref get(Demand demand) override {
+    auto& ref = refs_[winner_];
+    if (ref && demand != KeyOnly) {
+      ref = iters_[winner_]->get(demand);
+    }
+    return ref;
+  }
+
+  // Exhausted iterators lose every match; ties go to the earlier iterator
+  // like in MergeIterator.
+  bool beats(size_t i, size_t j) const {
+    if (!refs_[i]) {
+      return false;
+    } else if (!refs_[j]) {
+      return true;
+    } else {
+      auto c = suffix(refs_[i]).compare(suffix(refs_[j]));
+      return c < 0 || (c == 0 && i < j);
+    }
+  }
+
+  folly::ByteRange suffix(const Fact::Ref& ref) const {
+    assert(prefix_size <= ref.key().size());
+    return {ref.key().begin() + prefix_size, ref.key().end()};
+  }
+
+  std::vector<std::unique_ptr<FactIterator>> iters_;
+  // current fact of each iterator, invalid once it is exhausted
+  std::vector<Fact::Ref> refs_;
+  // losers_[k] is the loser at internal node k, losers_[0] is unused
+  std::vector<size_t> losers_;
+  size_t winner_;
+  const size_t prefix_size;
+};
+
+}
+
+std::unique_ptr<FactIterator> FactIterator::merge(
+    std::vector<std::unique_ptr<FactIterator>> iters,
+    size_t prefix_size) {
+  iters.erase(
+    std::remove_if(iters.begin(), iters.end(), [](const auto& iter) {
+      return !iter->get(KeyOnly);
+    }),
+    iters.end());
+  switch (iters.size()) {
+    case 0:
+      return std::make_unique<EmptyIterator>();
+    case 1:
+      return std::move(iters[0]);
+    case 2:
+      return std::make_unique<MergeIterator>(
+        std::move(iters[0]), std::move(iters[1]), prefix_size);
+    default:
+      return std::make_unique<LoserTreeIterator>(
+        std::move(iters), prefix_size);
+  }
+}
 
 std::unique_ptr<FactIterator> Section::enumerate(Id from, Id upto) {
   if (upto <= lowBoundary() || highBoundary() <= from) {
@@ -121,43 +228,18 @@ std::unique_ptr<FactIterator> Section::enumerateBack(Id from, Id downto) {
 
 std::unique_ptr<FactIterator> Section::seek(
     Pid type, folly::ByteRange start, size_t prefix_size) {
-  struct Iterator final : FactIterator {
-    Iterator(std::unique_ptr<FactIterator> base, Id upto, Id from)
-      : base_(std::move(base)), high_boundary_(upto), low_boundary_(from)
-      {}
-
-    void next() override { base_->next(); }
-
-    Fact::Ref get(Demand demand) override {
-      auto r = base_->get(demand);
-
-      while (r && !isWithinBounds(r.id)) {
-        r = base_->get(demand);
-      }
-
-      return r;
-    }
-
-    bool isWithinBounds(Id id) {
-      return low_boundary_ <= id && id < high_boundary_;
-    }
-
-    std::unique_ptr<FactIterator> base_;
-    Id high_boundary_;
-    Id low_boundary_;
-  };
-  return std::make_unique<Iterator>(
-    base()->seek(type, start, prefix_size),
-    highBoundary(),
-    lowBoundary());
+  return base()->seekWithinSection(
+    type, start, prefix_size, lowBoundary(), highBoundary());
 }
 
 std::unique_ptr<FactIterator> Section::seekWithinSection(
     Pid type, folly::ByteRange start, size_t prefix_size, Id from, Id upto) {
-  if (from <= lowBoundary() && highBoundary() <= upto) {
-    return seek(type, start, prefix_size);
+  from = std::max(from, lowBoundary());
+  upto = std::min(upto, highBoundary());
+  if (upto <= from) {
+    return std::make_unique<EmptyIterator>();
   } else {
-    return Section(base_, from, upto).seek(type, start, prefix_size);
+    return base()->seekWithinSection(type, start, prefix_size, from, upto);
   }
 }
 
@@ -249,6 +331,42 @@ std::unique_ptr<FactIterator> FactIterator::filter(
         std::move(visible));
 }
 
+namespace {
+
+struct SectionIterator final : FactIterator {
+  SectionIterator(std::unique_ptr<FactIterator> base, Id from, Id upto)
+    : base_(std::move(base)), low_boundary_(from), high_boundary_(upto)
+    {}
+
+  void next() override { base_->next(); }
+
+  Fact::Ref get(Demand demand) override {
+    // Check the id before fetching the value of facts we'll skip
+    auto r = base_->get(KeyOnly);
+    while (r && !isWithinBounds(r.id)) {
+      base_->next();
+      r = base_->get(KeyOnly);
+    }
+    return r && demand != KeyOnly ? base_->get(demand) : r;
+  }
+
+  bool isWithinBounds(Id id) const {
+    return low_boundary_ <= id && id < high_boundary_;
+  }
+
+  std::unique_ptr<FactIterator> base_;
+  Id low_boundary_;
+  Id high_boundary_;
+};
+
+}
+
+std::unique_ptr<FactIterator> FactIterator::section(
+    std::unique_ptr<FactIterator> base,
+    Id from,
+    Id upto) {
+  return std::make_unique<SectionIterator>(std::move(base), from, upto);
+}
 
 std::unique_ptr<Lookup> snapshot(Lookup *b, Id upto) {
   return std::make_unique<Section>(Section(b, Id::invalid(), upto));
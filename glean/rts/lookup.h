@@ -12,6 +12,7 @@
 #include "glean/rts/id.h"
 #include "glean/rts/stats.h"
 
+#include <algorithm>
 #include <vector>
 
 namespace facebook {
@@ -41,11 +42,25 @@ struct FactIterator {
     size_t prefix_size
   );
 
+  // Merge any number of iterators, see above. Empty iterators are dropped.
+  static std::unique_ptr<FactIterator> merge(
+    std::vector<std::unique_ptr<FactIterator>> iters,
+    size_t prefix_size
+  );
+
   static std::unique_ptr<FactIterator> append(
     std::unique_ptr<FactIterator> left,
     std::unique_ptr<FactIterator> right
   );
 
+  // Skip all facts with Ids outside of the range [from, upto). This is the
+  // fallback for Lookups which can't bound a seek by Id more efficiently.
+  static std::unique_ptr<FactIterator> section(
+    std::unique_ptr<FactIterator> base,
+    Id from,
+    Id upto
+  );
+
   // Filter the facts of the underlying DB according to the provided
   // visibility function. It is the responsibility of the caller to
   // ensure that the resulting set of facts is valid (has no dangling
@@ -85,6 +100,21 @@ struct Lookup {
   virtual bool factById(
     Id id, std::function<void(Pid, Fact::Clause)> f) = 0;
 
+  // Apply the function to the id, type, key and value of every fact in 'ids'
+  // which exists, in no particular order. The ids must be sorted and
+  // distinct. Implementations which can read many facts more efficiently
+  // than one at a time should override this; the default simply calls
+  // factById for each id.
+  virtual void factsById(
+      folly::Range<const Id*> ids,
+      std::function<void(Id, Pid, Fact::Clause)> f) {
+    for (auto id : ids) {
+      factById(id, [&](Pid type, Fact::Clause clause) {
+        f(id, type, clause);
+      });
+    }
+  }
+
   /// Return a fact id such that no facts in the Enumerate have an id below it.
   /// There is no guarantee that a fact with this particular id exists but fact
   /// ids are supposed to be dense between startingId and firstFreeId.
@@ -132,6 +162,8 @@ struct Lookup {
   // Perform a seek on a section of the Lookup.
   // Results will have Ids within the range [from, utpto).
   // Facts can reference Ids outside of the specified range.
+  // Implementations should avoid visiting facts outside of the section
+  // where they can, as the section is often much smaller than the Lookup.
   virtual std::unique_ptr<FactIterator> seekWithinSection(
     Pid type,
     folly::ByteRange start,
@@ -206,6 +238,14 @@ struct Section : Lookup {
     return isWithinBounds(id) && base()->factById(id, std::move(f));
   }
 
+  void factsById(
+      folly::Range<const Id*> ids,
+      std::function<void(Id, Pid, Fact::Clause)> f) override {
+    auto begin = std::lower_bound(ids.begin(), ids.end(), lowBoundary());
+    auto end = std::lower_bound(begin, ids.end(), highBoundary());
+    base()->factsById({begin, end}, std::move(f));
+  }
+
   Id startingId() const override {
     return std::max(lowBoundary(), std::min(highBoundary(), base()->startingId()));
   }
@@ -8,6 +8,15 @@
 
 #include "glean/rts/nat.h"
 
+#include <algorithm>
+
+#include <folly/CpuId.h>
+#include <folly/Varint.h>
+
+#if __x86_64__
+#include <immintrin.h>
+#endif
+
 namespace facebook {
 namespace glean {
 namespace rts {
@@ -289,6 +298,270 @@ size_t storeNat(unsigned char* out, uint64_t val) {
   }
 }
 
+namespace {
+
+// Bulk decoding of varints. The block functions classify up to 32 encoded
+// bytes at once. There is a scalar implementation and an AVX2 one, and we
+// pick the one the CPU supports at runtime.
+
+FOLLY_ALWAYS_INLINE std::pair<uint64_t, const unsigned char * FOLLY_NULLABLE>
+loadUntrustedVarint(const unsigned char* p, const unsigned char* e) {
+  folly::ByteRange range(p, e);
+  if (auto r = folly::tryDecodeVarint(range)) {
+    return {r.value(), range.begin()};
+  } else {
+    return {0, nullptr};
+  }
+}
+
+/// Decode n varints, handling runs of single-byte varints in bulk and
+/// decoding everything else one by one. Block::singleBytes(p,e) returns the
+/// number of bytes < 0x80 at the start of [p,e), looking at no more than 32
+/// bytes, and Block::widen(p,out,k) zero-extends k bytes into out.
+template <typename Block>
+FOLLY_ALWAYS_INLINE const unsigned char* FOLLY_NULLABLE loadBulk(
+    const unsigned char* p,
+    const unsigned char* e,
+    uint64_t* out,
+    size_t n) {
+  while (n != 0) {
+    const auto k = std::min(Block::singleBytes(p, e), n);
+    Block::widen(p, out, k);
+    p += k;
+    out += k;
+    n -= k;
+    if (n != 0 && (p >= e || *p >= 0x80)) {
+      auto r = loadUntrustedVarint(p, e);
+      if (UNLIKELY(r.second == nullptr)) {
+        return nullptr;
+      }
+      *out++ = r.first;
+      p = r.second;
+      --n;
+    }
+  }
+  return p;
+}
+
+FOLLY_ALWAYS_INLINE const unsigned char* FOLLY_NULLABLE
+skipVarints(const unsigned char* p, const unsigned char* e, size_t n) {
+  for (; n != 0; --n) {
+    auto r = loadUntrustedVarint(p, e);
+    if (UNLIKELY(r.second == nullptr)) {
+      return nullptr;
+    }
+    p = r.second;
+  }
+  return p;
+}
+
+struct Kernels {
+  const unsigned char* FOLLY_NULLABLE (*loadUntrustedVarints)(
+      const unsigned char* p,
+      const unsigned char* e,
+      uint64_t* out,
+      size_t n);
+  const unsigned char* FOLLY_NULLABLE (*skipUntrustedVarints)(
+      const unsigned char* p,
+      const unsigned char* e,
+      size_t n);
+};
+
+namespace scalar {
+
+struct Block {
+  static size_t singleBytes(const unsigned char* p, const unsigned char* e) {
+    size_t k = 0;
+    while (k < 32 && p + k < e && p[k] < 0x80) {
+      ++k;
+    }
+    return k;
+  }
+
+  static void widen(const unsigned char* p, uint64_t* out, size_t k) {
+    for (size_t i = 0; i < k; ++i) {
+      out[i] = p[i];
+    }
+  }
+};
+
+const unsigned char* FOLLY_NULLABLE loadUntrustedVarints(
+    const unsigned char* p,
+    const unsigned char* e,
+    uint64_t* out,
+    size_t n) {
+  return loadBulk<Block>(p, e, out, n);
+}
+
+const unsigned char* FOLLY_NULLABLE
+skipUntrustedVarints(const unsigned char* p, const unsigned char* e, size_t n) {
+  return skipVarints(p, e, n);
+}
+
+const Kernels kernels{loadUntrustedVarints, skipUntrustedVarints};
+
+} // namespace scalar
+
+#if __x86_64__
+
+#define GLEAN_AVX2 __attribute__((target("avx2,bmi2")))
+
+namespace avx2 {
+
+struct Block {
+  GLEAN_AVX2 static size_t singleBytes(
+      const unsigned char* p,
+      const unsigned char* e) {
+    if (e - p >= 32) {
+      const uint32_t high = _mm256_movemask_epi8(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+      return high == 0 ? 32 : __builtin_ctz(high);
+    }
+    return scalar::Block::singleBytes(p, e);
+  }
+
+  GLEAN_AVX2 static void
+  widen(const unsigned char* p, uint64_t* out, size_t k) {
+    for (; k >= 4; k -= 4, p += 4, out += 4) {
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(out),
+          _mm256_cvtepu8_epi64(
+              _mm_cvtsi32_si128(folly::loadUnaligned<int32_t>(p))));
+    }
+    scalar::Block::widen(p, out, k);
+  }
+};
+
+GLEAN_AVX2 const unsigned char* FOLLY_NULLABLE loadUntrustedVarints(
+    const unsigned char* p,
+    const unsigned char* e,
+    uint64_t* out,
+    size_t n) {
+  return loadBulk<Block>(p, e, out, n);
+}
+
+GLEAN_AVX2 const unsigned char* FOLLY_NULLABLE
+skipUntrustedVarints(const unsigned char* p, const unsigned char* e, size_t n) {
+  // Every varint ends in the first byte < 0x80, so we can find the ends of
+  // all varints in a block by looking at the high bits. We only need to
+  // decode varints that might be too long (10 bytes or more).
+  while (n != 0 && e - p >= 32) {
+    const uint32_t more = _mm256_movemask_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+    const uint32_t ends = ~more;
+    const size_t count = __builtin_popcount(ends);
+    if (count != 0) {
+      // the last byte of the last varint we skip in this block
+      const size_t last = count <= n
+          ? 31 - __builtin_clz(ends)
+          : __builtin_ctz(_pdep_u32(1u << (n - 1), ends));
+      // bit i is set if bytes i to i+8 are all continuation bytes
+      uint32_t long_runs = more;
+      for (int i = 1; i < 9; ++i) {
+        long_runs &= more >> i;
+      }
+      const uint32_t skipped = last == 31 ? ~0u : (1u << (last + 1)) - 1;
+      if ((long_runs & skipped) == 0) {
+        p += last + 1;
+        n -= std::min(count, n);
+        continue;
+      }
+    }
+    auto r = loadUntrustedVarint(p, e);
+    if (UNLIKELY(r.second == nullptr)) {
+      return nullptr;
+    }
+    p = r.second;
+    --n;
+  }
+  return skipVarints(p, e, n);
+}
+
+const Kernels kernels{loadUntrustedVarints, skipUntrustedVarints};
+
+} // namespace avx2
+
+#undef GLEAN_AVX2
+
+#endif
+
+const Kernels* kernelsFor(NatKernels k) {
+  switch (k) {
+#if __x86_64__
+    case NatKernels::AVX2: {
+      folly::CpuId cpu;
+      return cpu.avx2() && cpu.bmi2() ? &avx2::kernels : nullptr;
+    }
+#else
+    case NatKernels::AVX2:
+      return nullptr;
+#endif
+    case NatKernels::Scalar:
+      return &scalar::kernels;
+  }
+  return nullptr;
+}
+
+const Kernels*& currentKernels() {
+  static const Kernels* current = kernelsFor(bestNatKernels());
+  return current;
+}
+
+} // namespace
+
+NatKernels bestNatKernels() {
+#if __x86_64__
+  folly::CpuId cpu;
+  if (cpu.avx2() && cpu.bmi2()) {
+    return NatKernels::AVX2;
+  }
+#endif
+  return NatKernels::Scalar;
+}
+
+bool selectNatKernels(NatKernels k) {
+  if (auto p = kernelsFor(k)) {
+    currentKernels() = p;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+const unsigned char* FOLLY_NULLABLE loadUntrustedVarints(
+    const unsigned char* p,
+    const unsigned char* e,
+    uint64_t* out,
+    size_t n) {
+  return currentKernels()->loadUntrustedVarints(p, e, out, n);
+}
+
+const unsigned char* FOLLY_NULLABLE
+skipUntrustedVarints(const unsigned char* p, const unsigned char* e, size_t n) {
+  return currentKernels()->skipUntrustedVarints(p, e, n);
+}
+
+size_t storeVarints(unsigned char* out, const uint64_t* vals, size_t n) {
+  // Copy runs of values < 0x80 in bulk
+  const auto start = out;
+  size_t i = 0;
+  while (i < n) {
+    for (; i + 4 <= n &&
+         ((vals[i] | vals[i + 1] | vals[i + 2] | vals[i + 3]) < 0x80);
+         i += 4, out += 4) {
+      out[0] = static_cast<unsigned char>(vals[i]);
+      out[1] = static_cast<unsigned char>(vals[i + 1]);
+      out[2] = static_cast<unsigned char>(vals[i + 2]);
+      out[3] = static_cast<unsigned char>(vals[i + 3]);
+    }
+    if (i < n) {
+      out += folly::encodeVarint(vals[i], out);
+      ++i;
+    }
+  }
+  return out - start;
+}
+
 } // namespace rts
 } // namespace glean
 } // namespace facebook
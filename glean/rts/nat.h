@@ -153,6 +153,47 @@ inline constexpr size_t MAX_NAT_SIZE = 9;
 /// taken up by the encoding. This assumes that the buffer has enough space.
 size_t storeNat(unsigned char* out, uint64_t val);
 
+// Bulk decoding and encoding of varints
+//
+// Arrays of numbers are usually dominated by small values. The bulk
+// functions classify the lengths of a whole block of encoded numbers at
+// once and handle runs of single-byte numbers without decoding them one by
+// one. They work on the varints (folly/Varint.h) which are used for numbers
+// in fact keys and values.
+
+/// Check and decode n varints into out. Return a pointer to the first byte
+/// after the last varint or NULL if any of them is invalid or the buffer is
+/// too short.
+const unsigned char* FOLLY_NULLABLE loadUntrustedVarints(
+    const unsigned char* p, // pointer to first byte
+    const unsigned char* e, // pointer to end of buffer
+    uint64_t* out,
+    size_t n);
+
+/// Check and skip over n varints. Return a pointer to the first byte after
+/// the last varint or NULL if any of them is invalid or the buffer is too
+/// short.
+const unsigned char* FOLLY_NULLABLE skipUntrustedVarints(
+    const unsigned char* p, // pointer to first byte
+    const unsigned char* e, // pointer to end of buffer
+    size_t n);
+
+/// Encode and store n numbers as varints in the buffer and return the number
+/// of bytes taken up by the encodings. This assumes that the buffer has
+/// enough space (n * folly::kMaxVarintLength64 bytes are always enough).
+size_t storeVarints(unsigned char* out, const uint64_t* vals, size_t n);
+
+/// Implementations of the bulk decoders. By default, we use the best one
+/// supported by the CPU.
+enum class NatKernels { Scalar, AVX2 };
+
+/// The best kernels supported by the CPU.
+NatKernels bestNatKernels();
+
+/// Switch to the given kernels, returning false if the CPU doesn't support
+/// them. This is not thread safe and is only meant for tests and benchmarks.
+bool selectNatKernels(NatKernels);
+
 /// A stack-allocated encoded nat
 struct EncodedNat {
   explicit EncodedNat(uint64_t val) {
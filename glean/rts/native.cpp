@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "glean/rts/native.h"
+
+#include <mutex>
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+namespace {
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<NativeSchema> schemas;
+};
+
+// Registration happens during static initialisation so this can't be a
+// global.
+Registry& registry() {
+  static Registry r;
+  return r;
+}
+
+}
+
+void registerNativeSchema(NativeSchema schema) {
+  auto& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.schemas.push_back(schema);
+}
+
+std::vector<NativeSchema> nativeSchemas() {
+  auto& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  return r.schemas;
+}
+
+}
+}
+}
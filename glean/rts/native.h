@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "glean/rts/binary.h"
+#include "glean/rts/fact.h"
+#include "glean/rts/id.h"
+
+#include <folly/Range.h>
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+struct Renamer;
+struct Traverser;
+
+/// The hash of a predicate definition (see PredicateId in
+/// Glean.Angle.Types). Two predicates with the same hash have the same name,
+/// version and key/value types.
+struct PredicateHash {
+  uint64_t hi;
+  uint64_t lo;
+
+  bool operator==(const PredicateHash& other) const {
+    return hi == other.hi && lo == other.lo;
+  }
+  bool operator!=(const PredicateHash& other) const {
+    return !(*this == other);
+  }
+};
+
+/// Natively compiled versions of the subroutines of a Predicate, generated
+/// ahead of time from a schema (see glean/cpp/native.h). They behave exactly
+/// like the bytecode but take an extra argument, a table which maps the
+/// index of each predicate in the schema to its Pid in the Inventory.
+struct NativePredicate {
+  using Typecheck = void (*)(
+      const Pid* pids,
+      const Renamer& renamer,
+      Fact::Clause clause,
+      binary::Output& output,
+      uint64_t& key_size);
+  using Traverse = void (*)(
+      const Pid* pids,
+      const Traverser& traverser,
+      Fact::Clause clause);
+
+  PredicateHash hash;
+
+  /// Index of the predicate in the schema
+  size_t index;
+
+  /// Typecheck and substitute an untrusted clause
+  Typecheck typecheck;
+
+  /// Substitute a clause which is known to be type correct
+  Typecheck substitute;
+
+  /// Call the traverser for each fact ID in a clause
+  Traverse traverse;
+};
+
+/// The natively compiled predicates of a schema.
+struct NativeSchema {
+  /// Number of predicates in the schema, which is the size of the Pid
+  /// table the subroutines expect.
+  size_t count;
+
+  folly::Range<const NativePredicate*> predicates;
+};
+
+/// Make a NativeSchema available to Inventories constructed afterwards.
+/// Predicates in an Inventory which have a hash that matches one of the
+/// registered predicates will use the native code instead of the bytecode.
+void registerNativeSchema(NativeSchema schema);
+
+/// All registered schemas, in registration order.
+std::vector<NativeSchema> nativeSchemas();
+
+/// Registers a NativeSchema during static initialisation.
+struct NativeSchemaRegistration {
+  explicit NativeSchemaRegistration(NativeSchema schema) {
+    registerNativeSchema(schema);
+  }
+};
+
+}
+}
+}
@@ -6,8 +6,16 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <array>
+#include <filesystem>
 #include <numeric>
-#include <folly/container/F14Map.h>
+#include <thread>
+#include <unistd.h>
+
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
 
 #include "glean/rts/ownership/derived.h"
 #include "glean/rts/timer.h"
@@ -16,18 +24,25 @@ namespace facebook {
 namespace glean {
 namespace rts {
 
-void DefineOwnership::derivedFrom(Id id, const std::set<UsetId>& deps) {
+void DefineOwnership::derivedFrom(Id id, folly::Range<const UsetId*> deps) {
   if (deps.size() == 0) {
     LOG(ERROR) << "DefineOwnership::derivedFrom: empty deps";
     return;
   }
 
-  SetU32 set = SetU32::from(deps);
-
   UsetId usetid;
-  if (set.size() == 1) {
-    usetid = *deps.begin();
+  if (deps.size() == 1) {
+    usetid = deps[0];
+  } else if (lastOwner_ != INVALID_USET &&
+             std::equal(
+                 deps.begin(), deps.end(),
+                 lastDeps_.begin(), lastDeps_.end())) {
+    usetid = lastOwner_;
   } else {
+    SetU32 set;
+    for (auto dep : deps) {
+      set.append(dep);
+    }
     auto uset = std::make_unique<Uset>(set, And, 0);
     size_t size = set.size();
     usetid = ownership_->lookupSet(uset.get());
@@ -46,6 +61,8 @@ void DefineOwnership::derivedFrom(Id id, const std::set<UsetId>& deps) {
     } else {
       VLOG(2) << "existing set in DB: " << usetid;
     }
+    lastDeps_.assign(deps.begin(), deps.end());
+    lastOwner_ = usetid;
   }
 
   if (id >= first_id_) {
@@ -140,9 +157,210 @@ void DefineOwnership::subst(const Substitution& subst) {
   }
 }
 
+namespace {
+
+// (fact, owner) pairs, stored column-wise so that a pair takes 12 bytes.
+struct FactOwners {
+  std::vector<uint64_t> ids;
+  std::vector<UsetId> owners;
+
+  size_t size() const {
+    return ids.size();
+  }
+
+  size_t bytes() const {
+    return ids.size() * (sizeof(uint64_t) + sizeof(UsetId));
+  }
+
+  void clear() {
+    ids.clear();
+    owners.clear();
+  }
+};
+
+// Stable LSD radix sort of the pairs by fact id, 8 bits at a time. Ids
+// are sorted relative to the smallest one, and digits that are the same
+// for every id are skipped, so a dense range of ids takes only as many
+// passes as its span needs.
+//
+// Each pass is split across threads: every thread counts the digits in
+// its own slice of the input and then scatters that slice to offsets
+// reserved for it, which keeps the sort stable.
+void radixSort(FactOwners& buf, size_t threads) {
+  constexpr size_t RADIX = 256;
+  constexpr size_t MIN_PER_THREAD = 1 << 16;
+
+  const size_t n = buf.size();
+  if (n < 2) {
+    return;
+  }
+  const auto [lo, hi] = std::minmax_element(buf.ids.begin(), buf.ids.end());
+  const uint64_t min = *lo;
+  const uint64_t span = *hi - min;
+
+  threads = std::max<size_t>(1, std::min(threads, n / MIN_PER_THREAD));
+  const size_t chunk = (n + threads - 1) / threads;
+  auto parallel = [&](auto&& f) {
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+      workers.emplace_back(f, t);
+    }
+    f(0);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  };
+
+  std::vector<uint64_t> tmp_ids(n);
+  std::vector<UsetId> tmp_owners(n);
+  std::vector<std::array<size_t, RADIX>> counts(threads);
+
+  for (size_t shift = 0; shift < 64 && (span >> shift) != 0; shift += 8) {
+    const uint64_t *src_ids = buf.ids.data();
+    const UsetId *src_owners = buf.owners.data();
+    auto digit = [&](size_t i) {
+      return ((src_ids[i] - min) >> shift) & (RADIX - 1);
+    };
+
+    parallel([&](size_t t) {
+      auto& count = counts[t];
+      count.fill(0);
+      for (size_t i = t * chunk, e = std::min(n, i + chunk); i < e; ++i) {
+        ++count[digit(i)];
+      }
+    });
+
+    // Turn the counts into the offsets that each thread starts writing
+    // each digit at.
+    size_t offset = 0;
+    bool skip = false;
+    for (size_t d = 0; d < RADIX; ++d) {
+      auto start = offset;
+      for (auto& count : counts) {
+        auto k = count[d];
+        count[d] = offset;
+        offset += k;
+      }
+      skip = skip || offset - start == n;
+    }
+    if (skip) {
+      continue;
+    }
+
+    uint64_t *dst_ids = tmp_ids.data();
+    UsetId *dst_owners = tmp_owners.data();
+    parallel([&](size_t t) {
+      auto& offsets = counts[t];
+      for (size_t i = t * chunk, e = std::min(n, i + chunk); i < e; ++i) {
+        auto j = offsets[digit(i)]++;
+        dst_ids[j] = src_ids[i];
+        dst_owners[j] = src_owners[i];
+      }
+    });
+    std::swap(buf.ids, tmp_ids);
+    std::swap(buf.owners, tmp_owners);
+  }
+}
+
+// A sorted run of pairs spilled to a temporary file. The file is unlinked
+// as soon as it has been created, so it goes away when the run is
+// destroyed or the process dies. The run is stored as a sequence of
+// blocks, each consisting of the number of pairs followed by their ids
+// and then their owners.
+class SpilledRun {
+public:
+  static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+  SpilledRun(const std::string& dir, const FactOwners& buf) {
+    auto path = (dir.empty()
+        ? std::filesystem::temp_directory_path()
+        : std::filesystem::path(dir)) / "glean-ownership-XXXXXX";
+    std::string name = path.string();
+    int fd = mkstemp(name.data());
+    if (fd == -1) {
+      error("couldn't create {}: {}", name, folly::errnoStr(errno));
+    }
+    file = folly::File(fd, true);
+    unlink(name.c_str());
+
+    for (size_t i = 0; i < buf.size(); i += BLOCK_SIZE) {
+      uint64_t k = std::min(BLOCK_SIZE, buf.size() - i);
+      write(&k, sizeof(k));
+      write(buf.ids.data() + i, k * sizeof(uint64_t));
+      write(buf.owners.data() + i, k * sizeof(UsetId));
+    }
+    if (lseek(file.fd(), 0, SEEK_SET) == -1) {
+      error("couldn't rewind spilled run: {}", folly::errnoStr(errno));
+    }
+  }
+
+  // Read the next block, returns false at the end of the run.
+  bool read(FactOwners& block) {
+    uint64_t k;
+    if (!read(&k, sizeof(k))) {
+      return false;
+    }
+    block.ids.resize(k);
+    block.owners.resize(k);
+    if (!read(block.ids.data(), k * sizeof(uint64_t)) ||
+        !read(block.owners.data(), k * sizeof(UsetId))) {
+      error("truncated spilled run");
+    }
+    return true;
+  }
+
+private:
+  void write(const void *p, size_t n) {
+    if (folly::writeFull(file.fd(), p, n) != static_cast<ssize_t>(n)) {
+      error("couldn't write spilled run: {}", folly::errnoStr(errno));
+    }
+  }
+
+  bool read(void *p, size_t n) {
+    auto r = folly::readFull(file.fd(), p, n);
+    if (r == -1) {
+      error("couldn't read spilled run: {}", folly::errnoStr(errno));
+    }
+    return static_cast<size_t>(r) == n;
+  }
+
+  folly::File file;
+};
+
+// Reads a sorted run, either from memory or from disk, a block at a time.
+struct RunCursor {
+  FactOwners block;
+  size_t pos = 0;
+  std::unique_ptr<SpilledRun> run;  // null for the in-memory run
+
+  bool valid() const {
+    return pos < block.size();
+  }
+
+  uint64_t id() const {
+    return block.ids[pos];
+  }
+
+  UsetId owner() const {
+    return block.owners[pos];
+  }
+
+  void next() {
+    if (++pos == block.size() && run) {
+      pos = 0;
+      if (!run->read(block)) {
+        block.clear();
+      }
+    }
+  }
+};
+
+}
+
 std::unique_ptr<ComputedOwnership> computeDerivedOwnership(
   Ownership& ownership,
-  DerivedFactOwnershipIterator *iter) {
+  DerivedFactOwnershipIterator *iter,
+  const DerivedOwnershipOptions& opts) {
   auto t = makeAutoTimer("computeDerivedOwnership");
   VLOG(1) << "computing derived ownership";
 
@@ -150,59 +368,111 @@ std::unique_ptr<ComputedOwnership> computeDerivedOwnership(
   // different ways.  e.g. if a fact was derived twice with owners A
   // and B, then its final ownership set will be A || B. That is, the
   // fact will be visibile (derivable) if either A or B are visible.
+  //
+  // There can be hundreds of millions of derived facts, so rather than
+  // keeping a map from fact to owners we collect (fact, owner) pairs in
+  // a flat buffer, sort it by fact and spill it to disk as a sorted run
+  // whenever it gets too big. Merging the runs then produces the owners
+  // of each fact in fact order, which is the order we need for the
+  // intervals.
+
+  const size_t threads = opts.threads != 0
+    ? opts.threads
+    : std::max(1u, std::thread::hardware_concurrency());
 
-  std::map<uint64_t,UsetId> factOwners;
-  folly::F14FastMap<int64_t,std::set<UsetId>> factOwnerSets;
+  FactOwners buf;
+  std::vector<RunCursor> runs;
 
   while (const auto owners = iter->get()) {
-    for (uint32_t i = 0; i < owners->ids.size(); i++) {
-      auto id = owners->ids[i].toWord();
-      auto owner = owners->owners[i];
-      const auto [it, inserted] = factOwners.insert({id, owner});
-      if (!inserted) {
-        const auto [it2, _] = factOwnerSets.insert({id, {it->second}});
-        it2->second.insert(owner);
+    buf.ids.reserve(buf.size() + owners->ids.size());
+    for (auto id : owners->ids) {
+      buf.ids.push_back(id.toWord());
+    }
+    buf.owners.insert(
+        buf.owners.end(), owners->owners.begin(), owners->owners.end());
+    if (buf.bytes() > opts.memory_limit) {
+      radixSort(buf, threads);
+      RunCursor cursor;
+      cursor.run = std::make_unique<SpilledRun>(opts.spill_dir, buf);
+      if (!cursor.run->read(cursor.block)) {
+        cursor.block.clear();
       }
+      runs.push_back(std::move(cursor));
+      buf.clear();
+      VLOG(1) << "computing derived ownership: spilled run " << runs.size();
     }
   }
 
+  radixSort(buf, threads);
+  runs.push_back(RunCursor{std::move(buf)});
+
   // Create all the new sets
   //   we are under the write lock here, so we can create canonical
   //   sets, no need to rebase them later.
 
   Usets usets(ownership.nextSetId());
 
-  for (auto& pair : factOwnerSets) {
-    if (pair.second.size() > 1) {
-      SetU32 set = SetU32::from(pair.second);
+  // Merge the runs, using a heap of runs ordered by their current fact,
+  // and convert the owners into a vector of intervals.
+  auto later = [&](size_t a, size_t b) { return runs[a].id() > runs[b].id(); };
+  std::vector<size_t> heap;
+  for (size_t i = 0; i < runs.size(); ++i) {
+    if (runs[i].valid()) {
+      heap.push_back(i);
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), later);
+
+  std::vector<std::pair<Id,UsetId>> intervals;
+  std::vector<UsetId> owners;
+  UsetId current = INVALID_USET;
+  while (!heap.empty()) {
+    auto id = runs[heap.front()].id();
+    owners.clear();
+    while (!heap.empty() && runs[heap.front()].id() == id) {
+      std::pop_heap(heap.begin(), heap.end(), later);
+      auto& run = runs[heap.back()];
+      do {
+        owners.push_back(run.owner());
+        run.next();
+      } while (run.valid() && run.id() == id);
+      if (run.valid()) {
+        std::push_heap(heap.begin(), heap.end(), later);
+      } else {
+        heap.pop_back();
+      }
+    }
+
+    auto usetid = owners[0];
+    if (owners.size() > 1) {
+      std::sort(owners.begin(), owners.end());
+      owners.erase(std::unique(owners.begin(), owners.end()), owners.end());
+    }
+    if (owners.size() > 1) {
+      SetU32 set;
+      for (auto owner : owners) {
+        set.append(owner);
+      }
       auto uset = std::make_unique<Uset>(std::move(set), Or, 0);
-      auto usetid = ownership.lookupSet(uset.get());
+      usetid = ownership.lookupSet(uset.get());
       if (usetid == INVALID_USET) {
         auto p = usets.add(std::move(uset));
         usets.promote(p);
         usetid = p->id;
-        VLOG(1) << "new set: " << usetid;
+        VLOG(2) << "new set: " << usetid;
       } else {
-        VLOG(1) << "existing set: " << usetid;
+        VLOG(2) << "existing set: " << usetid;
       }
-      factOwners[pair.first] = usetid;
     }
-  }
-
-  auto sets = usets.toEliasFano();
 
-  // convert factOwners into a vector of intervals
-  std::vector<std::pair<Id,UsetId>> intervals;
-  intervals.reserve(factOwners.size());
-  UsetId current = INVALID_USET;
-  for (auto& pair : factOwners) {
-    auto usetid = pair.second;
     if (usetid != current) {
-      intervals.push_back(std::make_pair(Id::fromWord(pair.first), usetid));
+      intervals.push_back(std::make_pair(Id::fromWord(id), usetid));
       current = usetid;
     }
   }
 
+  auto sets = usets.toEliasFano();
+
   VLOG(1) << "computing derived ownership: " <<
     intervals.size() << " intervals";
 
@@ -25,8 +25,9 @@ struct DefineOwnership {
       first_id_(first_id),
       usets_(ownership->nextSetId()) {}
 
-  // record that a fact was derived from some other facts
-  void derivedFrom(Id id, const std::set<UsetId>& deps);
+  // record that a fact was derived from some other facts, given the
+  // owners of those facts in ascending order without duplicates
+  void derivedFrom(Id id, folly::Range<const UsetId*> deps);
 
   UsetId getOwner(Id id) {
     return ownership_->getOwner(id);
@@ -56,6 +57,12 @@ struct DefineOwnership {
   // new sets in order of creation, needed for rebasing the sets against
   // the DB later.
   std::vector<Uset*> newSets_;
+
+  // The owners passed to the last derivedFrom() call and the set we
+  // found for them. Consecutive derived facts usually come from the same
+  // facts, so this saves looking up the same set over and over.
+  std::vector<UsetId> lastDeps_;
+  UsetId lastOwner_ = INVALID_USET;
 };
 
 struct DerivedFactOwnership {
@@ -70,12 +77,26 @@ struct DerivedFactOwnershipIterator {
   virtual folly::Optional<DerivedFactOwnership> get() = 0;
 };
 
+struct DerivedOwnershipOptions {
+  // Sort the buffered (fact, owner) pairs and spill them to disk as a
+  // sorted run when they take up more than this many bytes.
+  size_t memory_limit = size_t(1) << 30;
+
+  // Where to put the spilled runs. Empty means the system temporary
+  // directory.
+  std::string spill_dir;
+
+  // Threads to use for sorting. 0 means the number of hardware threads.
+  size_t threads = 0;
+};
+
 ///
 // Compute ownership data for derived facts
 //
 std::unique_ptr<ComputedOwnership> computeDerivedOwnership(
   Ownership& ownership,
-  DerivedFactOwnershipIterator *iter);
+  DerivedFactOwnershipIterator *iter,
+  const DerivedOwnershipOptions& opts = {});
 
 }
 }
@@ -81,6 +81,12 @@ struct Sliced : Lookup {
     return base_->factById(id, std::move(f));
   }
 
+  void factsById(
+      folly::Range<const Id*> ids,
+      std::function<void(Id, Pid, Fact::Clause)> f) override {
+    base_->factsById(ids, std::move(f));
+  }
+
   Id startingId() const override {
     return base_->startingId();
   }
@@ -6,17 +6,24 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
 #include <chrono>
 #include <atomic>
+#include <map>
 
 #include <folly/Chrono.h>
+#include <folly/small_vector.h>
+#include <folly/hash/SpookyHashV2.h>
 #include <folly/stop_watch.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
 #include "glean/if/gen-cpp2/glean_types.h"
 #include "glean/if/gen-cpp2/glean_constants.h"
 #include "glean/if/gen-cpp2/internal_types.h"
+#include "glean/rts/bytecode/cache.h"
+#include "glean/rts/bytecode/profile.h"
 #include "glean/rts/query.h"
+#include "glean/rts/querycache.h"
 
 
 namespace facebook {
@@ -35,6 +42,57 @@ using Clock = folly::chrono::coarse_steady_clock;
 std::atomic<std::chrono::time_point<Clock>> last_interrupt =
   folly::chrono::coarse_steady_clock::time_point::min();
 
+// Collected when a query is run in profiling mode, see
+// thrift::QueryProfile.
+struct QueryProfiler {
+  SubroutineProfile sub;
+  SubroutineProfile::Counter seek;
+  SubroutineProfile::Counter next;
+  SubroutineProfile::Counter lookupKeyValue;
+
+  struct IterStats {
+    uint64_t seeks = 0;
+    uint64_t facts = 0;
+    uint64_t cycles = 0;
+  };
+
+  // Keyed by (nesting depth, predicate). The depth of an iterator is its
+  // token, so this tells apart the generators of a nested query.
+  std::map<std::pair<uint64_t, uint64_t>, IterStats> iters;
+
+  // Serialize as a thrift::QueryProfile with the compact protocol
+  std::string serialize() const;
+};
+
+std::string QueryProfiler::serialize() const {
+  thrift::QueryProfile profile;
+  auto counter = [](const char *name, const SubroutineProfile::Counter& c) {
+    thrift::QueryProfileCounter out;
+    out.name() = name;
+    out.count() = static_cast<int64_t>(c.count);
+    out.cycles() = static_cast<int64_t>(c.cycles);
+    return out;
+  };
+  for (size_t i = 0; i < sub.ops.size(); ++i) {
+    if (sub.ops[i].count != 0) {
+      profile.ops()->push_back(counter(opNames[i], sub.ops[i]));
+    }
+  }
+  profile.callbacks()->push_back(counter("seek", seek));
+  profile.callbacks()->push_back(counter("next", next));
+  profile.callbacks()->push_back(counter("lookupKeyValue", lookupKeyValue));
+  for (const auto& [key, stats] : iters) {
+    thrift::QueryProfileIterator iter;
+    iter.depth() = static_cast<int64_t>(key.first);
+    iter.predicate() = static_cast<int64_t>(key.second);
+    iter.seeks() = static_cast<int64_t>(stats.seeks);
+    iter.facts() = static_cast<int64_t>(stats.facts);
+    iter.cycles() = static_cast<int64_t>(stats.cycles);
+    profile.iterators()->push_back(std::move(iter));
+  }
+  return apache::thrift::CompactSerializer::serialize<std::string>(profile);
+}
+
 struct QueryExecutor {
 
   // The following methods are all invoked from the compiled query
@@ -99,6 +157,18 @@ struct QueryExecutor {
   void nestedFact(Id id, Pid pid);
   Traverser nestedFact_{[this](Id id, Pid pid) { nestedFact(id,pid); }};
 
+  //
+  // Fetch the pending nested facts, and the facts nested in those, see
+  // resultWithPid(). Returns the size in bytes of the facts fetched.
+  //
+  size_t expandNested();
+
+  //
+  // Record the time spent in a seek() or next() call in the profile
+  //
+  void profileSeek(IterToken token, uint64_t start);
+  void profileNext(IterToken token, bool found, uint64_t start);
+
   //
   // Record a qeury result.
   //
@@ -129,9 +199,27 @@ struct QueryExecutor {
   }
 
   //
-  // Done; collect and return the final results
+  // Done; collect and return the final results. If cacheKey is non-null
+  // and the results can be cached, add them to the result cache.
   //
-  std::unique_ptr<QueryResults> finish();
+  std::unique_ptr<QueryResults> finish(const std::string* cacheKey);
+
+  //
+  // Move the live iterators into the cursor table, if possible, and
+  // record the cursor in the continuation.
+  //
+  void parkIterators();
+
+  //
+  // Seek for a new iterator. Sets 'parkable' if the iterator only refers
+  // to facts that existed when the query started, and not to facts derived
+  // by it, so that it can outlive the request in the cursor table.
+  //
+  std::unique_ptr<FactIterator> seekFacts(
+      Pid type,
+      folly::ByteRange key,
+      size_t prefix_size,
+      bool& parkable);
 
   // ------------------------------------------------------------
   // Below here: query state
@@ -173,15 +261,15 @@ struct QueryExecutor {
   folly::F14FastSet<uint64_t, folly::Hash> results_added;
   std::vector<uint64_t> result_ids;
   std::vector<uint64_t> result_pids;
-  std::vector<HsString> result_keys;
-  std::vector<HsString> result_values;
+  std::vector<std::string> result_keys;
+  std::vector<std::string> result_values;
 
   // nested result facts
   folly::F14FastSet<uint64_t, folly::Hash> nested_results_added;
   std::vector<uint64_t> nested_result_ids;
   std::vector<uint64_t> nested_result_pids;
-  std::vector<HsString> nested_result_keys;
-  std::vector<HsString> nested_result_values;
+  std::vector<std::string> nested_result_keys;
+  std::vector<std::string> nested_result_values;
   std::vector<Id> nested_result_pending;
 
   folly::Optional<thrift::internal::QueryCont> queryCont;
@@ -190,6 +278,24 @@ struct QueryExecutor {
   folly::F14FastMap<uint64_t, uint64_t> stats;
   bool wantStats;
 
+  // if non-null, park the live iterators here when we return a
+  // continuation
+  CursorTable* cursors;
+  // whether the query was stopped by the time limit or an interrupt
+  bool timed_out = false;
+
+  // the first free fact id when the query started: facts below it are
+  // in the DB, facts above it have been derived by this request
+  Id first_free_id;
+
+  // nested fact expansion stats: number of batched fetch rounds and
+  // facts fetched
+  uint64_t expand_rounds = 0;
+  uint64_t expand_facts = 0;
+
+  // if non-null, we're profiling the query
+  std::unique_ptr<QueryProfiler> profile;
+
   // output registers
   std::vector<binary::Output> outputs;
 
@@ -202,6 +308,14 @@ struct QueryExecutor {
     Id id;
     size_t prefix_size;
     bool first;
+    // when profiling, where to count the work done by this iterator
+    QueryProfiler::IterStats* stats = nullptr;
+    // the owner of fact owner_id, cached when computing the ownership of
+    // derived facts
+    Id owner_id = Id::invalid();
+    UsetId owner = INVALID_USET;
+    // whether the iterator may be parked in the cursor table
+    bool parkable = false;
   };
 
   std::vector<Iter> iters;
@@ -209,15 +323,38 @@ struct QueryExecutor {
 
 
 uint64_t QueryExecutor::seek(Pid type, folly::ByteRange key) {
+  auto start = profile ? SubroutineProfile::now() : 0;
   auto token = iters.size();
   DVLOG(5) << "seek(" << type.toWord() << ") = " << token;
-  iters.emplace_back(Iter{facts.seek(type, key, key.size()),
+  bool parkable;
+  iters.emplace_back(Iter{seekFacts(type, key, key.size(), parkable),
                           type, Id::invalid(), key.size(), true});
+  iters.back().parkable = parkable;
+  if (profile) {
+    profileSeek(token, start);
+  }
   return static_cast<uint64_t>(token);
 };
 
+std::unique_ptr<FactIterator> QueryExecutor::seekFacts(
+    Pid type,
+    folly::ByteRange key,
+    size_t prefix_size,
+    bool& parkable) {
+  if (cursors) {
+    if (auto iter = CursorTable::seek(
+          facts, first_free_id, type, key, prefix_size)) {
+      parkable = true;
+      return iter;
+    }
+  }
+  parkable = false;
+  return facts.seek(type, key, prefix_size);
+}
+
 uint64_t QueryExecutor::seekWithinSection(
     Pid type, folly::ByteRange key, Id from, Id upto) {
+  auto start = profile ? SubroutineProfile::now() : 0;
   auto token = iters.size();
   DVLOG(5) << "seekWithinSection(" << type.toWord() << ") = " << token;
   iters.emplace_back(Iter{
@@ -227,9 +364,37 @@ uint64_t QueryExecutor::seekWithinSection(
       key.size(),
       true
   });
+  if (profile) {
+    profileSeek(token, start);
+  }
   return static_cast<uint64_t>(token);
 };
 
+void QueryExecutor::profileSeek(IterToken token, uint64_t start) {
+  auto& iter = iters[token];
+  iter.stats = &profile->iters[{token, iter.type.toWord()}];
+  auto cycles = SubroutineProfile::now() - start;
+  iter.stats->seeks++;
+  iter.stats->cycles += cycles;
+  profile->seek.count++;
+  profile->seek.cycles += cycles;
+}
+
+void QueryExecutor::profileNext(IterToken token, bool found, uint64_t start) {
+  auto& iter = iters[token];
+  if (!iter.stats) {
+    // an iterator restored from a continuation
+    iter.stats = &profile->iters[{token, iter.type.toWord()}];
+  }
+  auto cycles = SubroutineProfile::now() - start;
+  if (found) {
+    iter.stats->facts++;
+  }
+  iter.stats->cycles += cycles;
+  profile->next.count++;
+  profile->next.cycles += cycles;
+}
+
 
 uint64_t QueryExecutor::currentSeek() {
   return iters.size();
@@ -244,6 +409,7 @@ void QueryExecutor::endSeek(uint64_t token) {
 
 
 Fact::Ref QueryExecutor::next(uint64_t token, FactIterator::Demand demand) {
+  auto start = profile ? SubroutineProfile::now() : 0;
   assert(token == iters.size()-1);
   if (iters[token].first) {
     iters[token].first = false;
@@ -258,6 +424,9 @@ Fact::Ref QueryExecutor::next(uint64_t token, FactIterator::Demand demand) {
     }
   }
   DVLOG(5) << "next(" << token << ") = " << (res ? res.id.toWord() : 0);
+  if (profile) {
+    profileNext(token, bool(res), start);
+  }
   return res;
 };
 
@@ -267,6 +436,7 @@ Pid QueryExecutor::lookupKeyValue(
     binary::Output* kout,
     binary::Output* vout) {
   DVLOG(5) << "lookupKeyValue(" << fid.toWord() << ")";
+  auto start = profile ? SubroutineProfile::now() : 0;
   Pid pid;
   facts.factById(fid, [&](Pid pid_, auto clause) {
     pid = pid_;
@@ -279,6 +449,9 @@ Pid QueryExecutor::lookupKeyValue(
       vout->put(clause.value());
     }
   });
+  if (profile) {
+    profile->lookupKeyValue.record(start);
+  }
   return pid;
 };
 
@@ -303,21 +476,29 @@ Id QueryExecutor::newDerivedFact(
   // know its ownership set, which is determined by the facts it was
   // derived from.
   if (ownership) {
-    std::set<UsetId> owners;
+    folly::small_vector<UsetId, 8> owners;
 
     // The Ids can only be facts that we already have computed owners for.
-    for (const auto& iter : iters) {
+    // Outer iterators rarely move between derived facts, so each
+    // iterator remembers the owner of its current fact.
+    for (auto& iter : iters) {
       if (iter.id != Id::invalid()) {
-        auto owner = ownership->getOwner(iter.id);
-        if (owner == INVALID_USET) {
-          VLOG(1) << "fact " << iter.id.toWord() << " has no owner";
-        } else {
-          owners.insert(owner);
+        if (iter.owner_id != iter.id) {
+          iter.owner = ownership->getOwner(iter.id);
+          iter.owner_id = iter.id;
+          if (iter.owner == INVALID_USET) {
+            VLOG(1) << "fact " << iter.id.toWord() << " has no owner";
+          }
+        }
+        if (iter.owner != INVALID_USET) {
+          owners.push_back(iter.owner);
         }
       }
     }
     if (owners.size() > 0) {
-      ownership->derivedFrom(id, owners);
+      std::sort(owners.begin(), owners.end());
+      owners.erase(std::unique(owners.begin(), owners.end()), owners.end());
+      ownership->derivedFrom(id, folly::range(owners));
     }
   }
 
@@ -350,12 +531,25 @@ void QueryExecutor::saveState(uint64_t *pc, uint64_t *frame) {
   }
   cont.outputs() = std::move(contOutputs);
 
+  // The continuation always carries the bytecode, so that any server can
+  // restart it: one without the cache, one running an older version, or
+  // one where the bytecode has been evicted. The hash lets a server which
+  // still has the bytecode cached restart without rebuilding the
+  // Subroutine.
+  auto& cache = SubroutineCache::global();
   thrift::internal::SubroutineState subState;
+  if (cache.enabled()) {
+    auto subHash = SubroutineCache::hash(sub);
+    if (cache.touch(subHash) ||
+        cache.insert(subHash, std::make_shared<Subroutine>(sub))) {
+      subState.code_hash() = std::move(subHash);
+    }
+  }
   subState.code() =
       std::string(reinterpret_cast<const char *>(sub.code.data()),
                   sub.code.size() * sizeof(uint64_t));
-  subState.entry() = pc - sub.code.data();
   subState.literals() = sub.literals;
+  subState.entry() = pc - sub.code.data();
   std::vector<int64_t> locals(sub.locals);
   std::copy(frame + sub.inputs, frame + sub.inputs + sub.locals, locals.data());
   subState.locals() = std::move(locals);
@@ -363,6 +557,12 @@ void QueryExecutor::saveState(uint64_t *pc, uint64_t *frame) {
   cont.sub() = std::move(subState);
   cont.pid() = pid.toWord();
   if (traverse) {
+    if (cache.enabled()) {
+      auto traverseHash = SubroutineCache::hash(*traverse);
+      if (cache.touch(traverseHash) || cache.insert(traverseHash, traverse)) {
+        cont.traverse_hash() = std::move(traverseHash);
+      }
+    }
     cont.traverse() = Subroutine::toThrift(*traverse);
   }
   queryCont = std::move(cont);
@@ -418,115 +618,127 @@ size_t QueryExecutor::resultWithPid(
         predicate->traverse(nestedFact_, clause);
       }
     }
-    while (nested_result_pending.size() > 0) {
-      auto id = nested_result_pending[nested_result_pending.size() - 1];
-      nested_result_pending.pop_back();
-      facts.factById(id, [&](Pid pid_, auto clause) {
-        inventory.lookupPredicate(pid_)->traverse(nestedFact_, clause);
-        nested_result_ids.emplace_back(id.toWord());
-        nested_result_pids.emplace_back(pid_.toWord());
-        auto key = binary::mkString(clause.key());
-        auto val = binary::mkString(clause.value());
-        bytes += sizeof(Id) + key.size() + val.size();
-        nested_result_keys.emplace_back(std::move(key));
-        nested_result_values.emplace_back(std::move(val));
-      });
-    }
+    bytes += expandNested();
   }
   return bytes;
 };
 
 
-std::unique_ptr<QueryResults> QueryExecutor::finish() {
-  auto res = std::make_unique<QueryResults>();
-  res->fact_ids = std::move(result_ids);
-  res->fact_pids = std::move(result_pids);
-  res->fact_keys = std::move(result_keys);
-  res->fact_values = std::move(result_values);
-  res->nested_fact_ids = std::move(nested_result_ids);
-  res->nested_fact_pids = std::move(nested_result_pids);
-  res->nested_fact_keys = std::move(nested_result_keys);
-  res->nested_fact_values = std::move(nested_result_values);
+size_t QueryExecutor::expandNested() {
+  // Expand breadth-first: each round fetches all the facts discovered by
+  // the previous one with a single batched lookup in id order, instead of
+  // chasing one dependent random read at a time.
+  size_t bytes = 0;
+  std::vector<Id> round;
+  while (!nested_result_pending.empty()) {
+    round.swap(nested_result_pending);
+    nested_result_pending.clear();
+    std::sort(round.begin(), round.end());
+    ++expand_rounds;
+    facts.factsById(
+        folly::Range<const Id*>(round.data(), round.size()),
+        [&](Id id, Pid pid_, Fact::Clause clause) {
+          inventory.lookupPredicate(pid_)->traverse(nestedFact_, clause);
+          nested_result_ids.emplace_back(id.toWord());
+          nested_result_pids.emplace_back(pid_.toWord());
+          auto key = binary::mkString(clause.key());
+          auto val = binary::mkString(clause.value());
+          bytes += sizeof(Id) + key.size() + val.size();
+          nested_result_keys.emplace_back(std::move(key));
+          nested_result_values.emplace_back(std::move(val));
+          ++expand_facts;
+        });
+  }
+  return bytes;
+}
+
+void QueryExecutor::parkIterators() {
+  // The iterators can only outlive this query if they don't refer to
+  // any facts derived by it, because those are discarded at the end of
+  // the request. Any others are replaced by an EmptyIterator, which
+  // makes the next page seek again from the saved key.
+  if (!cursors || queryCont->iters()->size() != iters.size()) {
+    return;
+  }
+  // Rough estimate of the memory pinned by each live iterator on top of
+  // its current key.
+  constexpr size_t ITER_OVERHEAD = 1024;
+  CursorTable::Iterators live;
+  live.reserve(iters.size());
+  size_t bytes = 0;
+  for (auto& saved : *queryCont->iters()) {
+    auto& iter = iters[live.size()];
+    if (Pid::fromThrift(*saved.type()) && iter.parkable) {
+      bytes += ITER_OVERHEAD + saved.key()->size();
+      live.push_back(std::move(iter.iter));
+    } else {
+      live.push_back(std::make_unique<EmptyIterator>());
+    }
+  }
+  if (bytes == 0) {
+    return;
+  }
+  if (auto cursor = cursors->park(std::move(live), first_free_id, bytes)) {
+    queryCont->cursor() = static_cast<int64_t>(cursor);
+  }
+}
+
+std::unique_ptr<QueryResults> QueryExecutor::finish(
+    const std::string* cacheKey) {
+  CachedResults res;
+  res.fact_ids = std::move(result_ids);
+  res.fact_pids = std::move(result_pids);
+  res.fact_keys = std::move(result_keys);
+  res.fact_values = std::move(result_values);
+  res.nested_fact_ids = std::move(nested_result_ids);
+  res.nested_fact_pids = std::move(nested_result_pids);
+  res.nested_fact_keys = std::move(nested_result_keys);
+  res.nested_fact_values = std::move(nested_result_values);
+
+  // Results can't be reused if they refer to facts derived by the query,
+  // because the derived facts only exist for this request. Results that
+  // were cut short by a timeout aren't cached either, since the time limit
+  // isn't part of the key and the next run may get further.
+  const bool cache = cacheKey && facts.firstFreeId() == first_free_id
+    && !timed_out;
 
   if (queryCont) {
+    // Each cursor can only be taken once, so cached results mustn't carry
+    // one.
+    if (!cache) {
+      parkIterators();
+    }
     std::string out;
     using namespace apache::thrift;
     Serializer<BinaryProtocolReader, BinaryProtocolWriter>::serialize(
         *queryCont, &out);
-    res->continuation = std::move(out);
+    res.continuation = std::move(out);
   };
 
   if (wantStats) {
-    res->stats = std::move(stats);
+    res.stats.assign(stats.begin(), stats.end());
   }
-  res->elapsed_ns = watch.elapsed().count();
-  return res;
-}
-
-} // namespace {}
-
-void interruptRunningQueries() {
-  last_interrupt = Clock::now();
-}
-
-std::unique_ptr<QueryResults> restartQuery(
-    Inventory& inventory,
-    Define& facts,
-    DefineOwnership* ownership,
-    folly::Optional<uint64_t> maxResults,
-    folly::Optional<uint64_t> maxBytes,
-    folly::Optional<uint64_t> maxTime,
-    Depth depth,
-    std::unordered_set<Pid, folly::hasher<Pid>>& expandPids,
-    bool wantStats,
-    void* serializedCont,
-    uint64_t serializedContLen) {
-  thrift::internal::QueryCont queryCont;
-
-  // Deserialize the continuation into thrift::internal::QueryCont
-  using namespace apache::thrift;
-  Serializer<BinaryProtocolReader, BinaryProtocolWriter>::deserialize(
-      folly::ByteRange(
-          reinterpret_cast<unsigned char*>(serializedCont), serializedContLen),
-      queryCont);
-
-  // Build a Subroutine
-  uint64_t* code = reinterpret_cast<uint64_t*>(
-    const_cast<char*>(queryCont.sub()->code()->data()));
-  auto code_size = queryCont.sub()->code()->size() / sizeof(uint64_t);
-  Subroutine sub{std::vector<uint64_t>(code, code + code_size),
-                 static_cast<size_t>(*queryCont.sub()->inputs()),
-                 queryCont.outputs()->size(),
-                 static_cast<size_t>(queryCont.sub()->locals()->size()),
-                 {}, // no constants - they're already on the stack
-                 std::move(*queryCont.sub()->literals())};
-
-  std::shared_ptr<Subroutine> traverse;
-  if (queryCont.traverse().has_value()) {
-    traverse = Subroutine::fromThrift(*queryCont.traverse());
+  res.expand_rounds = expand_rounds;
+  res.expand_facts = expand_facts;
+
+  std::unique_ptr<QueryResults> results;
+  // Only pay for copying the results if the cache will take them.
+  if (cache && QueryCache::global().fits(*cacheKey, res)) {
+    auto cached = std::make_shared<CachedResults>(std::move(res));
+    results = cached->toResults();
+    QueryCache::global().insert(*cacheKey, std::move(cached));
+  } else {
+    results = std::move(res).toResults();
   }
-
-  // Setup the state as it was before, and execute the Subroutine
-  auto pid = Pid::fromWord(*queryCont.pid());
-
-  return executeQuery(
-      inventory,
-      facts,
-      ownership,
-      sub,
-      pid,
-      traverse,
-      maxResults,
-      maxBytes,
-      maxTime,
-      depth,
-      expandPids,
-      wantStats,
-      std::move(queryCont));
+  if (profile) {
+    results->profile = profile->serialize();
+  }
+  results->elapsed_ns = watch.elapsed().count();
+  return results;
 }
 
 
-std::unique_ptr<QueryResults> executeQuery (
+std::unique_ptr<QueryResults> runQuery(
     Inventory& inventory,
     Define& facts,
     DefineOwnership* ownership,
@@ -539,6 +751,9 @@ std::unique_ptr<QueryResults> executeQuery (
     Depth depth,
     std::unordered_set<Pid, folly::hasher<Pid>>& expandPids,
     bool wantStats,
+    bool wantProfile,
+    CursorTable* cursors,
+    const std::string* cacheKey,
     folly::Optional<thrift::internal::QueryCont> restart) {
 
   QueryExecutor q {
@@ -550,7 +765,9 @@ std::unique_ptr<QueryResults> executeQuery (
     .traverse = traverse,
     .depth = depth,
     .expandPids = expandPids,
-    .wantStats = wantStats
+    .wantStats = wantStats,
+    .cursors = cursors,
+    .first_free_id = facts.firstFreeId()
   };
   // coarse_steady_clock is around 1ms granularity which is enough for us.
   q.timeout = Clock::now();
@@ -562,21 +779,49 @@ std::unique_ptr<QueryResults> executeQuery (
     q.check_timeout = UINT64_MAX;
   }
 
+  if (wantProfile) {
+    q.profile = std::make_unique<QueryProfiler>();
+  }
+
   q.outputs.resize(sub.outputs);
 
-  // Set up all the iterators as before if we're restarting
+  // Set up all the iterators as before if we're restarting. If the
+  // previous page parked its live iterators, resume those instead of
+  // seeking again, as long as they are still where we left them.
   if (restart) {
-    for (auto& savedIter : *restart->iters()) {
+    auto& savedIters = *restart->iters();
+    CursorTable::Iterators live;
+    if (cursors && restart->cursor()) {
+      live = cursors->take(
+          static_cast<uint64_t>(*restart->cursor()), facts.firstFreeId());
+      if (live.size() != savedIters.size()) {
+        live.clear();
+      }
+    }
+    for (size_t i = 0; i < savedIters.size(); i++) {
+      auto& savedIter = savedIters[i];
       std::unique_ptr<FactIterator> iter;
       Id id;
+      bool parkable = false;
       if (const auto type = Pid::fromThrift(*savedIter.type())) {
         auto key = binary::byteRange(*savedIter.key());
-        iter = facts.seek(type, key, savedIter.get_prefix_size());
-        auto res = iter->get(FactIterator::KeyOnly);
-        if (!res || res.key() != key) {
-          error("restart iter didn't find a key");
+        if (!live.empty()) {
+          auto res = live[i]->get(FactIterator::KeyOnly);
+          if (res && res.key() == key) {
+            iter = std::move(live[i]);
+            id = res.id;
+            parkable = true;
+          }
+        }
+        if (!iter) {
+          iter = q.seekFacts(
+              type, key, savedIter.get_prefix_size(), parkable);
+          auto res = iter->get(FactIterator::KeyOnly);
+          if (!res || res.key() != key) {
+            error("restart iter didn't find a key");
+          }
+          id = res.id;
         }
-        id = res.id;
       } else {
         // We serialized a finished iterator
         iter = std::make_unique<EmptyIterator>();
@@ -587,6 +832,7 @@ std::unique_ptr<QueryResults> executeQuery (
           id,
           static_cast<size_t>(savedIter.get_prefix_size()),
           *savedIter.first()});
+      q.iters.back().parkable = parkable;
     }
   }
 
@@ -642,9 +888,11 @@ std::unique_ptr<QueryResults> executeQuery (
       next_ = [&](uint64_t token, uint64_t demand, uint64_t *clause_begin,
                   uint64_t *key_end, uint64_t *clause_end, uint64_t *id) {
         if (q.timeExpired()) {
+          q.timed_out = true;
           return 2;
         }
         if (q.interrupted()) {
+          q.timed_out = true;
           return 2;
         }
         auto res = q.next(token, demand != 0 ? FactIterator::KeyValue
@@ -724,14 +972,249 @@ std::unique_ptr<QueryResults> executeQuery (
         restart->sub()->locals()->begin(),
         restart->sub()->locals()->end(),
         std::back_inserter(args));
-    sub.restart(args.data(), *restart->sub()->entry());
+    sub.restart(
+        args.data(),
+        *restart->sub()->entry(),
+        q.profile ? &q.profile->sub : nullptr);
   } else {
-    sub.execute(args.data());
+    sub.execute(args.data(), q.profile ? &q.profile->sub : nullptr);
   }
 
-  return q.finish();
+  return q.finish(cacheKey);
+}
+
+// The key of a query in the result cache. 'db' identifies the facts that
+// the query runs against and 'query' what to run. The time limit is not
+// part of the key because results cut short by a timeout aren't cached
+// (see QueryExecutor::finish).
+std::string mkResultCacheKey(
+    folly::ByteRange db,
+    folly::ByteRange query,
+    folly::Optional<uint64_t> maxResults,
+    folly::Optional<uint64_t> maxBytes,
+    Depth depth,
+    const std::unordered_set<Pid, folly::hasher<Pid>>& expandPids,
+    bool wantStats) {
+  folly::hash::SpookyHashV2 h;
+  h.Init(0, 0);
+  auto word = [&](uint64_t w) { h.Update(&w, sizeof(w)); };
+  auto bytes = [&](folly::ByteRange b) {
+    word(b.size());
+    h.Update(b.data(), b.size());
+  };
+  bytes(db);
+  bytes(query);
+  word(maxResults.has_value());
+  word(maxResults.value_or(0));
+  word(maxBytes.has_value());
+  word(maxBytes.value_or(0));
+  word(static_cast<uint64_t>(depth));
+  std::vector<uint64_t> pids;
+  pids.reserve(expandPids.size());
+  for (auto pid : expandPids) {
+    pids.push_back(pid.toWord());
+  }
+  std::sort(pids.begin(), pids.end());
+  bytes(folly::ByteRange(
+      reinterpret_cast<const unsigned char*>(pids.data()),
+      pids.size() * sizeof(uint64_t)));
+  word(wantStats);
+  uint64_t out[2];
+  h.Final(&out[0], &out[1]);
+  return std::string(reinterpret_cast<const char *>(out), sizeof(out));
+}
+
+// Whether the results of a query can be cached. Queries that compute
+// ownership are storing derived facts, those always need to run, and so
+// do queries that we're profiling.
+bool cacheable(
+    folly::Optional<folly::ByteRange> resultCacheKey,
+    DefineOwnership* ownership,
+    bool wantProfile) {
+  return resultCacheKey && !ownership && !wantProfile &&
+    QueryCache::global().enabled();
+}
+
+std::unique_ptr<QueryResults> cachedResults(const std::string& key) {
+  folly::stop_watch<std::chrono::nanoseconds> watch;
+  if (auto cached = QueryCache::global().lookup(key)) {
+    auto res = cached->toResults();
+    res->cache_hits = 1;
+    res->elapsed_ns = watch.elapsed().count();
+    return res;
+  }
+  return nullptr;
+}
+
+} // namespace {}
+
+void interruptRunningQueries() {
+  last_interrupt = Clock::now();
 }
 
+std::unique_ptr<QueryResults> restartQuery(
+    Inventory& inventory,
+    Define& facts,
+    DefineOwnership* ownership,
+    folly::Optional<uint64_t> maxResults,
+    folly::Optional<uint64_t> maxBytes,
+    folly::Optional<uint64_t> maxTime,
+    Depth depth,
+    std::unordered_set<Pid, folly::hasher<Pid>>& expandPids,
+    bool wantStats,
+    bool wantProfile,
+    CursorTable* cursors,
+    folly::Optional<folly::ByteRange> resultCacheKey,
+    void* serializedCont,
+    uint64_t serializedContLen) {
+  auto contBytes = folly::ByteRange(
+      reinterpret_cast<unsigned char*>(serializedCont), serializedContLen);
+
+  std::string key;
+  if (cacheable(resultCacheKey, ownership, wantProfile)) {
+    key = mkResultCacheKey(
+        *resultCacheKey,
+        contBytes,
+        maxResults,
+        maxBytes,
+        depth,
+        expandPids,
+        wantStats);
+    if (auto res = cachedResults(key)) {
+      return res;
+    }
+  }
+
+  thrift::internal::QueryCont queryCont;
+
+  // Deserialize the continuation into thrift::internal::QueryCont
+  using namespace apache::thrift;
+  Serializer<BinaryProtocolReader, BinaryProtocolWriter>::deserialize(
+      contBytes, queryCont);
+
+  // Use the cached Subroutine if we have it and otherwise build it from
+  // the bytecode in the continuation. Continuations produced by earlier
+  // versions may carry only the hash.
+  auto& cache = SubroutineCache::global();
+  std::shared_ptr<Subroutine> sub;
+  if (auto hash = queryCont.sub()->code_hash()) {
+    sub = cache.lookup(*hash);
+  }
+  if (!sub) {
+    if (queryCont.sub()->code()->empty()) {
+      error("query continuation refers to bytecode that is no longer "
+            "cached, please restart the query");
+    }
+    uint64_t* code = reinterpret_cast<uint64_t*>(
+      const_cast<char*>(queryCont.sub()->code()->data()));
+    auto code_size = queryCont.sub()->code()->size() / sizeof(uint64_t);
+    sub = std::make_shared<Subroutine>(
+        std::vector<uint64_t>(code, code + code_size),
+        static_cast<size_t>(*queryCont.sub()->inputs()),
+        queryCont.outputs()->size(),
+        static_cast<size_t>(queryCont.sub()->locals()->size()),
+        std::vector<uint64_t>{}, // no constants - they're already on the stack
+        std::move(*queryCont.sub()->literals()));
+  }
+
+  std::shared_ptr<Subroutine> traverse;
+  if (auto hash = queryCont.traverse_hash()) {
+    traverse = cache.lookup(*hash);
+  }
+  if (!traverse) {
+    if (queryCont.traverse().has_value()) {
+      traverse = Subroutine::fromThrift(*queryCont.traverse());
+    } else if (queryCont.traverse_hash()) {
+      error("query continuation refers to a traversal that is no longer "
+            "cached, please restart the query");
+    }
+  }
+
+  // Setup the state as it was before, and execute the Subroutine
+  auto pid = Pid::fromWord(*queryCont.pid());
+
+  auto res = runQuery(
+      inventory,
+      facts,
+      ownership,
+      *sub,
+      pid,
+      traverse,
+      maxResults,
+      maxBytes,
+      maxTime,
+      depth,
+      expandPids,
+      wantStats,
+      wantProfile,
+      cursors,
+      key.empty() ? nullptr : &key,
+      std::move(queryCont));
+  if (!key.empty()) {
+    res->cache_misses = 1;
+  }
+  return res;
+}
+
+std::unique_ptr<QueryResults> executeQuery(
+    Inventory& inventory,
+    Define& facts,
+    DefineOwnership* ownership,
+    Subroutine& sub,
+    Pid pid,
+    std::shared_ptr<Subroutine> traverse,
+    folly::Optional<uint64_t> maxResults,
+    folly::Optional<uint64_t> maxBytes,
+    folly::Optional<uint64_t> maxTime,
+    Depth depth,
+    std::unordered_set<Pid, folly::hasher<Pid>>& expandPids,
+    bool wantStats,
+    bool wantProfile,
+    CursorTable* cursors,
+    folly::Optional<folly::ByteRange> resultCacheKey) {
+  std::string key;
+  if (cacheable(resultCacheKey, ownership, wantProfile)) {
+    auto query = SubroutineCache::hash(sub);
+    if (traverse) {
+      query += SubroutineCache::hash(*traverse);
+    }
+    auto p = pid.toWord();
+    query.append(reinterpret_cast<const char *>(&p), sizeof(p));
+    key = mkResultCacheKey(
+        *resultCacheKey,
+        binary::byteRange(query),
+        maxResults,
+        maxBytes,
+        depth,
+        expandPids,
+        wantStats);
+    if (auto res = cachedResults(key)) {
+      return res;
+    }
+  }
+
+  auto res = runQuery(
+      inventory,
+      facts,
+      ownership,
+      sub,
+      pid,
+      std::move(traverse),
+      maxResults,
+      maxBytes,
+      maxTime,
+      depth,
+      expandPids,
+      wantStats,
+      wantProfile,
+      cursors,
+      key.empty() ? nullptr : &key,
+      folly::none);
+  if (!key.empty()) {
+    res->cache_misses = 1;
+  }
+  return res;
+}
 
 }
 }
@@ -10,6 +10,7 @@
 
 #include <folly/container/F14Map.h>
 
+#include "glean/rts/cursor.h"
 #include "glean/rts/factset.h"
 #include "glean/rts/inventory.h"
 #include "glean/rts/ownership/derived.h"
@@ -35,8 +36,13 @@ struct QueryResults {
   HsArray<HsString> nested_fact_keys;
   HsArray<HsString> nested_fact_values;
   HsMap<uint64_t, uint64_t> stats;
+  uint64_t expand_rounds;   // batched fetch rounds expanding nested facts
+  uint64_t expand_facts;    // nested facts fetched
+  uint64_t cache_hits;      // 1 if the results came from the QueryCache
+  uint64_t cache_misses;    // 1 if they could have, but weren't cached
   uint64_t elapsed_ns;
   HsString continuation;
+  HsString profile;         // thrift::QueryProfile (compact) if requested
 };
 
 enum class Depth {
@@ -45,6 +51,14 @@ enum class Depth {
   ExpandPartial
 };
 
+// If resultCacheKey is set, it must uniquely identify the facts that the
+// query runs against (the DB and its slice, if any), and the results may
+// be served from and added to the global QueryCache. Only pass it for
+// queries over immutable DBs.
+//
+// If wantProfile is set, the query runs in a (much slower) profiling mode
+// and returns a thrift::QueryProfile in QueryResults::profile. Profiled
+// queries bypass the result cache.
 std::unique_ptr<QueryResults> executeQuery(
     Inventory& inventory,
     Define& facts,
@@ -58,7 +72,9 @@ std::unique_ptr<QueryResults> executeQuery(
     Depth depth,
     std::unordered_set<Pid, folly::hasher<Pid>>& expandPids,
     bool wantStats,
-    folly::Optional<thrift::internal::QueryCont> restart);
+    bool wantProfile,
+    CursorTable* cursors,
+    folly::Optional<folly::ByteRange> resultCacheKey);
 
 std::unique_ptr<QueryResults> restartQuery(
     Inventory& inventory,
@@ -70,6 +86,9 @@ std::unique_ptr<QueryResults> restartQuery(
     Depth depth,
     std::unordered_set<Pid, folly::hasher<Pid>>& expandPids,
     bool wantStats,
+    bool wantProfile,
+    CursorTable* cursors,
+    folly::Optional<folly::ByteRange> resultCacheKey,
     void* serializedCont,
     uint64_t serializedContLen);
 
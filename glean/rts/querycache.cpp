@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "glean/rts/querycache.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+namespace {
+
+size_t stringsSize(const std::vector<std::string>& v) {
+  size_t n = v.size() * sizeof(std::string);
+  for (const auto& s : v) {
+    n += s.size();
+  }
+  return n;
+}
+
+std::vector<HsString> toHs(const std::vector<std::string>& v) {
+  std::vector<HsString> r;
+  r.reserve(v.size());
+  for (const auto& s : v) {
+    r.emplace_back(std::string(s));
+  }
+  return r;
+}
+
+std::vector<HsString> toHs(std::vector<std::string>&& v) {
+  std::vector<HsString> r;
+  r.reserve(v.size());
+  for (auto& s : v) {
+    r.emplace_back(std::move(s));
+  }
+  return r;
+}
+
+// Copy or move the results, depending on whether we're given an lvalue
+// or an rvalue.
+template<typename Results>
+std::unique_ptr<QueryResults> toQueryResults(Results&& r) {
+  using Ids = std::vector<uint64_t>;
+  auto res = std::make_unique<QueryResults>();
+  res->fact_ids = Ids(std::forward<Results>(r).fact_ids);
+  res->fact_pids = Ids(std::forward<Results>(r).fact_pids);
+  res->fact_keys = toHs(std::forward<Results>(r).fact_keys);
+  res->fact_values = toHs(std::forward<Results>(r).fact_values);
+  res->nested_fact_ids = Ids(std::forward<Results>(r).nested_fact_ids);
+  res->nested_fact_pids = Ids(std::forward<Results>(r).nested_fact_pids);
+  res->nested_fact_keys = toHs(std::forward<Results>(r).nested_fact_keys);
+  res->nested_fact_values = toHs(std::forward<Results>(r).nested_fact_values);
+  res->stats = folly::F14FastMap<uint64_t, uint64_t>(
+      r.stats.begin(), r.stats.end());
+  res->expand_rounds = r.expand_rounds;
+  res->expand_facts = r.expand_facts;
+  res->continuation = std::string(std::forward<Results>(r).continuation);
+  return res;
+}
+
+}
+
+size_t CachedResults::size() const {
+  return sizeof(CachedResults)
+    + (fact_ids.size() + fact_pids.size()
+        + nested_fact_ids.size() + nested_fact_pids.size())
+      * sizeof(uint64_t)
+    + stringsSize(fact_keys)
+    + stringsSize(fact_values)
+    + stringsSize(nested_fact_keys)
+    + stringsSize(nested_fact_values)
+    + stats.size() * sizeof(stats[0])
+    + continuation.size();
+}
+
+std::unique_ptr<QueryResults> CachedResults::toResults() const& {
+  return toQueryResults(*this);
+}
+
+std::unique_ptr<QueryResults> CachedResults::toResults() && {
+  return toQueryResults(std::move(*this));
+}
+
+QueryCache::QueryCache(size_t capacity) : capacity_(capacity) {}
+
+void QueryCache::State::evict(size_t capacity) {
+  while (size > capacity && !lru.empty()) {
+    auto& victim = lru.back();
+    size -= victim.size;
+    index.erase(victim.key);
+    lru.pop_back();
+  }
+}
+
+std::shared_ptr<const CachedResults> QueryCache::lookup(
+    const std::string& key) {
+  {
+    auto s = state.lock();
+    auto it = s->index.find(key);
+    if (it != s->index.end()) {
+      s->lru.splice(s->lru.begin(), s->lru, it->second);
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return it->second->results;
+    }
+  }
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  return nullptr;
+}
+
+void QueryCache::insert(
+    const std::string& key,
+    std::shared_ptr<const CachedResults> res) {
+  auto capacity = capacity_.load(std::memory_order_relaxed);
+  auto size = res->size() + key.size();
+  if (size > capacity) {
+    return;
+  }
+  auto s = state.lock();
+  auto it = s->index.find(key);
+  if (it != s->index.end()) {
+    // Another query got there first, the results are the same.
+    s->lru.splice(s->lru.begin(), s->lru, it->second);
+    return;
+  }
+  s->lru.push_front(Entry{key, std::move(res), size});
+  s->index.emplace(key, s->lru.begin());
+  s->size += size;
+  s->evict(capacity);
+}
+
+void QueryCache::setCapacity(size_t capacity) {
+  capacity_.store(capacity, std::memory_order_relaxed);
+  state.lock()->evict(capacity);
+}
+
+QueryCache::Stats QueryCache::stats() {
+  auto s = state.lock();
+  return Stats{
+    s->lru.size(),
+    s->size,
+    hits_.load(std::memory_order_relaxed),
+    misses_.load(std::memory_order_relaxed)
+  };
+}
+
+QueryCache& QueryCache::global() {
+  static QueryCache cache(0);
+  return cache;
+}
+
+}
+}
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+
+#include "glean/rts/query.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+/// The results of a query in a form that can be copied, so that they can
+/// be kept in the QueryCache and handed out many times.
+struct CachedResults {
+  std::vector<uint64_t> fact_ids;
+  std::vector<uint64_t> fact_pids;
+  std::vector<std::string> fact_keys;
+  std::vector<std::string> fact_values;
+  std::vector<uint64_t> nested_fact_ids;
+  std::vector<uint64_t> nested_fact_pids;
+  std::vector<std::string> nested_fact_keys;
+  std::vector<std::string> nested_fact_values;
+  std::vector<std::pair<uint64_t, uint64_t>> stats;
+  uint64_t expand_rounds = 0;
+  uint64_t expand_facts = 0;
+  std::string continuation;
+
+  /// Approximate memory used by the results
+  size_t size() const;
+
+  /// Make a fresh QueryResults with a copy of the results.
+  std::unique_ptr<QueryResults> toResults() const&;
+
+  /// Move the results into a QueryResults.
+  std::unique_ptr<QueryResults> toResults() &&;
+};
+
+/// A bounded LRU cache of query results.
+///
+/// The key must identify everything that determines the results: the
+/// bytecode (or the continuation), the runtime limits and the exact set
+/// of facts that the query runs against, so the cache must only be used
+/// for queries over immutable DBs. Keys are built by the query engine,
+/// see executeQuery.
+///
+/// A capacity of 0 disables the cache.
+class QueryCache {
+public:
+  explicit QueryCache(size_t capacity);
+
+  QueryCache(const QueryCache&) = delete;
+  QueryCache& operator=(const QueryCache&) = delete;
+
+  /// Find cached results, counting a hit or a miss.
+  std::shared_ptr<const CachedResults> lookup(const std::string& key);
+
+  /// Whether results of this size can be cached at all. Check this before
+  /// making a copy of the results to insert.
+  bool fits(const std::string& key, const CachedResults& res) const {
+    return res.size() + key.size() <=
+      capacity_.load(std::memory_order_relaxed);
+  }
+
+  /// Add results under the given key, evicting the least recently used
+  /// entries to make room. Results that are too big for the cache are
+  /// dropped.
+  void insert(const std::string& key, std::shared_ptr<const CachedResults> res);
+
+  /// Change the capacity, evicting entries if necessary.
+  void setCapacity(size_t capacity);
+
+  bool enabled() const {
+    return capacity_.load(std::memory_order_relaxed) != 0;
+  }
+
+  struct Stats {
+    size_t entries;
+    size_t bytes;
+    uint64_t hits;
+    uint64_t misses;
+  };
+
+  Stats stats();
+
+  /// The cache used by the query engine.
+  static QueryCache& global();
+
+private:
+  struct Entry {
+    std::string key;
+    std::shared_ptr<const CachedResults> results;
+    size_t size;
+  };
+
+  struct State {
+    size_t size = 0;
+    // most recently used at the front
+    std::list<Entry> lru;
+    folly::F14FastMap<std::string, std::list<Entry>::iterator> index;
+
+    void evict(size_t capacity);
+  };
+
+  std::atomic<size_t> capacity_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  folly::Synchronized<State, std::mutex> state;
+};
+
+}
+}
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "glean/rts/stacked.h"
+
+namespace facebook {
+namespace glean {
+namespace rts {
+
+namespace {
+
+// The facts of each iterator in turn
+struct ConcatIterator final : FactIterator {
+  explicit ConcatIterator(std::vector<std::unique_ptr<FactIterator>> iters)
+    : iters_(std::move(iters))
+    , current_(0)
+    , checked_(false)
+  {}
+
+  void next() override {
+    if (!checked_) {
+      get(KeyOnly);
+    }
+    iters_[current_]->next();
+    checked_ = false;
+  }
+
+  Fact::Ref get(Demand demand) override {
+    checked_ = true;
+    for (; current_ < iters_.size(); ++current_) {
+      if (auto r = iters_[current_]->get(demand)) {
+        return r;
+      }
+    }
+    return Fact::Ref::invalid();
+  }
+
+  std::vector<std::unique_ptr<FactIterator>> iters_;
+  size_t current_;
+  bool checked_;
+};
+
+}
+
+Stacked<Lookup>::Stacked(Lookup *base, Lookup *stacked) {
+  const auto mid = stacked->startingId();
+  if (auto s = dynamic_cast<Stacked<Lookup> *>(base)) {
+    for (const auto& layer : s->layers_) {
+      push(layer.lookup, layer.from);
+    }
+  } else {
+    push(base, Id::invalid());
+  }
+  if (auto s = dynamic_cast<Stacked<Lookup> *>(stacked)) {
+    for (const auto& layer : s->layers_) {
+      push(layer.lookup, std::max(layer.from, mid));
+    }
+  } else {
+    push(stacked, mid);
+  }
+}
+
+void Stacked<Lookup>::push(Lookup *lookup, Id from) {
+  // Layers which the new one hides completely can be dropped
+  while (!layers_.empty() && from <= layers_.back().from) {
+    layers_.pop_back();
+  }
+  layers_.push_back({lookup, from});
+}
+
+size_t Stacked<Lookup>::layerOf(Id id) const {
+  auto i = std::upper_bound(
+    layers_.begin() + 1,
+    layers_.end(),
+    id,
+    [](Id id, const Layer& layer) { return id < layer.from; });
+  return i - layers_.begin() - 1;
+}
+
+Id Stacked<Lookup>::idByKey(Pid type, folly::ByteRange key) {
+  // Keys are unique in the stack so the first layer which has the key
+  // decides, even if the fact is hidden.
+  for (auto i = layers_.size(); i != 0; --i) {
+    if (auto id = layers_[i-1].lookup->idByKey(type, key)) {
+      return i == layers_.size() || id < upto(i-1) ? id : Id::invalid();
+    }
+  }
+  return Id::invalid();
+}
+
+Pid Stacked<Lookup>::typeById(Id id) {
+  return layers_[layerOf(id)].lookup->typeById(id);
+}
+
+bool Stacked<Lookup>::factById(
+    Id id,
+    std::function<void(Pid, Fact::Clause)> f) {
+  return layers_[layerOf(id)].lookup->factById(id, std::move(f));
+}
+
+void Stacked<Lookup>::factsById(
+    folly::Range<const Id*> ids,
+    std::function<void(Id, Pid, Fact::Clause)> f) {
+  auto begin = ids.begin();
+  for (size_t i = 0; i < layers_.size() && begin != ids.end(); ++i) {
+    auto end = i + 1 == layers_.size()
+      ? ids.end()
+      : std::lower_bound(begin, ids.end(), upto(i));
+    if (begin != end) {
+      layers_[i].lookup->factsById({begin, end}, f);
+    }
+    begin = end;
+  }
+}
+
+Id Stacked<Lookup>::startingId() const {
+  return layers_.front().lookup->startingId();
+}
+
+Id Stacked<Lookup>::firstFreeId() const {
+  return layers_.back().lookup->firstFreeId();
+}
+
+Interval Stacked<Lookup>::count(Pid pid) const {
+  auto n = layers_.front().lookup->count(pid);
+  for (size_t i = 1; i < layers_.size(); ++i) {
+    n = n + layers_[i].lookup->count(pid);
+  }
+  return n;
+}
+
+std::unique_ptr<FactIterator> Stacked<Lookup>::enumerate(Id from, Id upto) {
+  const auto lo = layerOf(from);
+  const auto hi = upto ? layerOf(upto - 1) : layers_.size() - 1;
+  if (hi < lo) {
+    return std::make_unique<EmptyIterator>();
+  } else if (hi == lo) {
+    return layers_[lo].lookup->enumerate(from, upto);
+  }
+  std::vector<std::unique_ptr<FactIterator>> iters;
+  for (auto i = lo; i <= hi; ++i) {
+    iters.push_back(layers_[i].lookup->enumerate(
+      std::max(from, layers_[i].from),
+      i == hi ? upto : this->upto(i)));
+  }
+  return std::make_unique<ConcatIterator>(std::move(iters));
+}
+
+std::unique_ptr<FactIterator> Stacked<Lookup>::enumerateBack(
+    Id from,
+    Id downto) {
+  const auto hi = from ? layerOf(from - 1) : layers_.size() - 1;
+  const auto lo = layerOf(downto);
+  if (hi < lo) {
+    return std::make_unique<EmptyIterator>();
+  } else if (hi == lo) {
+    return layers_[lo].lookup->enumerateBack(from, downto);
+  }
+  std::vector<std::unique_ptr<FactIterator>> iters;
+  for (auto i = hi + 1; i-- > lo; ) {
+    iters.push_back(layers_[i].lookup->enumerateBack(
+      i == hi ? from : upto(i),
+      std::max(downto, layers_[i].from)));
+  }
+  return std::make_unique<ConcatIterator>(std::move(iters));
+}
+
+std::unique_ptr<FactIterator> Stacked<Lookup>::seek(
+    Pid type,
+    folly::ByteRange start,
+    size_t prefix_size) {
+  std::vector<std::unique_ptr<FactIterator>> iters;
+  for (size_t i = 0; i + 1 < layers_.size(); ++i) {
+    iters.push_back(layers_[i].lookup->seekWithinSection(
+      type, start, prefix_size, layers_[i].from, upto(i)));
+  }
+  iters.push_back(layers_.back().lookup->seek(type, start, prefix_size));
+  return FactIterator::merge(std::move(iters), prefix_size);
+}
+
+std::unique_ptr<FactIterator> Stacked<Lookup>::seekWithinSection(
+    Pid type,
+    folly::ByteRange start,
+    size_t prefix_size,
+    Id from,
+    Id to) {
+  if (!to || to <= from) {
+    return std::make_unique<EmptyIterator>();
+  }
+  const auto lo = layerOf(from);
+  const auto hi = layerOf(to - 1);
+  std::vector<std::unique_ptr<FactIterator>> iters;
+  for (auto i = lo; i <= hi; ++i) {
+    iters.push_back(layers_[i].lookup->seekWithinSection(
+      type,
+      start,
+      prefix_size,
+      std::max(from, layers_[i].from),
+      i == hi ? to : upto(i)));
+  }
+  return FactIterator::merge(std::move(iters), prefix_size);
+}
+
+}
+}
+}
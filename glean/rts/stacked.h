@@ -45,6 +45,18 @@ struct StackedBase : Iface {
       : stacked->factById(id, std::move(f));
   }
 
+  void factsById(
+      folly::Range<const Id*> ids,
+      std::function<void(Id, Pid, Fact::Clause)> f) override {
+    auto split = std::lower_bound(ids.begin(), ids.end(), mid);
+    if (split != ids.begin()) {
+      base->factsById({ids.begin(), split}, f);
+    }
+    if (split != ids.end()) {
+      stacked->factsById({split, ids.end()}, f);
+    }
+  }
+
   Id startingId() const override {
     return base->startingId();
   }
@@ -128,9 +140,70 @@ protected:
 template<typename Iface>
 struct Stacked;
 
+/**
+ * Stacked Lookups are flattened: stacking on top of a Stacked<Lookup> (or
+ * stacking one) produces a single list of layers rather than a chain of
+ * nested Stackeds. Lookups then try the layers in a loop and seeks merge all
+ * layers at once, instead of going through one level of Stacked per layer.
+ *
+ * The layers only refer to the underlying Lookups, so they must outlive the
+ * Stacked but the Stackeds which were flattened needn't.
+ */
 template<>
-struct Stacked<Lookup> final : StackedBase<Lookup> {
-  using StackedBase<Lookup>::StackedBase;
+struct Stacked<Lookup> final : Lookup {
+  Stacked(Lookup *base, Lookup *stacked);
+
+  Id idByKey(Pid type, folly::ByteRange key) override;
+  Pid typeById(Id id) override;
+  bool factById(Id id, std::function<void(Pid, Fact::Clause)> f) override;
+  void factsById(
+    folly::Range<const Id*> ids,
+    std::function<void(Id, Pid, Fact::Clause)> f) override;
+
+  Id startingId() const override;
+  Id firstFreeId() const override;
+  Interval count(Pid pid) const override;
+
+  std::unique_ptr<FactIterator> enumerate(Id from, Id upto) override;
+  std::unique_ptr<FactIterator> enumerateBack(Id from, Id downto) override;
+
+  std::unique_ptr<FactIterator> seek(
+    Pid type,
+    folly::ByteRange start,
+    size_t prefix_size) override;
+
+  std::unique_ptr<FactIterator> seekWithinSection(
+    Pid type,
+    folly::ByteRange start,
+    size_t prefix_size,
+    Id from,
+    Id to) override;
+
+  size_t layers() const {
+    return layers_.size();
+  }
+
+private:
+  // A layer contributes the facts with ids from 'from' up to the 'from' of
+  // the next layer. The bottom layer has no lower bound and the top layer no
+  // upper bound.
+  struct Layer {
+    Lookup *lookup;
+    Id from;
+  };
+
+  void push(Lookup *lookup, Id from);
+
+  // the layer which owns the id
+  size_t layerOf(Id id) const;
+
+  // upper bound of the ids in a layer, Id::invalid() for the top layer
+  Id upto(size_t i) const {
+    return i + 1 < layers_.size() ? layers_[i+1].from : Id::invalid();
+  }
+
+  // bottom to top
+  std::vector<Layer> layers_;
 };
 
 template<>
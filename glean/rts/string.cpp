@@ -11,17 +11,117 @@
 #include "glean/rts/string.h"
 #include <cassert>
 #include <cstring>
+#include <folly/CpuId.h>
 #include <folly/Memory.h>
 #include <glog/logging.h>
 #include <unicode/utf8.h>
 #include <unicode/uchar.h>
 
+#if __x86_64__
+#include <immintrin.h>
+#endif
+
 namespace facebook {
 namespace glean {
 namespace rts {
 
 namespace {
 
+/// Kernels for scanning strings. There is a scalar implementation and SIMD
+/// ones, and we pick the fastest one the CPU supports at runtime.
+struct Kernels {
+  /// Return a pointer to the first NUL in [p,end) or end if there is none.
+  const uint8_t* (*findNul)(const uint8_t* p, const uint8_t* end);
+};
+
+namespace scalar {
+
+const uint8_t* findNul(const uint8_t* p, const uint8_t* end) {
+  auto q = static_cast<const uint8_t*>(std::memchr(p, 0, end-p));
+  return q ? q : end;
+}
+
+const Kernels kernels{findNul};
+
+}
+
+#if __x86_64__
+
+#define GLEAN_SSE42 __attribute__((target("sse4.2")))
+#define GLEAN_AVX2 __attribute__((target("avx2")))
+
+namespace sse42 {
+
+using V = __m128i;
+
+GLEAN_SSE42 const uint8_t* findNul(const uint8_t* p, const uint8_t* end) {
+  const auto zero = _mm_setzero_si128();
+  for (; end - p >= 16; p += 16) {
+    auto mask = _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const V*>(p)), zero));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return scalar::findNul(p, end);
+}
+
+const Kernels kernels{findNul};
+
+}
+
+namespace avx2 {
+
+using V = __m256i;
+
+GLEAN_AVX2 const uint8_t* findNul(const uint8_t* p, const uint8_t* end) {
+  const auto zero = _mm256_setzero_si256();
+  for (; end - p >= 32; p += 32) {
+    auto mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+      _mm256_loadu_si256(reinterpret_cast<const V*>(p)), zero));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return sse42::findNul(p, end);
+}
+
+const Kernels kernels{findNul};
+
+}
+
+#undef GLEAN_SSE42
+#undef GLEAN_AVX2
+
+#endif
+
+const Kernels* kernelsFor(StringKernels k) {
+  switch (k) {
+#if __x86_64__
+    case StringKernels::AVX2:
+      return folly::CpuId().avx2() ? &avx2::kernels : nullptr;
+    case StringKernels::SSE42:
+      return folly::CpuId().sse42() ? &sse42::kernels : nullptr;
+#else
+    case StringKernels::AVX2:
+    case StringKernels::SSE42:
+      return nullptr;
+#endif
+    case StringKernels::Scalar:
+      return &scalar::kernels;
+  }
+  return nullptr;
+}
+
+const Kernels*& currentKernels() {
+  static const Kernels* current = kernelsFor(bestStringKernels());
+  return current;
+}
+
+FOLLY_ALWAYS_INLINE const Kernels& kernels() {
+  return *currentKernels();
+}
+
 /// Iterate over chunks of a mangled string, delimited by NULs, and call
 /// Chunk for each chunk except the last and Last for the last one, passing
 /// a pointer one past the end of the chunk (including delimiters). Examples:
@@ -37,51 +137,60 @@ namespace {
 template<typename Chunk>
 FOLLY_ALWAYS_INLINE
 size_t untrustedChunks(folly::ByteRange range, Chunk&& chunk) {
-  const unsigned char * const p = range.data();
-  const size_t size = range.size();
+  const auto& k = kernels();
+  const auto begin = range.begin();
+  const auto end = range.end();
 
-  assert(p != nullptr);
+  assert(begin != nullptr);
 
-  int i;
-  for (i = 0; i < size && p[i] > 0 && p[i] < 0x80; ++i) {}
-  if (i+1 < size && p[i] == 0 && p[i+1] == 0) {
-    chunk(p, i);
-    return i+2;
-  }
-
-  int k = 0;
+  // This only checks the mangling and not that the string is valid UTF-8,
+  // which writers have never been required to produce.
+  auto p = begin;
   while (true) {
-    UChar c;
-    // NOTE: U8_NEXT returns c<0 on overlong (invalid) points so this doesn't
-    // transcode (and we don't have to worry about, say, overlong \NUL).
-    U8_NEXT(p, i, size, c);
-    if (c == 0) {
-      if (i < size) {
-        switch (p[i]) {
-          case 0:
-            chunk(p+k, i-k-1);
-            return i+1;
-
-          case 1:
-            chunk(p+k, i-k);
-            ++i;
-            k = i;
-            break;
-
-          default:
-            rts::error("invalid NUL in mangled string");
-        }
-      } else {
-        rts::error("truncated terminator in mangled string");
-      }
-    } else if (c < 0) {
-      rts::error("invalid UTF-8 string");
+    auto q = k.findNul(p, end);
+    if (q + 1 >= end) {
+      rts::error("truncated terminator in mangled string");
+    }
+    switch (q[1]) {
+      case 0:
+        chunk(p, q-p);
+        return q - begin + 2;
+
+      case 1:
+        chunk(p, q-p+1);
+        p = q + 2;
+        break;
+
+      default:
+        rts::error("invalid NUL in mangled string");
     }
   }
 }
 
 }
 
+StringKernels bestStringKernels() {
+#if __x86_64__
+  folly::CpuId cpu;
+  if (cpu.avx2()) {
+    return StringKernels::AVX2;
+  }
+  if (cpu.sse42()) {
+    return StringKernels::SSE42;
+  }
+#endif
+  return StringKernels::Scalar;
+}
+
+bool selectStringKernels(StringKernels k) {
+  if (auto p = kernelsFor(k)) {
+    currentKernels() = p;
+    return true;
+  } else {
+    return false;
+  }
+}
+
 size_t validateUntrustedString(folly::ByteRange range) {
   return untrustedChunks(range, [](auto, auto) {});
 }
@@ -98,11 +207,12 @@ namespace {
 template<typename Chunk>
 FOLLY_ALWAYS_INLINE
 size_t trustedChunks(folly::ByteRange range, Chunk&& chunk) noexcept {
+  const auto& k = kernels();
   const auto end = range.end();
   auto p = range.begin();
   while (true) {
-    auto q = static_cast<const unsigned char *>(std::memchr(p, 0, end-p));
-    CHECK(q && q+1 < end);
+    auto q = k.findNul(p, end);
+    CHECK(q+1 < end);
     if (q[1] == 0) {
       chunk(p, q-p);
       return q - range.begin() + 2;
@@ -140,15 +250,16 @@ size_t demangleTrustedString(folly::ByteRange range, uint8_t *buffer) noexcept {
 
 void mangleString(folly::ByteRange range, binary::Output& output) {
   if (!range.empty()) {
+    const auto& k = kernels();
+    const auto end = range.end();
     auto p = range.begin();
-    while (auto q = static_cast<const unsigned char *>(
-            std::memchr(p, 0, range.end()-p))) {
+    for (auto q = k.findNul(p, end); q != end; q = k.findNul(p, end)) {
       ++q;
       output.put({p,q});
       output.fixed<uint8_t>(1);
       p = q;
     }
-    output.put({p, range.end()});
+    output.put({p, end});
   }
   const unsigned char terminator[2] = {0,0};
   output.bytes(terminator, 2);
@@ -35,7 +35,7 @@ struct Output;
 namespace rts {
 
 /// Validate an untrusted mangled string and return its size, including the
-/// terminator.
+/// terminator. This checks the mangling but doesn't reject invalid UTF-8.
 size_t validateUntrustedString(folly::ByteRange);
 
 /// Demangle an untrusted mangled string into an Output and return its mangled
@@ -55,6 +55,18 @@ void mangleString(folly::ByteRange, binary::Output&);
 /// Tolower a mangled string
 void toLowerTrustedString(folly::ByteRange, binary::Output&);
 
+/// Implementations of the kernels which find the NULs in strings when
+/// validating and (de)mangling them.
+/// By default, we use the best one supported by the CPU.
+enum class StringKernels { Scalar, SSE42, AVX2 };
+
+/// The best kernels supported by the CPU.
+StringKernels bestStringKernels();
+
+/// Switch to the given kernels, returning false if the CPU doesn't support
+/// them. This is not thread safe and is only meant for tests and benchmarks.
+bool selectStringKernels(StringKernels);
+
 }
 }
 }
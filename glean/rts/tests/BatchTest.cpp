@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <functional>
+#include <set>
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/compression/Compression.h>
+#include <folly/lang/Bits.h>
+#include <folly/testing/TestUtil.h>
+#include <gtest/gtest.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include "glean/cpp/glean.h"
+#include "glean/cpp/native.h"
+#include "glean/cpp/sender.h"
+#include "glean/rts/define.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+using facebook::glean::cpp::BatchBase;
+using facebook::glean::cpp::BatchCache;
+using facebook::glean::cpp::SchemaInventory;
+
+namespace {
+
+struct Name : cpp::Predicate<uint64_t> {};
+struct Pair : cpp::Predicate<std::tuple<cpp::Fact<Name>, cpp::Fact<Name>>> {};
+struct Triple : cpp::Predicate<std::tuple<cpp::Fact<Pair>, cpp::Fact<Name>>> {};
+
+struct SCHEMA {
+  template<typename P> struct index;
+  static constexpr size_t count = 3;
+};
+
+}
+
+template<> struct SCHEMA::index<Name> { static constexpr size_t value = 0; };
+template<> struct SCHEMA::index<Pair> { static constexpr size_t value = 1; };
+template<> struct SCHEMA::index<Triple> { static constexpr size_t value = 2; };
+
+namespace {
+
+constexpr uint64_t HASH = 0x6261746368;
+
+const NativePredicate predicates[] = {
+  cpp::native::predicate<SCHEMA, Name>(HASH, 1),
+  cpp::native::predicate<SCHEMA, Pair>(HASH, 2),
+  cpp::native::predicate<SCHEMA, Triple>(HASH, 3),
+};
+
+NativeSchemaRegistration registration(
+  NativeSchema{SCHEMA::count, folly::range(predicates)});
+
+const Pid NAME = Pid::lowest();
+const Pid PAIR = Pid::lowest() + 1;
+const Pid TRIPLE = Pid::lowest() + 2;
+
+SchemaInventory schemaInventory() {
+  std::vector<Predicate> preds;
+  uint64_t i = 0;
+  for (auto pid : {NAME, PAIR, TRIPLE}) {
+    preds.push_back(Predicate{pid, "p", 1, {}, {}});
+    preds.back().hash = PredicateHash{HASH, ++i};
+  }
+  return SchemaInventory{Inventory(std::move(preds)), {}};
+}
+
+std::string key(std::initializer_list<uint64_t> xs) {
+  binary::Output out;
+  for (auto x : xs) {
+    out.packed(x);
+  }
+  return out.string();
+}
+
+Id define(BatchBase& batch, Pid type, std::initializer_list<uint64_t> xs) {
+  auto k = key(xs);
+  return batch.define(type, Fact::Clause::fromKey(binary::byteRange(k)));
+}
+
+// Stands in for a server which writes batches to a database of its own,
+// with ids that are nothing like the ones the client uses.
+struct Server {
+  const SchemaInventory& inventory;
+  FactSet db{Id::fromWord(1000000)};
+
+  thrift::Subst write(const thrift::Batch& batch) {
+    return defineUntrustedBatch(
+        db,
+        inventory.inventory,
+        Id::fromThrift(*batch.firstId()),
+        nullptr,
+        *batch.count(),
+        folly::ByteRange(folly::StringPiece(*batch.facts())))
+      .serialize();
+  }
+
+  Id id(Pid type, std::initializer_list<uint64_t> xs) {
+    auto k = key(xs);
+    return db.idByKey(type, binary::byteRange(k));
+  }
+};
+
+// The id of a fact in the cache, if it is there
+Id cached(BatchCache& cache, Pid type, std::initializer_list<uint64_t> xs) {
+  auto anchor = cache.cache.anchor(&EmptyLookup::instance());
+  auto k = key(xs);
+  return anchor.idByKey(type, binary::byteRange(k));
+}
+
+// The key of a fact in the cache
+std::string cachedKey(BatchCache& cache, Id id) {
+  auto anchor = cache.cache.anchor(&EmptyLookup::instance());
+  std::string k;
+  anchor.factById(id, [&](Pid, Fact::Clause clause) {
+    k = binary::mkString(clause.key());
+  });
+  return k;
+}
+
+// Load a file written by streamWriter the way `glean write --file-format
+// segments` does
+void load(Server& server, const std::string& path) {
+  std::string contents;
+  CHECK(folly::readFile(path.c_str(), contents));
+  folly::ByteRange input(folly::StringPiece(contents));
+  std::vector<Id> base;
+  while (!input.empty()) {
+    auto size = folly::Endian::little(folly::loadUnaligned<uint64_t>(
+      input.data()));
+    input.advance(sizeof(size));
+    auto segment = apache::thrift::CompactSerializer::deserialize<
+      thrift::BatchSegment>(folly::StringPiece(input.subpiece(0, size)));
+    input.advance(size);
+
+    EXPECT_EQ(
+      Id::fromThrift(*segment.firstId()),
+      Id::lowest() + base.size());
+    auto facts = segment.batch()->facts()->toStdString();
+    if (*segment.compression() == thrift::BatchCompression::Zstd) {
+      facts = folly::io::getCodec(folly::io::CodecType::ZSTD)
+        ->uncompress(facts);
+    }
+    binary::Output output;
+    const auto count = *segment.batch()->count();
+    auto first = substituteBatch(
+      server.inventory.inventory,
+      folly::range(base),
+      Id::fromThrift(*segment.firstId()),
+      count,
+      binary::byteRange(facts),
+      output);
+    auto subst = defineUntrustedBatch(
+      server.db,
+      server.inventory.inventory,
+      first,
+      nullptr,
+      count,
+      output.bytes());
+    auto ids = subst.serialize();
+    for (auto id : *ids.ids()) {
+      base.push_back(Id::fromThrift(id));
+    }
+  }
+}
+
+// The facts in a database with the references in their keys replaced by the
+// facts they refer to, so databases which number their facts differently
+// can be compared
+std::set<std::string> contents(FactSet& db) {
+  std::function<std::string(Id)> render = [&](Id id) {
+    Pid type;
+    std::vector<uint64_t> xs;
+    db.factById(id, [&](Pid ty, Fact::Clause clause) {
+      type = ty;
+      binary::Input input(clause.key());
+      while (!input.empty()) {
+        xs.push_back(input.packed<uint64_t>());
+      }
+    });
+    if (type == NAME) {
+      return folly::to<std::string>(xs.at(0));
+    }
+    std::string s = "(";
+    for (auto x : xs) {
+      s += render(Id::fromWord(x)) + ",";
+    }
+    return s + ")";
+  };
+  std::set<std::string> facts;
+  for (const auto& fact : db) {
+    facts.insert(render(fact.id()));
+  }
+  return facts;
+}
+
+// Produce facts in two batches which share a cache, sending them with 'send'
+// in the order a, b, a
+void produce(
+    BatchBase& a,
+    BatchBase& b,
+    const std::function<void(BatchBase&)>& send) {
+  auto n0 = define(a, NAME, {0});
+  auto n1 = define(a, NAME, {1});
+  define(a, PAIR, {n0.toWord(), n1.toWord()});
+  send(a);
+
+  // b doesn't see the facts a has sent
+  auto m1 = define(b, NAME, {1});
+  auto m2 = define(b, NAME, {2});
+  define(b, PAIR, {m2.toWord(), m1.toWord()});
+  define(b, PAIR, {m1.toWord(), m2.toWord()});
+  send(b);
+
+  // a sees its own facts in the cache now but not those of b
+  auto p01 = define(a, PAIR, {
+    define(a, NAME, {0}).toWord(),
+    define(a, NAME, {1}).toWord()});
+  auto n2 = define(a, NAME, {2});
+  define(a, TRIPLE, {p01.toWord(), n2.toWord()});
+  define(a, PAIR, {n2.toWord(), define(a, NAME, {3}).toWord()});
+  send(a);
+}
+
+}
+
+// Three batches in flight at once which refer to each other's facts. Each
+// one has to carry copies of the facts of earlier batches it depends on, and
+// the substitutions have to put the facts each batch sent for the first time
+// into the cache with the ids the server gave them.
+TEST(BatchTest, overlappingBatches) {
+  auto inventory = schemaInventory();
+  auto cache = std::make_shared<BatchCache>(1 << 20);
+  BatchBase batch(&inventory, cache);
+  Server server{inventory};
+
+  auto n0 = define(batch, NAME, {0});
+  auto n1 = define(batch, NAME, {1});
+  auto p01 = define(batch, PAIR, {n0.toWord(), n1.toWord()});
+  size_t copied1;
+  auto b1 = batch.serializeFrom(0, copied1);
+  EXPECT_EQ(copied1, 0u);
+  EXPECT_EQ(*b1.count(), 3);
+
+  // refers to p01 and through it to n0 and n1
+  auto n2 = define(batch, NAME, {2});
+  auto t = define(batch, TRIPLE, {p01.toWord(), n2.toWord()});
+  size_t copied2;
+  auto b2 = batch.serializeFrom(3, copied2);
+  EXPECT_EQ(copied2, 3u);
+  EXPECT_EQ(*b2.count(), 5);
+
+  // refers to n2 from the second batch and n1 from the first
+  define(batch, PAIR, {n2.toWord(), n1.toWord()});
+  size_t copied3;
+  auto b3 = batch.serializeFrom(5, copied3);
+  EXPECT_EQ(copied3, 2u);
+  EXPECT_EQ(*b3.count(), 3);
+
+  // The server sees the batches in order
+  auto s1 = server.write(b1);
+  auto s2 = server.write(b2);
+  auto s3 = server.write(b3);
+
+  // the copies didn't create new facts
+  EXPECT_EQ(server.db.size(), 6u);
+  const auto sn0 = server.id(NAME, {0});
+  const auto sn1 = server.id(NAME, {1});
+  const auto sn2 = server.id(NAME, {2});
+  const auto sp01 = server.id(PAIR, {sn0.toWord(), sn1.toWord()});
+  const auto st = server.id(TRIPLE, {sp01.toWord(), sn2.toWord()});
+  const auto sp21 = server.id(PAIR, {sn2.toWord(), sn1.toWord()});
+  for (auto id : {sn0, sn1, sn2, sp01, st, sp21}) {
+    EXPECT_NE(id, Id::invalid());
+  }
+
+  batch.rebase(s1, copied1);
+  EXPECT_EQ(cached(*cache, NAME, {0}), sn0);
+  EXPECT_EQ(cached(*cache, NAME, {1}), sn1);
+  EXPECT_EQ(cached(*cache, PAIR, {sn0.toWord(), sn1.toWord()}), sp01);
+  EXPECT_EQ(cached(*cache, NAME, {2}), Id::invalid());
+  EXPECT_EQ(batch.bufferStats().count, 3u);
+  // known facts are now found in the cache
+  EXPECT_EQ(define(batch, NAME, {1}), sn1);
+
+  batch.rebase(s2, copied2);
+  EXPECT_EQ(cached(*cache, NAME, {2}), sn2);
+  EXPECT_EQ(cached(*cache, TRIPLE, {sp01.toWord(), sn2.toWord()}), st);
+  EXPECT_EQ(cachedKey(*cache, st), key({sp01.toWord(), sn2.toWord()}));
+  EXPECT_EQ(cached(*cache, PAIR, {sn2.toWord(), sn1.toWord()}), Id::invalid());
+  EXPECT_EQ(batch.bufferStats().count, 1u);
+
+  batch.rebase(s3, copied3);
+  EXPECT_EQ(cached(*cache, PAIR, {sn2.toWord(), sn1.toWord()}), sp21);
+  EXPECT_EQ(cachedKey(*cache, sp21), key({sn2.toWord(), sn1.toWord()}));
+  EXPECT_EQ(batch.bufferStats().count, 0u);
+
+  // nothing is left to send
+  size_t copied4;
+  auto b4 = batch.serializeFrom(0, copied4);
+  EXPECT_EQ(*b4.count(), 0);
+  EXPECT_EQ(define(batch, TRIPLE, {sp01.toWord(), sn2.toWord()}), st);
+  EXPECT_EQ(batch.bufferStats().count, 0u);
+}
+
+// Segments written by two batches which share a cache load into the same
+// facts as sending the batches to a server.
+TEST(BatchTest, segments) {
+  auto inventory = schemaInventory();
+
+  Server expected{inventory};
+  {
+    auto cache = std::make_shared<BatchCache>(1 << 20);
+    BatchBase a(&inventory, cache);
+    BatchBase b(&inventory, cache);
+    produce(a, b, [&](BatchBase& batch) {
+      batch.rebase(expected.write(batch.serialize()));
+    });
+  }
+
+  for (auto compress : {false, true}) {
+    folly::test::TemporaryDirectory dir;
+    auto path = (dir.path() / "segments").string();
+    {
+      auto cache = std::make_shared<BatchCache>(1 << 20);
+      BatchBase a(&inventory, cache);
+      BatchBase b(&inventory, cache);
+      auto writer = streamWriter(path, compress);
+      produce(a, b, [&](BatchBase& batch) { writer->rebaseAndSend(batch); });
+      writer->flush(a);
+      writer->flush(b);
+      EXPECT_EQ(a.bufferStats().count, 0u);
+      EXPECT_EQ(b.bufferStats().count, 0u);
+    }
+
+    Server loaded{inventory};
+    load(loaded, path);
+    EXPECT_EQ(loaded.db.size(), expected.db.size());
+    EXPECT_EQ(contents(loaded.db), contents(expected.db));
+  }
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <thread>
+#include <gtest/gtest.h>
+
+#include "glean/rts/cursor.h"
+#include "glean/rts/factset.h"
+#include "glean/rts/stacked.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+CursorTable::Iterators iterators(size_t n) {
+  CursorTable::Iterators iters;
+  for (size_t i = 0; i < n; ++i) {
+    iters.push_back(std::make_unique<EmptyIterator>());
+  }
+  return iters;
+}
+
+CursorTable::Options options(size_t capacity, int64_t ttl_ms = 60000) {
+  return CursorTable::Options{capacity, std::chrono::milliseconds(ttl_ms)};
+}
+
+const Pid P = Pid::lowest();
+
+void define(Define& facts, const std::string& key) {
+  facts.define(P, Fact::Clause::fromKey(binary::byteRange(key)));
+}
+
+std::vector<std::string> keys(FactIterator& iter) {
+  std::vector<std::string> keys;
+  for (; auto ref = iter.get(FactIterator::KeyOnly); iter.next()) {
+    keys.push_back(binary::mkString(ref.key()));
+  }
+  return keys;
+}
+
+}
+
+TEST(CursorTest, takeOnce) {
+  CursorTable table(options(1024));
+  auto id = table.park(iterators(3), Id::lowest(), 100);
+  ASSERT_NE(id, 0);
+  EXPECT_EQ(table.take(id, Id::lowest()).size(), 3);
+  EXPECT_EQ(table.take(id, Id::lowest()).size(), 0);
+  EXPECT_EQ(table.stats().cursors, 0);
+}
+
+TEST(CursorTest, boundMismatch) {
+  CursorTable table(options(1024));
+  auto id = table.park(iterators(1), Id::lowest(), 100);
+  EXPECT_EQ(table.take(id, Id::lowest() + 1).size(), 0);
+  // the cursor is dropped even if the bound didn't match
+  EXPECT_EQ(table.take(id, Id::lowest()).size(), 0);
+}
+
+TEST(CursorTest, evictOldest) {
+  CursorTable table(options(250));
+  auto a = table.park(iterators(1), Id::lowest(), 100);
+  auto b = table.park(iterators(1), Id::lowest(), 100);
+  auto c = table.park(iterators(1), Id::lowest(), 100);
+  EXPECT_EQ(table.stats().cursors, 2);
+  EXPECT_EQ(table.take(a, Id::lowest()).size(), 0);
+  EXPECT_EQ(table.take(b, Id::lowest()).size(), 1);
+  EXPECT_EQ(table.take(c, Id::lowest()).size(), 1);
+
+  // too big to park at all
+  EXPECT_EQ(table.park(iterators(1), Id::lowest(), 1000), 0);
+}
+
+TEST(CursorTest, expire) {
+  CursorTable table(options(1024, 1));
+  auto id = table.park(iterators(1), Id::lowest(), 100);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(table.take(id, Id::lowest()).size(), 0);
+}
+
+TEST(CursorTest, close) {
+  CursorTable table(options(1024));
+  auto id = table.park(iterators(1), Id::lowest(), 100);
+  table.close();
+  EXPECT_EQ(table.take(id, Id::lowest()).size(), 0);
+  EXPECT_EQ(table.park(iterators(1), Id::lowest(), 100), 0);
+}
+
+// Queries run against the DB with a FactSet of derived facts stacked on
+// top, which only lives for one request. A parked iterator must still work
+// on the next request after the derived facts have gone.
+TEST(CursorTest, restartStacked) {
+  FactSet db(Id::lowest());
+  for (auto key : {"a", "b", "c", "d"}) {
+    define(db, key);
+  }
+  CursorTable table(options(1024));
+
+  uint64_t cursor;
+  {
+    auto derived = std::make_unique<FactSet>(db.firstFreeId());
+    Stacked<Define> facts(&db, derived.get());
+    const auto bound = facts.firstFreeId();
+    auto iter = CursorTable::seek(facts, bound, P, {}, 0);
+    ASSERT_NE(iter, nullptr);
+    iter->next();
+
+    // the query derives facts after the seek, which the parked iterator
+    // mustn't see
+    define(facts, "bb");
+    EXPECT_EQ(CursorTable::seek(facts, bound, P, {}, 0), nullptr);
+
+    CursorTable::Iterators iters;
+    iters.push_back(std::move(iter));
+    cursor = table.park(std::move(iters), bound, 100);
+    ASSERT_NE(cursor, 0);
+  }
+
+  // the next page, with a fresh set of derived facts
+  auto derived = std::make_unique<FactSet>(db.firstFreeId());
+  Stacked<Define> facts(&db, derived.get());
+  define(facts, "cc");
+  auto iters = table.take(cursor, db.firstFreeId());
+  ASSERT_EQ(iters.size(), 1);
+  derived.reset();
+  EXPECT_EQ(keys(*iters[0]), (std::vector<std::string>{"b", "c", "d"}));
+}
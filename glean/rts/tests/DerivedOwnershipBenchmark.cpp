@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <common/init/Init.h>
+#include <folly/Benchmark.h>
+
+#include "glean/rts/ownership/derived.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+const size_t FACTS = 20000000;
+const size_t BATCH = 100000;
+const UsetId UNITS = 100000;
+const uint64_t FIRST_FACT = 1024;
+
+// No sets in the DB, so every multiply-derived fact gets a new set.
+struct EmptyOwnership final : Ownership {
+  UsetId getOwner(Id) override {
+    return INVALID_USET;
+  }
+
+  std::unique_ptr<OwnershipSetIterator> getSetIterator() override {
+    return nullptr;
+  }
+
+  UsetId nextSetId() override {
+    return UNITS;
+  }
+
+  UsetId lookupSet(Uset*) override {
+    return INVALID_USET;
+  }
+
+  folly::Optional<SetExpr<SetU32>> getUset(UsetId) override {
+    return folly::none;
+  }
+};
+
+struct Batch {
+  std::vector<Id> ids;
+  std::vector<UsetId> owners;
+};
+
+// A synthetic stream of derived-ownership batches in the order a
+// derivation produces them: each batch derives a run of new facts, owned
+// by a few units each, and re-derives a fraction 1/dups of the facts from
+// earlier batches with a random owner.
+std::vector<Batch> genStream(size_t facts, size_t dups) {
+  std::vector<Batch> batches;
+  for (uint64_t start = 0; start < facts; start += BATCH) {
+    Batch batch;
+    for (uint64_t i = start; i < std::min(facts, start + BATCH); ++i) {
+      batch.ids.push_back(Id::fromWord(FIRST_FACT + i));
+      batch.owners.push_back((i / 64) % UNITS);
+      if (dups != 0 && uniform64(i) % dups == 0) {
+        auto earlier = uniform64(i) % (i + 1);
+        batch.ids.push_back(Id::fromWord(FIRST_FACT + earlier));
+        batch.owners.push_back(uniform28(i) % UNITS);
+      }
+    }
+    batches.push_back(std::move(batch));
+  }
+  return batches;
+}
+
+struct StreamIterator final : DerivedFactOwnershipIterator {
+  explicit StreamIterator(const std::vector<Batch>& batches)
+      : batches_(batches) {}
+
+  folly::Optional<DerivedFactOwnership> get() override {
+    if (i_ >= batches_.size()) {
+      return folly::none;
+    }
+    auto& batch = batches_[i_++];
+    return DerivedFactOwnership{
+      folly::range(batch.ids),
+      folly::range(batch.owners)
+    };
+  }
+
+  const std::vector<Batch>& batches_;
+  size_t i_ = 0;
+};
+
+void run(size_t dups, DerivedOwnershipOptions opts) {
+  folly::BenchmarkSuspender braces;
+  auto batches = genStream(FACTS, dups);
+  EmptyOwnership ownership;
+  StreamIterator iter(batches);
+  braces.dismiss();
+  auto computed = computeDerivedOwnership(ownership, &iter, opts);
+  folly::doNotOptimizeAway(computed->facts_.size());
+  braces.rehire();
+  computed.reset();
+}
+
+DerivedOwnershipOptions inMemory(size_t threads) {
+  DerivedOwnershipOptions opts;
+  opts.memory_limit = SIZE_MAX;
+  opts.threads = threads;
+  return opts;
+}
+
+DerivedOwnershipOptions spilling(size_t threads) {
+  DerivedOwnershipOptions opts;
+  opts.memory_limit = 16 << 20;
+  opts.threads = threads;
+  return opts;
+}
+
+} // namespace
+
+BENCHMARK(Unique_1Thread) {
+  run(0, inMemory(1));
+}
+
+BENCHMARK(Unique_8Threads) {
+  run(0, inMemory(8));
+}
+
+BENCHMARK(Dups10_1Thread) {
+  run(10, inMemory(1));
+}
+
+BENCHMARK(Dups10_8Threads) {
+  run(10, inMemory(8));
+}
+
+BENCHMARK(Dups10_Spill16M_8Threads) {
+  run(10, spilling(8));
+}
+
+BENCHMARK(Dups2_Spill16M_8Threads) {
+  run(2, spilling(8));
+}
+
+int main(int argc, char** argv) {
+  facebook::initFacebook(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
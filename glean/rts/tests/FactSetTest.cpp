@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <set>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "glean/rts/factset.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+const Pid A = Pid::fromWord(1024);
+const Pid B = Pid::fromWord(1025);
+
+std::string key(uint64_t i) {
+  // Short keys over a small alphabet so prefixes are shared a lot
+  std::string s;
+  for (auto n = uniform7(i) % 6 + 1; n != 0; --n) {
+    s += 'a' + uniform64(i * 7 + n) % 4;
+  }
+  return s;
+}
+
+std::vector<std::string> seek(FactSet& facts, Pid pid, const std::string& s) {
+  std::vector<std::string> keys;
+  for (auto iter = facts.seek(pid, binary::byteRange(s), s.size());
+       auto ref = iter->get();
+       iter->next()) {
+    EXPECT_EQ(ref.type, pid);
+    keys.push_back(binary::mkString(ref.key()));
+  }
+  return keys;
+}
+
+std::vector<std::string> expected(
+    const std::set<std::string>& keys,
+    const std::string& prefix) {
+  std::vector<std::string> r;
+  for (const auto& k : keys) {
+    if (k.compare(0, prefix.size(), prefix) == 0) {
+      r.push_back(k);
+    }
+  }
+  return r;
+}
+
+}
+
+// Interleave definitions and seeks, so the index has to absorb new facts
+// into existing runs.
+TEST(FactSetTest, incrementalSeek) {
+  FactSet facts(Id::lowest());
+  std::set<std::string> a, b;
+  for (uint64_t i = 0; i < 2000; ++i) {
+    auto k = key(i);
+    auto pid = uniform7(i * 3) % 3 == 0 ? B : A;
+    facts.define(pid, Fact::Clause::fromKey(binary::byteRange(k)));
+    (pid == A ? a : b).insert(k);
+
+    if (uniform7(i) % 5 == 0) {
+      auto prefix = key(i + 1000000).substr(0, uniform7(i + 1) % 3);
+      EXPECT_EQ(seek(facts, A, prefix), expected(a, prefix)) << i;
+      if (i > 1000) {
+        EXPECT_EQ(seek(facts, B, prefix), expected(b, prefix)) << i;
+      }
+    }
+  }
+  EXPECT_EQ(seek(facts, A, ""), expected(a, ""));
+  EXPECT_EQ(seek(facts, B, ""), expected(b, ""));
+  EXPECT_TRUE(seek(facts, Pid::fromWord(1026), "").empty());
+}
+
+// Concurrent seeks, each of which may be the one that indexes new facts
+TEST(FactSetTest, concurrentSeek) {
+  FactSet facts(Id::lowest());
+  std::set<std::string> a;
+  for (uint64_t round = 0; round < 10; ++round) {
+    for (uint64_t i = round * 100; i < (round + 1) * 100; ++i) {
+      auto k = key(i);
+      facts.define(A, Fact::Clause::fromKey(binary::byteRange(k)));
+      a.insert(k);
+    }
+    const auto all = expected(a, "");
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+      threads.emplace_back([&] {
+        EXPECT_EQ(seek(facts, A, ""), all);
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <common/init/Init.h>
+#include <folly/Benchmark.h>
+#include <folly/json.h>
+
+#include "glean/rts/fact.h"
+#include "glean/rts/jsonfacts.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+const Pid NAME = Pid::fromWord(1024);
+const Pid DECL = Pid::fromWord(1025);
+const Id FIRST = Id::fromWord(uint64_t(1) << 62);
+
+void word(std::string& s, uint64_t x) {
+  s.append(reinterpret_cast<const char *>(&x), sizeof(x));
+}
+
+void kind(std::string& s, JsonType::Kind k) {
+  s += static_cast<char>(k);
+}
+
+void str(std::string& s, const std::string& x) {
+  word(s, x.size());
+  s += x;
+}
+
+// test.Name.1 : string
+// test.Decl.1 : {
+//   name : test.Name, span : { start : nat, length : nat }, lines : [nat]
+// }
+std::unique_ptr<JsonFactSchema> schema() {
+  using K = JsonType::Kind;
+  std::string s;
+  word(s, 2);
+  word(s, NAME.toWord());
+  kind(s, K::String);
+  kind(s, K::Record);
+  word(s, 0);
+  word(s, DECL.toWord());
+  kind(s, K::Record);
+  word(s, 3);
+  str(s, "name");
+  kind(s, K::Predicate);
+  word(s, NAME.toWord());
+  str(s, "span");
+  kind(s, K::Record);
+  word(s, 2);
+  str(s, "start");
+  kind(s, K::Nat);
+  str(s, "length");
+  kind(s, K::Nat);
+  str(s, "lines");
+  kind(s, K::Array);
+  kind(s, K::Nat);
+  kind(s, K::Record);
+  word(s, 0);
+  word(s, 2);
+  str(s, "test.Name");
+  word(s, 1);
+  word(s, NAME.toWord());
+  str(s, "test.Decl");
+  word(s, 1);
+  word(s, DECL.toWord());
+  return JsonFactSchema::decode(binary::byteRange(s));
+}
+
+// A file of n Decl facts, each with a nested Name fact
+std::string document(size_t n) {
+  std::string s = R"([{"predicate": "test.Decl.1", "facts": [)";
+  for (uint64_t i = 0; i < n; ++i) {
+    if (i != 0) {
+      s += ",";
+    }
+    s += folly::sformat(
+      "\n  {{\"key\": {{\"name\": {{\"key\": \"identifier_{}\"}}, "
+      "\"span\": {{\"start\": {}, \"length\": {}}}, \"lines\": [",
+      uniform64(i) % 100000,
+      uniform28(i),
+      uniform7(i));
+    for (uint64_t j = 0; j < uniform7(i) % 8; ++j) {
+      s += folly::sformat("{}{}", j == 0 ? "" : ", ", uniform14(i + j));
+    }
+    s += "]}}";
+  }
+  s += "\n]}]";
+  return s;
+}
+
+// What glean_json_parse and Glean.Write.JSON do today: parse the entire
+// document to a folly::dynamic and then walk it.
+struct Dynamic {
+  binary::Output facts;
+  Id next = FIRST;
+
+  void value(const JsonType& ty, const folly::dynamic& v, binary::Output& o) {
+    switch (ty.kind) {
+      case JsonType::Kind::String: {
+        auto s = v.getString();
+        o.mangleString(binary::byteRange(s));
+        break;
+      }
+      case JsonType::Kind::Nat:
+        o.packed(v.getInt());
+        break;
+      case JsonType::Kind::Array:
+        o.packed(v.size());
+        for (const auto& x : v) {
+          value(*ty.elem, x, o);
+        }
+        break;
+      case JsonType::Kind::Record:
+        for (const auto& f : ty.fields) {
+          value(*f.type, v[f.name], o);
+        }
+        break;
+      case JsonType::Kind::Predicate:
+        o.packed(fact(*schema->lookup(Pid::fromWord(ty.arg)), v));
+        break;
+      default:
+        break;
+    }
+  }
+
+  Id fact(const JsonFactSchema::Predicate& pred, const folly::dynamic& v) {
+    binary::Output clause;
+    value(*pred.key, v["key"], clause);
+    Fact::serialize(facts, pred.pid, Fact::Clause::fromKey(clause.bytes()));
+    return next++;
+  }
+
+  const JsonFactSchema *schema;
+};
+
+void dynamic(size_t iters, size_t n) {
+  folly::BenchmarkSuspender braces;
+  auto s = schema();
+  auto doc = document(n);
+  braces.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    auto json = folly::parseJson(doc);
+    Dynamic d;
+    d.schema = s.get();
+    for (const auto& batch : json) {
+      auto pred = s->lookup("test.Decl", 1);
+      for (const auto& f : batch["facts"]) {
+        d.fact(*pred, f);
+      }
+    }
+    folly::doNotOptimizeAway(d.facts.size());
+  }
+}
+
+void streaming(size_t iters, size_t n, size_t window) {
+  folly::BenchmarkSuspender braces;
+  auto s = schema();
+  auto doc = document(n);
+  JsonFactOptions opts;
+  opts.window = window;
+  braces.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    auto facts = convertJsonFacts(*s, binary::byteRange(doc), FIRST, opts);
+    folly::doNotOptimizeAway(facts.facts.size());
+  }
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM(dynamic, 1k, 1000)
+BENCHMARK_RELATIVE_NAMED_PARAM(streaming, 1k, 1000, 256 * 1024)
+BENCHMARK_RELATIVE_NAMED_PARAM(streaming, 1k_window4k, 1000, 4096)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(dynamic, 100k, 100000)
+BENCHMARK_RELATIVE_NAMED_PARAM(streaming, 100k, 100000, 256 * 1024)
+BENCHMARK_RELATIVE_NAMED_PARAM(streaming, 100k_window4k, 100000, 4096)
+
+int main(int argc, char** argv) {
+  facebook::initFacebook(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
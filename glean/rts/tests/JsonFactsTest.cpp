@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "glean/rts/fact.h"
+#include "glean/rts/jsonfacts.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+using namespace std::string_literals;
+
+namespace {
+
+const Pid NAME = Pid::fromWord(1024);
+const Pid DECL = Pid::fromWord(1025);
+const Id FIRST = Id::fromWord(uint64_t(1) << 62);
+
+const JsonFactsKernels ALL_KERNELS[] = {
+  JsonFactsKernels::Scalar,
+  JsonFactsKernels::AVX2,
+};
+
+// Run f for every implementation the CPU supports
+template<typename F>
+void forEachKernels(F&& f) {
+  for (auto k : ALL_KERNELS) {
+    if (selectJsonFactsKernels(k)) {
+      SCOPED_TRACE(static_cast<int>(k));
+      f();
+    }
+  }
+  selectJsonFactsKernels(bestJsonFactsKernels());
+}
+
+// Serialised JsonFactSchema, see jsonfacts.h
+struct SchemaBuilder {
+  std::string bytes;
+
+  SchemaBuilder& word(uint64_t x) {
+    bytes.append(reinterpret_cast<const char *>(&x), sizeof(x));
+    return *this;
+  }
+  SchemaBuilder& kind(JsonType::Kind k) {
+    bytes += static_cast<char>(k);
+    return *this;
+  }
+  SchemaBuilder& str(const std::string& s) {
+    word(s.size());
+    bytes += s;
+    return *this;
+  }
+};
+
+// test.Name.1 : string
+// test.Decl.2 : {
+//   name : string, n : nat, b : byte, arr : [nat], bytes : [byte],
+//   m : maybe nat, s : { x : nat | y : string }, e : enum { a | b | c },
+//   f : bool, ref : test.Name
+// } -> nat
+std::unique_ptr<JsonFactSchema> schema() {
+  using K = JsonType::Kind;
+  SchemaBuilder b;
+  b.word(2);
+  b.word(NAME.toWord()).kind(K::String).kind(K::Record).word(0);
+  b.word(DECL.toWord()).kind(K::Record).word(10);
+  b.str("name").kind(K::String);
+  b.str("n").kind(K::Nat);
+  b.str("b").kind(K::Byte);
+  b.str("arr").kind(K::Array).kind(K::Nat);
+  b.str("bytes").kind(K::Array).kind(K::Byte);
+  b.str("m").kind(K::Maybe).kind(K::Nat);
+  b.str("s").kind(K::Sum).word(2);
+  b.str("x").kind(K::Nat).str("y").kind(K::String);
+  b.str("e").kind(K::Enum).word(3);
+  b.str("f").kind(K::Bool);
+  b.str("ref").kind(K::Predicate).word(NAME.toWord());
+  b.kind(K::Nat);
+  b.word(2);
+  b.str("test.Name").word(1).word(NAME.toWord());
+  b.str("test.Decl").word(2).word(DECL.toWord());
+  return JsonFactSchema::decode(binary::byteRange(b.bytes));
+}
+
+JsonFacts convert(const std::string& json, size_t window = 256 * 1024) {
+  static auto s = schema();
+  JsonFactOptions opts;
+  opts.window = window;
+  return convertJsonFacts(*s, binary::byteRange(json), FIRST, opts);
+}
+
+void fact(binary::Output& out, Pid pid, binary::Output& clause, size_t key) {
+  Fact::serialize(out, pid, Fact::Clause::from(clause.bytes(), key));
+}
+
+void name(binary::Output& out, const std::string& s) {
+  binary::Output clause;
+  clause.mangleString(binary::byteRange(s));
+  fact(out, NAME, clause, clause.size());
+}
+
+// Remove whitespace outside of strings
+std::string minify(const std::string& s) {
+  std::string r;
+  bool in_string = false, escaped = false;
+  for (auto c : s) {
+    if (in_string) {
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        escaped = true;
+      } else if (c == '"') {
+        in_string = false;
+      }
+    } else if (c == '"') {
+      in_string = true;
+    } else if (isspace(c)) {
+      continue;
+    }
+    r += c;
+  }
+  return r;
+}
+
+const std::string DOC = R"([
+  {"predicate": "test.Name", "unit": "u1", "facts": [
+    {"key": "hello"},
+    {"id": 5, "key": "wé😀\"\\\/\n"}
+  ]},
+  {"facts": [
+    {"key": {"name": "x", "n": 300, "ref": {"key": "nested"}, "b": 7,
+             "arr": [1, 2, 128], "bytes": "AAEC/w==", "m": 4,
+             "s": {"y": "sv"}, "e": 2, "f": true},
+     "value": 9},
+    {"value": 3, "key": {"f": false, "ref": 5, "name": "y"}},
+    {"id": 7}
+  ], "ignored": [1, {"a": "]"}], "unit": "u2",
+  "predicate": {"name": "test.Decl", "version": 2}},
+  {"predicate": "test.Name.1", "facts": [], "unit": null}
+])";
+
+binary::Output expected() {
+  binary::Output out;
+  name(out, "hello");
+  name(out, "w\xC3\xA9\xF0\x9F\x98\x80\"\\/\n");
+  name(out, "nested");
+
+  binary::Output x;
+  x.mangleString(binary::byteRange("x"s));
+  x.packed(300);
+  x.fixed<uint8_t>(7);
+  x.packed(3);
+  x.packed(1);
+  x.packed(2);
+  x.packed(128);
+  x.packed(4);
+  x.put(binary::byteRange("\x00\x01\x02\xFF"s));
+  x.packed(1);
+  x.packed(4);
+  x.packed(1);
+  x.mangleString(binary::byteRange("sv"s));
+  x.packed(2);
+  x.packed(1);
+  x.packed(FIRST + 2);
+  auto key = x.size();
+  x.packed(9);
+  fact(out, DECL, x, key);
+
+  binary::Output y;
+  y.mangleString(binary::byteRange("y"s));
+  for (int i = 0; i < 5; ++i) {
+    y.packed(0); // n, b, arr, bytes, m
+  }
+  y.packed(0); // s
+  y.packed(0);
+  y.packed(0); // e
+  y.packed(0); // f
+  y.packed(5);
+  key = y.size();
+  y.packed(3);
+  fact(out, DECL, y, key);
+  return out;
+}
+
+}
+
+TEST(JsonFactsTest, convert) {
+  auto facts = convert(DOC);
+  EXPECT_EQ(facts.count, 5);
+  EXPECT_EQ(facts.facts.string(), expected().string());
+  EXPECT_EQ(facts.ids, (std::vector<int64_t>{0, 5, 0, 0, 0}));
+  ASSERT_EQ(facts.owned.size(), 2);
+  EXPECT_EQ(facts.owned[0].first, "u1");
+  EXPECT_EQ(facts.owned[0].second, std::make_pair(FIRST, FIRST + 1));
+  EXPECT_EQ(facts.owned[1].first, "u2");
+  EXPECT_EQ(facts.owned[1].second, std::make_pair(FIRST + 2, FIRST + 4));
+}
+
+// The result mustn't depend on how the input is split into windows or on
+// whitespace
+TEST(JsonFactsTest, windows) {
+  const auto expected = convert(DOC).facts.string();
+  const auto mini = minify(DOC);
+  forEachKernels([&] {
+    for (size_t window : {64, 128, 192, 4096}) {
+      EXPECT_EQ(convert(DOC, window).facts.string(), expected) << window;
+      EXPECT_EQ(convert(mini, window).facts.string(), expected) << window;
+    }
+  });
+}
+
+// Strings with escapes, quotes and brackets straddling block boundaries
+TEST(JsonFactsTest, strings) {
+  for (uint64_t i = 0; i < 1000; ++i) {
+    std::string json = R"([{"predicate":"test.Name","facts":[)";
+    binary::Output out;
+    for (uint64_t j = 0; j < uniform7(i) % 5 + 1; ++j) {
+      std::string raw, s;
+      for (uint64_t k = 0; k < uniform64(i * 7 + j) % 150; ++k) {
+        switch (uniform64(i * 1000 + j * 150 + k) % 8) {
+          case 0: raw += R"(\\)"; s += '\\'; break;
+          case 1: raw += R"(\")"; s += '"'; break;
+          case 2: raw += "]},:["; s += "]},:["; break;
+          case 3: raw += R"(\u0000)"; s += '\0'; break;
+          default: raw += 'a' + k % 26; s += raw.back(); break;
+        }
+      }
+      if (j != 0) {
+        json += ',';
+      }
+      json += std::string(uniform64(i + j) % 70, ' ');
+      json += R"({"key":")" + raw + "\"}";
+      name(out, s);
+    }
+    json += "]}]";
+    forEachKernels([&] {
+      for (size_t window : {64, 128, 4096}) {
+        EXPECT_EQ(convert(json, window).facts.string(), out.string()) << json;
+      }
+    });
+  }
+}
+
+TEST(JsonFactsTest, errors) {
+  const std::string bad[] = {
+    "[",
+    "[{}]",
+    R"([{"predicate":"test.Name"}])",
+    R"([{"predicate":"test.Other","facts":[]}])",
+    R"([{"predicate":"test.Name","facts":[{"key":1}]}])",
+    R"([{"predicate":"test.Name","facts":[{"key":"a","bogus":1}]}])",
+    R"([{"predicate":"test.Name","facts":[{"id":0}]}])",
+    R"([{"predicate":"test.Name","facts":[{"key":"a\x"}]}])",
+    R"([{"predicate":"test.Name","facts":[{"key":"a}]}])",
+    R"([{"predicate":"test.Name","facts":[{"key":"a"} {"key":"b"}]}])",
+    R"([{"predicate":"test.Name","facts":[{"key" "a"}]}])",
+    R"([{"predicate":"test.Name","facts":[]}] x)",
+    R"([{"predicate":"test.Name",)"
+      R"("facts":[{"id":4611686018427387904,"key":"a"}]}])",
+    R"([{"predicate":"test.Decl.2","facts":[{"key":{"name":"x"}}]}])",
+  };
+  const std::string bad_decls[] = {
+    R"("n":1.5)",
+    R"("n":99999999999999999999)",
+    R"("e":3)",
+    R"("f":1)",
+    R"("s":{})",
+    R"("s":{"x":1,"y":"a"})",
+    R"("name":"y","name":"z")",
+    R"("unknown":1)",
+  };
+  for (const auto& json : bad) {
+    EXPECT_ANY_THROW(convert(json, 64)) << json;
+  }
+  for (const auto& field : bad_decls) {
+    auto json = R"([{"predicate":"test.Decl.2","facts":[{"key":{"ref":1,)"
+      + field + "}}]}]";
+    EXPECT_ANY_THROW(convert(json, 64)) << json;
+  }
+}
@@ -82,6 +82,31 @@ void checkLookupInvariants(Lookup& lookup) {
     CHECK(found);
   }
 
+  /***********************************************************************
+   * factsById
+   ***********************************************************************/
+  {
+    std::vector<Id> ids;
+    ids.push_back(start-1);
+    for (auto id = start; id < finish; ++id) {
+      ids.push_back(id);
+    }
+    ids.push_back(finish);
+    size_t found = 0;
+    lookup.factsById(
+        folly::Range<const Id*>(ids.data(), ids.size()),
+        [&](Id id, Pid ty, Fact::Clause clause) {
+          CHECK_GE(id, start);
+          CHECK_LT(id, finish);
+          const auto& fact = facts[id - start];
+          CHECK_EQ(ty, fact->type());
+          CHECK_EQ(clause.key().str(), fact->key().str());
+          CHECK_EQ(clause.value().str(), fact->value().str());
+          ++found;
+        });
+    CHECK_EQ(found, facts.size());
+  }
+
   /***********************************************************************
    * facts outside of the range don't exist
    ***********************************************************************/
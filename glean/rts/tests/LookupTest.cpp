@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <map>
+#include <string>
+
+#include <folly/Format.h>
+#include <gtest/gtest.h>
+
+#include "glean/rts/factset.h"
+#include "glean/rts/lookup.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+const Pid P = Pid::fromWord(1024);
+
+std::string key(uint64_t i) {
+  return folly::sformat("{:x}", uniform28(i));
+}
+
+std::vector<std::pair<std::string, Id>> collect(
+    std::unique_ptr<FactIterator> iter) {
+  std::vector<std::pair<std::string, Id>> facts;
+  for (; auto ref = iter->get(); iter->next()) {
+    facts.emplace_back(binary::mkString(ref.key()), ref.id);
+  }
+  return facts;
+}
+
+}
+
+TEST(LookupTest, section) {
+  FactSet facts(Id::lowest());
+  std::map<std::string, Id> all;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    auto k = key(i);
+    auto id = facts.define(P, Fact::Clause::fromKey(binary::byteRange(k)));
+    all.emplace(k, id);
+  }
+
+  for (uint64_t i = 0; i < 100; ++i) {
+    auto from = Id::lowest() + uniform64(i) % 1100;
+    auto upto = from + uniform64(i + 1) % 200;
+    std::vector<std::pair<std::string, Id>> expected;
+    for (const auto& [k, id] : all) {
+      if (from <= id && id < upto) {
+        expected.emplace_back(k, id);
+      }
+    }
+    EXPECT_EQ(
+      collect(FactIterator::section(facts.seek(P, {}, 0), from, upto)),
+      expected);
+  }
+}
+
+TEST(LookupTest, mergeMany) {
+  std::vector<std::unique_ptr<FactSet>> sets;
+  std::map<std::string, Id> all;
+  uint64_t n = 0;
+  for (size_t i = 0; i < 7; ++i) {
+    auto start = sets.empty() ? Id::lowest() : sets.back()->firstFreeId();
+    sets.push_back(std::make_unique<FactSet>(start));
+    for (auto j = uniform7(i) % 100; j != 0; --j, ++n) {
+      auto k = key(n);
+      if (!all.count(k)) {
+        auto id =
+          sets.back()->define(P, Fact::Clause::fromKey(binary::byteRange(k)));
+        all.emplace(k, id);
+      }
+    }
+  }
+
+  for (size_t count = 0; count <= sets.size(); ++count) {
+    std::vector<std::unique_ptr<FactIterator>> iters;
+    for (size_t i = 0; i < count; ++i) {
+      iters.push_back(sets[i]->seek(P, {}, 0));
+    }
+    std::vector<std::pair<std::string, Id>> expected;
+    for (const auto& [k, id] : all) {
+      if (count != 0 && id < sets[count - 1]->firstFreeId()) {
+        expected.emplace_back(k, id);
+      }
+    }
+    EXPECT_EQ(collect(FactIterator::merge(std::move(iters), 0)), expected);
+  }
+}
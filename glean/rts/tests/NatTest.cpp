@@ -124,3 +124,79 @@ RC_GTEST_PROP(NatTest, memcmp, (uint64_t val1, uint64_t val2)) {
   }
   RC_ASSERT(k == compare(val1, val2));
 }
+
+// Bulk decoding and encoding. Mix in small numbers so we get runs of
+// single-byte encodings.
+namespace {
+
+std::vector<uint64_t> mixed(const std::vector<uint64_t>& vals) {
+  std::vector<uint64_t> xs;
+  for (auto val : vals) {
+    xs.push_back(val);
+    for (uint64_t i = 0; i < val % 40; ++i) {
+      xs.push_back((val >> i) & 0x7F);
+    }
+  }
+  return xs;
+}
+
+const facebook::glean::rts::NatKernels ALL_KERNELS[] = {
+    facebook::glean::rts::NatKernels::Scalar,
+    facebook::glean::rts::NatKernels::AVX2,
+};
+
+// Run f for every implementation the CPU supports
+template <typename F>
+void forEachKernels(F&& f) {
+  for (auto k : ALL_KERNELS) {
+    if (facebook::glean::rts::selectNatKernels(k)) {
+      f();
+    }
+  }
+  facebook::glean::rts::selectNatKernels(
+      facebook::glean::rts::bestNatKernels());
+}
+
+} // namespace
+
+RC_GTEST_PROP(NatTest, bulkPacked, (const std::vector<uint64_t>& vals)) {
+  auto xs = mixed(vals);
+  facebook::glean::binary::Output out;
+  out.packedArray(xs.data(), xs.size());
+  facebook::glean::binary::Output one;
+  for (auto x : xs) {
+    one.packed(x);
+  }
+  RC_ASSERT(out.bytes() == one.bytes());
+
+  forEachKernels([&] {
+    std::vector<uint64_t> ys(xs.size());
+    facebook::glean::binary::Input input(out.bytes());
+    input.packedArray(ys.data(), ys.size());
+    RC_ASSERT(ys == xs);
+    RC_ASSERT(input.empty());
+
+    facebook::glean::binary::Input skipped(out.bytes());
+    skipped.skipPackedArray(xs.size());
+    RC_ASSERT(skipped.empty());
+
+    if (!xs.empty()) {
+      facebook::glean::binary::Input truncated(
+          out.bytes().begin(), out.bytes().end() - 1);
+      RC_ASSERT_THROWS(truncated.skipPackedArray(xs.size()));
+      facebook::glean::binary::Input truncated2(
+          out.bytes().begin(), out.bytes().end() - 1);
+      RC_ASSERT_THROWS(truncated2.packedArray(ys.data(), ys.size()));
+    }
+  });
+}
+
+TEST(NatTest, bulkPackedTooLong) {
+  // 11 bytes, with single-byte varints on either side
+  std::vector<unsigned char> bytes(40, 1);
+  std::fill(bytes.begin() + 10, bytes.begin() + 21, 0x80);
+  forEachKernels([&] {
+    facebook::glean::binary::Input input(bytes.data(), bytes.size());
+    ASSERT_ANY_THROW(input.skipPackedArray(30));
+  });
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Native subroutines for the schema used by NativeTypecheckTest, which
+// checks them against the bytecode generated for the same types.
+
+#ifdef OSS
+#include <cpp/ffi.h> // @manual
+#include <cpp/wrap.h> // @manual
+#else
+#include <common/hs/util/cpp/ffi.h>
+#include <common/hs/util/cpp/wrap.h>
+#endif
+#include "glean/cpp/native.h"
+#include "glean/rts/inventory.h"
+#include "glean/rts/substitution.h"
+
+using namespace facebook::hs;
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+enum class Colour { Red, Green, Blue };
+
+}
+
+namespace facebook {
+namespace glean {
+namespace cpp {
+
+template<> struct Repr_<Colour> { using Type = Enum<3>; };
+
+}
+}
+}
+
+namespace {
+
+// Keep in sync with the types in NativeTypecheckTest.hs
+
+struct Name : cpp::Predicate<std::string> {};
+
+struct Decl : cpp::Predicate<
+    std::tuple<
+      cpp::Fact<Name>,
+      unsigned char,
+      std::vector<unsigned char>,
+      std::vector<uint64_t>,
+      std::vector<std::string>,
+      std::vector<std::tuple<uint64_t, cpp::Fact<Name>>>,
+      cpp::maybe_type<cpp::Fact<Name>>,
+      bool,
+      boost::variant<
+        cpp::Alt<0, uint64_t>,
+        cpp::Alt<1, std::string>,
+        cpp::Alt<2, std::vector<cpp::Fact<Name>>>>,
+      Colour>,
+    std::tuple<uint64_t, cpp::Fact<Name>>> {};
+
+struct SCHEMA {
+  template<typename P> struct index;
+  static constexpr size_t count = 2;
+};
+
+}
+
+template<> struct SCHEMA::index<Name> { static constexpr size_t value = 0; };
+template<> struct SCHEMA::index<Decl> { static constexpr size_t value = 1; };
+
+namespace {
+
+const NativePredicate predicates[] = {
+  cpp::native::predicate<SCHEMA, Name>(0x6e6174697665ULL, 1),
+  cpp::native::predicate<SCHEMA, Decl>(0x6e6174697665ULL, 2),
+};
+
+NativeSchemaRegistration registration(
+  NativeSchema{SCHEMA::count, folly::range(predicates)});
+
+}
+
+extern "C" {
+
+// Run the typechecker (mode 0), the substitution (mode 1) or the traversal
+// (mode 2) of a predicate on a clause. The typechecker renames fact IDs to
+// id + pid and the substitution to id + 1000. The traversal outputs the
+// pairs of id and pid it was called with.
+const char *glean_test_native_run(
+    Inventory *inventory,
+    int64_t pid,
+    int mode,
+    const void *clause,
+    size_t key_size,
+    size_t clause_size,
+    const void **out,
+    size_t *out_size,
+    size_t *out_key_size) {
+  return ffi::wrap([=] {
+    auto predicate = inventory->lookupPredicate(Pid::fromWord(pid));
+    if (predicate == nullptr) {
+      rts::error("unknown predicate {}", pid);
+    }
+    auto data = static_cast<const unsigned char *>(clause);
+    auto in = Fact::Clause{data, static_cast<uint32_t>(key_size),
+      static_cast<uint32_t>(clause_size - key_size)};
+    Renamer renamer([](Id id, Pid type) {
+      return Id::fromWord(id.toWord() + type.toWord());
+    });
+    binary::Output output;
+    uint64_t size = 0;
+    switch (mode) {
+      case 0:
+        predicate->typecheck(renamer, in, output, size);
+        break;
+      case 1: {
+        Substitution subst(Id::lowest(), 0);
+        predicate->substitute(Substituter(&subst, 1000), in, output, size);
+        break;
+      }
+      default:
+        predicate->traverse(Traverser([&](Id id, Pid type) {
+          output.nat(id.toWord());
+          output.nat(type.toWord());
+        }), in);
+        size = output.size();
+        break;
+    }
+    ffi::clone_bytes(output.bytes()).release_to(out, out_size);
+    *out_key_size = size;
+  });
+}
+
+}
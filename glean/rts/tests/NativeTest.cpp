@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "glean/cpp/native.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+// A tiny schema, as it would be generated by gen-schema --cpp
+
+struct Name : cpp::Predicate<std::string> {};
+
+struct Decl : cpp::Predicate<
+    std::tuple<
+      cpp::Fact<Name>,
+      std::vector<uint8_t>,
+      cpp::maybe_type<cpp::Fact<Name>>>,
+    uint64_t> {};
+
+struct SCHEMA {
+  template<typename P> struct index;
+  static constexpr size_t count = 2;
+};
+
+}
+
+template<> struct SCHEMA::index<Name> { static constexpr size_t value = 0; };
+template<> struct SCHEMA::index<Decl> { static constexpr size_t value = 1; };
+
+namespace {
+
+const NativePredicate predicates[] = {
+  cpp::native::predicate<SCHEMA, Name>(1, 1),
+  cpp::native::predicate<SCHEMA, Decl>(2, 2),
+};
+
+NativeSchemaRegistration registration(
+  NativeSchema{SCHEMA::count, folly::range(predicates)});
+
+const Pid NAME = Pid::lowest();
+const Pid DECL = Pid::lowest() + 1;
+const Pid pids[] = {NAME, DECL};
+
+// Decl {name, bytes, maybe other} with value 42
+binary::Output decl(
+    uint64_t name,
+    const std::string& bytes,
+    folly::Optional<uint64_t> other,
+    uint64_t& key_size) {
+  binary::Output out;
+  out.packed(name);
+  out.packed(bytes.size());
+  out.bytes(bytes.data(), bytes.size());
+  if (other) {
+    out.packed(1);
+    out.packed(*other);
+  } else {
+    out.packed(0);
+  }
+  key_size = out.size();
+  out.packed(42);
+  return out;
+}
+
+Fact::Clause clause(binary::Output& out, uint64_t key_size) {
+  return Fact::Clause::from(out.bytes(), key_size);
+}
+
+Renamer renamer([](Id id, Pid pid) {
+  EXPECT_EQ(pid, NAME);
+  return id + 1000;
+});
+
+}
+
+TEST(NativeTest, typecheck) {
+  uint64_t in_key, expected_key;
+  auto in = decl(1025, "abc", 1026, in_key);
+  auto expected = decl(2025, "abc", 2026, expected_key);
+
+  binary::Output out;
+  uint64_t key_size = 0;
+  predicates[1].typecheck(pids, renamer, clause(in, in_key), out, key_size);
+  EXPECT_EQ(out.string(), expected.string());
+  EXPECT_EQ(key_size, expected_key);
+
+  binary::Output subst;
+  uint64_t subst_key_size = 0;
+  predicates[1].substitute(
+    pids, renamer, clause(in, in_key), subst, subst_key_size);
+  EXPECT_EQ(subst.string(), expected.string());
+  EXPECT_EQ(subst_key_size, expected_key);
+
+  std::vector<Id> ids;
+  Traverser traverser([&](Id id, Pid pid) {
+    EXPECT_EQ(pid, NAME);
+    ids.push_back(id);
+  });
+  predicates[1].traverse(pids, traverser, clause(in, in_key));
+  EXPECT_EQ(ids, (std::vector<Id>{Id::fromWord(1025), Id::fromWord(1026)}));
+}
+
+TEST(NativeTest, typecheckErrors) {
+  binary::Output out;
+  uint64_t key_size;
+
+  // selector out of range
+  binary::Output bad;
+  bad.packed(1025);
+  bad.packed(0);
+  bad.packed(2);
+  EXPECT_ANY_THROW(predicates[1].typecheck(
+    pids, renamer, Fact::Clause::fromKey(bad.bytes()), out, key_size));
+
+  // extra bytes in the key
+  uint64_t in_key;
+  auto in = decl(1025, "", folly::none, in_key);
+  EXPECT_ANY_THROW(predicates[1].typecheck(
+    pids, renamer, clause(in, in_key + 1), out, key_size));
+}
+
+TEST(NativeTest, inventory) {
+  std::vector<Predicate> preds;
+  preds.push_back(Predicate{NAME, "name", 1, {}, {}});
+  preds.back().hash = PredicateHash{1, 1};
+  preds.push_back(Predicate{DECL, "decl", 1, {}, {}});
+  preds.back().hash = PredicateHash{2, 3};
+  Inventory inventory(std::move(preds));
+
+  auto name = inventory.lookupPredicate(NAME);
+  ASSERT_NE(name, nullptr);
+  EXPECT_EQ(name->native, &predicates[0]);
+  EXPECT_EQ((*name->native_pids)[0], NAME);
+
+  // different definition
+  auto decl = inventory.lookupPredicate(DECL);
+  ASSERT_NE(decl, nullptr);
+  EXPECT_EQ(decl->native, nullptr);
+}
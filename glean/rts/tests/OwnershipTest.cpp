@@ -9,6 +9,7 @@
 #include <fmt/core.h>
 
 #include "glean/rts/ownership.h"
+#include "glean/rts/ownership/derived.h"
 #include "glean/rts/ownership/slice.h"
 
 #include <gtest/gtest.h>
@@ -43,7 +44,8 @@ struct TestOwnership final : Ownership {
   std::unique_ptr<OwnershipSetIterator> getSetIterator() override;
 
   UsetId lookupSet(Uset*) override {
-    LOG(FATAL) << "unimplemented: lookupSet";
+    // the tests don't look up existing sets
+    return INVALID_USET;
   }
 
   folly::Optional<SetExpr<SetU32>> getUset(UsetId) override {
@@ -310,3 +312,79 @@ TEST(OwnershipTest, SliceTest) {
   checkVisibility(ownership, firstUsetId, numSets, {0,1,2}, true);
   checkVisibility(ownership, firstUsetId, numSets, {0,1,2}, false);
 }
+
+namespace {
+
+struct TestDerivedIterator final : DerivedFactOwnershipIterator {
+  explicit TestDerivedIterator(
+      std::vector<std::pair<std::vector<Id>, std::vector<UsetId>>> batches)
+      : batches_(std::move(batches)) {}
+
+  folly::Optional<DerivedFactOwnership> get() override {
+    if (i_ >= batches_.size()) {
+      return folly::none;
+    }
+    auto& batch = batches_[i_++];
+    return DerivedFactOwnership{
+      folly::range(batch.first),
+      folly::range(batch.second)
+    };
+  }
+
+  std::vector<std::pair<std::vector<Id>, std::vector<UsetId>>> batches_;
+  size_t i_ = 0;
+};
+
+UsetId ownerOf(const ComputedOwnership& computed, Id id) {
+  auto it = std::upper_bound(
+      computed.facts_.begin(),
+      computed.facts_.end(),
+      id,
+      [](Id id, const auto& interval) { return id < interval.first; });
+  return it == computed.facts_.begin() ? INVALID_USET : std::prev(it)->second;
+}
+
+}
+
+TEST(OwnershipTest, DerivedOwnershipSpill) {
+  // Facts derived in batches, out of order, with every 7th fact derived a
+  // second time with a different owner.
+  std::vector<std::pair<std::vector<Id>, std::vector<UsetId>>> batches;
+  for (uint64_t b = 0; b < 10; b++) {
+    std::vector<Id> ids;
+    std::vector<UsetId> owners;
+    for (uint64_t i = 0; i < 100; i++) {
+      auto id = 1024 + i * 10 + (9 - b);
+      ids.push_back(Id::fromWord(id));
+      owners.push_back(id / 50 % 3);
+      if (id % 7 == 0) {
+        ids.push_back(Id::fromWord(id));
+        owners.push_back(5);
+      }
+    }
+    batches.emplace_back(std::move(ids), std::move(owners));
+  }
+
+  TestOwnership ownership(10, {}, {});
+
+  TestDerivedIterator inMemory(batches);
+  auto expected = computeDerivedOwnership(ownership, &inMemory);
+
+  DerivedOwnershipOptions opts;
+  opts.memory_limit = 0; // spill every batch
+  opts.threads = 2;
+  TestDerivedIterator spilling(batches);
+  auto actual = computeDerivedOwnership(ownership, &spilling, opts);
+
+  EXPECT_EQ(expected->facts_, actual->facts_);
+  EXPECT_EQ(expected->sets_.size(), actual->sets_.size());
+
+  for (uint64_t id = 1024; id < 2024; id++) {
+    auto owner = ownerOf(*actual, Id::fromWord(id));
+    if (id % 7 == 0) {
+      EXPECT_GE(owner, 10u);
+    } else {
+      EXPECT_EQ(owner, id / 50 % 3);
+    }
+  }
+}
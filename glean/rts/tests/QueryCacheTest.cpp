@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "glean/rts/querycache.h"
+
+using namespace facebook::glean::rts;
+
+namespace {
+
+std::shared_ptr<const CachedResults> results(size_t n) {
+  auto res = std::make_shared<CachedResults>();
+  for (size_t i = 0; i < n; ++i) {
+    res->fact_ids.push_back(i);
+    res->fact_keys.push_back(std::string(100, 'k'));
+    res->fact_values.push_back("");
+  }
+  return res;
+}
+
+}
+
+TEST(QueryCacheTest, hitMiss) {
+  QueryCache cache(1 << 20);
+  EXPECT_EQ(cache.lookup("a"), nullptr);
+  auto res = results(3);
+  cache.insert("a", res);
+  EXPECT_EQ(cache.lookup("a"), res);
+  EXPECT_EQ(cache.lookup("b"), nullptr);
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.entries, 1);
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 2);
+}
+
+TEST(QueryCacheTest, evictLeastRecentlyUsed) {
+  auto size = results(10)->size() + 1;
+  QueryCache cache(2 * size);
+  cache.insert("a", results(10));
+  cache.insert("b", results(10));
+  EXPECT_NE(cache.lookup("a"), nullptr);
+  cache.insert("c", results(10));
+  EXPECT_NE(cache.lookup("a"), nullptr);
+  EXPECT_EQ(cache.lookup("b"), nullptr);
+  EXPECT_NE(cache.lookup("c"), nullptr);
+  EXPECT_LE(cache.stats().bytes, 2 * size);
+}
+
+TEST(QueryCacheTest, tooBig) {
+  QueryCache cache(100);
+  EXPECT_FALSE(cache.fits("a", *results(10)));
+  EXPECT_TRUE(cache.fits("a", *results(0)));
+  cache.insert("a", results(10));
+  EXPECT_EQ(cache.lookup("a"), nullptr);
+  EXPECT_EQ(cache.stats().entries, 0);
+}
+
+TEST(QueryCacheTest, setCapacity) {
+  QueryCache cache(1 << 20);
+  EXPECT_TRUE(cache.enabled());
+  cache.insert("a", results(10));
+  cache.setCapacity(0);
+  EXPECT_FALSE(cache.enabled());
+  EXPECT_EQ(cache.stats().entries, 0);
+  cache.insert("a", results(10));
+  EXPECT_EQ(cache.lookup("a"), nullptr);
+}
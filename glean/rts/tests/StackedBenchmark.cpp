@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <common/init/Init.h>
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+
+#include <map>
+
+#include "glean/rts/stacked.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+const Pid P = Pid::fromWord(1024);
+
+// Facts in each layer, like a small incremental update
+constexpr size_t FACTS = 2000;
+
+// A stack of FactSets, both as a chain of binary Stackeds (which is what
+// Stacked<Define> still builds and what Stacked<Lookup> used to) and as a
+// flattened Stacked<Lookup>.
+struct Stack {
+  explicit Stack(size_t layers) {
+    uint64_t n = 0;
+    for (size_t i = 0; i < layers; ++i) {
+      auto start = sets.empty() ? Id::lowest() : sets.back()->firstFreeId();
+      sets.push_back(std::make_unique<FactSet>(start));
+      for (size_t j = 0; j < FACTS; ++j, ++n) {
+        auto key = folly::sformat("{:016x}", uniform64(n));
+        keys.push_back(key);
+        sets.back()->define(P, Fact::Clause::fromKey(binary::byteRange(key)));
+      }
+      if (i > 0) {
+        chain.push_back(std::make_unique<Stacked<Define>>(
+          i == 1 ? sets[0].get() : static_cast<Lookup *>(chain.back().get()),
+          sets.back().get()));
+        flat.push_back(std::make_unique<Stacked<Lookup>>(
+          i == 1 ? sets[0].get() : static_cast<Lookup *>(flat.back().get()),
+          sets.back().get()));
+      }
+    }
+  }
+
+  Lookup& top(bool flattened) {
+    return flattened
+      ? static_cast<Lookup&>(*flat.back())
+      : static_cast<Lookup&>(*chain.back());
+  }
+
+  std::vector<std::unique_ptr<FactSet>> sets;
+  std::vector<std::unique_ptr<Stacked<Define>>> chain;
+  std::vector<std::unique_ptr<Stacked<Lookup>>> flat;
+  std::vector<std::string> keys;
+};
+
+Stack& stack(size_t layers) {
+  static std::map<size_t, std::unique_ptr<Stack>> stacks;
+  auto& s = stacks[layers];
+  if (!s) {
+    s = std::make_unique<Stack>(layers);
+  }
+  return *s;
+}
+
+void seek(size_t iters, size_t layers, bool flattened) {
+  folly::BenchmarkSuspender braces;
+  auto& lookup = stack(layers).top(flattened);
+  braces.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    size_t n = 0;
+    for (auto iter = lookup.seek(P, {}, 0);
+         iter->get(FactIterator::KeyOnly);
+         iter->next()) {
+      ++n;
+    }
+    folly::doNotOptimizeAway(n);
+  }
+}
+
+void idByKey(size_t iters, size_t layers, bool flattened) {
+  folly::BenchmarkSuspender braces;
+  auto& s = stack(layers);
+  auto& lookup = s.top(flattened);
+  braces.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    const auto& key = s.keys[uniform64(i) % s.keys.size()];
+    folly::doNotOptimizeAway(lookup.idByKey(P, binary::byteRange(key)));
+  }
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM(seek, chain_10, 10, false)
+BENCHMARK_RELATIVE_NAMED_PARAM(seek, flat_10, 10, true)
+BENCHMARK_NAMED_PARAM(seek, chain_25, 25, false)
+BENCHMARK_RELATIVE_NAMED_PARAM(seek, flat_25, 25, true)
+BENCHMARK_NAMED_PARAM(seek, chain_50, 50, false)
+BENCHMARK_RELATIVE_NAMED_PARAM(seek, flat_50, 50, true)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(idByKey, chain_10, 10, false)
+BENCHMARK_RELATIVE_NAMED_PARAM(idByKey, flat_10, 10, true)
+BENCHMARK_NAMED_PARAM(idByKey, chain_25, 25, false)
+BENCHMARK_RELATIVE_NAMED_PARAM(idByKey, flat_25, 25, true)
+BENCHMARK_NAMED_PARAM(idByKey, chain_50, 50, false)
+BENCHMARK_RELATIVE_NAMED_PARAM(idByKey, flat_50, 50, true)
+
+int main(int argc, char** argv) {
+  facebook::initFacebook(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <map>
+#include <string>
+
+#include <folly/Format.h>
+#include <gtest/gtest.h>
+
+#include "glean/rts/stacked.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+const Pid P = Pid::fromWord(1024);
+
+// A stack of FactSets, each stacked on the Stacked of the ones below it
+struct Stack {
+  explicit Stack(size_t layers) {
+    uint64_t n = 0;
+    for (size_t i = 0; i < layers; ++i) {
+      auto start = sets.empty() ? Id::lowest() : sets.back()->firstFreeId();
+      sets.push_back(std::make_unique<FactSet>(start));
+      for (auto j = uniform7(i) % 50 + 1; j != 0; --j, ++n) {
+        auto k = folly::sformat("{:x}", uniform28(n));
+        if (!all.count(k)) {
+          auto clause = Fact::Clause::fromKey(binary::byteRange(k));
+          all.emplace(k, sets.back()->define(P, clause));
+        }
+      }
+      if (i > 0) {
+        Lookup *base = i == 1 ? sets[0].get() : stacks.back().get();
+        stacks.push_back(
+          std::make_unique<Stacked<Lookup>>(base, sets.back().get()));
+      }
+    }
+  }
+
+  Stacked<Lookup>& top() {
+    return *stacks.back();
+  }
+
+  std::vector<std::unique_ptr<FactSet>> sets;
+  std::vector<std::unique_ptr<Stacked<Lookup>>> stacks;
+  std::map<std::string, Id> all;
+};
+
+}
+
+TEST(StackedTest, flatten) {
+  Stack stack(20);
+  auto& top = stack.top();
+  EXPECT_EQ(top.layers(), 20);
+  EXPECT_EQ(top.startingId(), Id::lowest());
+  EXPECT_EQ(top.firstFreeId(), stack.sets.back()->firstFreeId());
+  EXPECT_EQ(top.count(P).high(), stack.all.size());
+
+  std::vector<std::pair<std::string, Id>> expected(
+    stack.all.begin(), stack.all.end());
+  std::vector<std::pair<std::string, Id>> seen;
+  for (auto iter = top.seek(P, {}, 0); auto ref = iter->get(); iter->next()) {
+    seen.emplace_back(binary::mkString(ref.key()), ref.id);
+  }
+  EXPECT_EQ(seen, expected);
+
+  for (const auto& [k, id] : stack.all) {
+    EXPECT_EQ(top.idByKey(P, binary::byteRange(k)), id);
+    EXPECT_EQ(top.typeById(id), P);
+  }
+  EXPECT_FALSE(top.idByKey(P, binary::byteRange(std::string("missing"))));
+}
+
+TEST(StackedTest, ranges) {
+  Stack stack(10);
+  auto& top = stack.top();
+  const auto start = top.startingId();
+  const auto size = top.firstFreeId() - start;
+  for (uint64_t i = 0; i < 100; ++i) {
+    auto from = start + uniform64(i) % size;
+    auto upto = from + uniform64(i + 1) % (size / 2) + 1;
+
+    std::vector<Id> forward;
+    for (auto iter = top.enumerate(from, upto);
+         auto ref = iter->get();
+         iter->next()) {
+      forward.push_back(ref.id);
+    }
+    std::vector<Id> expected;
+    for (auto id = from; id < std::min(upto, top.firstFreeId()); ++id) {
+      expected.push_back(id);
+    }
+    EXPECT_EQ(forward, expected);
+
+    std::vector<Id> backward;
+    for (auto iter = top.enumerateBack(upto, from);
+         auto ref = iter->get();
+         iter->next()) {
+      backward.push_back(ref.id);
+    }
+    std::reverse(expected.begin(), expected.end());
+    EXPECT_EQ(backward, expected);
+  }
+
+  // FactSets only support seeking all of their facts, so sections have to
+  // cover entire layers
+  for (size_t lo = 0; lo < stack.sets.size(); ++lo) {
+    for (auto hi = lo; hi < stack.sets.size(); ++hi) {
+      const auto from = stack.sets[lo]->startingId();
+      const auto upto = stack.sets[hi]->firstFreeId();
+      std::vector<std::pair<std::string, Id>> expected;
+      for (const auto& [k, id] : stack.all) {
+        if (from <= id && id < upto) {
+          expected.emplace_back(k, id);
+        }
+      }
+      std::vector<std::pair<std::string, Id>> seen;
+      for (auto iter = top.seekWithinSection(P, {}, 0, from, upto);
+           auto ref = iter->get();
+           iter->next()) {
+        seen.emplace_back(binary::mkString(ref.key()), ref.id);
+      }
+      EXPECT_EQ(seen, expected);
+    }
+  }
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <common/init/Init.h>
+#include <folly/Benchmark.h>
+
+#include "glean/rts/binary.h"
+#include "glean/rts/string.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+
+namespace {
+
+const size_t STRINGS = 100000;
+
+// Identifier-like ASCII strings of up to 64 bytes
+std::string ascii(uint64_t i) {
+  std::string s(uniform7(i) % 64 + 1, 'a');
+  for (size_t j = 0; j < s.size(); ++j) {
+    s[j] = 'a' + uniform64(i + j) % 26;
+  }
+  return s;
+}
+
+// Strings with a mix of 1, 2, 3 and 4 byte characters
+std::string mixed(uint64_t i) {
+  static const char* chars[] = {
+    "a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80"};
+  std::string s;
+  for (size_t j = 0; j < uniform7(i) % 32 + 1; ++j) {
+    s += chars[uniform64(i + j) % 4];
+  }
+  return s;
+}
+
+binary::Output genStrings(std::string (*f)(uint64_t)) {
+  binary::Output out;
+  for (uint64_t i = 0; i < STRINGS; ++i) {
+    out.mangleString(binary::byteRange(f(i)));
+  }
+  return out;
+}
+
+void validate(StringKernels k, std::string (*f)(uint64_t)) {
+  folly::BenchmarkSuspender braces;
+  if (!selectStringKernels(k)) {
+    return;
+  }
+  auto strings = genStrings(f);
+  braces.dismiss();
+  binary::Input input(strings.bytes());
+  while (!input.empty()) {
+    input.skipUntrustedString();
+  }
+}
+
+void mangle(StringKernels k, std::string (*f)(uint64_t)) {
+  folly::BenchmarkSuspender braces;
+  if (!selectStringKernels(k)) {
+    return;
+  }
+  std::vector<std::string> strings;
+  for (uint64_t i = 0; i < STRINGS; ++i) {
+    strings.push_back(f(i));
+  }
+  braces.dismiss();
+  binary::Output out;
+  for (const auto& s : strings) {
+    out.mangleString(binary::byteRange(s));
+  }
+  folly::doNotOptimizeAway(out.size());
+}
+
+} // namespace
+
+#define MK_BENCHMARK(op, kernels, gen)    \
+  BENCHMARK(op##_##kernels##_##gen) {     \
+    op(StringKernels::kernels, gen);      \
+  }
+
+#define BENCHMARK_STRINGS(op)             \
+  MK_BENCHMARK(op, Scalar, ascii)         \
+  MK_BENCHMARK(op, SSE42, ascii)          \
+  MK_BENCHMARK(op, AVX2, ascii)           \
+  MK_BENCHMARK(op, Scalar, mixed)         \
+  MK_BENCHMARK(op, SSE42, mixed)          \
+  MK_BENCHMARK(op, AVX2, mixed)
+
+BENCHMARK_STRINGS(validate)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_STRINGS(mangle)
+
+int main(int argc, char** argv) {
+  facebook::initFacebook(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <string>
+
+#include <folly/String.h>
+#include <gtest/gtest.h>
+
+#include "glean/rts/binary.h"
+#include "glean/rts/string.h"
+#include "glean/rts/tests/uniform.h"
+
+using namespace facebook::glean;
+using namespace facebook::glean::rts;
+using namespace std::string_literals;
+
+namespace {
+
+const StringKernels ALL_KERNELS[] = {
+  StringKernels::Scalar,
+  StringKernels::SSE42,
+  StringKernels::AVX2,
+};
+
+// Run f for every implementation the CPU supports
+template<typename F>
+void forEachKernels(F&& f) {
+  for (auto k : ALL_KERNELS) {
+    if (selectStringKernels(k)) {
+      SCOPED_TRACE(static_cast<int>(k));
+      f();
+    }
+  }
+  selectStringKernels(bestStringKernels());
+}
+
+std::string mangle(const std::string& s) {
+  binary::Output out;
+  mangleString(binary::byteRange(s), out);
+  return binary::mkString(out.bytes());
+}
+
+bool valid(const std::string& s) {
+  auto mangled = mangle(s);
+  try {
+    return validateUntrustedString(binary::byteRange(mangled))
+      == mangled.size();
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
+// Strings long enough to go through the vector loops, with s at various
+// offsets so it straddles block boundaries.
+template<typename F>
+void forEachPadding(const std::string& s, F&& f) {
+  for (size_t before : {0, 1, 15, 30, 31, 63}) {
+    for (size_t after : {0, 1, 17, 64}) {
+      f(std::string(before, 'x') + s + std::string(after, 'y'));
+    }
+  }
+}
+
+const std::string STRINGS[] = {
+  ""s,
+  "abc"s,
+  "\0"s,
+  "abc\0def\0"s,
+  "\xC3\xA9"s,                // U+00E9
+  "\xE2\x82\xAC"s,            // U+20AC
+  "\xF0\x9F\x98\x80"s,        // U+1F600
+  "\xF4\x8F\xBF\xBF"s,        // U+10FFFF
+  "caf\xC3\xA9 \xE2\x82\xAC\0\xF0\x9F\x98\x80"s,
+  // Strings aren't required to be valid UTF-8
+  "\x80"s,                    // lone continuation
+  "\xC3"s,                    // truncated
+  "\xC3\0\xA9"s,              // truncated by NUL
+  "\xC0\x80"s,                // overlong NUL
+  "\xED\xA0\x80"s,            // surrogate
+  "\xFF"s,                    // invalid byte
+};
+
+}
+
+TEST(StringTest, valid) {
+  forEachKernels([] {
+    for (const auto& s : STRINGS) {
+      forEachPadding(s, [](const std::string& t) {
+        EXPECT_TRUE(valid(t)) << folly::hexlify(t);
+      });
+    }
+  });
+}
+
+TEST(StringTest, invalidMangling) {
+  forEachKernels([] {
+    for (const auto& s : {"abc"s, "abc\0"s, "abc\0\2\0\0"s, "a\0\1b\0"s}) {
+      EXPECT_ANY_THROW(validateUntrustedString(binary::byteRange(s)))
+        << folly::hexlify(s);
+    }
+  });
+}
+
+// All kernels must agree with the scalar one on random mangled strings,
+// which may or may not be valid.
+TEST(StringTest, kernelsAgree) {
+  const std::string fragments[] = {
+    "a"s, "\0"s, "\1"s, "\2"s, "0123456789abcdefghijklmnopqrstuv"s,
+    "\xC3\xA9"s, "\xF0\x9F\x98\x80"s, "\x80"s,
+  };
+  const size_t n = sizeof(fragments) / sizeof(fragments[0]);
+  auto size = [](const std::string& s) -> int64_t {
+    try {
+      return validateUntrustedString(binary::byteRange(s));
+    } catch (const std::exception&) {
+      return -1;
+    }
+  };
+  for (uint64_t i = 0; i < 10000; ++i) {
+    std::string s;
+    for (uint64_t j = 0; j < uniform7(i) % 24; ++j) {
+      s += fragments[uniform64(i * 31 + j) % n];
+    }
+    selectStringKernels(StringKernels::Scalar);
+    auto expected = size(s);
+    forEachKernels([&] {
+      EXPECT_EQ(size(s), expected) << folly::hexlify(s);
+    });
+  }
+}
+
+TEST(StringTest, mangling) {
+  forEachKernels([] {
+    for (const auto& s : STRINGS) {
+      forEachPadding(s, [](const std::string& t) {
+        auto mangled = mangle(t);
+        EXPECT_EQ(mangled.size(), t.size() + 2 +
+          std::count(t.begin(), t.end(), '\0'));
+
+        binary::Output out;
+        EXPECT_EQ(
+          demangleUntrustedString(binary::byteRange(mangled), out),
+          mangled.size());
+        EXPECT_EQ(binary::mkString(out.bytes()), t);
+
+        auto sizes = skipTrustedString(binary::byteRange(mangled));
+        EXPECT_EQ(sizes.first, mangled.size());
+        EXPECT_EQ(sizes.second, t.size());
+
+        std::string buf(t.size(), '\xFF');
+        EXPECT_EQ(
+          demangleTrustedString(
+            binary::byteRange(mangled),
+            reinterpret_cast<uint8_t*>(&buf[0])),
+          mangled.size());
+        EXPECT_EQ(buf, t);
+      });
+    }
+  });
+}
@@ -12,6 +12,7 @@
 #include <folly/Benchmark.h>
 
 #include "glean/rts/binary.h"
+#include "glean/rts/nat.h"
 #include "glean/rts/tests/uniform.h"
 
 using namespace facebook::glean;
@@ -100,6 +101,57 @@ BENCHMARK_VARINTS(SumVarints, value) {
   folly::doNotOptimizeAway(sum);
 }
 
+// Validate an array of varints in bulk and copy it. This is what the
+// InputSkipNats instruction does.
+void memcpyVarintsBulk(rts::NatKernels kernels, binary::Input value) {
+  if (!rts::selectNatKernels(kernels)) {
+    return;
+  }
+  binary::Output out;
+  const size_t count = value.packed<size_t>();
+  out.packed(count);
+  const auto p = value.data();
+  value.skipPackedArray(count);
+  out.bytes(p, value.data() - p);
+  if (!value.empty()) {
+    rts::error("input too long");
+  }
+}
+
+BENCHMARK_VARINTS(MemcpyVarintsBulk, value) {
+  memcpyVarintsBulk(rts::bestNatKernels(), value);
+}
+
+BENCHMARK_VARINTS(MemcpyVarintsBulkScalar, value) {
+  memcpyVarintsBulk(rts::NatKernels::Scalar, value);
+}
+
+// Decode and reencode chunks of varints. This is what the InputNats
+// instruction does.
+void copyVarintsBulk(rts::NatKernels kernels, binary::Input value) {
+  if (!rts::selectNatKernels(kernels)) {
+    return;
+  }
+  binary::Output out;
+  uint64_t buf[256];
+  const size_t count = value.packed<size_t>();
+  out.packed(count);
+  for (size_t n = count; n != 0;) {
+    const auto k = std::min(n, size_t(256));
+    value.packedArray(buf, k);
+    out.packedArray(buf, k);
+    n -= k;
+  }
+}
+
+BENCHMARK_VARINTS(CopyVarintsBulk, value) {
+  copyVarintsBulk(rts::bestNatKernels(), value);
+}
+
+BENCHMARK_VARINTS(CopyVarintsBulkScalar, value) {
+  copyVarintsBulk(rts::NatKernels::Scalar, value);
+}
+
 int main(int argc, char** argv) {
   facebook::initFacebook(&argc, &argv);
   folly::runBenchmarks();
@@ -11,6 +11,7 @@
 {-# LANGUAGE NamedFieldPuns, OverloadedStrings #-}
 module Glean.Schema.Gen.Cpp
   ( genSchemaCpp
+  , genSchemaCppNative
   ) where
 
 import Control.Monad
@@ -21,9 +22,12 @@ import qualified Data.Map as Map
 import Data.Maybe
 import Data.Text (Text)
 import qualified Data.Text as Text
+import GHC.Fingerprint (Fingerprint(..))
+import Text.Printf
 import TextShow
 
 import Glean.Schema.Gen.Utils hiding (pushDefs, popDefs)
+import Glean.Angle.Hash (Hash)
 import Glean.Angle.Types hiding (schemaName)
 import Glean.Schema.Types
 
@@ -47,6 +51,55 @@ genSchemaCpp version preddefs typedefs =
 
     body = Text.intercalate (newline <> newline) pieces
 
+-- | Generate native typecheckers for the predicates in the schema generated
+-- by 'genSchemaCpp', see glean/cpp/native.h. They are registered by
+-- predicate hash, so they are only used for predicates whose definition is
+-- identical to the one the code was generated from.
+genSchemaCppNative
+  :: (PredicateRef -> Maybe Hash)
+  -> Version
+  -> [ResolvedPredicateDef]
+  -> [ResolvedTypeDef]
+  -> [(FilePath,Text)]
+genSchemaCppNative hashOf _version preddefs typedefs =
+  [("", Text.unlines nativeLeading <> body)]
+  where
+    namePolicy = mkNamePolicy preddefs typedefs
+    (entries, _) = runM Data [] namePolicy typedefs $
+      forM preddefs $ \PredicateDef{..} -> do
+        name <- cppNameIn schemaNamespace . schemaName <$>
+          predicateName predicateDefRef
+        return $ case hashOf predicateDefRef of
+          Nothing -> error $ "no hash for predicate " <> show predicateDefRef
+          Just (Fingerprint hi lo) ->
+            "native::predicate<SCHEMA, " <> name <> ">("
+              <> hex hi <> ", " <> hex lo <> "),"
+    hex w = Text.pack (printf "0x%016xULL" w)
+    body = Text.intercalate (newline <> newline) $
+      withNS [(schemaNamespace, Text.unlines definitions)]
+    definitions =
+      [ "namespace {"
+      , ""
+      , "const rts::NativePredicate predicates[] = {" ]
+      ++ indentLines entries ++
+      [ "};"
+      , ""
+      , "rts::NativeSchemaRegistration registration("
+      , "  rts::NativeSchema{SCHEMA::count, folly::range(predicates)});"
+      , ""
+      , "} // namespace" ]
+
+nativeLeading :: [Text]
+nativeLeading =
+  ["// @" <> "generated"
+  ,"// Glean.Schema.Gen.Cpp native typecheckers for fbcode/glean/lang/clang/schema.h"
+  ,"// by //glean/hs:predicates using --cpp-native"
+  ,""
+  ,"#include \"glean/cpp/native.h\""
+  ,"#include \"glean/lang/clang/schema.h\""
+  ,""
+  ]
+
 -- Check against hardcoded list of what glean.h provides
 provided :: (NameSpaces, Text) -> Maybe ResolvedType
 provided (_,ident) = Map.lookup ident known
@@ -13,7 +13,8 @@ glean/schema/TARGETS.
 
 buck run @mode/opt //glean/schema/gen:gen-schema -- --help
 
-Usage: gen-schema ([--cpp ARG] | [--thrift ARG] | [--hs ARG]) (-i|--input FILE)
+Usage: gen-schema ([--cpp ARG] | [--cpp-native ARG] | [--thrift ARG] | [--hs ARG])
+                  (-i|--input FILE)
                   [-d|--install_dir DIR]
 
 Available options:
@@ -67,7 +68,7 @@ import qualified Glean.Internal.Types as Internal
 import Glean.RTS.Types (PidRef(..), ExpandedType(..))
 import Glean.Schema.Util (showRef)
 import Glean.Schema.Gen.Thrift
-import Glean.Schema.Gen.Cpp ( genSchemaCpp )
+import Glean.Schema.Gen.Cpp ( genSchemaCpp, genSchemaCppNative )
 import Glean.Schema.Gen.HackJson ( genSchemaHackJson )
 import Glean.Schema.Gen.Haskell ( genSchemaHS )
 import Glean.Schema.Gen.Utils ( Mode(..) )
@@ -99,6 +100,7 @@ data GraphType = SchemaGraph | PredicateGraph
 data GenOptions =  GenOptions
   { thrift :: Maybe FilePath
   , cpp :: Maybe FilePath
+  , cppNative :: Maybe FilePath
   , hackjson :: Maybe FilePath
   , hs :: Maybe FilePath
   , source :: Maybe FilePath
@@ -163,6 +165,10 @@ options = do
         long "thrift" <> metavar "FILE"
       cpp <- optional $ strOption $
         long "cpp" <> metavar "FILE"
+      cppNative <- optional $ strOption $
+        long "cpp-native" <> metavar "FILE" <>
+        help ("Generate native typecheckers for the predicates in the " <>
+          "--cpp schema")
       hackjson <- optional $ strOption $
         long "hackjson" <> metavar "FILE"
       hs <- optional $ strOption $
@@ -277,7 +283,7 @@ main = do
     Right opts -> do
       forM_ (source opts) $ \f -> BC.writeFile f src
       forM_ (updateIndex opts) (doUpdateIndex src schema)
-      reportTime "gen" $ gen opts versions
+      reportTime "gen" $ gen opts dbschema versions
 
 graph :: GraphOptions -> DbSchema -> SourceSchemas -> [Version] -> IO ()
 graph opts dbschema sourceSchemas versions =
@@ -368,11 +374,16 @@ drawGraph GraphOptions{..} deps' roots =
 
 gen
   :: GenOptions
+  -> DbSchema
   -> [(Version, SchemaId, ResolvedSchemaRef, Maybe FilePath)]
   -> IO ()
-gen GenOptions{..} versions =
+gen GenOptions{..} dbschema versions =
   mapM_ genFor versions
   where
+  predicateHashes = HashMap.fromList
+    [ (predicateIdRef predId, predicateIdHash predId)
+    | predId <- HashMap.keys (predicatesById dbschema) ]
+
   genFor :: (Version, SchemaId, ResolvedSchemaRef, Maybe FilePath) -> IO ()
   genFor (_, hash, ResolvedSchema{..}, dir) = do
       let
@@ -387,6 +398,7 @@ gen GenOptions{..} versions =
             createDirectoryIfMissing True (takeDirectory path)
             Text.writeFile path (text <> "\n")
       doGen genSchemaCpp cpp
+      doGen (genSchemaCppNative (`HashMap.lookup` predicateHashes)) cppNative
       doGen genSchemaHackJson hackjson
       doGen genSchemaHS hs
       doGen (genSchemaThrift Data dir hash) thrift
@@ -99,6 +99,8 @@ handler State{..} req =
 
     Service.DeleteDatabase repo -> Backend.deleteDatabase backend repo
 
+    Service.FlattenDatabase rq -> Backend.flattenDatabase backend rq
+
     Service.Restore loc -> Backend.restoreDatabase backend loc
 
     SuperFacebookService c -> fb303Handler fb303State c
@@ -386,7 +386,7 @@ helptext mode = vcat
       , ("list-all [<db>]",
             "List available databases and restorable backups which match "
             <> "<db>")
-      , ("debug off|[-]ir|[-]bytecode|all",
+      , ("debug off|[-]ir|[-]bytecode|[-]profile|all",
             "Enable/disable query debugging options")
       , ("describe [<db>]",
             "Like :list, but show more details")
@@ -601,7 +601,8 @@ commands =
   , Cmd "database" completeDatabases $ const . dbCmd
   , Cmd "db" completeDatabaseName $ const . dbCmd
   , Cmd "debug" (completeWords (pure
-      ["off", "ir", "-ir", "bytecode", "-bytecode", "all"])) $
+      ["off", "ir", "-ir", "bytecode", "-bytecode", "profile", "-profile",
+        "all"])) $
         \str _ -> debugCmd str
   , Cmd "reload" Haskeline.noCompletion $ const $ const reloadCmd
   , Cmd "schema" (completeWords availablePredicatesAndTypes) $
@@ -798,7 +799,8 @@ debugCmd str = case words (strip str) of
     output $ "query debugging is currently: " <>
       let opts =
             [ "ir" | Thrift.queryDebugOptions_ir d ] ++
-            [ "bytecode" | Thrift.queryDebugOptions_bytecode d ]
+            [ "bytecode" | Thrift.queryDebugOptions_bytecode d ] ++
+            [ "profile" | Thrift.queryDebugOptions_profile d ]
       in
       if null opts then "off" else hcat (punctuate "," opts)
   ["all"] -> do
@@ -806,14 +808,18 @@ debugCmd str = case words (strip str) of
       { debug = Thrift.QueryDebugOptions
         { queryDebugOptions_ir = True
         , queryDebugOptions_bytecode = True
+        , queryDebugOptions_profile = True
         }
       }
   [word] | Just onoff <- irFlag word -> Eval $ State.modify $ \s -> s
     { debug = (debug s) { Thrift.queryDebugOptions_ir = onoff } }
   [word] | Just onoff <- bytecodeFlag word -> Eval $ State.modify $ \s -> s
     { debug = (debug s) { Thrift.queryDebugOptions_bytecode = onoff } }
+  [word] | Just onoff <- profileFlag word -> Eval $ State.modify $ \s -> s
+    { debug = (debug s) { Thrift.queryDebugOptions_profile = onoff } }
   ["off"] -> Eval $ State.modify $ \s -> s { debug = def }
-  _ -> liftIO $ throwIO $ ErrorCall "syntax: :debug off|[-]ir|[-]bytecode|all"
+  _ -> liftIO $ throwIO $ ErrorCall
+    "syntax: :debug off|[-]ir|[-]bytecode|[-]profile|all"
   where
   irFlag "ir" = Just True
   irFlag "-ir" = Just False
@@ -823,6 +829,46 @@ debugCmd str = case words (strip str) of
   bytecodeFlag "-bytecode" = Just False
   bytecodeFlag _ = Nothing
 
+  profileFlag "profile" = Just True
+  profileFlag "-profile" = Just False
+  profileFlag _ = Nothing
+
+-- | Render a query profile. Iterators are shown in order of nesting
+-- depth, so a generator with a large fan-out stands out against the
+-- ones nested inside it.
+renderProfile
+  :: Map.Map Thrift.Id PredicateRef
+  -> Thrift.QueryProfile
+  -> Doc ann
+renderProfile pidMap Thrift.QueryProfile{..} = vcat $
+  [ "Iterators:"
+  , pretty (printf "  %-46s %10s %12s %12s"
+      ("predicate" :: String) ("seeks" :: String) ("facts" :: String)
+      ("Mcycles" :: String) :: String) ]
+  ++
+  [ pretty (printf "  %-46s %10d %12d %12.2f"
+      (replicate (2 * fromIntegral queryProfileIterator_depth) ' ' <>
+        maybe (show queryProfileIterator_predicate) (show . pretty)
+          (Map.lookup queryProfileIterator_predicate pidMap))
+      queryProfileIterator_seeks
+      queryProfileIterator_facts
+      (mcycles queryProfileIterator_cycles) :: String)
+  | Thrift.QueryProfileIterator{..} <- queryProfile_iterators ]
+  ++
+  [ "Callbacks:" ] ++ map counter queryProfile_callbacks ++
+  [ "Instructions:" ] ++
+    map counter
+      (sortOn (Down . Thrift.queryProfileCounter_cycles) queryProfile_ops)
+  where
+  counter Thrift.QueryProfileCounter{..} =
+    pretty (printf "  %-46s %10d %12.2f"
+      (Text.unpack queryProfileCounter_name)
+      queryProfileCounter_count
+      (mcycles queryProfileCounter_cycles) :: String)
+
+  mcycles :: Int64 -> Double
+  mcycles n = fromIntegral n / 1000000
+
 
 expandCmd :: String -> Eval ()
 expandCmd str = case str of
@@ -965,6 +1011,20 @@ runUserQuery SchemaQuery
     , Just m <- [Thrift.userQueryStats_facts_searched stats]
     ]
     ++
+    [ pretty (printf "Nested facts fetched: %d in %d rounds" facts rounds
+        :: String)
+    | stats == FullStats
+    , Just stats <- [userQueryResults_stats]
+    , Just facts <- [Thrift.userQueryStats_expand_facts stats]
+    , Just rounds <- [Thrift.userQueryStats_expand_rounds stats]
+    , rounds > 0
+    ]
+    ++
+    [ renderProfile (Thrift.schemaInfo_predicateIds schemaInfo) profile
+    | Just stats <- [userQueryResults_stats]
+    , Just profile <- [Thrift.userQueryStats_profile stats]
+    ]
+    ++
     [ vcat $ if Thrift.userQueryStats_result_count stats < fromIntegral limit
         then
             [ case timeout of
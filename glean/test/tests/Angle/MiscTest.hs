@@ -41,6 +41,7 @@ main = withUnitTest $ testRunner $ TestList
   [ TestLabel "justKeys" $ justKeys id
   , TestLabel "justKeys/page" $ justKeys (limit 1)
   , TestLabel "reorder" reorderTest
+  , TestLabel "profile" profileTest
   , TestLabel "scoping" scopingTest
   , TestLabel "dsl" $ angleDSL id
   , TestLabel "queryOptions" angleQueryOptions
@@ -206,6 +207,24 @@ queryStats be repo (Query query) = do
   return (results, userQueryResults_stats)
 
 
+queryProfile
+  :: forall q backend . (Backend backend)
+  => backend
+  -> Repo
+  -> Query q
+  -> IO (Maybe QueryProfile)
+
+queryProfile be repo (Query query) = do
+  let
+    opts = fromMaybe def (userQuery_options query)
+    query' = query
+      { userQuery_encodings = [UserQueryEncoding_bin def]
+      , userQuery_options = Just opts
+        { userQueryOptions_debug = def { queryDebugOptions_profile = True } }
+      }
+  UserQueryResults{..} <- userQuery be repo query'
+  return (userQueryStats_profile =<< userQueryResults_stats)
+
 factsSearched
   :: PredicateRef
   -> Map PredicateRef Int64
@@ -218,6 +237,34 @@ factsSearched ref lookupPid maybeStats = do
   count <- Map.lookup pid searched
   return (fromIntegral count)
 
+profileTest :: Test
+profileTest = dbTestCase $ \env repo -> do
+  si <- getSchemaInfo env repo
+  let lookupPid = Map.fromList
+        [ (ref,pid) | (pid,ref) <- Map.toList (schemaInfo_predicateIds si) ]
+
+  profile <- queryProfile env repo $ angleData @Text
+    [s|
+      "result" where
+        glean.test.Tree {
+          { label = "b" },
+          _,
+          { just = { { label = "d" }, _, _ } }
+        }
+    |]
+  QueryProfile{..} <- maybe (assertFailure "no profile") return profile
+  let treePid = Map.lookup (PredicateRef "glean.test.Tree" 5) lookupPid
+  assertBool "profile iterators" $ or
+    [ queryProfileIterator_facts > 0
+    | QueryProfileIterator{..} <- queryProfile_iterators
+    , Just queryProfileIterator_predicate == treePid ]
+  assertBool "profile callbacks" $ or
+    [ queryProfileCounter_count > 0
+    | QueryProfileCounter{..} <- queryProfile_callbacks
+    , queryProfileCounter_name == "next" ]
+  assertBool "profile ops" $
+    "Ret" `elem` map queryProfileCounter_name queryProfile_ops
+
 {-
   Test reordering of nested matches using a simple DAG:
 
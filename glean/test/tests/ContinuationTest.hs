@@ -9,6 +9,7 @@
 {-# LANGUAGE TypeApplications #-}
 module ContinuationTest (main) where
 
+import Control.Exception (bracket_)
 import Data.Proxy
 import Test.HUnit
 
@@ -16,6 +17,7 @@ import TestRunner
 
 import Glean.Init
 import Glean.Query.Thrift
+import Glean.RTS.Foreign.Query (setSubroutineCacheCapacity)
 import qualified Glean.Schema.Cxx1.Types as Cxx
 import Glean.Types
 
@@ -41,10 +43,47 @@ continuationCheckTest f = dbTestCase $ \env repo -> do
   assertThrowsType "bad cont" (Proxy :: Proxy BadQuery)
       $ runQueryPage env repo (Just $ f cont) $ allFacts @Cxx.Name
 
+-- | A continuation which refers to bytecode that has been evicted from the
+-- server's cache still works: it carries the bytecode too.
+continuationEvictedTest :: Test
+continuationEvictedTest = dbTestCase $ \env repo ->
+  bracket_
+    (setSubroutineCacheCapacity (1024*1024))
+    (setSubroutineCacheCapacity 0) $ do
+  (r, Just cont) <-
+    runQueryPage env repo Nothing $ limit 1 $ allFacts @Cxx.Name
+  assertEqual "first result" (length r) 1
+
+  -- evict everything
+  setSubroutineCacheCapacity 0
+  setSubroutineCacheCapacity (1024*1024)
+
+  (r, _) <-
+    runQueryPage env repo (Just cont) $ limit 1 $ allFacts @Cxx.Name
+  assertEqual "after eviction" (length r) 1
+
+-- | A continuation produced with the cache enabled works on a server which
+-- doesn't have the cache, like a replica with a different configuration or
+-- an older version.
+continuationUncachedTest :: Test
+continuationUncachedTest = dbTestCase $ \env repo -> do
+  (r, Just cont) <-
+    bracket_
+      (setSubroutineCacheCapacity (1024*1024))
+      (setSubroutineCacheCapacity 0) $
+    runQueryPage env repo Nothing $ limit 1 $ allFacts @Cxx.Name
+  assertEqual "first result" (length r) 1
+
+  (r, _) <-
+    runQueryPage env repo (Just cont) $ limit 1 $ allFacts @Cxx.Name
+  assertEqual "without the cache" (length r) 1
+
 main :: IO ()
 main = withUnitTest $ testRunner $ TestList
   [ TestLabel "version" $ continuationCheckTest $ \c -> c
       { userQueryCont_version = 0 }
   , TestLabel "bytes" $ continuationCheckTest $ \c -> c
       { userQueryCont_continuation = "helloworld" }
+  , TestLabel "evicted" continuationEvictedTest
+  , TestLabel "uncached" continuationUncachedTest
   ]
@@ -29,6 +29,7 @@ import Glean.Database.Test
 import Glean.Derive
 import qualified Glean.Schema.GleanTest as Glean.Test
 import qualified Glean.Schema.GleanTest.Types as Glean.Test
+import qualified Glean.Types as Thrift
 
 
 {-
@@ -339,6 +340,48 @@ deriveTest = TestCase $
       predicate @Glean.Test.SkipRevEdge wild
     assertEqual "derived 6" 1 (length results)
 
+flattenTest :: Test
+flattenTest = TestCase $
+  withTestEnv [] $ \env -> do
+    let base = Repo "base" "0"
+    kickOffTestDB env base id
+    mkGraph env base
+    completeTestDB env base
+
+    -- exclude unit A and add a new node
+    inc <- incrementalDB env base (Repo "base-inc" "0") ["A"]
+    writeFactsIntoDB env inc [ Glean.Test.allPredicates ] $
+      withUnit "E" $
+        makeFact_ @Glean.Test.Node (Glean.Test.Node_key "e")
+    completeTestDB env inc
+
+    Thrift.FlattenDatabaseResult flat <- flattenDatabase env
+      (Thrift.FlattenDatabase inc "1")
+    waitUntilComplete env flat
+
+    -- the copy replaces the stack as the latest database of the repo name
+    assertEqual "flatten repo" (Repo "base-inc" "1") flat
+    latest <- getLatestRepo env "base-inc"
+    assertEqual "flatten latest" flat latest
+
+    results <- runQuery_ env flat $ query $
+      var $ \n ->
+        n `where_` [
+          wild .= predicate @Glean.Test.Node (rec $ field @"label" n end)
+        ]
+    assertEqual "flatten 0" ["b","c","d","e"] (sort results)
+
+    -- the edges refer to the copies of the nodes
+    results <- runQuery_ env flat $ query $
+      var $ \n ->
+        n `where_` [
+          wild .= predicate @Glean.Test.Edge (rec $
+            field @"parent" (rec $ field @"label" n end) $
+            field @"child" (rec $ field @"label" (string "d") end)
+          end)
+        ]
+    assertEqual "flatten 1" ["b","c"] (sort results)
+
 main :: IO ()
 main = do
   if System.Info.arch == "x86_64"
@@ -353,4 +396,5 @@ main_ = withUnitTest $ testRunner $ TestList
   , TestLabel "dupSetTest" dupSetTest
   , TestLabel "orphanTest" orphanTest
   , TestLabel "deriveTest" deriveTest
+  , TestLabel "flattenTest" flattenTest
   ]
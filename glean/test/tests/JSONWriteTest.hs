@@ -11,9 +11,14 @@ module JSONWriteTest (main) where
 
 import Control.Monad
 import Data.ByteString (ByteString)
+import qualified Data.ByteString as BS
 import qualified Data.ByteString.Char8 as BC
 import Data.Default
 import Data.Proxy
+import qualified Data.Text as Text
+import qualified Data.Text.Encoding as Text
+import System.FilePath
+import System.IO.Temp
 import Test.HUnit
 
 import TestRunner
@@ -23,8 +28,17 @@ import Util.String.Quasi
 import Glean hiding (query)
 import Glean.Angle
 import Glean.Init
+import Glean.Database.Open (withOpenDatabase)
 import Glean.Database.Test
-import Glean.Write.JSON (syncWriteJsonBatch)
+import Glean.Database.Types (odbSchema)
+import Glean.Write (fileToBatches)
+import Glean.Write.JSON
+  ( buildJsonBatch
+  , buildJsonBatchStreaming
+  , buildJsonBatchesStreaming
+  , newJsonFactSchema
+  , syncWriteJsonBatch
+  )
 import qualified Glean.Schema.GleanTest.Types as Glean.Test
 import qualified Glean.Schema.Sys.Types as Sys
 
@@ -295,7 +309,50 @@ writeJsonBatchTest = TestCase $ withEmptyTestDB [] $ \env repo -> do
     [_,_] -> return ()
     _ -> assertFailure "syncWriteJsonBatch - named fact that refers to anon facts"
 
+-- The streaming conversion of a file and of the batches sent to the server
+-- must give the same batch as parsing the JSON and calling buildJsonBatch.
+streamingTest :: Test
+streamingTest = TestCase $ withEmptyTestDB [] $ \env repo ->
+  withSystemTempDirectory "glean-json" $ \dir -> do
+  let
+    file = dir </> "facts.json"
+    ref (PredicateRef name version) =
+      "\"" <> name <> "." <> Text.pack (show version) <> "\""
+  BS.writeFile file $ Text.encodeUtf8 $ Text.unlines
+    [ "[ { \"predicate\": " <> ref (getName (Proxy @Glean.Test.StringPair))
+    , "  , \"facts\":"
+    , "    [ { \"id\": 1"
+    , "      , \"key\": { \"fst\": \"a\", \"snd\": \"b\\\"\\n\\u00e9\" } }"
+    , "    , { \"key\": { \"fst\": \"\228\", \"snd\": \"\" } }"
+    , "    ]"
+    , "  , \"unit\": \"u1\""
+    , "  }"
+    , ", { \"predicate\": " <> ref (getName (Proxy @Glean.Test.DualStringPair))
+    , "  , \"facts\":"
+    , "    [ { \"key\":"
+    , "        { \"fst\": 1"
+    , "        , \"snd\": { \"key\": { \"fst\": \"c\", \"snd\": \"d\" } } } }"
+    , "    , { \"id\": 3, \"key\": { \"fst\": { \"id\": 1 }, \"snd\": 1 } }"
+    , "    ]"
+    , "  , \"unit\": \"u2\""
+    , "  }"
+    , ", { \"predicate\": " <> ref (getName (Proxy @Sys.Blob))
+    , "  , \"facts\": [ { \"key\": \"aGVsbG8=\" } ]"
+    , "  , \"unit\": \"u1\""
+    , "  }"
+    , "]"
+    ]
+  batches <- fileToBatches file
+  dbSchema <- withOpenDatabase env repo (return . odbSchema)
+  expected <- buildJsonBatch dbSchema Nothing batches
+  schema <- newJsonFactSchema dbSchema
+  fromFile <- buildJsonBatchStreaming schema Nothing file
+  assertEqual "file" expected fromFile
+  fromBatches <- buildJsonBatchesStreaming env repo Nothing batches
+  assertEqual "batches" expected fromBatches
+
 main :: IO ()
 main = withUnitTest $ testRunner $ TestList
   [ TestLabel "writeJsonBatchTest" writeJsonBatchTest
+  , TestLabel "streamingTest" streamingTest
   ]
@@ -0,0 +1,202 @@
+{-
+  Copyright (c) Meta Platforms, Inc. and affiliates.
+  All rights reserved.
+
+  This source code is licensed under the BSD-style license found in the
+  LICENSE file in the root directory of this source tree.
+-}
+
+-- | Check that the native subroutines in glean/rts/tests/NativeDifferential.cpp
+-- behave exactly like the bytecode generated for the same predicates.
+module NativeTypecheckTest
+  ( main
+  , inventory
+  , namePid
+  , declPid
+  , declKey
+  , declValue
+  ) where
+
+import Control.Exception
+import Control.Monad
+import qualified Data.ByteString as BS
+import Data.ByteString (ByteString)
+import Data.Either
+import qualified Data.Text as Text
+import Foreign hiding (with)
+import Foreign.C
+import GHC.Fingerprint (Fingerprint(..))
+import Test.HUnit
+import Test.QuickCheck
+import Test.QuickCheck.Monadic as QuickCheck
+
+import TestRunner
+import Util.FFI
+import Util.Testing
+
+import qualified Glean.Angle.Types as T
+import Glean.Angle.Hash (Hash)
+import Glean.FFI
+import Glean.Init
+import Glean.RTS
+import Glean.RTS.Foreign.Inventory (CompiledPredicate(..), Inventory)
+import qualified Glean.RTS.Foreign.Inventory as Inventory
+import Glean.RTS.Substitute
+import Glean.RTS.Traverse
+import Glean.RTS.Typecheck
+import Glean.RTS.Types
+import Glean.Types (PredicateRef(..))
+
+import RTSTest (valueFor)
+
+namePid, declPid :: Pid
+namePid = Pid 1024
+declPid = Pid 1025
+
+nameRef :: PidRef
+nameRef = PidRef namePid $
+  T.PredicateId (T.PredicateRef "test.Name" 1) nativeNameHash
+
+-- Keep in sync with Decl in NativeDifferential.cpp
+nameKey, declKey, declValue :: Type
+nameKey = T.StringTy
+declKey = T.RecordTy $ fields
+  [ T.PredicateTy nameRef
+  , T.ByteTy
+  , T.ArrayTy T.ByteTy
+  , T.ArrayTy T.NatTy
+  , T.ArrayTy T.StringTy
+  , T.ArrayTy $ T.RecordTy $ fields [T.NatTy, T.PredicateTy nameRef]
+  , T.MaybeTy $ T.PredicateTy nameRef
+  , T.BooleanTy
+  , T.SumTy $ fields
+      [ T.NatTy, T.StringTy, T.ArrayTy (T.PredicateTy nameRef) ]
+  , T.EnumeratedTy ["red", "green", "blue"]
+  ]
+declValue = T.RecordTy $ fields [T.NatTy, T.PredicateTy nameRef]
+
+unit :: Type
+unit = T.RecordTy []
+
+fields :: [Type] -> [T.FieldDef_ PidRef ExpandedType]
+fields tys =
+  [ T.FieldDef (Text.pack $ 'x' : show i) ty
+  | (i, ty) <- zip [0 :: Int ..] tys ]
+
+-- Registered by NativeDifferential.cpp
+nativeNameHash, nativeDeclHash :: Hash
+nativeNameHash = Fingerprint 0x6e6174697665 1
+nativeDeclHash = Fingerprint 0x6e6174697665 2
+
+-- | An inventory with the test predicates. With the right hashes, they use
+-- the native subroutines and otherwise the bytecode.
+inventory :: Bool -> IO Inventory
+inventory native = do
+  name <- predicate namePid "test.Name" nameKey unit
+    (if native then nativeNameHash else Fingerprint 0 1)
+  decl <- predicate declPid "test.Decl" declKey declValue
+    (if native then nativeDeclHash else Fingerprint 0 2)
+  return $ Inventory.new [name, decl]
+  where
+    predicate pid name key value hash = do
+      typecheck <- checkSignature key value
+      traversal <- genTraversal key value
+      substitution <- genSubstitution key value
+      return CompiledPredicate
+        { compiledPid = pid
+        , compiledRef = PredicateRef name 1
+        , compiledTypecheck = typecheck
+        , compiledTraversal = traversal
+        , compiledSubstitution = substitution
+        , compiledHash = hash
+        }
+
+data Mode = Typecheck | Substitute | Traverse
+  deriving (Enum, Show)
+
+runPredicate
+  :: Inventory
+  -> Pid
+  -> Mode
+  -> (ByteString, ByteString)
+  -> IO (Either String (ByteString, Int))
+runPredicate inv pid mode (key, value) =
+  fmap (either (\e -> Left (show (e :: SomeException))) Right) $ try $
+  with inv $ \inv_ptr ->
+  unsafeWithBytes (key <> value) $ \clause_ptr clause_size -> do
+    (out, out_size, key_size) <- invoke $ glean_test_native_run
+      inv_ptr
+      (fromPid pid)
+      (fromIntegral (fromEnum mode))
+      clause_ptr
+      (fromIntegral (BS.length key))
+      clause_size
+    bytes <- unsafeMallocedByteString out out_size
+    return (bytes, fromIntegral key_size)
+
+prop_valid :: Inventory -> Inventory -> Property
+prop_valid native bytecode =
+  forAll (valueFor declKey) $ \key ->
+  forAll (valueFor declValue) $ \value -> monadicIO $ do
+    let clause = (fromValue key, fromValue value)
+    forM_ [Typecheck, Substitute, Traverse] $ \mode -> do
+      n <- QuickCheck.run $ runPredicate native declPid mode clause
+      b <- QuickCheck.run $ runPredicate bytecode declPid mode clause
+      QuickCheck.monitor $ counterexample $ show (mode, n, b)
+      QuickCheck.assert $ isRight n && n == b
+
+-- | Untrusted clauses which are likely to be malformed. Only the
+-- typechecker has to cope with these. Both must reject a clause or
+-- produce the same output, although the error messages may differ.
+prop_malformed :: Inventory -> Inventory -> Property
+prop_malformed native bytecode =
+  forAll (elements [(namePid, nameKey, unit), (declPid, declKey, declValue)])
+    $ \(pid, keyTy, valueTy) ->
+  forAll (valueFor keyTy) $ \key ->
+  forAll (valueFor valueTy) $ \value ->
+  forAll (mutate (fromValue key, fromValue value)) $ \clause ->
+  monadicIO $ do
+    n <- QuickCheck.run $ runPredicate native pid Typecheck clause
+    b <- QuickCheck.run $ runPredicate bytecode pid Typecheck clause
+    QuickCheck.monitor $ counterexample $ show (clause, n, b)
+    QuickCheck.assert $ case (n, b) of
+      (Left _, Left _) -> True
+      _ -> n == b
+  where
+    mutate (key, value) = oneof
+      [ do
+          k <- choose (0, BS.length key)
+          return (BS.take k key, value)
+      , do
+          extra <- BS.pack <$> arbitrary
+          elements [(key <> extra, value), (key, value <> extra)]
+      , do
+          i <- choose (0, max 0 (BS.length key - 1))
+          b <- arbitrary
+          let (before, after) = BS.splitAt i key
+          return (before <> BS.cons b (BS.drop 1 after), value)
+      , (,) <$> (BS.pack <$> arbitrary) <*> pure value
+      ]
+
+main :: IO ()
+main = withUnitTest $ do
+  native <- inventory True
+  bytecode <- inventory False
+  testRunner $ TestList
+    [ TestLabel "valid" $ TestCase $ assertProperty "mismatch" $
+        prop_valid native bytecode
+    , TestLabel "malformed" $ TestCase $ assertProperty "mismatch" $
+        prop_malformed native bytecode
+    ]
+
+foreign import ccall unsafe glean_test_native_run
+  :: Ptr Inventory
+  -> Int64
+  -> CInt
+  -> Ptr ()
+  -> CSize
+  -> CSize
+  -> Ptr (Ptr ())
+  -> Ptr CSize
+  -> Ptr CSize
+  -> IO CString
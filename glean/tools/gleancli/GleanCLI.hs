@@ -81,6 +81,7 @@ plugins =
   , plugin @StatusCommand
   , plugin @DumpCommand
   , plugin @DeleteCommand
+  , plugin @FlattenCommand
   , plugin @DeriveCommand
   , plugin @QueryCommand
   , plugin @RestoreCommand
@@ -296,6 +297,34 @@ instance Plugin DeleteCommand where
   runCommand _ _ backend Delete{..} =
     void $ Glean.deleteDatabase backend deleteRepo
 
+data FlattenCommand
+  = Flatten
+      { flattenRepo :: Repo
+      , flattenHash :: Text
+      }
+
+instance Plugin FlattenCommand where
+  parseCommand =
+    commandParser "flatten"
+      (progDesc $ "Copy a stack of databases into a new database of the "
+        <> "same name without dependencies, which replaces the stack "
+        <> "once it is complete") $ do
+      flattenRepo <- repoOpts
+      flattenHash <- textOption
+        (  long "new-hash"
+        <> metavar "HASH"
+        <> help "hash of the flattened database"
+        )
+      return Flatten{..}
+
+  runCommand _ _ backend Flatten{..} = do
+    Thrift.FlattenDatabaseResult repo <- Glean.flattenDatabase backend
+      Thrift.FlattenDatabase
+        { flattenDatabase_repo = flattenRepo
+        , flattenDatabase_hash = flattenHash
+        }
+    putStrLn $ "flattening into " <> Glean.showRepo repo
+
 
 data ValidateCommand
   = Validate
@@ -18,10 +18,13 @@ import Data.Default
 import Data.Proxy
 import qualified Data.HashMap.Strict as HashMap
 import Data.Maybe
+import Data.List (sort)
 import Data.List.Split (splitOn)
 import Data.Text (Text)
 import qualified Data.Text as Text
 import Options.Applicative
+import System.Directory
+import System.FilePath
 
 import Control.Concurrent.Stream (stream)
 import Thrift.Protocol.Compact (Compact)
@@ -33,11 +36,12 @@ import Util.OptParse
 import Glean hiding (options)
 import qualified Glean.LocalOrRemote as LocalOrRemote
 import Glean.Database.Schema
+import Glean.Database.Write.Segments (loadSegments)
 import Glean.Datasource.Scribe.Write
 import Glean.Types as Thrift
 import Glean.Util.Time
 import Glean.Write
-import Glean.Write.JSON ( buildJsonBatch )
+import Glean.Write.JSON ( newJsonFactSchema, buildJsonBatchStreaming )
 
 import GleanCLI.Common
 import GleanCLI.Finish
@@ -53,10 +57,12 @@ data ScribeOptions = ScribeOptions
 data FileFormat
   = JsonFormat
   | BinaryFormat
+  | SegmentsFormat
 
 parseFileFormat :: String -> Either String FileFormat
 parseFileFormat "json" = Right JsonFormat
 parseFileFormat "binary" = Right BinaryFormat
+parseFileFormat "segments" = Right SegmentsFormat
 parseFileFormat s = Left $ "unknown format: " <> s
 
 data WriteCommand
@@ -141,8 +147,11 @@ instance Plugin WriteCommand where
         writeFileFormat <-
               optional $ option (eitherReader parseFileFormat)
                 ( long "file-format"
-                <> metavar "(json|binary)"
-                <> help "Format of the input files"
+                <> metavar "(json|binary|segments)"
+                <> help ("Format of the input files. Segments are written "
+                  <> "by streaming file senders and can only be loaded into "
+                  <> "a local database (--db-root); directories are loaded "
+                  <> "in their entirety.")
                 )
         return Write
           { create=False, writeRepoTime=Nothing
@@ -262,6 +271,7 @@ instance Plugin WriteCommand where
       schemaInfo <- Glean.getSchemaInfo backend repo
       dbSchema <- fromSchemaInfo schemaInfo readWriteContent
       logMessages <- newTQueueIO
+      jsonSchema <- newJsonFactSchema dbSchema
       let inventory = schemaInventory dbSchema
       Glean.withSendAndRebaseQueue backend repo inventory useLocalCache $
         \queue ->
@@ -272,9 +282,11 @@ instance Plugin WriteCommand where
                 case deserializeGen (Proxy :: Proxy Compact) r of
                   Left parseError -> die 3 $ "Parse error: " <> parseError
                   Right result -> return result
-              JsonFormat -> do
-                batches <- fileToBatches file
-                buildJsonBatch dbSchema Nothing batches
+              JsonFormat ->
+                handleAll (throwIO . ErrorCall . ((file <> ": ") <>) . show) $
+                  buildJsonBatchStreaming jsonSchema Nothing file
+              SegmentsFormat ->
+                die 3 "Cannot use segments format with a local cache"
             _ <- Glean.writeSendAndRebaseQueue queue batch $
               \_ -> writeTQueue logMessages $ "Wrote " <> file
             atomically (flushTQueue logMessages) >>= mapM_ putStrLn
@@ -290,27 +302,46 @@ instance Plugin WriteCommand where
             Right result -> return result
           void $ Glean.sendBatch backend repo batch
 
-    write repo files max scribe Nothing JsonFormat = do
+    write repo files max Nothing Nothing JsonFormat = do
+      schemaInfo <- Glean.getSchemaInfo backend repo
+      dbSchema <- fromSchemaInfo schemaInfo readWriteContent
+      jsonSchema <- newJsonFactSchema dbSchema
+      stream max (forM_ files) $ \file -> do
+        handleAll (throwIO . ErrorCall . ((file <> ": ") <>) . show) $ do
+          batch <- buildJsonBatchStreaming jsonSchema Nothing file
+          void $ Glean.sendBatch backend repo batch
+
+    -- Scribe takes the JSON batches rather than binary facts
+    write _ files max (Just ScribeOptions
+        { writeFromScribe = WriteFromScribe{..}, .. }) Nothing JsonFormat =
       stream max (forM_ files) $ \file -> do
         batches <- fileToBatches file
-        case scribe of
-          Nothing ->
-            void $ LocalOrRemote.sendJsonBatch backend repo batches Nothing
-          Just ScribeOptions
-            { writeFromScribe = WriteFromScribe{..}, .. } ->
-              scribeWriteBatches
-                writeFromScribe_category
-                (case writeFromScribe_bucket of
-                  Just (PickScribeBucket_bucket n) ->
-                      Just (fromIntegral n :: Int)
-                  Nothing -> Nothing)
-                batches
-                scribeCompress
+        scribeWriteBatches
+          writeFromScribe_category
+          (case writeFromScribe_bucket of
+            Just (PickScribeBucket_bucket n) ->
+                Just (fromIntegral n :: Int)
+            Nothing -> Nothing)
+          batches
+          scribeCompress
+
+    write repo files max Nothing Nothing SegmentsFormat =
+      case LocalOrRemote.backendKind backend of
+        LocalOrRemote.BackendEnv env -> do
+          paths <- fmap concat $ forM files $ \file -> do
+            dir <- doesDirectoryExist file
+            if dir
+              then map (file </>) . sort <$> listDirectory file
+              else return [file]
+          loadSegments env repo max paths
+        _ -> die 3 "Segments can only be loaded into a local database"
 
     write _repo _files _max (Just _scribe) (Just _useLocalCache) _  =
       die 3 "Cannot use a local cache with scribe"
     write _repo _files _max (Just _scribe) Nothing BinaryFormat  =
       die 3 "Cannot use binary format with scribe"
+    write _repo _files _max (Just _scribe) Nothing SegmentsFormat  =
+      die 3 "Cannot use segments format with scribe"
 
     resultToFailure Right{} = Nothing
     resultToFailure (Left err) = Just (show err)